@@ -18,6 +18,7 @@
 #include "commands/model_del_cmd.h"
 #include "commands/model_get_cmd.h"
 #include "commands/model_import_cmd.h"
+#include "commands/model_inspect_cmd.h"
 #include "commands/model_list_cmd.h"
 #include "commands/model_pull_cmd.h"
 #include "commands/model_start_cmd.h"
@@ -275,6 +276,25 @@ void CommandLineParser::SetupModelCommands() {
                                  cml_data_.model_id);
   });
 
+  auto inspect_models_cmd = models_cmd->add_subcommand(
+      "inspect", "Show the tensor layout of a local model by ID");
+  inspect_models_cmd->usage("Usage:\n" + commands::GetCortexBinary() +
+                            " models inspect [model_id]");
+  inspect_models_cmd->group(kSubcommands);
+  inspect_models_cmd->add_option("model_id", cml_data_.model_id, "");
+  inspect_models_cmd->callback([this, inspect_models_cmd]() {
+    if (std::exchange(executed_, true))
+      return;
+    if (cml_data_.model_id.empty()) {
+      CLI_LOG("[model_id] is required\n");
+      CLI_LOG(inspect_models_cmd->help());
+      return;
+    };
+    commands::ModelInspectCmd().Exec(cml_data_.config.apiServerHost,
+                                     std::stoi(cml_data_.config.apiServerPort),
+                                     cml_data_.model_id);
+  });
+
   auto model_del_cmd =
       models_cmd->add_subcommand("delete", "Delete a local model by ID");
   model_del_cmd->usage("Usage:\n" + commands::GetCortexBinary() +
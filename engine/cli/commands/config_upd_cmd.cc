@@ -31,6 +31,12 @@ inline Json::Value NormalizeJson(
       root[key] = origin_array;
     } else if (config.accept_value == "string") {
       root[key] = value;
+    } else if (config.accept_value == "integer") {
+      try {
+        root[key] = std::stoi(value);
+      } catch (const std::exception&) {
+        CLI_LOG_ERROR("Invalid integer for " << key << ": " << value);
+      }
     } else {
       CTL_ERR("Not support configuration type: " << config.accept_value
                                                  << " for config key: " << key);
@@ -0,0 +1,102 @@
+#include "model_inspect_cmd.h"
+#include <json/reader.h>
+#include <json/value.h>
+#include <iomanip>
+#include <sstream>
+#include "server_start_cmd.h"
+#include "utils/curl_utils.h"
+#include "utils/format_utils.h"
+#include "utils/logging_utils.h"
+#include "utils/url_parser.h"
+
+// clang-format off
+#include <tabulate/table.hpp>
+// clang-format on
+
+namespace commands {
+namespace {
+std::string FormatParameterCount(uint64_t count) {
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(2);
+  if (count >= 1'000'000'000) {
+    ss << count / 1e9 << "B";
+  } else if (count >= 1'000'000) {
+    ss << count / 1e6 << "M";
+  } else if (count >= 1'000) {
+    ss << count / 1e3 << "K";
+  } else {
+    return std::to_string(count);
+  }
+  return ss.str();
+}
+}  // namespace
+
+void ModelInspectCmd::Exec(const std::string& host, int port,
+                           const std::string& model_handle) const {
+  // Start server if server is not started yet
+  if (!commands::IsServerAlive(host, port)) {
+    CLI_LOG("Starting server ...");
+    commands::ServerStartCmd ssc;
+    if (!ssc.Exec(host, port)) {
+      return;
+    }
+  }
+
+  auto url = url_parser::Url{
+      .protocol = "http",
+      .host = host + ":" + std::to_string(port),
+      .pathParams = {"v1", "models", model_handle, "tensors"},
+  };
+  auto result = curl_utils::SimpleGetJson(url.ToFullPath());
+  if (result.has_error()) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(result.error(), root)) {
+      CLI_LOG(result.error());
+      return;
+    }
+    CLI_LOG(root["message"].asString());
+    return;
+  }
+
+  auto const& report = result.value();
+  std::ostringstream bpw;
+  bpw << std::fixed << std::setprecision(2)
+      << report["bits_per_weight"].asDouble();
+
+  tabulate::Table summary;
+  summary.add_row({"Model", report["model"].asString()});
+  summary.add_row({"Architecture", report["architecture"].asString()});
+  summary.add_row(
+      {"Tensors", std::to_string(report["tensor_count"].asUInt64())});
+  summary.add_row({"Parameters", FormatParameterCount(
+                                     report["parameter_count"].asUInt64())});
+  summary.add_row({"Size", format_utils::BytesToHumanReadable(
+                               report["bytes"].asUInt64())});
+  summary.add_row({"Bits per weight", bpw.str()});
+  std::cout << summary << std::endl;
+
+  tabulate::Table quantization;
+  quantization.add_row({"Type", "Tensors", "Parameters", "Size", "Block size",
+                        "Bytes per block"});
+  for (auto const& q : report["quantization"]) {
+    quantization.add_row(
+        {q["type"].asString(), std::to_string(q["tensor_count"].asUInt64()),
+         FormatParameterCount(q["parameter_count"].asUInt64()),
+         format_utils::BytesToHumanReadable(q["bytes"].asUInt64()),
+         std::to_string(q["block_size"].asUInt()),
+         std::to_string(q["bytes_per_block"].asUInt())});
+  }
+  std::cout << quantization << std::endl;
+
+  tabulate::Table layers;
+  layers.add_row({"Layer", "Tensors", "Parameters", "Size"});
+  for (auto const& l : report["layers"]) {
+    layers.add_row(
+        {l["name"].asString(), std::to_string(l["tensor_count"].asUInt64()),
+         FormatParameterCount(l["parameter_count"].asUInt64()),
+         format_utils::BytesToHumanReadable(l["bytes"].asUInt64())});
+  }
+  std::cout << layers << std::endl;
+}
+}  // namespace commands
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+namespace commands {
+
+class ModelInspectCmd {
+ public:
+  void Exec(const std::string& host, int port,
+            const std::string& model_handle) const;
+};
+}  // namespace commands
@@ -2,6 +2,7 @@
 #include "server_start_cmd.h"
 #include "utils/cli_selection_utils.h"
 #include "utils/download_progress.h"
+#include "utils/format_utils.h"
 #include "utils/json_helper.h"
 #include "utils/logging_utils.h"
 #include "utils/scope_exit.h"
@@ -58,6 +59,21 @@ std::optional<std::string> ModelPullCmd::Exec(const std::string& host, int port,
         avails.push_back(v.asString());
       }
       auto download_url = root["downloadUrl"].asString();
+      if (root.isMember("gguf")) {
+        auto const& gguf = root["gguf"];
+        std::string quantization;
+        for (auto const& q : gguf["quantization"]) {
+          quantization += (quantization.empty() ? "" : ", ") +
+                          q["type"].asString();
+        }
+        CLI_LOG("Architecture: " << gguf["architecture"].asString()
+                                 << ", context length: "
+                                 << gguf["context_length"].asInt64());
+        CLI_LOG("Parameters: " << gguf["parameter_count"].asUInt64()
+                               << ", quantization: " << quantization);
+        CLI_LOG("Estimated memory: " << format_utils::BytesToHumanReadable(
+                    gguf["estimated_memory_bytes"].asUInt64()));
+      }
 
       if (downloaded.empty() && avails.empty()) {
         model_id = id;
@@ -135,7 +135,10 @@ bool DownloadProgress::Handle(
                      .count();
         uint64_t bytes_per_sec = downloaded / (d + 1);
         std::string time_remaining;
-        if (downloaded == total || bytes_per_sec == 0) {
+        if (it.etaSeconds.has_value()) {
+          // The server measures the rate over a sliding window
+          time_remaining = format_utils::TimeDownloadFormat(*it.etaSeconds);
+        } else if (downloaded == total || bytes_per_sec == 0) {
           time_remaining = "00m:00s";
         } else {
           time_remaining = format_utils::TimeDownloadFormat(
@@ -97,17 +97,101 @@ static const std::unordered_map<std::string, ApiConfigurationMetadata>
                                   .accept_value = "string",
                                   .default_value = "",
                                   .allow_empty = true}},
+        {"download_segments",
+         ApiConfigurationMetadata{
+             .name = "download_segments",
+             .desc = "Parallel connections used to download a single file "
+                     "from servers that support byte ranges",
+             .group = "Download",
+             .accept_value = "integer",
+             .default_value = "4"}},
+        {"download_progress_interval_ms",
+         ApiConfigurationMetadata{
+             .name = "download_progress_interval_ms",
+             .desc = "Milliseconds between two progress events of a running "
+                     "download",
+             .group = "Download",
+             .accept_value = "integer",
+             .default_value = "1000"}},
+        {"download_max_rate",
+         ApiConfigurationMetadata{
+             .name = "download_max_rate",
+             .desc = "Receive rate cap in KiB/s for all downloads together, 0 for "
+                     "unlimited",
+             .group = "Download",
+             .accept_value = "integer",
+             .default_value = "0"}},
+        {"download_max_rate_high",
+         ApiConfigurationMetadata{
+             .name = "download_max_rate_high",
+             .desc = "Receive rate cap in KiB/s for high priority downloads, 0 for "
+                     "unlimited",
+             .group = "Download",
+             .accept_value = "integer",
+             .default_value = "0"}},
+        {"download_max_rate_normal",
+         ApiConfigurationMetadata{
+             .name = "download_max_rate_normal",
+             .desc = "Receive rate cap in KiB/s for normal priority downloads, 0 for "
+                     "unlimited",
+             .group = "Download",
+             .accept_value = "integer",
+             .default_value = "0"}},
+        {"download_max_rate_low",
+         ApiConfigurationMetadata{
+             .name = "download_max_rate_low",
+             .desc = "Receive rate cap in KiB/s for low priority downloads, 0 for "
+                     "unlimited",
+             .group = "Download",
+             .accept_value = "integer",
+             .default_value = "0"}},
+        {"download_direct_io",
+         ApiConfigurationMetadata{
+             .name = "download_direct_io",
+             .desc = "Write downloads around the page cache where the "
+                     "filesystem allows it",
+             .group = "Download",
+             .accept_value = "[on|off]",
+             .default_value = "off"}},
+        {"download_mirrors",
+         ApiConfigurationMetadata{
+             .name = "download_mirrors",
+             .desc = "Mirrors tried besides the original download host. "
+                     "Comma separated host=url pairs, a host may start with "
+                     "*. and repeat. E.g. "
+                     "huggingface.co=https://hf.example.com",
+             .group = "Download",
+             .accept_value = "comma separated",
+             .default_value = "",
+             .allow_empty = true}},
+        {"download_keep_archives",
+         ApiConfigurationMetadata{
+             .name = "download_keep_archives",
+             .desc = "Keep engine archives on disk besides extracting them "
+                     "while they download",
+             .group = "Download",
+             .accept_value = "[on|off]",
+             .default_value = "off"}},
 };
 
 class ApiServerConfiguration {
  public:
+  static constexpr int kMaxDownloadSegments = 16;
+  static constexpr int kMinDownloadProgressIntervalMs = 100;
+  static constexpr int kMaxDownloadProgressIntervalMs = 60000;
+
   ApiServerConfiguration(
       bool cors = true, std::vector<std::string> allowed_origins = {},
       bool verify_proxy_ssl = true, bool verify_proxy_host_ssl = true,
       const std::string& proxy_url = "", const std::string& proxy_username = "",
       const std::string& proxy_password = "", const std::string& no_proxy = "",
       bool verify_peer_ssl = true, bool verify_host_ssl = true,
-      const std::string& hf_token = "")
+      const std::string& hf_token = "", int download_segments = 4,
+      int download_progress_interval_ms = 1000, int download_max_rate = 0,
+      int download_max_rate_high = 0, int download_max_rate_normal = 0,
+      int download_max_rate_low = 0, bool download_direct_io = false,
+      std::vector<std::string> download_mirrors = {},
+      bool download_keep_archives = false)
       : cors{cors},
         allowed_origins{allowed_origins},
         verify_proxy_ssl{verify_proxy_ssl},
@@ -118,7 +202,16 @@ class ApiServerConfiguration {
         no_proxy{no_proxy},
         verify_peer_ssl{verify_peer_ssl},
         verify_host_ssl{verify_host_ssl},
-        hf_token{hf_token} {}
+        hf_token{hf_token},
+        download_segments{download_segments},
+        download_progress_interval_ms{download_progress_interval_ms},
+        download_max_rate{download_max_rate},
+        download_max_rate_high{download_max_rate_high},
+        download_max_rate_normal{download_max_rate_normal},
+        download_max_rate_low{download_max_rate_low},
+        download_direct_io{download_direct_io},
+        download_mirrors{download_mirrors},
+        download_keep_archives{download_keep_archives} {}
 
   // cors
   bool cors{true};
@@ -139,6 +232,18 @@ class ApiServerConfiguration {
   // token
   std::string hf_token{""};
 
+  // download
+  int download_segments{4};
+  int download_progress_interval_ms{1000};
+  // KiB/s, 0 for unlimited
+  int download_max_rate{0};
+  int download_max_rate_high{0};
+  int download_max_rate_normal{0};
+  int download_max_rate_low{0};
+  bool download_direct_io{false};
+  std::vector<std::string> download_mirrors;
+  bool download_keep_archives{false};
+
   Json::Value ToJson() const {
     Json::Value root;
     root["cors"] = cors;
@@ -155,6 +260,18 @@ class ApiServerConfiguration {
     root["verify_peer_ssl"] = verify_peer_ssl;
     root["verify_host_ssl"] = verify_host_ssl;
     root["huggingface_token"] = hf_token;
+    root["download_segments"] = download_segments;
+    root["download_progress_interval_ms"] = download_progress_interval_ms;
+    root["download_max_rate"] = download_max_rate;
+    root["download_max_rate_high"] = download_max_rate_high;
+    root["download_max_rate_normal"] = download_max_rate_normal;
+    root["download_max_rate_low"] = download_max_rate_low;
+    root["download_direct_io"] = download_direct_io;
+    root["download_mirrors"] = Json::Value(Json::arrayValue);
+    for (const auto& mirror : download_mirrors) {
+      root["download_mirrors"].append(mirror);
+    }
+    root["download_keep_archives"] = download_keep_archives;
 
     return root;
   }
@@ -247,6 +364,99 @@ class ApiServerConfiguration {
                return true;
              }},
 
+            {"download_segments",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isInt() || value.asInt() < 1 ||
+                   value.asInt() > kMaxDownloadSegments) {
+                 return false;
+               }
+               download_segments = value.asInt();
+               return true;
+             }},
+
+            {"download_progress_interval_ms",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isInt() ||
+                   value.asInt() < kMinDownloadProgressIntervalMs ||
+                   value.asInt() > kMaxDownloadProgressIntervalMs) {
+                 return false;
+               }
+               download_progress_interval_ms = value.asInt();
+               return true;
+             }},
+
+            {"download_max_rate",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isInt() || value.asInt() < 0) {
+                 return false;
+               }
+               download_max_rate = value.asInt();
+               return true;
+             }},
+
+            {"download_max_rate_high",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isInt() || value.asInt() < 0) {
+                 return false;
+               }
+               download_max_rate_high = value.asInt();
+               return true;
+             }},
+
+            {"download_max_rate_normal",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isInt() || value.asInt() < 0) {
+                 return false;
+               }
+               download_max_rate_normal = value.asInt();
+               return true;
+             }},
+
+            {"download_max_rate_low",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isInt() || value.asInt() < 0) {
+                 return false;
+               }
+               download_max_rate_low = value.asInt();
+               return true;
+             }},
+
+            {"download_direct_io",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isBool()) {
+                 return false;
+               }
+               download_direct_io = value.asBool();
+               return true;
+             }},
+
+            {"download_mirrors",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isArray()) {
+                 return false;
+               }
+               for (const auto& mirror : value) {
+                 if (!mirror.isString()) {
+                   return false;
+                 }
+               }
+
+               download_mirrors.clear();
+               for (const auto& mirror : value) {
+                 download_mirrors.push_back(mirror.asString());
+               }
+               return true;
+             }},
+
+            {"download_keep_archives",
+             [this](const Json::Value& value) -> bool {
+               if (!value.isBool()) {
+                 return false;
+               }
+               download_keep_archives = value.asBool();
+               return true;
+             }},
+
             {"cors",
              [this](const Json::Value& value) -> bool {
                if (!value.isBool()) {
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <json/json.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "utils/json_helper.h"
+#include "utils/result.hpp"
+
+/**
+ * Progress of a ranged download, kept in a sidecar file next to the partial
+ * output so that a stopped or crashed download resumes where it was.
+ */
+struct DownloadState {
+  struct Segment {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    // Bytes of [offset, offset + length) known to be on disk
+    uint64_t written = 0;
+  };
+
+  std::string url;
+
+  uint64_t size = 0;
+
+  std::string etag;
+
+  std::string last_modified;
+
+  std::vector<Segment> segments;
+
+  /**
+   * Validator sent as If-Range, so a file that changed on the server is
+   * downloaded again instead of being stitched together. Weak ETags cannot
+   * be used for ranges.
+   */
+  std::string Validator() const {
+    if (!etag.empty() && etag.rfind("W/", 0) != 0) {
+      return etag;
+    }
+    return last_modified;
+  }
+
+  static std::filesystem::path SidecarPath(
+      const std::filesystem::path& local_path) {
+    auto path = local_path;
+    path += ".download";
+    return path;
+  }
+
+  Json::Value ToJson() const {
+    Json::Value root;
+    root["url"] = url;
+    root["size"] = Json::Value::UInt64(size);
+    root["etag"] = etag;
+    root["last_modified"] = last_modified;
+    root["segments"] = Json::Value(Json::arrayValue);
+    for (const auto& segment : segments) {
+      Json::Value s;
+      s["offset"] = Json::Value::UInt64(segment.offset);
+      s["length"] = Json::Value::UInt64(segment.length);
+      s["written"] = Json::Value::UInt64(segment.written);
+      root["segments"].append(s);
+    }
+    return root;
+  }
+
+  static cpp::result<DownloadState, std::string> FromJson(
+      const Json::Value& root) {
+    if (!root.isObject() || !root["segments"].isArray()) {
+      return cpp::fail(std::string("Invalid download state"));
+    }
+    DownloadState state{
+        .url = root["url"].asString(),
+        .size = root["size"].asUInt64(),
+        .etag = root["etag"].asString(),
+        .last_modified = root["last_modified"].asString(),
+    };
+    uint64_t end = 0;
+    for (const auto& s : root["segments"]) {
+      Segment segment{.offset = s["offset"].asUInt64(),
+                      .length = s["length"].asUInt64(),
+                      .written = s["written"].asUInt64()};
+      // Segments must tile the file in order
+      if (segment.offset != end || segment.written > segment.length) {
+        return cpp::fail(std::string("Invalid download state segments"));
+      }
+      end += segment.length;
+      state.segments.push_back(segment);
+    }
+    if (end != state.size || state.segments.empty()) {
+      return cpp::fail(std::string("Invalid download state segments"));
+    }
+    return state;
+  }
+
+  static cpp::result<DownloadState, std::string> Load(
+      const std::filesystem::path& local_path) {
+    std::ifstream file(SidecarPath(local_path));
+    if (!file) {
+      return cpp::fail(std::string("No download state"));
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return FromJson(json_helper::ParseJsonString(buffer.str()));
+  }
+
+  /**
+   * Replace the sidecar atomically, a crash leaves either the old or the
+   * new state behind.
+   */
+  cpp::result<void, std::string> Save(
+      const std::filesystem::path& local_path) const {
+    auto path = SidecarPath(local_path);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    {
+      std::ofstream file(tmp_path, std::ios::trunc);
+      file << json_helper::DumpJsonString(ToJson());
+      if (!file.flush()) {
+        return cpp::fail("Failed to write " + tmp_path.string());
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+      return cpp::fail("Failed to write " + path.string() + ": " +
+                       ec.message());
+    }
+    return {};
+  }
+
+  static void Remove(const std::filesystem::path& local_path) {
+    std::error_code ec;
+    std::filesystem::remove(SidecarPath(local_path), ec);
+  }
+};
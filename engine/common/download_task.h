@@ -21,10 +21,30 @@ struct DownloadItem {
 
   std::optional<std::string> checksum;
 
+  /**
+   * Directory the archive is extracted into while it downloads. Entries land
+   * in a staging directory which replaces this one once the archive is
+   * complete and verified. The archive itself only reaches localPath when
+   * download_keep_archives is set. Not saved with the task, a restored
+   * download writes the archive instead.
+   */
+  std::optional<std::filesystem::path> extractPath;
+
+  // Extract the files of the archive without their parent directories
+  bool ignoreParentDir = false;
+
   std::optional<uint64_t> bytes;
 
   std::optional<uint64_t> downloadedBytes;
 
+  /**
+   * Transfer rate over the last few seconds, and the remaining time it
+   * predicts. Only set on progress events of a running download.
+   */
+  std::optional<uint64_t> bytesPerSecond;
+
+  std::optional<uint64_t> etaSeconds;
+
   std::string ToString() const {
     std::ostringstream output;
     output << "DownloadItem{id: " << id << ", downloadUrl: " << downloadUrl
@@ -69,6 +89,52 @@ inline DownloadType DownloadTypeFromString(const std::string& str) {
   }
 }
 
+/**
+ * Scheduling class of a download task. Higher classes leave the queue first,
+ * take connections from lower ones and draw first from the shared bandwidth.
+ */
+enum class DownloadPriority { High, Normal, Low };
+
+constexpr std::size_t kDownloadPriorityCount = 3;
+
+inline DownloadPriority DefaultDownloadPriority(DownloadType type) {
+  switch (type) {
+    case DownloadType::Engine:
+    case DownloadType::CudaToolkit:
+    case DownloadType::Cortex:
+      return DownloadPriority::High;
+    case DownloadType::Model:
+      return DownloadPriority::Low;
+    default:
+      return DownloadPriority::Normal;
+  }
+}
+
+inline std::string DownloadPriorityToString(DownloadPriority priority) {
+  switch (priority) {
+    case DownloadPriority::High:
+      return "high";
+    case DownloadPriority::Normal:
+      return "normal";
+    case DownloadPriority::Low:
+      return "low";
+    default:
+      return "normal";
+  }
+}
+
+inline std::optional<DownloadPriority> DownloadPriorityFromString(
+    const std::string& str) {
+  if (str == "high") {
+    return DownloadPriority::High;
+  } else if (str == "normal") {
+    return DownloadPriority::Normal;
+  } else if (str == "low") {
+    return DownloadPriority::Low;
+  }
+  return std::nullopt;
+}
+
 struct DownloadTask {
   enum class Status { Pending, InProgress, Completed, Cancelled, Error };
 
@@ -80,6 +146,15 @@ struct DownloadTask {
 
   std::vector<DownloadItem> items;
 
+  /**
+   * Set by the requester, otherwise derived from the type.
+   */
+  std::optional<DownloadPriority> priority;
+
+  DownloadPriority GetPriority() const {
+    return priority.value_or(DefaultDownloadPriority(type));
+  }
+
   std::string ToString() const {
     std::ostringstream output;
     output << "DownloadTask{id: " << id << ", type: " << static_cast<int>(type)
@@ -95,6 +170,7 @@ struct DownloadTask {
     Json::Value root;
     root["id"] = id;
     root["type"] = DownloadTypeToString(type);
+    root["priority"] = DownloadPriorityToString(GetPriority());
 
     Json::Value itemsArray(Json::arrayValue);
     for (const auto& item : items) {
@@ -106,6 +182,13 @@ struct DownloadTask {
       itemObj["bytes"] = Json::Value::UInt64(item.bytes.value_or(0));
       itemObj["downloadedBytes"] =
           Json::Value::UInt64(item.downloadedBytes.value_or(0));
+      if (item.bytesPerSecond.has_value()) {
+        itemObj["bytesPerSecond"] =
+            Json::Value::UInt64(item.bytesPerSecond.value());
+      }
+      if (item.etaSeconds.has_value()) {
+        itemObj["etaSeconds"] = Json::Value::UInt64(item.etaSeconds.value());
+      }
       itemsArray.append(itemObj);
     }
     root["items"] = itemsArray;
@@ -114,6 +197,38 @@ struct DownloadTask {
   }
 };
 
+inline std::string DownloadTaskStatusToString(DownloadTask::Status status) {
+  switch (status) {
+    case DownloadTask::Status::Pending:
+      return "pending";
+    case DownloadTask::Status::InProgress:
+      return "in_progress";
+    case DownloadTask::Status::Completed:
+      return "completed";
+    case DownloadTask::Status::Cancelled:
+      return "cancelled";
+    case DownloadTask::Status::Error:
+      return "error";
+    default:
+      return "pending";
+  }
+}
+
+inline DownloadTask::Status DownloadTaskStatusFromString(
+    const std::string& str) {
+  if (str == "in_progress") {
+    return DownloadTask::Status::InProgress;
+  } else if (str == "completed") {
+    return DownloadTask::Status::Completed;
+  } else if (str == "cancelled") {
+    return DownloadTask::Status::Cancelled;
+  } else if (str == "error") {
+    return DownloadTask::Status::Error;
+  } else {
+    return DownloadTask::Status::Pending;
+  }
+}
+
 namespace common {
 inline DownloadItem GetDownloadItemFromJson(const Json::Value item_json) {
   DownloadItem item;
@@ -140,6 +255,14 @@ inline DownloadItem GetDownloadItemFromJson(const Json::Value item_json) {
     item.downloadedBytes = item_json["downloadedBytes"].asUInt64();
   }
 
+  if (!item_json["bytesPerSecond"].isNull()) {
+    item.bytesPerSecond = item_json["bytesPerSecond"].asUInt64();
+  }
+
+  if (!item_json["etaSeconds"].isNull()) {
+    item.etaSeconds = item_json["etaSeconds"].asUInt64();
+  }
+
   return item;
 }
 
@@ -154,6 +277,10 @@ inline DownloadTask GetDownloadTaskFromJson(const Json::Value item_json) {
     task.type = DownloadTypeFromString(item_json["type"].asString());
   }
 
+  if (!item_json["priority"].isNull()) {
+    task.priority = DownloadPriorityFromString(item_json["priority"].asString());
+  }
+
   if (!item_json["items"].isNull() && item_json["items"].isArray()) {
     for (auto const& i_json : item_json["items"]) {
       task.items.emplace_back(GetDownloadItemFromJson(i_json));
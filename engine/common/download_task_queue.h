@@ -1,5 +1,9 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
 #include <condition_variable>
-#include <deque>
+#include <list>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
@@ -7,40 +11,70 @@
 #include <unordered_map>
 #include "common/download_task.h"
 
+/**
+ * Pending download tasks, one FIFO per priority class. pop takes the oldest
+ * task of the highest non-empty class. push, pop and cancelTask are O(1),
+ * the lists keep the iterators in taskMap valid across insertions and
+ * erasures.
+ */
 class DownloadTaskQueue {
  private:
-  std::deque<DownloadTask> taskQueue;
-  std::unordered_map<std::string, typename std::deque<DownloadTask>::iterator>
-      taskMap;
+  using TaskList = std::list<DownloadTask>;
+  using TaskIndex =
+      std::unordered_map<std::string, std::pair<TaskList*, TaskList::iterator>>;
+
+  std::array<TaskList, kDownloadPriorityCount> taskQueues;
+  TaskIndex taskMap;
   mutable std::shared_mutex mutex;
   std::condition_variable_any cv;
 
+  void erase(TaskIndex::iterator it) {
+    it->second.first->erase(it->second.second);
+    taskMap.erase(it);
+  }
+
  public:
   void push(DownloadTask task) {
     std::unique_lock lock(mutex);
-    taskQueue.push_back(std::move(task));
-    taskMap[taskQueue.back().id] = std::prev(taskQueue.end());
+    auto& tasks = taskQueues[static_cast<size_t>(task.GetPriority())];
+    tasks.push_back(std::move(task));
+    taskMap[tasks.back().id] = {&tasks, std::prev(tasks.end())};
     cv.notify_one();
   }
 
   std::optional<DownloadTask> pop() {
     std::unique_lock lock(mutex);
-    if (taskQueue.empty()) {
-      return std::nullopt;
+    for (auto& tasks : taskQueues) {
+      if (tasks.empty()) {
+        continue;
+      }
+      DownloadTask task = std::move(tasks.front());
+      tasks.pop_front();
+      taskMap.erase(task.id);
+      return task;
     }
-    DownloadTask task = std::move(taskQueue.front());
-    taskQueue.pop_front();
-    taskMap.erase(task.id);
-    return task;
+    return std::nullopt;
+  }
+
+  /**
+   * Class of the task pop would return next.
+   */
+  std::optional<DownloadPriority> topPriority() const {
+    std::shared_lock lock(mutex);
+    for (size_t i = 0; i < taskQueues.size(); i++) {
+      if (!taskQueues[i].empty()) {
+        return static_cast<DownloadPriority>(i);
+      }
+    }
+    return std::nullopt;
   }
 
   bool cancelTask(const std::string& taskId) {
     std::unique_lock lock(mutex);
     auto it = taskMap.find(taskId);
     if (it != taskMap.end()) {
-      it->second->status = DownloadTask::Status::Cancelled;
-      taskQueue.erase(it->second);
-      taskMap.erase(it);
+      it->second.second->status = DownloadTask::Status::Cancelled;
+      erase(it);
       return true;
     }
     return false;
@@ -51,26 +85,31 @@ class DownloadTaskQueue {
     std::unique_lock lock(mutex);
     auto it = taskMap.find(taskId);
     if (it != taskMap.end()) {
-      it->second->status = newStatus;
+      it->second.second->status = newStatus;
       if (newStatus == DownloadTask::Status::Cancelled ||
           newStatus == DownloadTask::Status::Error) {
-        taskQueue.erase(it->second);
-        taskMap.erase(it);
+        erase(it);
       }
       return true;
     }
     return false;
   }
 
-  std::optional<DownloadTask> getNextPendingTask() {
+  bool empty() const {
     std::shared_lock lock(mutex);
-    auto it = std::find_if(
-        taskQueue.begin(), taskQueue.end(), [](const DownloadTask& task) {
-          return task.status == DownloadTask::Status::Pending;
-        });
+    return taskMap.empty();
+  }
 
-    if (it != taskQueue.end()) {
-      return *it;
+  std::optional<DownloadTask> getNextPendingTask() {
+    std::shared_lock lock(mutex);
+    for (const auto& tasks : taskQueues) {
+      auto it = std::find_if(
+          tasks.begin(), tasks.end(), [](const DownloadTask& task) {
+            return task.status == DownloadTask::Status::Pending;
+          });
+      if (it != tasks.end()) {
+        return *it;
+      }
     }
     return std::nullopt;
   }
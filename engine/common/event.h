@@ -3,6 +3,7 @@
 #include <eventpp/eventqueue.h>
 #include <string>
 #include "common/download_task.h"
+#include "common/model_start_job.h"
 #include "eventpp/utilities/anydata.h"
 #include "utils/json_helper.h"
 
@@ -11,6 +12,7 @@ namespace cortex::event {
 enum class EventType {
   DownloadEvent,
   ExitEvent,
+  ModelLoadEvent,
 };
 
 struct Event {};
@@ -60,6 +62,25 @@ inline DownloadEventType DownloadEventTypeFromString(const std::string& str) {
     return DownloadEventType::DownloadError;
   }
 }
+
+std::string ModelLoadEventTypeToString(ModelStartJob::Phase phase) {
+  switch (phase) {
+    case ModelStartJob::Phase::Queued:
+      return "ModelLoadQueued";
+    case ModelStartJob::Phase::Prefetching:
+      return "ModelLoadPrefetching";
+    case ModelStartJob::Phase::EngineLoading:
+      return "ModelLoadEngineLoading";
+    case ModelStartJob::Phase::Warmup:
+      return "ModelLoadWarmup";
+    case ModelStartJob::Phase::Ready:
+      return "ModelLoadReady";
+    case ModelStartJob::Phase::Failed:
+      return "ModelLoadFailed";
+    default:
+      return "Unknown";
+  }
+}
 }  // namespace
 
 struct DownloadEvent : public cortex::event::Event {
@@ -85,8 +106,20 @@ inline DownloadEvent GetDownloadEventFromJson(const Json::Value& item_json) {
   }
   return ev;
 }
+
+struct ModelLoadEvent : public cortex::event::Event {
+  ModelStartJob job_;
+
+  std::string ToJsonString() const {
+    Json::Value root;
+    root["type"] = ModelLoadEventTypeToString(job_.phase);
+    root["job"] = job_.ToJsonCpp();
+    return json_helper::DumpJsonString(root);
+  }
+};
 }  // namespace cortex::event
 
 constexpr std::size_t eventMaxSize =
     eventpp::maxSizeOf<cortex::event::Event, cortex::event::DownloadEvent,
-                       cortex::event::ExitEvent, std::string>();
+                       cortex::event::ExitEvent, cortex::event::ModelLoadEvent,
+                       std::string>();
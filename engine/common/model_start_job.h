@@ -0,0 +1,71 @@
+#pragma once
+
+#include <json/json.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * Tracks an asynchronous model start request. The job walks through the
+ * phases below in order and ends either in Ready or Failed.
+ */
+struct ModelStartJob {
+  enum class Phase { Queued, Prefetching, EngineLoading, Warmup, Ready, Failed };
+
+  std::string id;
+
+  std::string model;
+
+  Phase phase = Phase::Queued;
+
+  // Error message when phase is Failed
+  std::optional<std::string> error;
+
+  std::optional<std::string> warning;
+
+  // Unix timestamps in milliseconds
+  uint64_t created_at = 0;
+
+  uint64_t updated_at = 0;
+
+  bool IsFinished() const {
+    return phase == Phase::Ready || phase == Phase::Failed;
+  }
+
+  Json::Value ToJsonCpp() const;
+};
+
+inline std::string ModelStartPhaseToString(ModelStartJob::Phase phase) {
+  switch (phase) {
+    case ModelStartJob::Phase::Queued:
+      return "queued";
+    case ModelStartJob::Phase::Prefetching:
+      return "prefetching";
+    case ModelStartJob::Phase::EngineLoading:
+      return "engine-loading";
+    case ModelStartJob::Phase::Warmup:
+      return "warmup";
+    case ModelStartJob::Phase::Ready:
+      return "ready";
+    case ModelStartJob::Phase::Failed:
+      return "failed";
+    default:
+      return "unknown";
+  }
+}
+
+inline Json::Value ModelStartJob::ToJsonCpp() const {
+  Json::Value root;
+  root["id"] = id;
+  root["model"] = model;
+  root["phase"] = ModelStartPhaseToString(phase);
+  if (error) {
+    root["error"] = *error;
+  }
+  if (warning) {
+    root["warning"] = *warning;
+  }
+  root["created_at"] = Json::Value::UInt64(created_at);
+  root["updated_at"] = Json::Value::UInt64(updated_at);
+  return root;
+}
@@ -3,7 +3,8 @@
 #include <cstring>
 #include <ctime>
 #include <iostream>
-#include <regex>
+#include <iterator>
+#include <map>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -23,6 +24,7 @@
 #include "chat_template_renderer.h"
 
 #include "gguf_parser.h"
+#include "jinja_template.h"
 #include "trantor/utils/Logger.h"
 #include "utils/engine_constants.h"
 
@@ -30,6 +32,257 @@ namespace config {
 #define NOMINMAX
 constexpr int kDefaultMaxContextLength = 8192;
 
+namespace {
+constexpr uint32_t kGGUFTypeString = 8;
+constexpr uint32_t kGGUFTypeArray = 9;
+
+// Size of a fixed size GGUF value type, 0 for strings and arrays
+size_t GGUFTypeSize(uint32_t type) {
+  switch (type) {
+    case 0:  // UINT8
+    case 1:  // INT8
+    case 7:  // BOOL
+      return 1;
+    case 2:  // UINT16
+    case 3:  // INT16
+      return 2;
+    case 4:  // UINT32
+    case 5:  // INT32
+    case 6:  // FLOAT32
+      return 4;
+    case 10:  // UINT64
+    case 11:  // INT64
+    case 12:  // FLOAT64
+      return 8;
+    case kGGUFTypeString:
+    case kGGUFTypeArray:
+      return 0;
+    default:
+      throw std::runtime_error("Unsupported metadata type: " +
+                               std::to_string(type));
+  }
+}
+
+constexpr uint64_t kDefaultTensorAlignment = 32;
+
+// Indexed by ggml_type, types that were removed from ggml have no name
+constexpr GGMLTypeTraits kGGMLTypeTraits[] = {
+    {"F32", 1, 4},        {"F16", 1, 2},       {"Q4_0", 32, 18},
+    {"Q4_1", 32, 20},     {nullptr, 0, 0},     {nullptr, 0, 0},
+    {"Q5_0", 32, 22},     {"Q5_1", 32, 24},    {"Q8_0", 32, 34},
+    {"Q8_1", 32, 36},     {"Q2_K", 256, 84},   {"Q3_K", 256, 110},
+    {"Q4_K", 256, 144},   {"Q5_K", 256, 176},  {"Q6_K", 256, 210},
+    {"Q8_K", 256, 292},   {"IQ2_XXS", 256, 66}, {"IQ2_XS", 256, 74},
+    {"IQ3_XXS", 256, 98}, {"IQ1_S", 256, 50},  {"IQ4_NL", 32, 18},
+    {"IQ3_S", 256, 110},  {"IQ2_S", 256, 82},  {"IQ4_XS", 256, 136},
+    {"I8", 1, 1},         {"I16", 1, 2},       {"I32", 1, 4},
+    {"I64", 1, 8},        {"F64", 1, 8},       {"IQ1_M", 256, 56},
+    {"BF16", 1, 2},       {"Q4_0_4_4", 32, 18}, {"Q4_0_4_8", 32, 18},
+    {"Q4_0_8_8", 32, 18}, {"TQ1_0", 256, 54},  {"TQ2_0", 256, 66},
+};
+
+// The engines take a prompt template with {system_message} and {prompt}
+// placeholders, so render the jinja template with those as the contents.
+// The engine adds BOS itself when it tokenizes the prompt, so it is rendered
+// empty, and a BOS the template spells out is stripped like llama.cpp does.
+std::string ChatTemplateFromJinja(const std::string& value,
+                                  const std::string& bos_token,
+                                  const std::string& eos_token) {
+  auto tmpl = JinjaTemplate::Compile(value);
+  if (tmpl.has_value()) {
+    Json::Value system_message;
+    system_message["role"] = "system";
+    system_message["content"] = "{system_message}";
+    Json::Value user_message;
+    user_message["role"] = "user";
+    user_message["content"] = "{prompt}";
+
+    Json::Value messages(Json::arrayValue);
+    messages.append(system_message);
+    messages.append(user_message);
+    std::string result;
+    auto res = tmpl.value()->Render(
+        ChatTemplateContext(messages, true, "", eos_token), result);
+    if (res.has_error()) {
+      // Some templates reject the system role
+      messages = Json::Value(Json::arrayValue);
+      messages.append(user_message);
+      res = tmpl.value()->Render(
+          ChatTemplateContext(messages, true, "", eos_token), result);
+    }
+    if (res.has_value()) {
+      if (!bos_token.empty() && result.starts_with(bos_token)) {
+        result.erase(0, bos_token.size());
+      }
+      return result;
+    }
+    LOG_WARN << res.error();
+  } else {
+    LOG_WARN << tmpl.error();
+  }
+
+  try {
+    std::vector<llama_chat_msg> messages{
+        llama_chat_msg{"system", "{system_message}"},
+        llama_chat_msg{"user", "{prompt}"}};
+    return llama_chat_apply_template(value, messages, true);
+  } catch (const std::exception& e) {
+    std::cerr << "Error render chat template: " << e.what()
+              << ". Using default template: \n[INST] "
+                 "<<SYS>>\n{system_message}\n<</SYS>>\n{prompt}[/INST]"
+              << "\n";
+    return "[INST] <<SYS>>\n{system_message}\n<</SYS>>\n{prompt}[/INST]";
+  }
+}
+}  // namespace
+
+std::optional<GGMLTypeTraits> GetGGMLTypeTraits(uint32_t type) {
+  if (type >= std::size(kGGMLTypeTraits) ||
+      kGGMLTypeTraits[type].name == nullptr) {
+    return std::nullopt;
+  }
+  return kGGMLTypeTraits[type];
+}
+
+uint64_t GGUFTensorInfo::ElementCount() const {
+  uint64_t count = 1;
+  for (auto d : dims) {
+    count *= d;
+  }
+  return count;
+}
+
+uint64_t GGUFTensorInfo::ByteSize() const {
+  auto traits = GetGGMLTypeTraits(type);
+  if (!traits) {
+    return 0;
+  }
+  return ElementCount() / traits->block_size * traits->type_size;
+}
+
+Json::Value GGUFTensorInfosToJson(const std::vector<GGUFTensorInfo>& tensors) {
+  Json::Value res(Json::arrayValue);
+  for (const auto& t : tensors) {
+    Json::Value tj;
+    tj["name"] = t.name;
+    Json::Value dims(Json::arrayValue);
+    for (auto d : t.dims) {
+      dims.append(Json::Value::UInt64(d));
+    }
+    tj["dims"] = dims;
+    auto traits = GetGGMLTypeTraits(t.type);
+    tj["type"] = traits ? traits->name : "unknown";
+    tj["type_id"] = t.type;
+    tj["offset"] = Json::Value::UInt64(t.offset);
+    tj["bytes"] = Json::Value::UInt64(t.ByteSize());
+    res.append(tj);
+  }
+  return res;
+}
+
+std::vector<GGUFTensorInfo> GGUFTensorInfosFromJson(const Json::Value& json) {
+  std::vector<GGUFTensorInfo> res;
+  res.reserve(json.size());
+  for (const auto& tj : json) {
+    GGUFTensorInfo t;
+    t.name = tj["name"].asString();
+    for (const auto& d : tj["dims"]) {
+      t.dims.push_back(d.asUInt64());
+    }
+    t.type = tj["type_id"].asUInt();
+    t.offset = tj["offset"].asUInt64();
+    res.push_back(std::move(t));
+  }
+  return res;
+}
+
+Json::Value GGUFTensorReport(const std::vector<GGUFTensorInfo>& tensors) {
+  struct Group {
+    uint64_t tensor_count = 0;
+    uint64_t parameter_count = 0;
+    uint64_t bytes = 0;
+  };
+  auto add = [](Group& g, const GGUFTensorInfo& t) {
+    g.tensor_count++;
+    g.parameter_count += t.ElementCount();
+    g.bytes += t.ByteSize();
+  };
+
+  Group total;
+  std::map<uint32_t, Group> by_type;
+  // Keep layers in numeric order, other groups in order of appearance
+  std::map<int, Group> layers;
+  std::vector<std::pair<std::string, Group>> others;
+  for (const auto& t : tensors) {
+    add(total, t);
+    add(by_type[t.type], t);
+
+    int layer = -1;
+    if (t.name.rfind("blk.", 0) == 0) {
+      try {
+        layer = std::stoi(t.name.substr(4));
+      } catch (const std::exception&) {
+      }
+    }
+    if (layer >= 0) {
+      add(layers[layer], t);
+    } else {
+      auto prefix = t.name.substr(0, t.name.find('.'));
+      auto it = std::find_if(others.begin(), others.end(),
+                             [&](const auto& p) { return p.first == prefix; });
+      if (it == others.end()) {
+        others.emplace_back(prefix, Group{});
+        it = std::prev(others.end());
+      }
+      add(it->second, t);
+    }
+  }
+
+  auto group_to_json = [](const Group& g) {
+    Json::Value j;
+    j["tensor_count"] = Json::Value::UInt64(g.tensor_count);
+    j["parameter_count"] = Json::Value::UInt64(g.parameter_count);
+    j["bytes"] = Json::Value::UInt64(g.bytes);
+    return j;
+  };
+
+  Json::Value res;
+  res["tensor_count"] = Json::Value::UInt64(total.tensor_count);
+  res["parameter_count"] = Json::Value::UInt64(total.parameter_count);
+  res["bytes"] = Json::Value::UInt64(total.bytes);
+  res["bits_per_weight"] =
+      total.parameter_count == 0
+          ? 0.0
+          : static_cast<double>(total.bytes) * 8 / total.parameter_count;
+
+  Json::Value quantization(Json::arrayValue);
+  for (const auto& [type, g] : by_type) {
+    auto j = group_to_json(g);
+    auto traits = GetGGMLTypeTraits(type);
+    j["type"] = traits ? traits->name : "unknown";
+    j["type_id"] = type;
+    j["block_size"] = traits ? traits->block_size : 0;
+    j["bytes_per_block"] = traits ? traits->type_size : 0;
+    quantization.append(j);
+  }
+  res["quantization"] = quantization;
+
+  Json::Value layers_json(Json::arrayValue);
+  for (const auto& [layer, g] : others) {
+    auto j = group_to_json(g);
+    j["name"] = layer;
+    layers_json.append(j);
+  }
+  for (const auto& [layer, g] : layers) {
+    auto j = group_to_json(g);
+    j["name"] = "blk." + std::to_string(layer);
+    layers_json.append(j);
+  }
+  res["layers"] = layers_json;
+  res["tensors"] = GGUFTensorInfosToJson(tensors);
+  return res;
+}
+
 void GGUFHandler::OpenFile(const std::string& file_path) {
 #ifdef _WIN32
   HANDLE file_handle_ = INVALID_HANDLE_VALUE;
@@ -67,6 +320,7 @@ void GGUFHandler::OpenFile(const std::string& file_path) {
 
   // Close the file handle, as it is no longer needed after mapping
   CloseHandle(file_handle_);
+  owns_mapping_ = true;
 
 #else
   file_size_ = std::filesystem::file_size(file_path);
@@ -82,21 +336,26 @@ void GGUFHandler::OpenFile(const std::string& file_path) {
   }
 
   close(file_descriptor);
+  owns_mapping_ = true;
 
 #endif
 }
 
 void GGUFHandler::CloseFile() {
+  if (owns_mapping_) {
 #ifdef _WIN32
-  if (data_ != nullptr) {
-    UnmapViewOfFile(data_);
-    data_ = nullptr;
-  }
+    if (data_ != nullptr) {
+      UnmapViewOfFile(data_);
+    }
 #else
-  if (data_ != nullptr && data_ != MAP_FAILED) {
-    munmap(data_, file_size_);
-  }
+    if (data_ != nullptr && data_ != MAP_FAILED) {
+      munmap(const_cast<uint8_t*>(data_), file_size_);
+    }
 #endif
+  }
+  owns_mapping_ = false;
+  data_ = nullptr;
+  metadata_index_.clear();
 }
 
 std::pair<std::size_t, std::string> GGUFHandler::ReadString(
@@ -282,41 +541,323 @@ size_t GGUFHandler::ReadArray(std::size_t offset, const std::string& key) {
   return array_offset;
 }
 
-void GGUFHandler::Parse(const std::string& file_path) {
+std::string_view GGUFHandler::ReadStringView(std::size_t offset) const {
+  if (offset + 8 > file_size_) {
+    throw GGUFTruncatedError("GGUF metadata is truncated");
+  }
+  uint64_t length;
+  std::memcpy(&length, data_ + offset, sizeof(uint64_t));
+  if (length > file_size_ - offset - 8) {
+    throw GGUFTruncatedError("GGUF metadata is truncated");
+  }
+  return std::string_view(reinterpret_cast<const char*>(data_ + offset + 8),
+                          length);
+}
+
+size_t GGUFHandler::SkipMetadataValue(uint32_t type,
+                                      std::size_t offset) const {
+  if (type == kGGUFTypeString) {
+    return 8 + ReadStringView(offset).size();
+  }
+  if (type != kGGUFTypeArray) {
+    auto size = GGUFTypeSize(type);
+    if (offset + size > file_size_) {
+      throw GGUFTruncatedError("GGUF metadata is truncated");
+    }
+    return size;
+  }
+
+  if (offset + 12 > file_size_) {
+    throw GGUFTruncatedError("GGUF metadata is truncated");
+  }
+  uint32_t array_type;
+  uint64_t array_length;
+  std::memcpy(&array_type, data_ + offset, sizeof(uint32_t));
+  std::memcpy(&array_length, data_ + offset + 4, sizeof(uint64_t));
+  std::size_t array_offset = 12;
+  // Fixed size elements are skipped in one step, only strings and nested
+  // arrays need to be walked
+  if (auto size = GGUFTypeSize(array_type); size > 0) {
+    if (array_length > (file_size_ - offset - array_offset) / size) {
+      throw GGUFTruncatedError("GGUF metadata is truncated");
+    }
+    return array_offset + array_length * size;
+  }
+  for (uint64_t i = 0; i < array_length; ++i) {
+    array_offset += SkipMetadataValue(array_type, offset + array_offset);
+  }
+  return array_offset;
+}
+
+std::optional<int64_t> GGUFHandler::GetMetadataInteger(
+    std::string_view key) const {
+  auto it = metadata_index_.find(key);
+  if (it == metadata_index_.end()) {
+    return std::nullopt;
+  }
+  const auto* p = data_ + it->second.offset;
+  switch (it->second.type) {
+    case 0:
+      return static_cast<int64_t>(*p);
+    case 1:
+      return static_cast<int64_t>(static_cast<int8_t>(*p));
+    case 2: {
+      uint16_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return static_cast<int64_t>(v);
+    }
+    case 3: {
+      int16_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return static_cast<int64_t>(v);
+    }
+    case 4: {
+      uint32_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return static_cast<int64_t>(v);
+    }
+    case 5: {
+      int32_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return static_cast<int64_t>(v);
+    }
+    case 10: {
+      uint64_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return static_cast<int64_t>(v);
+    }
+    case 11: {
+      int64_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    default:
+      return std::nullopt;
+  }
+}
+
+std::optional<std::string_view> GGUFHandler::GetMetadataString(
+    std::string_view key) const {
+  auto it = metadata_index_.find(key);
+  if (it == metadata_index_.end() || it->second.type != kGGUFTypeString) {
+    return std::nullopt;
+  }
+  return ReadStringView(it->second.offset);
+}
+
+std::optional<std::string_view> GGUFHandler::GetMetadataArrayString(
+    std::string_view key, uint64_t index) const {
+  auto it = metadata_index_.find(key);
+  if (it == metadata_index_.end() || it->second.type != kGGUFTypeArray) {
+    return std::nullopt;
+  }
+  auto offset = it->second.offset;
+  uint32_t array_type;
+  uint64_t array_length;
+  std::memcpy(&array_type, data_ + offset, sizeof(uint32_t));
+  std::memcpy(&array_length, data_ + offset + 4, sizeof(uint64_t));
+  if (array_type != kGGUFTypeString || index >= array_length) {
+    return std::nullopt;
+  }
+  offset += 12;
+  for (uint64_t i = 0; i < index; ++i) {
+    offset += 8 + ReadStringView(offset).size();
+  }
+  return ReadStringView(offset);
+}
+
+std::optional<bool> GGUFHandler::GetMetadataBool(std::string_view key) const {
+  auto it = metadata_index_.find(key);
+  if (it == metadata_index_.end() || it->second.type != 7) {
+    return std::nullopt;
+  }
+  return data_[it->second.offset] != 0;
+}
+
+std::optional<std::pair<std::size_t, uint64_t>> GGUFHandler::GetMetadataArray(
+    std::string_view key, uint32_t element_type) const {
+  auto it = metadata_index_.find(key);
+  if (it == metadata_index_.end() || it->second.type != kGGUFTypeArray) {
+    return std::nullopt;
+  }
+  uint32_t array_type;
+  uint64_t array_length;
+  std::memcpy(&array_type, data_ + it->second.offset, sizeof(uint32_t));
+  std::memcpy(&array_length, data_ + it->second.offset + 4, sizeof(uint64_t));
+  if (array_type != element_type) {
+    return std::nullopt;
+  }
+  return std::make_pair(it->second.offset + 12, array_length);
+}
+
+void GGUFHandler::ReadVocab() {
+  vocab_ = GGUFVocab{};
+  vocab_.model =
+      std::string(GetMetadataString("tokenizer.ggml.model").value_or(""));
+  vocab_.pre =
+      std::string(GetMetadataString("tokenizer.ggml.pre").value_or(""));
+
+  auto read_strings = [this](std::string_view key,
+                             std::vector<std::string>& out) {
+    auto array = GetMetadataArray(key, kGGUFTypeString);
+    if (!array) {
+      return;
+    }
+    auto [offset, length] = *array;
+    out.reserve(length);
+    for (uint64_t i = 0; i < length; ++i) {
+      auto str = ReadStringView(offset);
+      out.emplace_back(str);
+      offset += 8 + str.size();
+    }
+  };
+  read_strings("tokenizer.ggml.tokens", vocab_.tokens);
+  read_strings("tokenizer.ggml.merges", vocab_.merges);
+
+  // Offsets were validated by the metadata pass
+  if (auto array = GetMetadataArray("tokenizer.ggml.scores", 6); array) {
+    vocab_.scores.resize(array->second);
+    std::memcpy(vocab_.scores.data(), data_ + array->first,
+                array->second * sizeof(float));
+  }
+  if (auto array = GetMetadataArray("tokenizer.ggml.token_type", 5); array) {
+    vocab_.token_types.resize(array->second);
+    std::memcpy(vocab_.token_types.data(), data_ + array->first,
+                array->second * sizeof(int32_t));
+  }
+
+  vocab_.bos_id =
+      GetMetadataInteger("tokenizer.ggml.bos_token_id").value_or(-1);
+  vocab_.eos_id =
+      GetMetadataInteger("tokenizer.ggml.eos_token_id").value_or(-1);
+  vocab_.unk_id =
+      GetMetadataInteger("tokenizer.ggml.unknown_token_id").value_or(-1);
+  vocab_.add_bos = GetMetadataBool("tokenizer.ggml.add_bos_token");
+  vocab_.add_eos = GetMetadataBool("tokenizer.ggml.add_eos_token");
+  vocab_.add_space_prefix = GetMetadataBool("tokenizer.ggml.add_space_prefix");
+}
+
+std::size_t GGUFHandler::ReadTensorInfos(std::size_t offset) {
+  tensor_infos_.clear();
+  tensor_infos_.reserve(tensor_count_);
+  for (uint64_t i = 0; i < tensor_count_; ++i) {
+    GGUFTensorInfo info;
+    auto name = ReadStringView(offset);
+    info.name = std::string(name);
+    offset += 8 + name.size();
+
+    if (offset + 4 > file_size_) {
+      throw GGUFTruncatedError("GGUF tensor info is truncated");
+    }
+    uint32_t n_dims;
+    std::memcpy(&n_dims, data_ + offset, sizeof(uint32_t));
+    offset += 4;
+    if (n_dims > (file_size_ - offset) / 8) {
+      throw GGUFTruncatedError("GGUF tensor info is truncated");
+    }
+    info.dims.resize(n_dims);
+    std::memcpy(info.dims.data(), data_ + offset, n_dims * sizeof(uint64_t));
+    offset += n_dims * sizeof(uint64_t);
+
+    if (offset + 12 > file_size_) {
+      throw GGUFTruncatedError("GGUF tensor info is truncated");
+    }
+    std::memcpy(&info.type, data_ + offset, sizeof(uint32_t));
+    std::memcpy(&info.offset, data_ + offset + 4, sizeof(uint64_t));
+    offset += 12;
+    tensor_infos_.push_back(std::move(info));
+  }
+  return offset;
+}
+
+void GGUFHandler::Parse(const std::string& file_path, ParseMode mode) {
   OpenFile(file_path);
-  LOG_INFO << "GGUF magic number: " << *reinterpret_cast<const uint32_t*>(data_)
-           << "\n";
-  if (*reinterpret_cast<const uint32_t*>(data_) != GGUF_MAGIC_NUMBER) {
+  try {
+    ParseData(mode);
+  } catch (...) {
+    CloseFile();
+    throw;
+  }
+  CloseFile();
+}
+
+void GGUFHandler::ParseBuffer(const uint8_t* data, size_t size) {
+  data_ = data;
+  file_size_ = size;
+  try {
+    ParseData(ParseMode::Lazy);
+  } catch (...) {
+    CloseFile();
+    throw;
+  }
+  CloseFile();
+}
+
+void GGUFHandler::ParseData(ParseMode mode) {
+  bool full = mode == ParseMode::Full;
+  if (file_size_ >= 4 &&
+      *reinterpret_cast<const uint32_t*>(data_) != GGUF_MAGIC_NUMBER) {
     throw std::runtime_error("Not a valid GGUF file");
   }
+  if (file_size_ < 24) {
+    throw GGUFTruncatedError("GGUF header is truncated");
+  }
 
   version_ = *reinterpret_cast<const uint32_t*>(data_ + 4);
   tensor_count_ = *reinterpret_cast<const uint64_t*>(data_ + 8);
   uint64_t metadata_kv_count = *reinterpret_cast<const uint64_t*>(data_ + 16);
-  LOG_INFO << "version: " << version_ << "\ntensor count: " << tensor_count_
-           << "\nmetadata key-value pairs: " << metadata_kv_count << "\n";
+  if (full) {
+    LOG_INFO << "version: " << version_ << "\ntensor count: " << tensor_count_
+             << "\nmetadata key-value pairs: " << metadata_kv_count << "\n";
+  }
 
   std::size_t offset = 24;
 
+  metadata_index_.clear();
   for (uint64_t i = 0; i < metadata_kv_count; ++i) {
-    LOG_INFO << "Parsing key-value number " << i << "\n";
-    auto [key_byte_length, key] = ReadString(offset);
-    offset += key_byte_length;
-    LOG_INFO << "key: " << key << "\n";
+    auto key = ReadStringView(offset);
+    offset += 8 + key.size();
+    if (offset + 4 > file_size_) {
+      throw GGUFTruncatedError("GGUF metadata is truncated");
+    }
     uint32_t value_type = *reinterpret_cast<const uint32_t*>(data_ + offset);
     offset += 4;
-    LOG_INFO << "value type number: " << value_type << "\n";
-    size_t value_byte_length = ReadMetadataValue(value_type, offset, key);
-    offset += value_byte_length;
-    LOG_INFO << "-------------------------------------------- " << "\n";
+    metadata_index_[key] = MetadataEntry{.type = value_type, .offset = offset};
+    if (full) {
+      LOG_INFO << "key: " << std::string(key)
+               << ", value type number: " << value_type << "\n";
+      offset += ReadMetadataValue(value_type, offset, std::string(key));
+    } else {
+      offset += SkipMetadataValue(value_type, offset);
+    }
   }
-  try {
-    PrintMetadata();
-  } catch (const std::exception& e) {
-    LOG_ERROR << "Error parsing metadata: " << e.what() << "\n";
+  if (full) {
+    try {
+      PrintMetadata();
+    } catch (const std::exception& e) {
+      LOG_ERROR << "Error parsing metadata: " << e.what() << "\n";
+    }
+  }
+  architecture_ =
+      std::string(GetMetadataString("general.architecture").value_or(""));
+  split_info_.reset();
+  if (auto count = GetMetadataInteger("split.count"); count && *count > 1) {
+    split_info_ = GGUFSplitInfo{
+        .no = static_cast<int>(GetMetadataInteger("split.no").value_or(0)),
+        .count = static_cast<int>(*count),
+        .tensors_count =
+            GetMetadataInteger("split.tensors.count").value_or(0)};
   }
+  offset = ReadTensorInfos(offset);
+  uint64_t alignment = kDefaultTensorAlignment;
+  if (auto v = GetMetadataInteger("general.alignment"); v && *v > 0) {
+    alignment = static_cast<uint64_t>(*v);
+  }
+  tensor_data_offset_ = (offset + alignment - 1) / alignment * alignment;
   ModelConfigFromMetadata();
-  CloseFile();
+  if (mode == ParseMode::Vocab) {
+    ReadVocab();
+  }
 }
 
 void GGUFHandler::PrintMetadata() {
@@ -377,9 +918,10 @@ void GGUFHandler::PrintMetadata() {
 }
 
 void GGUFHandler::ModelConfigFromMetadata() {
-  int eos_token, bos_token, max_tokens, version, ngl;
-  std::string chat_template, name, eos_string, bos_string;
-  std::vector<std::string> tokens, stop;
+  int eos_token = -1, max_tokens = kDefaultMaxContextLength, version = 0,
+      ngl = 0;
+  std::string chat_template, name;
+  std::vector<std::string> stop;
   model_config_.top_p = 0.95;
   model_config_.temperature = 0.7;
   model_config_.frequency_penalty = 0;
@@ -408,160 +950,65 @@ void GGUFHandler::ModelConfigFromMetadata() {
   model_config_.grammar = "";
 
   // Get version, bos, eos id, contex_len, ngl from meta data
-  for (const auto& [key, value] : metadata_uint8_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-
-  for (const auto& [key, value] : metadata_int8_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-
-  for (const auto& [key, value] : metadata_uint16_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-
-  for (const auto& [key, value] : metadata_int16_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-
-  for (const auto& [key, value] : metadata_uint32_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-
-  for (const auto& [key, value] : metadata_int32_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-  for (const auto& [key, value] : metadata_uint64_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-
-  for (const auto& [key, value] : metadata_int64_) {
-    if (key.compare("general.quantization_version") == 0)
-      version = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.bos_token_id") == 0)
-      bos_token = static_cast<int>(value);
-    else if (key.compare("tokenizer.ggml.eos_token_id") == 0)
-      eos_token = static_cast<int>(value);
-    else if (key.find("context_length") != std::string::npos)
-      max_tokens = static_cast<int>(value);
-    else if (key.find("block_count") != std::string::npos)
-      ngl = static_cast<int>(value) + 1;
-  }
-  for (const auto& [key, value] : metadata_array_string_) {
-    if (key.compare("tokenizer.ggml.tokens") == 0) {
-      tokens = std::move(value);
+  for (const auto& [key, entry] : metadata_index_) {
+    if (key.find("context_length") != std::string_view::npos) {
+      if (auto v = GetMetadataInteger(key); v) {
+        max_tokens = static_cast<int>(*v);
+      }
+    } else if (key.find("block_count") != std::string_view::npos) {
+      if (auto v = GetMetadataInteger(key); v) {
+        ngl = static_cast<int>(*v) + 1;
+      }
     }
   }
-  for (const auto& [key, value] : metadata_string_) {
-    if (key.compare("general.name") == 0) {
-      name = std::regex_replace(value, std::regex(" "), "-");
-    } else if (key.find("chat_template") != std::string::npos) {
-      if (value.compare(ZEPHYR_JINJA) == 0) {
-        chat_template =
-            "<|system|>\n{system_message}</s>\n<|user|>\n{prompt}</"
-            "s>\n<|assistant|>\n";
-      } else if (value.compare(OPEN_CHAT_3_5_JINJA) == 0) {
-        chat_template =
-            "GPT4 Correct User: {prompt}<|end_of_turn|>GPT4 Correct Assistant:";
-      } else if (value.compare(LLAMA_3_JINJA) == 0 ||
-                 value.compare(LLAMA_3_1_JINJA) == 0) {
-        chat_template =
-            "<|begin_of_text|><|start_header_id|>system<|end_header_id|>\n\n{"
-            "system_message}<|eot_id|><|start_header_id|>user<|end_header_id|>"
-            "\n\n{prompt}<|eot_id|><|start_header_id|>assistant<|end_header_id|"
-            ">\n\n";
-      } else {
-        try {
-          std::vector<llama_chat_msg> messages{
-              llama_chat_msg{"system", "{system_message}"},
-              llama_chat_msg{"user", "{prompt}"}};
-          chat_template = llama_chat_apply_template(value, messages, true);
-        } catch (const std::exception& e) {
-          std::cerr << "Error render chat template: " << e.what()
-                    << ". Using default template: \n[INST] "
-                       "<<SYS>>\n{system_message}\n<</SYS>>\n{prompt}[/INST]"
-                    << "\n";
-          chat_template =
-              "[INST] <<SYS>>\n{system_message}\n<</SYS>>\n{prompt}[/INST]";
-        }
-      }
+  version = static_cast<int>(
+      GetMetadataInteger("general.quantization_version").value_or(0));
+  eos_token = static_cast<int>(
+      GetMetadataInteger("tokenizer.ggml.eos_token_id").value_or(-1));
+  context_length_ = max_tokens;
+  bos_token_.clear();
+  eos_token_.clear();
+  if (auto bos_id = GetMetadataInteger("tokenizer.ggml.bos_token_id"); bos_id) {
+    if (auto v = GetMetadataArrayString("tokenizer.ggml.tokens", *bos_id); v) {
+      bos_token_ = std::string(*v);
     }
   }
 
-  try {
-    if (tokens.size() > eos_token) {
-      eos_string = tokens[eos_token];
-      stop.push_back(std::move(eos_string));
+  if (eos_token >= 0) {
+    if (auto v = GetMetadataArrayString("tokenizer.ggml.tokens", eos_token);
+        v) {
+      eos_token_ = std::string(*v);
+      stop.push_back(eos_token_);
     } else {
       LOG_ERROR << "Can't find stop token";
     }
-  } catch (const std::exception& e) {
+  } else {
     LOG_ERROR << "Can't find stop token";
   }
 
+  if (auto v = GetMetadataString("general.name"); v) {
+    name = std::string(*v);
+    std::replace(name.begin(), name.end(), ' ', '-');
+  }
+
+  // Prefer the default template when the model ships several of them
+  auto jinja = GetMetadataString("tokenizer.chat_template");
+  if (!jinja) {
+    for (const auto& [key, entry] : metadata_index_) {
+      if (key.find("chat_template") != std::string_view::npos &&
+          entry.type == kGGUFTypeString) {
+        jinja = ReadStringView(entry.offset);
+        break;
+      }
+    }
+  }
+  chat_template_jinja_.clear();
+  if (jinja) {
+    chat_template_jinja_ = std::string(*jinja);
+    chat_template =
+        ChatTemplateFromJinja(chat_template_jinja_, bos_token_, eos_token_);
+  }
+
   model_config_.stop = std::move(stop);
   if (chat_template.empty())
     chat_template =
@@ -580,4 +1027,40 @@ void GGUFHandler::ModelConfigFromMetadata() {
 const ModelConfig& GGUFHandler::GetModelConfig() const {
   return model_config_;
 }
+
+const std::vector<GGUFTensorInfo>& GGUFHandler::GetTensorInfos() const {
+  return tensor_infos_;
+}
+
+const std::string& GGUFHandler::GetArchitecture() const {
+  return architecture_;
+}
+
+int64_t GGUFHandler::GetContextLength() const {
+  return context_length_;
+}
+
+const std::string& GGUFHandler::GetBosToken() const {
+  return bos_token_;
+}
+
+const std::string& GGUFHandler::GetEosToken() const {
+  return eos_token_;
+}
+
+const std::string& GGUFHandler::GetChatTemplate() const {
+  return chat_template_jinja_;
+}
+
+const GGUFVocab& GGUFHandler::GetVocab() const {
+  return vocab_;
+}
+
+const std::optional<GGUFSplitInfo>& GGUFHandler::GetSplitInfo() const {
+  return split_info_;
+}
+
+uint64_t GGUFHandler::GetTensorDataOffset() const {
+  return tensor_data_offset_;
+}
 }  // namespace config
@@ -1,5 +1,10 @@
 #pragma once
+#include <json/json.h>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include "yaml_config.h"
 
 namespace config {
@@ -32,26 +37,160 @@ constexpr char LLAMA_3_JINJA[] =
     "'<|start_header_id|>assistant<|end_header_id|>\n\n' }}";
 constexpr uint32_t GGUF_MAGIC_NUMBER = 1179993927;
 
+struct GGMLTypeTraits {
+  const char* name;
+  // Number of weights stored in one block
+  uint32_t block_size;
+  // Size of one block in bytes
+  uint32_t type_size;
+};
+
+// Returns std::nullopt for types this build does not know about
+std::optional<GGMLTypeTraits> GetGGMLTypeTraits(uint32_t type);
+
+struct GGUFTensorInfo {
+  std::string name;
+  std::vector<uint64_t> dims;
+  // ggml_type
+  uint32_t type;
+  // Offset from the start of the tensor data section
+  uint64_t offset;
+
+  uint64_t ElementCount() const;
+  // 0 if the type is unknown
+  uint64_t ByteSize() const;
+};
+
+Json::Value GGUFTensorInfosToJson(const std::vector<GGUFTensorInfo>& tensors);
+
+std::vector<GGUFTensorInfo> GGUFTensorInfosFromJson(const Json::Value& json);
+
+/**
+ * Summarize a tensor table: totals, the mix of quantization types, and sizes
+ * per layer. Tensors named blk.N.* are grouped by layer N, others by their
+ * name prefix.
+ */
+Json::Value GGUFTensorReport(const std::vector<GGUFTensorInfo>& tensors);
+
+// Split metadata written by gguf-split into every shard
+struct GGUFSplitInfo {
+  // 0-based shard number
+  int no;
+  int count;
+  // Number of tensors across all shards
+  int64_t tensors_count;
+};
+
+// Tokenizer data copied out of the tokenizer.ggml.* keys
+struct GGUFVocab {
+  // "llama" for SentencePiece vocabularies, "gpt2" for byte level BPE
+  std::string model;
+  // Pre-tokenizer name of BPE vocabularies, e.g. "llama-bpe" or "qwen2"
+  std::string pre;
+  std::vector<std::string> tokens;
+  std::vector<float> scores;
+  // llama_token_type of every token, empty if the file has none
+  std::vector<int32_t> token_types;
+  // "left right" pairs in merge order
+  std::vector<std::string> merges;
+  int64_t bos_id = -1;
+  int64_t eos_id = -1;
+  int64_t unk_id = -1;
+  std::optional<bool> add_bos;
+  std::optional<bool> add_eos;
+  std::optional<bool> add_space_prefix;
+};
+
+// Thrown when the data ends before the GGUF header and tensor table do
+class GGUFTruncatedError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
 class GGUFHandler {
  public:
+  /**
+   * Full decodes every metadata value into memory. Lazy records where each
+   * value lives in the mapped file during a single pass, skipping over array
+   * bodies, and only decodes the keys needed for the model config. Use Lazy
+   * when only the model config is needed. Vocab parses like Lazy and also
+   * copies the tokenizer vocabulary out of the file.
+   */
+  enum class ParseMode { Full, Lazy, Vocab };
+
   void CloseFile();
-  void Parse(const std::string& file_path);
+  void Parse(const std::string& file_path, ParseMode mode = ParseMode::Full);
+  /**
+   * Lazily parse the beginning of a GGUF file held in memory, e.g. fetched
+   * with a HTTP range request. Throws GGUFTruncatedError if the buffer ends
+   * before the tensor info table, the caller can then retry with more bytes.
+   */
+  void ParseBuffer(const uint8_t* data, size_t size);
   const ModelConfig& GetModelConfig() const;
+  const std::vector<GGUFTensorInfo>& GetTensorInfos() const;
+  const std::string& GetArchitecture() const;
+  // Context length of the model, before it is capped for the model config
+  int64_t GetContextLength() const;
+  const std::string& GetBosToken() const;
+  const std::string& GetEosToken() const;
+  // Raw jinja chat template, empty if the model has none
+  const std::string& GetChatTemplate() const;
+  // Only filled by ParseMode::Vocab
+  const GGUFVocab& GetVocab() const;
+  // std::nullopt if the file is not a shard of a split model
+  const std::optional<GGUFSplitInfo>& GetSplitInfo() const;
+  // Absolute file offset of the tensor data section
+  uint64_t GetTensorDataOffset() const;
   void PrintMetadata();
 
  private:
+  struct MetadataEntry {
+    uint32_t type;
+    // Offset of the value in the mapped file
+    std::size_t offset;
+  };
+
   std::pair<std::size_t, std::string> ReadString(std::size_t offset) const;
   size_t ReadMetadataValue(int type, std::size_t offset,
                            const std::string& key);
   size_t ReadArray(std::size_t offset, const std::string& key);
+  // Byte length of a value without decoding it
+  size_t SkipMetadataValue(uint32_t type, std::size_t offset) const;
+  std::string_view ReadStringView(std::size_t offset) const;
+  std::optional<int64_t> GetMetadataInteger(std::string_view key) const;
+  std::optional<std::string_view> GetMetadataString(
+      std::string_view key) const;
+  std::optional<std::string_view> GetMetadataArrayString(
+      std::string_view key, uint64_t index) const;
+  std::optional<bool> GetMetadataBool(std::string_view key) const;
+  // Offset of the first element and the length of an array of element_type
+  std::optional<std::pair<std::size_t, uint64_t>> GetMetadataArray(
+      std::string_view key, uint32_t element_type) const;
+  void ReadVocab();
   void ModelConfigFromMetadata();
+  // Returns the offset right after the tensor info table
+  std::size_t ReadTensorInfos(std::size_t offset);
   void OpenFile(const std::string& file_path);
+  void ParseData(ParseMode mode);
 
-  uint8_t* data_;
-  size_t file_size_;
+  const uint8_t* data_ = nullptr;
+  // False when data_ points to a caller owned buffer
+  bool owns_mapping_ = false;
+  size_t file_size_ = 0;
   uint32_t version_;
   uint64_t tensor_count_;
   ModelConfig model_config_;
+  std::string architecture_;
+  int64_t context_length_ = 0;
+  std::string bos_token_;
+  std::string eos_token_;
+  std::string chat_template_jinja_;
+  GGUFVocab vocab_;
+  std::optional<GGUFSplitInfo> split_info_;
+  std::vector<GGUFTensorInfo> tensor_infos_;
+  uint64_t tensor_data_offset_ = 0;
+  // Keys and values point into the mapped file, only valid until CloseFile
+  std::unordered_map<std::string_view, MetadataEntry> metadata_index_;
   std::unordered_map<std::string, uint8_t> metadata_uint8_;
   std::unordered_map<std::string, int8_t> metadata_int8_;
   std::unordered_map<std::string, uint16_t> metadata_uint16_;
@@ -68,4 +207,4 @@ class GGUFHandler {
   std::unordered_map<std::string, std::vector<std::string>>
       metadata_array_string_;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,52 @@
+#include "config/gguf_remote.h"
+#include <algorithm>
+#include "utils/curl_utils.h"
+#include "utils/logging_utils.h"
+
+namespace config {
+
+cpp::result<void, std::string> ParseRemoteGGUF(const GGUFRangeFetcher& fetch,
+                                               GGUFHandler& handler,
+                                               uint64_t initial_bytes,
+                                               uint64_t max_bytes) {
+  std::string buffer;
+  uint64_t wanted = std::min(std::max<uint64_t>(initial_bytes, 24), max_bytes);
+  while (true) {
+    auto res = fetch(buffer.size(), wanted - buffer.size());
+    if (res.has_error()) {
+      return cpp::fail(res.error());
+    }
+    bool eof = res.value().size() < wanted - buffer.size();
+    buffer += res.value();
+
+    try {
+      handler.ParseBuffer(reinterpret_cast<const uint8_t*>(buffer.data()),
+                          buffer.size());
+      CTL_DBG("Parsed remote GGUF header with " << buffer.size() << " bytes");
+      return {};
+    } catch (const GGUFTruncatedError& e) {
+      if (eof) {
+        return cpp::fail(std::string(e.what()));
+      }
+      if (wanted >= max_bytes) {
+        return cpp::fail("GGUF header is larger than " +
+                         std::to_string(max_bytes) + " bytes");
+      }
+      wanted = std::min(wanted * 2, max_bytes);
+    } catch (const std::exception& e) {
+      return cpp::fail(std::string(e.what()));
+    }
+  }
+}
+
+cpp::result<void, std::string> ParseRemoteGGUF(const std::string& url,
+                                               GGUFHandler& handler,
+                                               uint64_t initial_bytes,
+                                               uint64_t max_bytes) {
+  return ParseRemoteGGUF(
+      [&url](uint64_t offset, uint64_t length) {
+        return curl_utils::SimpleGetRange(url, offset, length);
+      },
+      handler, initial_bytes, max_bytes);
+}
+}  // namespace config
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include "config/gguf_parser.h"
+#include "utils/result.hpp"
+
+namespace config {
+
+// Returns up to length bytes of a file starting at offset
+using GGUFRangeFetcher = std::function<cpp::result<std::string, std::string>(
+    uint64_t offset, uint64_t length)>;
+
+constexpr uint64_t kGGUFRemoteInitialBytes = 1024 * 1024;
+constexpr uint64_t kGGUFRemoteMaxBytes = 128 * 1024 * 1024;
+
+/**
+ * Parse the header and tensor table of a GGUF file without downloading the
+ * tensor data. The first initial_bytes are fetched, and while the parser
+ * runs out of data the buffer is doubled by fetching only the missing range.
+ * Fails if the header does not fit in max_bytes.
+ */
+cpp::result<void, std::string> ParseRemoteGGUF(
+    const GGUFRangeFetcher& fetch, GGUFHandler& handler,
+    uint64_t initial_bytes = kGGUFRemoteInitialBytes,
+    uint64_t max_bytes = kGGUFRemoteMaxBytes);
+
+// Same as above, fetching with HTTP range requests
+cpp::result<void, std::string> ParseRemoteGGUF(
+    const std::string& url, GGUFHandler& handler,
+    uint64_t initial_bytes = kGGUFRemoteInitialBytes,
+    uint64_t max_bytes = kGGUFRemoteMaxBytes);
+}  // namespace config
@@ -0,0 +1,718 @@
+#include "config/gguf_tokenizer.h"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <queue>
+
+namespace config {
+namespace {
+// llama_token_type
+constexpr int32_t kTokenNormal = 1;
+constexpr int32_t kTokenUnknown = 2;
+constexpr int32_t kTokenControl = 3;
+constexpr int32_t kTokenUserDefined = 4;
+constexpr int32_t kTokenByte = 6;
+
+// SentencePiece replaces spaces with U+2581
+constexpr std::string_view kSpmSpace = "\xe2\x96\x81";
+
+size_t Utf8Length(char lead) {
+  auto b = static_cast<unsigned char>(lead);
+  if (b < 0x80) {
+    return 1;
+  }
+  if ((b & 0xE0) == 0xC0) {
+    return 2;
+  }
+  if ((b & 0xF0) == 0xE0) {
+    return 3;
+  }
+  if ((b & 0xF8) == 0xF0) {
+    return 4;
+  }
+  return 1;
+}
+
+void AppendUtf8(uint32_t cp, std::string& out) {
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+// Decodes the code point at pos and moves pos past it. Invalid bytes decode
+// to themselves
+uint32_t NextCodePoint(std::string_view s, size_t& pos) {
+  auto len = Utf8Length(s[pos]);
+  if (len == 1 || pos + len > s.size()) {
+    return static_cast<unsigned char>(s[pos++]);
+  }
+  static constexpr uint8_t kLeadMasks[] = {0, 0, 0x1F, 0x0F, 0x07};
+  uint32_t cp = static_cast<unsigned char>(s[pos]) & kLeadMasks[len];
+  for (size_t i = 1; i < len; i++) {
+    cp = (cp << 6) | (static_cast<unsigned char>(s[pos + i]) & 0x3F);
+  }
+  pos += len;
+  return cp;
+}
+
+// GPT-2 maps every byte to a printable code point before running the merges
+struct ByteEncoder {
+  std::array<std::string, 256> encode;
+  std::unordered_map<uint32_t, uint8_t> decode;
+
+  ByteEncoder() {
+    uint32_t next = 256;
+    for (uint32_t b = 0; b < 256; b++) {
+      bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) ||
+                       (b >= 174 && b <= 255);
+      uint32_t cp = printable ? b : next++;
+      AppendUtf8(cp, encode[b]);
+      decode[cp] = static_cast<uint8_t>(b);
+    }
+  }
+};
+
+const ByteEncoder& GetByteEncoder() {
+  static const ByteEncoder encoder;
+  return encoder;
+}
+
+enum class CharClass : uint8_t { None, Letter, Digit, Space, Other };
+
+constexpr std::array<CharClass, 128> kAsciiClasses = [] {
+  std::array<CharClass, 128> classes{};
+  for (int c = 0; c < 128; c++) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      classes[c] = CharClass::Letter;
+    } else if (c >= '0' && c <= '9') {
+      classes[c] = CharClass::Digit;
+    } else if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      classes[c] = CharClass::Space;
+    } else {
+      classes[c] = CharClass::Other;
+    }
+  }
+  return classes;
+}();
+
+CharClass Classify(uint32_t cp) {
+  if (cp < 128) {
+    return kAsciiClasses[cp];
+  }
+  if (cp == 0x85 || cp == 0xA0 || cp == 0x1680 ||
+      (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 || cp == 0x2029 ||
+      cp == 0x202F || cp == 0x205F || cp == 0x3000) {
+    return CharClass::Space;
+  }
+  // Latin-1 symbols, general punctuation and CJK punctuation
+  if ((cp >= 0xA1 && cp <= 0xBF) || cp == 0xD7 || cp == 0xF7 ||
+      (cp >= 0x2010 && cp <= 0x205E) || (cp >= 0x3001 && cp <= 0x3011) ||
+      (cp >= 0xFF01 && cp <= 0xFF0F)) {
+    return CharClass::Other;
+  }
+  return CharClass::Letter;
+}
+
+/**
+ * Splits text into words like the GPT-2 or llama 3 pre-tokenizer regex and
+ * calls emit with the byte range of every word.
+ */
+template <typename F>
+void PreTokenize(std::string_view text, bool llama3, int max_digits,
+                 F&& emit) {
+  std::vector<uint32_t> cps;
+  std::vector<size_t> offsets;
+  cps.reserve(text.size());
+  offsets.reserve(text.size() + 1);
+  for (size_t pos = 0; pos < text.size();) {
+    offsets.push_back(pos);
+    cps.push_back(NextCodePoint(text, pos));
+  }
+  offsets.push_back(text.size());
+
+  size_t n = cps.size();
+  auto cls = [&](size_t i) {
+    return i < n ? Classify(cps[i]) : CharClass::None;
+  };
+  auto is_newline = [&](size_t i) {
+    return i < n && (cps[i] == '\r' || cps[i] == '\n');
+  };
+  auto lower = [llama3](uint32_t c) {
+    return llama3 && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+  };
+  auto word = [&](size_t start, size_t end) {
+    emit(offsets[start], offsets[end]);
+  };
+
+  size_t i = 0;
+  while (i < n) {
+    // 's 't 're 've 'm 'll 'd
+    if (cps[i] == '\'' && i + 1 < n) {
+      auto c1 = lower(cps[i + 1]);
+      auto c2 = i + 2 < n ? lower(cps[i + 2]) : 0;
+      size_t len = 0;
+      if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') {
+        len = 2;
+      } else if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') ||
+                 (c1 == 'l' && c2 == 'l')) {
+        len = 3;
+      }
+      if (len > 0) {
+        word(i, i + len);
+        i += len;
+        continue;
+      }
+    }
+
+    auto c = cls(i);
+    size_t k = i;
+    if (llama3) {
+      // [^\r\n\p{L}\p{N}]?\p{L}+
+      if (c == CharClass::Letter ||
+          (c != CharClass::Digit && !is_newline(i) &&
+           cls(i + 1) == CharClass::Letter)) {
+        k = c == CharClass::Letter ? i : i + 1;
+        while (cls(k) == CharClass::Letter) {
+          k++;
+        }
+        word(i, k);
+        i = k;
+        continue;
+      }
+      // \p{N}{1,3}
+      if (c == CharClass::Digit) {
+        while (cls(k) == CharClass::Digit &&
+               (max_digits == 0 || k - i < static_cast<size_t>(max_digits))) {
+          k++;
+        }
+        word(i, k);
+        i = k;
+        continue;
+      }
+      // ' ?[^\s\p{L}\p{N}]+[\r\n]*'
+      size_t j = i + (cps[i] == ' ' ? 1 : 0);
+      if (cls(j) == CharClass::Other) {
+        k = j;
+        while (cls(k) == CharClass::Other) {
+          k++;
+        }
+        while (is_newline(k)) {
+          k++;
+        }
+        word(i, k);
+        i = k;
+        continue;
+      }
+    } else {
+      // ' ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+'
+      size_t j = i;
+      if (cps[i] == ' ' && cls(i + 1) != CharClass::Space &&
+          cls(i + 1) != CharClass::None) {
+        j = i + 1;
+      }
+      auto cj = cls(j);
+      if (cj == CharClass::Letter || cj == CharClass::Digit ||
+          cj == CharClass::Other) {
+        k = j;
+        while (cls(k) == cj &&
+               (cj != CharClass::Digit || max_digits == 0 ||
+                k - j < static_cast<size_t>(max_digits))) {
+          k++;
+        }
+        word(i, k);
+        i = k;
+        continue;
+      }
+    }
+
+    // White space
+    while (cls(k) == CharClass::Space) {
+      k++;
+    }
+    if (llama3) {
+      // \s*[\r\n]+ ends at the last line break of the run
+      size_t last_newline = k;
+      for (size_t m = i; m < k; m++) {
+        if (is_newline(m)) {
+          last_newline = m;
+        }
+      }
+      if (last_newline < k) {
+        word(i, last_newline + 1);
+        i = last_newline + 1;
+        continue;
+      }
+    }
+    // \s+(?!\S) leaves the last space to prefix the next word
+    if (k < n && k - i > 1) {
+      k--;
+    }
+    word(i, k);
+    i = k;
+  }
+}
+}  // namespace
+
+cpp::result<std::shared_ptr<const GGUFTokenizer>, std::string>
+GGUFTokenizer::Create(const GGUFVocab& vocab) {
+  if (vocab.tokens.empty()) {
+    return cpp::fail("GGUF file has no tokenizer vocabulary");
+  }
+  std::shared_ptr<GGUFTokenizer> res(new GGUFTokenizer());
+  if (vocab.model == "llama") {
+    res->type_ = Type::SPM;
+  } else if (vocab.model == "gpt2") {
+    res->type_ = Type::BPE;
+  } else {
+    return cpp::fail("Unsupported tokenizer model '" + vocab.model + "'");
+  }
+
+  size_t n = vocab.tokens.size();
+  size_t total = 0;
+  for (const auto& token : vocab.tokens) {
+    total += token.size();
+  }
+  if (total > std::numeric_limits<uint32_t>::max() ||
+      n > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return cpp::fail("Tokenizer vocabulary is too large");
+  }
+  res->texts_.reserve(total);
+  res->offsets_.reserve(n + 1);
+  for (const auto& token : vocab.tokens) {
+    res->offsets_.push_back(static_cast<uint32_t>(res->texts_.size()));
+    res->texts_ += token;
+  }
+  res->offsets_.push_back(static_cast<uint32_t>(res->texts_.size()));
+
+  res->scores_ = vocab.scores;
+  res->scores_.resize(n, 0.0f);
+  res->types_.assign(n, kTokenNormal);
+  if (vocab.token_types.size() == n) {
+    std::transform(vocab.token_types.begin(), vocab.token_types.end(),
+                   res->types_.begin(),
+                   [](int32_t t) { return static_cast<uint8_t>(t); });
+  }
+
+  // texts_ is complete, views into it stay valid
+  res->ids_.reserve(n);
+  res->byte_tokens_.fill(-1);
+  for (size_t i = 0; i < n; i++) {
+    auto id = static_cast<int32_t>(i);
+    auto text = res->TokenText(id);
+    res->ids_[text] = id;
+    auto type = res->types_[i];
+    if (type == kTokenByte && text.size() == 6 && text.substr(0, 3) == "<0x") {
+      unsigned int byte = 0;
+      auto [p, ec] =
+          std::from_chars(text.data() + 3, text.data() + 5, byte, 16);
+      if (ec == std::errc() && p == text.data() + 5) {
+        res->byte_tokens_[byte] = id;
+      }
+    } else if ((type == kTokenControl || type == kTokenUserDefined) &&
+               !text.empty()) {
+      res->specials_[static_cast<unsigned char>(text[0])].push_back(id);
+    } else if (type == kTokenUnknown && res->unk_id_ < 0) {
+      res->unk_id_ = id;
+    }
+  }
+  for (auto& specials : res->specials_) {
+    std::sort(specials.begin(), specials.end(),
+              [&res](int32_t a, int32_t b) {
+                return res->TokenText(a).size() > res->TokenText(b).size();
+              });
+  }
+
+  for (size_t rank = 0; rank < vocab.merges.size(); rank++) {
+    const auto& merge = vocab.merges[rank];
+    auto pos = merge.find(' ', 1);
+    if (pos == std::string::npos) {
+      continue;
+    }
+    auto left = res->FindToken(std::string_view(merge).substr(0, pos));
+    auto right = res->FindToken(std::string_view(merge).substr(pos + 1));
+    if (left >= 0 && right >= 0) {
+      res->merge_ranks_.emplace(
+          (static_cast<uint64_t>(left) << 32) | static_cast<uint32_t>(right),
+          static_cast<int32_t>(rank));
+    }
+  }
+
+  if (res->type_ == Type::BPE) {
+    res->llama3_pre_ = !vocab.pre.empty() && vocab.pre != "default" &&
+                       vocab.pre != "gpt-2" && vocab.pre != "gpt2";
+    res->max_digits_ = vocab.pre == "qwen2" ? 1 : res->llama3_pre_ ? 3 : 0;
+  }
+
+  auto valid_id = [n](int64_t id) {
+    return id >= 0 && static_cast<size_t>(id) < n ? static_cast<int32_t>(id)
+                                                  : -1;
+  };
+  res->bos_id_ = valid_id(vocab.bos_id);
+  res->eos_id_ = valid_id(vocab.eos_id);
+  if (auto unk = valid_id(vocab.unk_id); unk >= 0) {
+    res->unk_id_ = unk;
+  }
+  res->add_bos_ = vocab.add_bos.value_or(res->type_ == Type::SPM);
+  res->add_eos_ = vocab.add_eos.value_or(false);
+  res->add_space_prefix_ =
+      vocab.add_space_prefix.value_or(res->type_ == Type::SPM);
+  return res;
+}
+
+std::vector<int32_t> GGUFTokenizer::Encode(std::string_view text,
+                                           bool add_special) const {
+  std::vector<int32_t> out;
+  EncodeInto(text, add_special, out);
+  return out;
+}
+
+size_t GGUFTokenizer::CountTokens(std::string_view text,
+                                  bool add_special) const {
+  thread_local std::vector<int32_t> buffer;
+  buffer.clear();
+  EncodeInto(text, add_special, buffer);
+  return buffer.size();
+}
+
+void GGUFTokenizer::EncodeInto(std::string_view text, bool add_special,
+                               std::vector<int32_t>& out) const {
+  if (add_special && add_bos_ && bos_id_ >= 0) {
+    out.push_back(bos_id_);
+  }
+
+  // SentencePiece prefixes a space at the start and after special tokens
+  bool prev_special = true;
+  size_t raw_start = 0;
+  auto encode_raw = [&](size_t end) {
+    if (end <= raw_start) {
+      return;
+    }
+    auto raw = text.substr(raw_start, end - raw_start);
+    if (type_ == Type::SPM) {
+      std::string prefixed;
+      if (add_space_prefix_ && prev_special) {
+        prefixed.push_back(' ');
+      }
+      prefixed += raw;
+      EncodeSPM(prefixed, out);
+    } else {
+      EncodeBPE(raw, out);
+    }
+    prev_special = false;
+  };
+
+  size_t pos = 0;
+  while (pos < text.size()) {
+    int32_t match = -1;
+    for (auto id : specials_[static_cast<unsigned char>(text[pos])]) {
+      auto special = TokenText(id);
+      if (text.substr(pos, special.size()) == special) {
+        match = id;
+        break;
+      }
+    }
+    if (match < 0) {
+      pos++;
+      continue;
+    }
+    encode_raw(pos);
+    out.push_back(match);
+    prev_special = true;
+    pos += TokenText(match).size();
+    raw_start = pos;
+  }
+  encode_raw(text.size());
+
+  if (add_special && add_eos_ && eos_id_ >= 0) {
+    out.push_back(eos_id_);
+  }
+}
+
+void GGUFTokenizer::EncodeSPM(std::string_view text,
+                              std::vector<int32_t>& out) const {
+  std::string escaped;
+  escaped.reserve(text.size() * 2);
+  for (char c : text) {
+    if (c == ' ') {
+      escaped += kSpmSpace;
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  if (escaped.empty()) {
+    return;
+  }
+  std::string_view view(escaped);
+
+  struct Symbol {
+    int prev;
+    int next;
+    size_t start;
+    size_t len;
+  };
+  std::vector<Symbol> symbols;
+  for (size_t pos = 0; pos < view.size();) {
+    auto len = std::min(Utf8Length(view[pos]), view.size() - pos);
+    int index = static_cast<int>(symbols.size());
+    symbols.push_back({index - 1, index + 1, pos, len});
+    pos += len;
+  }
+  symbols.back().next = -1;
+
+  // Highest score first, leftmost first on ties
+  struct Bigram {
+    int left;
+    int right;
+    float score;
+    size_t len;
+  };
+  auto cmp = [](const Bigram& a, const Bigram& b) {
+    return a.score < b.score || (a.score == b.score && a.left > b.left);
+  };
+  std::priority_queue<Bigram, std::vector<Bigram>, decltype(cmp)> queue(cmp);
+  auto try_add = [&](int left, int right) {
+    if (left < 0 || right < 0) {
+      return;
+    }
+    auto merged = view.substr(symbols[left].start,
+                              symbols[left].len + symbols[right].len);
+    auto id = FindToken(merged);
+    if (id >= 0) {
+      queue.push({left, right, scores_[id], merged.size()});
+    }
+  };
+  for (size_t i = 1; i < symbols.size(); i++) {
+    try_add(static_cast<int>(i) - 1, static_cast<int>(i));
+  }
+
+  while (!queue.empty()) {
+    auto bigram = queue.top();
+    queue.pop();
+    auto& left = symbols[bigram.left];
+    auto& right = symbols[bigram.right];
+    // Skip bigrams whose symbols were merged since they were queued
+    if (left.len == 0 || right.len == 0 ||
+        left.len + right.len != bigram.len) {
+      continue;
+    }
+    left.len += right.len;
+    right.len = 0;
+    left.next = right.next;
+    if (right.next >= 0) {
+      symbols[right.next].prev = bigram.left;
+    }
+    try_add(left.prev, bigram.left);
+    try_add(bigram.left, left.next);
+  }
+
+  for (int i = 0; i >= 0; i = symbols[i].next) {
+    auto piece = view.substr(symbols[i].start, symbols[i].len);
+    if (auto id = FindToken(piece); id >= 0) {
+      out.push_back(id);
+      continue;
+    }
+    // Byte fallback
+    for (char c : piece) {
+      auto id = byte_tokens_[static_cast<unsigned char>(c)];
+      if (id >= 0) {
+        out.push_back(id);
+      } else if (unk_id_ >= 0) {
+        out.push_back(unk_id_);
+      }
+    }
+  }
+}
+
+void GGUFTokenizer::EncodeBPE(std::string_view text,
+                              std::vector<int32_t>& out) const {
+  PreTokenize(text, llama3_pre_, max_digits_, [&](size_t start, size_t end) {
+    EncodeBPEWord(text.substr(start, end - start), out);
+  });
+}
+
+void GGUFTokenizer::EncodeBPEWord(std::string_view word,
+                                  std::vector<int32_t>& out) const {
+  const auto& encoder = GetByteEncoder();
+  std::string mapped;
+  mapped.reserve(word.size() * 2);
+  for (char c : word) {
+    mapped += encoder.encode[static_cast<unsigned char>(c)];
+  }
+  std::string_view view(mapped);
+  if (auto id = FindToken(view); id >= 0) {
+    out.push_back(id);
+    return;
+  }
+
+  struct Symbol {
+    int prev;
+    int next;
+    size_t start;
+    size_t len;
+    int32_t id;
+  };
+  std::vector<Symbol> symbols;
+  for (size_t pos = 0; pos < view.size();) {
+    auto len = std::min(Utf8Length(view[pos]), view.size() - pos);
+    int index = static_cast<int>(symbols.size());
+    symbols.push_back(
+        {index - 1, index + 1, pos, len, FindToken(view.substr(pos, len))});
+    pos += len;
+  }
+  symbols.back().next = -1;
+
+  // Lowest rank first, leftmost first on ties
+  struct Bigram {
+    int left;
+    int right;
+    int32_t rank;
+    size_t len;
+  };
+  auto cmp = [](const Bigram& a, const Bigram& b) {
+    return a.rank > b.rank || (a.rank == b.rank && a.left > b.left);
+  };
+  std::priority_queue<Bigram, std::vector<Bigram>, decltype(cmp)> queue(cmp);
+  auto try_add = [&](int left, int right) {
+    if (left < 0 || right < 0 || symbols[left].id < 0 ||
+        symbols[right].id < 0) {
+      return;
+    }
+    auto key = (static_cast<uint64_t>(symbols[left].id) << 32) |
+               static_cast<uint32_t>(symbols[right].id);
+    if (auto it = merge_ranks_.find(key); it != merge_ranks_.end()) {
+      queue.push(
+          {left, right, it->second, symbols[left].len + symbols[right].len});
+    }
+  };
+  for (size_t i = 1; i < symbols.size(); i++) {
+    try_add(static_cast<int>(i) - 1, static_cast<int>(i));
+  }
+
+  while (!queue.empty()) {
+    auto bigram = queue.top();
+    queue.pop();
+    auto& left = symbols[bigram.left];
+    auto& right = symbols[bigram.right];
+    if (left.len == 0 || right.len == 0 ||
+        left.len + right.len != bigram.len) {
+      continue;
+    }
+    auto merged = FindToken(view.substr(left.start, bigram.len));
+    if (merged < 0) {
+      continue;
+    }
+    left.len += right.len;
+    left.id = merged;
+    right.len = 0;
+    left.next = right.next;
+    if (right.next >= 0) {
+      symbols[right.next].prev = bigram.left;
+    }
+    try_add(left.prev, bigram.left);
+    try_add(bigram.left, left.next);
+  }
+
+  for (int i = 0; i >= 0; i = symbols[i].next) {
+    if (symbols[i].id >= 0) {
+      out.push_back(symbols[i].id);
+      continue;
+    }
+    auto piece = view.substr(symbols[i].start, symbols[i].len);
+    for (size_t pos = 0; pos < piece.size();) {
+      auto len = std::min(Utf8Length(piece[pos]), piece.size() - pos);
+      auto id = FindToken(piece.substr(pos, len));
+      if (id >= 0 || unk_id_ >= 0) {
+        out.push_back(id >= 0 ? id : unk_id_);
+      }
+      pos += len;
+    }
+  }
+}
+
+std::string GGUFTokenizer::Decode(const std::vector<int32_t>& ids,
+                                  bool skip_special) const {
+  const auto& encoder = GetByteEncoder();
+  std::string out;
+  bool at_start = true;
+  for (auto id : ids) {
+    if (id < 0 || static_cast<size_t>(id) >= VocabSize()) {
+      continue;
+    }
+    auto type = types_[id];
+    auto text = TokenText(id);
+    if (type == kTokenControl) {
+      if (!skip_special) {
+        out += text;
+      }
+      continue;
+    }
+    if (type == kTokenUserDefined) {
+      out += text;
+      at_start = false;
+      continue;
+    }
+
+    if (type_ == Type::SPM) {
+      if (type == kTokenByte) {
+        unsigned int byte = 0;
+        std::from_chars(text.data() + 3, text.data() + text.size() - 1, byte,
+                        16);
+        out.push_back(static_cast<char>(byte));
+      } else {
+        std::string piece;
+        for (size_t pos = 0; pos < text.size();) {
+          if (text.substr(pos, kSpmSpace.size()) == kSpmSpace) {
+            piece.push_back(' ');
+            pos += kSpmSpace.size();
+          } else {
+            piece.push_back(text[pos++]);
+          }
+        }
+        // Drop the space the encoder put in front of the text
+        if (at_start && add_space_prefix_ && !piece.empty() &&
+            piece[0] == ' ') {
+          piece.erase(0, 1);
+        }
+        out += piece;
+      }
+    } else {
+      for (size_t pos = 0; pos < text.size();) {
+        auto start = pos;
+        auto cp = NextCodePoint(text, pos);
+        if (auto it = encoder.decode.find(cp); it != encoder.decode.end()) {
+          out.push_back(static_cast<char>(it->second));
+        } else {
+          out += text.substr(start, pos - start);
+        }
+      }
+    }
+    at_start = false;
+  }
+  return out;
+}
+
+std::string_view GGUFTokenizer::TokenText(int32_t id) const {
+  if (id < 0 || static_cast<size_t>(id) + 1 >= offsets_.size()) {
+    return {};
+  }
+  return std::string_view(texts_).substr(offsets_[id],
+                                         offsets_[id + 1] - offsets_[id]);
+}
+
+int32_t GGUFTokenizer::FindToken(std::string_view text) const {
+  auto it = ids_.find(text);
+  return it == ids_.end() ? -1 : it->second;
+}
+}  // namespace config
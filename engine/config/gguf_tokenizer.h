@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "config/gguf_parser.h"
+#include "utils/result.hpp"
+
+namespace config {
+
+/**
+ * Tokenizer built from the vocabulary of a GGUF file, following what
+ * llama.cpp does for SentencePiece ("llama") and byte level BPE ("gpt2")
+ * vocabularies. Control and user defined tokens in the input are always
+ * matched as a whole, like the server's tokenize endpoint does.
+ *
+ * The BPE pre-tokenizer works on code points with an ascii class table.
+ * Non ascii code points count as letters, except for unicode white space and
+ * general punctuation, so counts can differ from the reference regex on text
+ * with non-latin digits or symbols.
+ */
+class GGUFTokenizer {
+ public:
+  enum class Type { SPM, BPE };
+
+  GGUFTokenizer(const GGUFTokenizer&) = delete;
+  GGUFTokenizer& operator=(const GGUFTokenizer&) = delete;
+
+  static cpp::result<std::shared_ptr<const GGUFTokenizer>, std::string>
+  Create(const GGUFVocab& vocab);
+
+  // add_special adds the BOS / EOS tokens the vocabulary asks for
+  std::vector<int32_t> Encode(std::string_view text, bool add_special) const;
+
+  // Same as Encode(text, add_special).size(), reuses a per thread buffer
+  size_t CountTokens(std::string_view text, bool add_special) const;
+
+  std::string Decode(const std::vector<int32_t>& ids,
+                     bool skip_special = false) const;
+
+  // Text of a token as stored in the vocabulary, empty if id is out of range
+  std::string_view TokenText(int32_t id) const;
+
+  size_t VocabSize() const { return offsets_.size() - 1; }
+
+  Type GetType() const { return type_; }
+
+ private:
+  GGUFTokenizer() = default;
+
+  void EncodeInto(std::string_view text, bool add_special,
+                  std::vector<int32_t>& out) const;
+  void EncodeSPM(std::string_view text, std::vector<int32_t>& out) const;
+  void EncodeBPE(std::string_view text, std::vector<int32_t>& out) const;
+  void EncodeBPEWord(std::string_view word, std::vector<int32_t>& out) const;
+  int32_t FindToken(std::string_view text) const;
+
+  Type type_ = Type::SPM;
+  // Token texts back to back, token i is [offsets_[i], offsets_[i + 1])
+  std::string texts_;
+  std::vector<uint32_t> offsets_;
+  std::vector<float> scores_;
+  std::vector<uint8_t> types_;
+  // Keys point into texts_
+  std::unordered_map<std::string_view, int32_t> ids_;
+  // (left id << 32 | right id) to merge rank
+  std::unordered_map<uint64_t, int32_t> merge_ranks_;
+  // Special tokens by their first byte, longest first
+  std::array<std::vector<int32_t>, 256> specials_;
+  // SentencePiece <0xXX> tokens
+  std::array<int32_t, 256> byte_tokens_;
+  // Digits kept together by the BPE pre-tokenizer, 0 for no limit
+  int max_digits_ = 0;
+  // Pre-tokenize like the llama 3 regex instead of the GPT-2 one
+  bool llama3_pre_ = false;
+  int32_t bos_id_ = -1;
+  int32_t eos_id_ = -1;
+  int32_t unk_id_ = -1;
+  bool add_bos_ = false;
+  bool add_eos_ = false;
+  bool add_space_prefix_ = false;
+};
+}  // namespace config
@@ -0,0 +1,2060 @@
+#include "config/jinja_template.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <ctime>
+#include <initializer_list>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace config {
+namespace jinja {
+
+class TemplateError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// A template value. Values read from the context or from loop variables
+// borrow the underlying json instead of copying it, so walking a long
+// conversation does not copy the messages.
+class Value {
+ public:
+  Value() : defined_(false) {}
+
+  explicit Value(Json::Value v) : owned_(std::move(v)) {}
+
+  static Value Ref(const Json::Value& v) {
+    Value res{Json::Value{}};
+    res.ref_ = &v;
+    return res;
+  }
+
+  const Json::Value& get() const { return ref_ != nullptr ? *ref_ : owned_; }
+
+  bool defined() const { return defined_; }
+
+  // Member of this value, borrowed if this value is borrowed
+  Value Child(const Json::Value& child) const {
+    return ref_ != nullptr ? Ref(child) : Value(child);
+  }
+
+ private:
+  Json::Value owned_;
+  const Json::Value* ref_ = nullptr;
+  bool defined_ = true;
+};
+
+struct Expr;
+using ExprPtr = std::unique_ptr<Expr>;
+
+struct Expr {
+  enum class Kind {
+    Literal,
+    Name,
+    Attr,
+    Index,
+    Slice,
+    Call,
+    Method,
+    Filter,
+    Test,
+    Negate,
+    Binary,
+    And,
+    Or,
+    Not,
+    Cond,
+    List,
+    Dict,
+  };
+
+  Kind kind;
+  // Variable, attribute, function, method, filter or test name, or operator
+  std::string name;
+  Json::Value literal;
+  // Operands. For Slice the missing bounds are nullptr
+  std::vector<ExprPtr> args;
+  std::vector<std::pair<std::string, ExprPtr>> kwargs;
+  // "is not" tests
+  bool negated = false;
+};
+
+struct Node;
+using NodeList = std::vector<std::unique_ptr<Node>>;
+
+struct Node {
+  enum class Kind { Text, Output, If, For, Set };
+
+  Kind kind;
+  std::string text;
+  // Output value, For iterable, Set value (nullptr for block sets)
+  ExprPtr expr;
+  // If branches in order, the else branch has no condition
+  std::vector<std::pair<ExprPtr, NodeList>> branches;
+  // For
+  std::vector<std::string> targets;
+  ExprPtr filter;
+  NodeList body;
+  NodeList else_body;
+  // Set
+  std::string target;
+  std::string attr;
+};
+
+namespace {
+// Tokenizer ---------------------------------------------------------------
+
+struct Token {
+  enum class Type { Name, String, Number, Op, End };
+  Type type;
+  std::string text;
+  Json::Value number;
+};
+
+std::vector<Token> Tokenize(const std::string& src) {
+  std::vector<Token> tokens;
+  size_t i = 0;
+  while (i < src.size()) {
+    char c = src[i];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      i++;
+    } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+      size_t start = i;
+      while (i < src.size() &&
+             (std::isalnum(static_cast<unsigned char>(src[i])) ||
+              src[i] == '_')) {
+        i++;
+      }
+      tokens.push_back({Token::Type::Name, src.substr(start, i - start), {}});
+    } else if (std::isdigit(static_cast<unsigned char>(c))) {
+      size_t start = i;
+      bool is_float = false;
+      while (i < src.size() &&
+             std::isdigit(static_cast<unsigned char>(src[i]))) {
+        i++;
+      }
+      if (i + 1 < src.size() && src[i] == '.' &&
+          std::isdigit(static_cast<unsigned char>(src[i + 1]))) {
+        is_float = true;
+        i++;
+        while (i < src.size() &&
+               std::isdigit(static_cast<unsigned char>(src[i]))) {
+          i++;
+        }
+      }
+      auto text = src.substr(start, i - start);
+      Json::Value number = is_float
+                               ? Json::Value(std::stod(text))
+                               : Json::Value(Json::Int64(std::stoll(text)));
+      tokens.push_back({Token::Type::Number, text, number});
+    } else if (c == '\'' || c == '"') {
+      std::string value;
+      i++;
+      while (i < src.size() && src[i] != c) {
+        if (src[i] == '\\' && i + 1 < src.size()) {
+          i++;
+          switch (src[i]) {
+            case 'n':
+              value.push_back('\n');
+              break;
+            case 't':
+              value.push_back('\t');
+              break;
+            case 'r':
+              value.push_back('\r');
+              break;
+            default:
+              value.push_back(src[i]);
+          }
+        } else {
+          value.push_back(src[i]);
+        }
+        i++;
+      }
+      if (i >= src.size()) {
+        throw TemplateError("Unterminated string literal");
+      }
+      i++;
+      tokens.push_back({Token::Type::String, value, {}});
+    } else {
+      static const char* kTwoCharOps[] = {"==", "!=", "<=", ">=", "//", "**"};
+      std::string op(1, c);
+      for (auto two : kTwoCharOps) {
+        if (src.compare(i, 2, two) == 0) {
+          op = two;
+          break;
+        }
+      }
+      if (op.size() == 1 &&
+          std::string_view("<>+-*/%~|.,:()[]{}=").find(c) ==
+              std::string_view::npos) {
+        throw TemplateError(std::string("Unexpected character '") + c + "'");
+      }
+      i += op.size();
+      tokens.push_back({Token::Type::Op, op, {}});
+    }
+  }
+  tokens.push_back({Token::Type::End, "", {}});
+  return tokens;
+}
+
+bool IsKeyword(const std::string& name) {
+  return name == "and" || name == "or" || name == "not" || name == "if" ||
+         name == "else" || name == "in" || name == "is";
+}
+
+ExprPtr MakeExpr(Expr::Kind kind, std::string name = "") {
+  auto e = std::make_unique<Expr>();
+  e->kind = kind;
+  e->name = std::move(name);
+  return e;
+}
+
+ExprPtr MakeBinary(Expr::Kind kind, std::string op, ExprPtr lhs, ExprPtr rhs) {
+  auto e = MakeExpr(kind, std::move(op));
+  e->args.push_back(std::move(lhs));
+  e->args.push_back(std::move(rhs));
+  return e;
+}
+
+// Expression parser -------------------------------------------------------
+
+class ExprParser {
+ public:
+  explicit ExprParser(std::vector<Token> tokens) : tokens_(std::move(tokens)) {}
+
+  bool AtEnd() const { return Peek().type == Token::Type::End; }
+
+  void ExpectEnd() const {
+    if (!AtEnd()) {
+      throw TemplateError("Unexpected token '" + Peek().text + "'");
+    }
+  }
+
+  bool AcceptName(const char* name) {
+    if (Peek().type == Token::Type::Name && Peek().text == name) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+
+  bool AcceptOp(const char* op) {
+    if (Peek().type == Token::Type::Op && Peek().text == op) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+
+  void ExpectOp(const char* op) {
+    if (!AcceptOp(op)) {
+      throw TemplateError(std::string("Expected '") + op + "'");
+    }
+  }
+
+  std::string ExpectName() {
+    if (Peek().type != Token::Type::Name) {
+      throw TemplateError("Expected a name, got '" + Peek().text + "'");
+    }
+    return tokens_[pos_++].text;
+  }
+
+  ExprPtr ParseExpression() {
+    auto e = ParseOr();
+    if (AcceptName("if")) {
+      auto cond = MakeExpr(Expr::Kind::Cond);
+      cond->args.push_back(ParseOr());
+      cond->args.push_back(std::move(e));
+      cond->args.push_back(AcceptName("else") ? ParseExpression() : nullptr);
+      return cond;
+    }
+    return e;
+  }
+
+  ExprPtr ParseOr() {
+    auto e = ParseAnd();
+    while (AcceptName("or")) {
+      e = MakeBinary(Expr::Kind::Or, "or", std::move(e), ParseAnd());
+    }
+    return e;
+  }
+
+ private:
+  const Token& Peek(size_t ahead = 0) const {
+    return tokens_[std::min(pos_ + ahead, tokens_.size() - 1)];
+  }
+
+  ExprPtr ParseAnd() {
+    auto e = ParseNot();
+    while (AcceptName("and")) {
+      e = MakeBinary(Expr::Kind::And, "and", std::move(e), ParseNot());
+    }
+    return e;
+  }
+
+  ExprPtr ParseNot() {
+    if (AcceptName("not")) {
+      auto e = MakeExpr(Expr::Kind::Not);
+      e->args.push_back(ParseNot());
+      return e;
+    }
+    return ParseCompare();
+  }
+
+  ExprPtr ParseCompare() {
+    auto e = ParseMath1();
+    while (true) {
+      std::string op;
+      if (Peek().type == Token::Type::Op &&
+          (Peek().text == "==" || Peek().text == "!=" || Peek().text == "<" ||
+           Peek().text == ">" || Peek().text == "<=" || Peek().text == ">=")) {
+        op = tokens_[pos_++].text;
+      } else if (AcceptName("in")) {
+        op = "in";
+      } else if (Peek().type == Token::Type::Name && Peek().text == "not" &&
+                 Peek(1).type == Token::Type::Name && Peek(1).text == "in") {
+        pos_ += 2;
+        op = "not in";
+      } else {
+        return e;
+      }
+      e = MakeBinary(Expr::Kind::Binary, op, std::move(e), ParseMath1());
+    }
+  }
+
+  ExprPtr ParseMath1() {
+    auto e = ParseConcat();
+    while (Peek().type == Token::Type::Op &&
+           (Peek().text == "+" || Peek().text == "-")) {
+      auto op = tokens_[pos_++].text;
+      e = MakeBinary(Expr::Kind::Binary, op, std::move(e), ParseConcat());
+    }
+    return e;
+  }
+
+  ExprPtr ParseConcat() {
+    auto e = ParseMath2();
+    while (AcceptOp("~")) {
+      e = MakeBinary(Expr::Kind::Binary, "~", std::move(e), ParseMath2());
+    }
+    return e;
+  }
+
+  ExprPtr ParseMath2() {
+    auto e = ParseUnary();
+    while (Peek().type == Token::Type::Op &&
+           (Peek().text == "*" || Peek().text == "/" || Peek().text == "//" ||
+            Peek().text == "%")) {
+      auto op = tokens_[pos_++].text;
+      e = MakeBinary(Expr::Kind::Binary, op, std::move(e), ParseUnary());
+    }
+    return e;
+  }
+
+  ExprPtr ParseUnary() {
+    if (AcceptOp("-")) {
+      auto e = MakeExpr(Expr::Kind::Negate);
+      e->args.push_back(ParseUnary());
+      return e;
+    }
+    AcceptOp("+");
+    return ParseFilters(ParsePostfix(ParsePrimary()));
+  }
+
+  ExprPtr ParseFilters(ExprPtr e) {
+    while (true) {
+      if (AcceptOp("|")) {
+        auto f = MakeExpr(Expr::Kind::Filter, ExpectName());
+        f->args.push_back(std::move(e));
+        if (AcceptOp("(")) {
+          ParseArgs(*f);
+        }
+        e = ParsePostfix(std::move(f));
+      } else if (AcceptName("is")) {
+        auto negated = AcceptName("not");
+        auto t = MakeExpr(Expr::Kind::Test, ExpectName());
+        t->negated = negated;
+        t->args.push_back(std::move(e));
+        if (AcceptOp("(")) {
+          ParseArgs(*t);
+        } else if (Peek().type == Token::Type::String ||
+                   Peek().type == Token::Type::Number ||
+                   (Peek().type == Token::Type::Name &&
+                    !IsKeyword(Peek().text))) {
+          // Single argument without parentheses: "is divisibleby 3"
+          t->args.push_back(ParsePostfix(ParsePrimary()));
+        }
+        e = std::move(t);
+      } else {
+        return e;
+      }
+    }
+  }
+
+  // Parses "a, b, key=c)" after the opening parenthesis
+  void ParseArgs(Expr& e) {
+    if (AcceptOp(")")) {
+      return;
+    }
+    do {
+      if (Peek().type == Token::Type::Name && Peek(1).type == Token::Type::Op &&
+          Peek(1).text == "=") {
+        auto key = ExpectName();
+        pos_++;
+        e.kwargs.emplace_back(key, ParseExpression());
+      } else {
+        e.args.push_back(ParseExpression());
+      }
+    } while (AcceptOp(","));
+    ExpectOp(")");
+  }
+
+  ExprPtr ParsePostfix(ExprPtr e) {
+    while (true) {
+      if (AcceptOp(".")) {
+        auto name = ExpectName();
+        if (AcceptOp("(")) {
+          auto m = MakeExpr(Expr::Kind::Method, name);
+          m->args.push_back(std::move(e));
+          ParseArgs(*m);
+          e = std::move(m);
+        } else {
+          auto a = MakeExpr(Expr::Kind::Attr, name);
+          a->args.push_back(std::move(e));
+          e = std::move(a);
+        }
+      } else if (AcceptOp("[")) {
+        ExprPtr start = nullptr;
+        if (Peek().type != Token::Type::Op || Peek().text != ":") {
+          start = ParseExpression();
+        }
+        if (AcceptOp(":")) {
+          auto s = MakeExpr(Expr::Kind::Slice);
+          s->args.push_back(std::move(e));
+          s->args.push_back(std::move(start));
+          ExprPtr stop = nullptr;
+          ExprPtr step = nullptr;
+          if (Peek().text != "]" && Peek().text != ":") {
+            stop = ParseExpression();
+          }
+          if (AcceptOp(":") && Peek().text != "]") {
+            step = ParseExpression();
+          }
+          s->args.push_back(std::move(stop));
+          s->args.push_back(std::move(step));
+          e = std::move(s);
+        } else {
+          auto i = MakeExpr(Expr::Kind::Index);
+          i->args.push_back(std::move(e));
+          i->args.push_back(std::move(start));
+          e = std::move(i);
+        }
+        ExpectOp("]");
+      } else if (e->kind == Expr::Kind::Name && AcceptOp("(")) {
+        auto c = MakeExpr(Expr::Kind::Call, e->name);
+        ParseArgs(*c);
+        e = std::move(c);
+      } else {
+        return e;
+      }
+    }
+  }
+
+  ExprPtr ParsePrimary() {
+    const auto& tok = Peek();
+    if (tok.type == Token::Type::String) {
+      auto e = MakeExpr(Expr::Kind::Literal);
+      std::string value;
+      while (Peek().type == Token::Type::String) {
+        value += tokens_[pos_++].text;
+      }
+      e->literal = value;
+      return e;
+    }
+    if (tok.type == Token::Type::Number) {
+      auto e = MakeExpr(Expr::Kind::Literal);
+      e->literal = tok.number;
+      pos_++;
+      return e;
+    }
+    if (tok.type == Token::Type::Name) {
+      auto name = tokens_[pos_++].text;
+      auto e = MakeExpr(Expr::Kind::Literal);
+      if (name == "true" || name == "True") {
+        e->literal = true;
+      } else if (name == "false" || name == "False") {
+        e->literal = false;
+      } else if (name == "none" || name == "None") {
+        e->literal = Json::Value::null;
+      } else {
+        return MakeExpr(Expr::Kind::Name, name);
+      }
+      return e;
+    }
+    if (AcceptOp("(")) {
+      auto e = ParseExpression();
+      if (AcceptOp(",")) {
+        // Tuples behave like lists
+        auto list = MakeExpr(Expr::Kind::List);
+        list->args.push_back(std::move(e));
+        if (!AcceptOp(")")) {
+          do {
+            list->args.push_back(ParseExpression());
+          } while (AcceptOp(",") && Peek().text != ")");
+          ExpectOp(")");
+        }
+        return list;
+      }
+      ExpectOp(")");
+      return e;
+    }
+    if (AcceptOp("[")) {
+      auto list = MakeExpr(Expr::Kind::List);
+      if (!AcceptOp("]")) {
+        do {
+          if (Peek().text == "]") {
+            break;
+          }
+          list->args.push_back(ParseExpression());
+        } while (AcceptOp(","));
+        ExpectOp("]");
+      }
+      return list;
+    }
+    if (AcceptOp("{")) {
+      auto dict = MakeExpr(Expr::Kind::Dict);
+      if (!AcceptOp("}")) {
+        do {
+          if (Peek().text == "}") {
+            break;
+          }
+          dict->args.push_back(ParseExpression());
+          ExpectOp(":");
+          dict->args.push_back(ParseExpression());
+        } while (AcceptOp(","));
+        ExpectOp("}");
+      }
+      return dict;
+    }
+    throw TemplateError("Unexpected token '" + tok.text + "'");
+  }
+
+  std::vector<Token> tokens_;
+  size_t pos_ = 0;
+};
+
+// Template structure ------------------------------------------------------
+
+struct Segment {
+  enum class Kind { Text, Output, Statement };
+  Kind kind;
+  std::string text;
+};
+
+bool IsBlank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+void RightTrim(std::string& s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.pop_back();
+  }
+}
+
+// Finds the closing delimiter of a tag, skipping over string literals
+size_t FindTagEnd(const std::string& src, size_t pos, const char* close) {
+  char quote = 0;
+  for (size_t i = pos; i + 1 < src.size(); i++) {
+    if (quote != 0) {
+      if (src[i] == '\\') {
+        i++;
+      } else if (src[i] == quote) {
+        quote = 0;
+      }
+    } else if (src[i] == '\'' || src[i] == '"') {
+      quote = src[i];
+    } else if (src[i] == close[0] && src[i + 1] == close[1]) {
+      return i;
+    }
+  }
+  return std::string::npos;
+}
+
+std::vector<Segment> SplitSegments(std::string src) {
+  // keep_trailing_newline is off by default
+  if (!src.empty() && src.back() == '\n') {
+    src.pop_back();
+  }
+
+  std::vector<Segment> segments;
+  size_t pos = 0;
+  bool trim_next = false;
+  bool strip_newline = false;
+  while (pos < src.size()) {
+    size_t open = src.find('{', pos);
+    while (open != std::string::npos &&
+           (open + 1 >= src.size() ||
+            std::string_view("{%#").find(src[open + 1]) ==
+                std::string_view::npos)) {
+      open = src.find('{', open + 1);
+    }
+
+    std::string text = src.substr(
+        pos, (open == std::string::npos ? src.size() : open) - pos);
+    if (trim_next) {
+      auto first = text.find_first_not_of(" \t\r\n");
+      text.erase(0, first == std::string::npos ? text.size() : first);
+    } else if (strip_newline) {
+      // trim_blocks
+      if (text.rfind("\n", 0) == 0) {
+        text.erase(0, 1);
+      } else if (text.rfind("\r\n", 0) == 0) {
+        text.erase(0, 2);
+      }
+    }
+    if (open == std::string::npos) {
+      if (!text.empty()) {
+        segments.push_back({Segment::Kind::Text, std::move(text)});
+      }
+      break;
+    }
+
+    char kind = src[open + 1];
+    size_t inner = open + 2;
+    bool left_trim = inner < src.size() && src[inner] == '-';
+    bool left_keep = inner < src.size() && src[inner] == '+';
+    if (left_trim || left_keep) {
+      inner++;
+    }
+    if (left_trim) {
+      RightTrim(text);
+    } else if (kind != '{' && !left_keep) {
+      // lstrip_blocks, only when the tag starts the line
+      size_t ws_start = open;
+      while (ws_start > pos && IsBlank(src[ws_start - 1])) {
+        ws_start--;
+      }
+      if (ws_start == 0 || src[ws_start - 1] == '\n') {
+        text.resize(text.size() - std::min(text.size(), open - ws_start));
+      }
+    }
+    if (!text.empty()) {
+      segments.push_back({Segment::Kind::Text, std::move(text)});
+    }
+
+    const char* close = kind == '{' ? "}}" : kind == '%' ? "%}" : "#}";
+    size_t end = kind == '#' ? src.find(close, inner)
+                             : FindTagEnd(src, inner, close);
+    if (end == std::string::npos) {
+      throw TemplateError("Unclosed tag");
+    }
+    std::string body = src.substr(inner, end - inner);
+    bool right_trim = !body.empty() && body.back() == '-';
+    bool right_keep = !body.empty() && body.back() == '+';
+    if (right_trim || right_keep) {
+      body.pop_back();
+    }
+    pos = end + 2;
+    trim_next = right_trim;
+    strip_newline = !right_trim && !right_keep && kind != '{';
+
+    if (kind == '{') {
+      segments.push_back({Segment::Kind::Output, std::move(body)});
+    } else if (kind == '%') {
+      segments.push_back({Segment::Kind::Statement, std::move(body)});
+    }
+  }
+  return segments;
+}
+
+class TemplateParser {
+ public:
+  explicit TemplateParser(std::vector<Segment> segments)
+      : segments_(std::move(segments)) {}
+
+  NodeList Parse() {
+    auto nodes = ParseBody({}, nullptr);
+    return nodes;
+  }
+
+ private:
+  struct Terminator {
+    std::string keyword;
+    std::unique_ptr<ExprParser> rest;
+  };
+
+  NodeList ParseBody(std::initializer_list<const char*> ends,
+                     Terminator* terminator) {
+    NodeList nodes;
+    while (pos_ < segments_.size()) {
+      auto& segment = segments_[pos_++];
+      if (segment.kind == Segment::Kind::Text) {
+        auto n = std::make_unique<Node>();
+        n->kind = Node::Kind::Text;
+        n->text = std::move(segment.text);
+        nodes.push_back(std::move(n));
+        continue;
+      }
+      auto parser = std::make_unique<ExprParser>(Tokenize(segment.text));
+      if (segment.kind == Segment::Kind::Output) {
+        auto n = std::make_unique<Node>();
+        n->kind = Node::Kind::Output;
+        n->expr = parser->ParseExpression();
+        parser->ExpectEnd();
+        nodes.push_back(std::move(n));
+        continue;
+      }
+
+      auto keyword = parser->ExpectName();
+      for (auto end : ends) {
+        if (keyword == end) {
+          terminator->keyword = keyword;
+          terminator->rest = std::move(parser);
+          return nodes;
+        }
+      }
+      if (keyword == "if") {
+        nodes.push_back(ParseIf(*parser));
+      } else if (keyword == "for") {
+        nodes.push_back(ParseFor(*parser));
+      } else if (keyword == "set") {
+        nodes.push_back(ParseSet(*parser));
+      } else if (keyword == "generation") {
+        // Only marks assistant output for training, render the content
+        parser->ExpectEnd();
+        Terminator t;
+        auto body = ParseBody({"endgeneration"}, &t);
+        t.rest->ExpectEnd();
+        for (auto& n : body) {
+          nodes.push_back(std::move(n));
+        }
+      } else {
+        throw TemplateError("Unsupported tag '" + keyword + "'");
+      }
+    }
+    if (ends.size() > 0) {
+      throw TemplateError("Unexpected end of template, expected '" +
+                          std::string(*ends.begin()) + "'");
+    }
+    return nodes;
+  }
+
+  std::unique_ptr<Node> ParseIf(ExprParser& parser) {
+    auto n = std::make_unique<Node>();
+    n->kind = Node::Kind::If;
+    auto cond = parser.ParseExpression();
+    parser.ExpectEnd();
+    while (true) {
+      Terminator t;
+      auto body = ParseBody({"elif", "else", "endif"}, &t);
+      n->branches.emplace_back(std::move(cond), std::move(body));
+      if (t.keyword == "elif") {
+        cond = t.rest->ParseExpression();
+        t.rest->ExpectEnd();
+      } else if (t.keyword == "else") {
+        t.rest->ExpectEnd();
+        Terminator end;
+        auto else_body = ParseBody({"endif"}, &end);
+        end.rest->ExpectEnd();
+        n->branches.emplace_back(nullptr, std::move(else_body));
+        return n;
+      } else {
+        t.rest->ExpectEnd();
+        return n;
+      }
+    }
+  }
+
+  std::unique_ptr<Node> ParseFor(ExprParser& parser) {
+    auto n = std::make_unique<Node>();
+    n->kind = Node::Kind::For;
+    do {
+      n->targets.push_back(parser.ExpectName());
+    } while (parser.AcceptOp(","));
+    if (!parser.AcceptName("in")) {
+      throw TemplateError("Expected 'in' in for loop");
+    }
+    // No conditional expression here, "if" starts the loop filter
+    n->expr = parser.ParseOr();
+    if (parser.AcceptName("if")) {
+      n->filter = parser.ParseExpression();
+    }
+    parser.AcceptName("recursive");
+    parser.ExpectEnd();
+
+    Terminator t;
+    n->body = ParseBody({"else", "endfor"}, &t);
+    t.rest->ExpectEnd();
+    if (t.keyword == "else") {
+      Terminator end;
+      n->else_body = ParseBody({"endfor"}, &end);
+      end.rest->ExpectEnd();
+    }
+    return n;
+  }
+
+  std::unique_ptr<Node> ParseSet(ExprParser& parser) {
+    auto n = std::make_unique<Node>();
+    n->kind = Node::Kind::Set;
+    n->target = parser.ExpectName();
+    if (parser.AcceptOp(".")) {
+      n->attr = parser.ExpectName();
+    }
+    if (parser.AcceptOp("=")) {
+      n->expr = parser.ParseExpression();
+      parser.ExpectEnd();
+    } else {
+      parser.ExpectEnd();
+      Terminator t;
+      n->body = ParseBody({"endset"}, &t);
+      t.rest->ExpectEnd();
+    }
+    return n;
+  }
+
+  std::vector<Segment> segments_;
+  size_t pos_ = 0;
+};
+
+// Value helpers -----------------------------------------------------------
+
+bool IsInteger(const Json::Value& v) {
+  return v.type() == Json::intValue || v.type() == Json::uintValue;
+}
+
+bool IsNumber(const Json::Value& v) {
+  return IsInteger(v) || v.type() == Json::realValue;
+}
+
+bool Truthy(const Value& v) {
+  if (!v.defined()) {
+    return false;
+  }
+  const auto& j = v.get();
+  switch (j.type()) {
+    case Json::nullValue:
+      return false;
+    case Json::booleanValue:
+      return j.asBool();
+    case Json::intValue:
+      return j.asInt64() != 0;
+    case Json::uintValue:
+      return j.asUInt64() != 0;
+    case Json::realValue:
+      return j.asDouble() != 0.0;
+    case Json::stringValue:
+      return !j.asString().empty();
+    default:
+      return j.size() > 0;
+  }
+}
+
+std::string FormatDouble(double d) {
+  if (std::isnan(d)) {
+    return "nan";
+  }
+  if (std::isinf(d)) {
+    return d > 0 ? "inf" : "-inf";
+  }
+  char buf[64];
+  auto res = std::to_chars(buf, buf + sizeof(buf), d);
+  std::string s(buf, res.ptr);
+  if (s.find_first_of(".e") == std::string::npos) {
+    s += ".0";
+  }
+  return s;
+}
+
+void AppendJsonString(const std::string& s, std::string& out) {
+  out.push_back('"');
+  for (unsigned char c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      case '\b':
+        out += "\\b";
+        break;
+      case '\f':
+        out += "\\f";
+        break;
+      default:
+        if (c < 0x20) {
+          static constexpr char kHex[] = "0123456789abcdef";
+          out += "\\u00";
+          out.push_back(kHex[c >> 4]);
+          out.push_back(kHex[c & 0x0f]);
+        } else {
+          out.push_back(static_cast<char>(c));
+        }
+    }
+  }
+  out.push_back('"');
+}
+
+// Same output as python's json.dumps(v, ensure_ascii=False, indent=indent)
+void AppendJson(const Json::Value& v, std::string& out, int indent,
+                int level) {
+  auto newline = [&](int l) {
+    if (indent > 0) {
+      out.push_back('\n');
+      out.append(static_cast<size_t>(indent * l), ' ');
+    }
+  };
+  switch (v.type()) {
+    case Json::nullValue:
+      out += "null";
+      break;
+    case Json::booleanValue:
+      out += v.asBool() ? "true" : "false";
+      break;
+    case Json::intValue:
+      out += std::to_string(v.asInt64());
+      break;
+    case Json::uintValue:
+      out += std::to_string(v.asUInt64());
+      break;
+    case Json::realValue:
+      out += FormatDouble(v.asDouble());
+      break;
+    case Json::stringValue:
+      AppendJsonString(v.asString(), out);
+      break;
+    case Json::arrayValue: {
+      if (v.empty()) {
+        out += "[]";
+        break;
+      }
+      out.push_back('[');
+      for (Json::ArrayIndex i = 0; i < v.size(); i++) {
+        if (i > 0) {
+          out += indent > 0 ? "," : ", ";
+        }
+        newline(level + 1);
+        AppendJson(v[i], out, indent, level + 1);
+      }
+      newline(level);
+      out.push_back(']');
+      break;
+    }
+    case Json::objectValue: {
+      if (v.empty()) {
+        out += "{}";
+        break;
+      }
+      out.push_back('{');
+      bool first = true;
+      for (auto it = v.begin(); it != v.end(); ++it) {
+        if (!first) {
+          out += indent > 0 ? "," : ", ";
+        }
+        first = false;
+        newline(level + 1);
+        AppendJsonString(it.name(), out);
+        out += ": ";
+        AppendJson(*it, out, indent, level + 1);
+      }
+      newline(level);
+      out.push_back('}');
+      break;
+    }
+  }
+}
+
+// Python's str() of a value
+void AppendString(const Json::Value& v, std::string& out, bool nested) {
+  switch (v.type()) {
+    case Json::nullValue:
+      out += "None";
+      break;
+    case Json::booleanValue:
+      out += v.asBool() ? "True" : "False";
+      break;
+    case Json::stringValue:
+      if (nested) {
+        out.push_back('\'');
+        out += v.asString();
+        out.push_back('\'');
+      } else {
+        out += v.asString();
+      }
+      break;
+    case Json::arrayValue:
+      out.push_back('[');
+      for (Json::ArrayIndex i = 0; i < v.size(); i++) {
+        if (i > 0) {
+          out += ", ";
+        }
+        AppendString(v[i], out, true);
+      }
+      out.push_back(']');
+      break;
+    case Json::objectValue: {
+      out.push_back('{');
+      bool first = true;
+      for (auto it = v.begin(); it != v.end(); ++it) {
+        if (!first) {
+          out += ", ";
+        }
+        first = false;
+        out += "'" + it.name() + "': ";
+        AppendString(*it, out, true);
+      }
+      out.push_back('}');
+      break;
+    }
+    default:
+      AppendJson(v, out, 0, 0);
+  }
+}
+
+void AppendValue(const Value& v, std::string& out) {
+  if (v.defined()) {
+    AppendString(v.get(), out, false);
+  }
+}
+
+std::string ToString(const Value& v) {
+  std::string s;
+  AppendValue(v, s);
+  return s;
+}
+
+bool ValuesEqual(const Value& a, const Value& b) {
+  if (!a.defined() || !b.defined()) {
+    return a.defined() == b.defined();
+  }
+  const auto& x = a.get();
+  const auto& y = b.get();
+  if (IsNumber(x) && IsNumber(y)) {
+    if (IsInteger(x) && IsInteger(y)) {
+      return x.asInt64() == y.asInt64();
+    }
+    return x.asDouble() == y.asDouble();
+  }
+  return x == y;
+}
+
+size_t Utf8Length(const std::string& s) {
+  return std::count_if(s.begin(), s.end(), [](char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+  });
+}
+
+std::string Strip(const std::string& s, const std::string& chars, bool left,
+                  bool right) {
+  size_t start = 0;
+  size_t end = s.size();
+  auto strip = [&chars](char c) {
+    return chars.empty() ? std::isspace(static_cast<unsigned char>(c)) != 0
+                         : chars.find(c) != std::string::npos;
+  };
+  while (left && start < end && strip(s[start])) {
+    start++;
+  }
+  while (right && end > start && strip(s[end - 1])) {
+    end--;
+  }
+  return s.substr(start, end - start);
+}
+
+std::string ReplaceAll(std::string s, const std::string& from,
+                       const std::string& to, int64_t count = -1) {
+  if (from.empty()) {
+    return s;
+  }
+  size_t pos = 0;
+  while (count != 0 && (pos = s.find(from, pos)) != std::string::npos) {
+    s.replace(pos, from.size(), to);
+    pos += to.size();
+    count--;
+  }
+  return s;
+}
+
+std::string Capitalize(const std::string& s) {
+  std::string res = s;
+  std::transform(res.begin(), res.end(), res.begin(), ::tolower);
+  if (!res.empty()) {
+    res[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(res[0])));
+  }
+  return res;
+}
+
+std::string Title(const std::string& s) {
+  std::string res = s;
+  bool word_start = true;
+  for (auto& c : res) {
+    auto uc = static_cast<unsigned char>(c);
+    c = static_cast<char>(word_start ? std::toupper(uc) : std::tolower(uc));
+    word_start = !std::isalnum(uc);
+  }
+  return res;
+}
+
+std::string Upper(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+  return s;
+}
+
+std::string Lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+  return s;
+}
+
+int64_t NormalizeIndex(int64_t index, int64_t size) {
+  return index < 0 ? index + size : index;
+}
+
+// Renderer ----------------------------------------------------------------
+
+class Renderer {
+ public:
+  Renderer(const Json::Value& context, std::string& out) : out_(out) {
+    scopes_.emplace_back();
+    if (context.isObject()) {
+      for (auto it = context.begin(); it != context.end(); ++it) {
+        scopes_.back()[it.name()] = Value::Ref(*it);
+      }
+    }
+  }
+
+  void Render(const NodeList& nodes) {
+    for (const auto& n : nodes) {
+      RenderNode(*n);
+    }
+  }
+
+ private:
+  void RenderNode(const Node& n) {
+    switch (n.kind) {
+      case Node::Kind::Text:
+        out_ += n.text;
+        break;
+      case Node::Kind::Output:
+        AppendValue(Eval(*n.expr), out_);
+        break;
+      case Node::Kind::If:
+        for (const auto& [cond, body] : n.branches) {
+          if (cond == nullptr || Truthy(Eval(*cond))) {
+            Render(body);
+            break;
+          }
+        }
+        break;
+      case Node::Kind::For:
+        RenderFor(n);
+        break;
+      case Node::Kind::Set:
+        RenderSet(n);
+        break;
+    }
+  }
+
+  void RenderFor(const Node& n) {
+    auto iterable = Eval(*n.expr);
+    const auto& seq = iterable.get();
+    // Dicts iterate over their keys and strings over their characters
+    Json::Value converted;
+    const Json::Value* items = &seq;
+    if (seq.isObject()) {
+      converted = Json::Value(Json::arrayValue);
+      for (const auto& key : seq.getMemberNames()) {
+        converted.append(key);
+      }
+      items = &converted;
+    } else if (seq.isString()) {
+      converted = Json::Value(Json::arrayValue);
+      for (char c : seq.asString()) {
+        converted.append(std::string(1, c));
+      }
+      items = &converted;
+    } else if (!seq.isArray()) {
+      if (iterable.defined() && !seq.isNull()) {
+        throw TemplateError("Value is not iterable");
+      }
+      Render(n.else_body);
+      return;
+    }
+
+    scopes_.emplace_back();
+    std::vector<const Json::Value*> selected;
+    selected.reserve(items->size());
+    for (const auto& item : *items) {
+      if (n.filter != nullptr) {
+        BindTargets(n.targets, item);
+        if (!Truthy(Eval(*n.filter))) {
+          continue;
+        }
+      }
+      selected.push_back(&item);
+    }
+
+    if (selected.empty()) {
+      scopes_.pop_back();
+      Render(n.else_body);
+      return;
+    }
+
+    auto length = static_cast<Json::Int64>(selected.size());
+    for (Json::Int64 i = 0; i < length; i++) {
+      BindTargets(n.targets, *selected[i]);
+      Json::Value loop;
+      loop["index0"] = i;
+      loop["index"] = i + 1;
+      loop["revindex0"] = length - i - 1;
+      loop["revindex"] = length - i;
+      loop["first"] = i == 0;
+      loop["last"] = i == length - 1;
+      loop["length"] = length;
+      if (i > 0) {
+        loop["previtem"] = *selected[i - 1];
+      }
+      if (i + 1 < length) {
+        loop["nextitem"] = *selected[i + 1];
+      }
+      scopes_.back()["loop"] = Value(std::move(loop));
+      Render(n.body);
+    }
+    scopes_.pop_back();
+  }
+
+  void BindTargets(const std::vector<std::string>& targets,
+                   const Json::Value& item) {
+    auto& scope = scopes_.back();
+    if (targets.size() == 1) {
+      scope[targets[0]] = Value::Ref(item);
+      return;
+    }
+    if (!item.isArray() || item.size() != targets.size()) {
+      throw TemplateError("Can not unpack loop item");
+    }
+    for (Json::ArrayIndex i = 0; i < targets.size(); i++) {
+      scope[targets[i]] = Value::Ref(item[i]);
+    }
+  }
+
+  void RenderSet(const Node& n) {
+    Json::Value value;
+    if (n.expr != nullptr) {
+      value = Eval(*n.expr).get();
+    } else {
+      std::string captured;
+      std::swap(captured, out_);
+      Render(n.body);
+      std::swap(captured, out_);
+      value = captured;
+    }
+
+    if (n.attr.empty()) {
+      scopes_.back()[n.target] = Value(std::move(value));
+      return;
+    }
+    // Namespace attributes are the only way to carry state out of a loop
+    for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+      if (auto var = it->find(n.target); var != it->end()) {
+        auto ns = var->second.get();
+        if (!ns.isObject()) {
+          throw TemplateError("Can not set attribute of '" + n.target + "'");
+        }
+        ns[n.attr] = std::move(value);
+        var->second = Value(std::move(ns));
+        return;
+      }
+    }
+    throw TemplateError("'" + n.target + "' is undefined");
+  }
+
+  Value Lookup(const std::string& name) const {
+    for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+      if (auto var = it->find(name); var != it->end()) {
+        return Value::Ref(var->second.get());
+      }
+    }
+    return Value();
+  }
+
+  Value Eval(const Expr& e) {
+    switch (e.kind) {
+      case Expr::Kind::Literal:
+        return Value(e.literal);
+      case Expr::Kind::Name:
+        return Lookup(e.name);
+      case Expr::Kind::Attr: {
+        auto obj = Eval(*e.args[0]);
+        const auto& j = obj.get();
+        if (j.isObject()) {
+          if (auto m = j.find(e.name.data(), e.name.data() + e.name.size());
+              m != nullptr) {
+            return obj.Child(*m);
+          }
+        }
+        return Value();
+      }
+      case Expr::Kind::Index:
+        return EvalIndex(Eval(*e.args[0]), Eval(*e.args[1]));
+      case Expr::Kind::Slice:
+        return EvalSlice(e);
+      case Expr::Kind::Call:
+        return EvalCall(e);
+      case Expr::Kind::Method:
+        return EvalMethod(e);
+      case Expr::Kind::Filter: {
+        auto args = EvalArgs(e, 1);
+        return ApplyFilter(e.name, Eval(*e.args[0]), args, e);
+      }
+      case Expr::Kind::Test: {
+        auto args = EvalArgs(e, 1);
+        bool res = ApplyTest(e.name, Eval(*e.args[0]), args);
+        return Value(Json::Value(e.negated ? !res : res));
+      }
+      case Expr::Kind::Negate: {
+        auto v = Eval(*e.args[0]);
+        if (IsInteger(v.get())) {
+          return Value(Json::Value(-v.get().asInt64()));
+        }
+        if (IsNumber(v.get())) {
+          return Value(Json::Value(-v.get().asDouble()));
+        }
+        throw TemplateError("Can not negate a non number");
+      }
+      case Expr::Kind::Binary:
+        return EvalBinary(e.name, Eval(*e.args[0]), Eval(*e.args[1]));
+      case Expr::Kind::And: {
+        auto lhs = Eval(*e.args[0]);
+        return Truthy(lhs) ? Eval(*e.args[1]) : lhs;
+      }
+      case Expr::Kind::Or: {
+        auto lhs = Eval(*e.args[0]);
+        return Truthy(lhs) ? lhs : Eval(*e.args[1]);
+      }
+      case Expr::Kind::Not:
+        return Value(Json::Value(!Truthy(Eval(*e.args[0]))));
+      case Expr::Kind::Cond:
+        if (Truthy(Eval(*e.args[0]))) {
+          return Eval(*e.args[1]);
+        }
+        return e.args[2] != nullptr ? Eval(*e.args[2]) : Value();
+      case Expr::Kind::List: {
+        Json::Value list(Json::arrayValue);
+        for (const auto& a : e.args) {
+          list.append(Eval(*a).get());
+        }
+        return Value(std::move(list));
+      }
+      case Expr::Kind::Dict: {
+        Json::Value dict(Json::objectValue);
+        for (size_t i = 0; i + 1 < e.args.size(); i += 2) {
+          dict[ToString(Eval(*e.args[i]))] = Eval(*e.args[i + 1]).get();
+        }
+        return Value(std::move(dict));
+      }
+    }
+    return Value();
+  }
+
+  std::vector<Value> EvalArgs(const Expr& e, size_t first) {
+    std::vector<Value> args;
+    for (size_t i = first; i < e.args.size(); i++) {
+      args.push_back(Eval(*e.args[i]));
+    }
+    return args;
+  }
+
+  Value Kwarg(const Expr& e, const std::string& name) {
+    for (const auto& [key, value] : e.kwargs) {
+      if (key == name) {
+        return Eval(*value);
+      }
+    }
+    return Value();
+  }
+
+  Value EvalIndex(const Value& obj, const Value& key) {
+    const auto& j = obj.get();
+    const auto& k = key.get();
+    if (j.isArray() && IsInteger(k)) {
+      auto i = NormalizeIndex(k.asInt64(), j.size());
+      if (i >= 0 && i < static_cast<int64_t>(j.size())) {
+        return obj.Child(j[static_cast<Json::ArrayIndex>(i)]);
+      }
+    } else if (j.isObject() && k.isString()) {
+      auto name = k.asString();
+      if (auto m = j.find(name.data(), name.data() + name.size());
+          m != nullptr) {
+        return obj.Child(*m);
+      }
+    } else if (j.isString() && IsInteger(k)) {
+      auto s = j.asString();
+      auto i = NormalizeIndex(k.asInt64(), s.size());
+      if (i >= 0 && i < static_cast<int64_t>(s.size())) {
+        return Value(Json::Value(std::string(1, s[i])));
+      }
+    }
+    return Value();
+  }
+
+  Value EvalSlice(const Expr& e) {
+    auto obj = Eval(*e.args[0]);
+    const auto& j = obj.get();
+    int64_t size = j.isArray()    ? j.size()
+                   : j.isString() ? j.asString().size()
+                                  : -1;
+    if (size < 0) {
+      throw TemplateError("Value can not be sliced");
+    }
+    auto bound = [this, &e](size_t i) -> std::optional<int64_t> {
+      if (e.args[i] == nullptr) {
+        return std::nullopt;
+      }
+      auto v = Eval(*e.args[i]);
+      if (!IsInteger(v.get())) {
+        return std::nullopt;
+      }
+      return v.get().asInt64();
+    };
+    int64_t step = bound(3).value_or(1);
+    if (step == 0) {
+      throw TemplateError("Slice step can not be zero");
+    }
+    auto clamp = [size, step](std::optional<int64_t> v, int64_t def) {
+      if (!v) {
+        return def;
+      }
+      auto i = NormalizeIndex(*v, size);
+      return step > 0 ? std::clamp<int64_t>(i, 0, size)
+                      : std::clamp<int64_t>(i, -1, size - 1);
+    };
+    int64_t start = clamp(bound(1), step > 0 ? 0 : size - 1);
+    int64_t stop = clamp(bound(2), step > 0 ? size : -1);
+
+    if (j.isString()) {
+      auto s = j.asString();
+      std::string res;
+      for (auto i = start; step > 0 ? i < stop : i > stop; i += step) {
+        res.push_back(s[i]);
+      }
+      return Value(Json::Value(res));
+    }
+    Json::Value res(Json::arrayValue);
+    for (auto i = start; step > 0 ? i < stop : i > stop; i += step) {
+      res.append(j[static_cast<Json::ArrayIndex>(i)]);
+    }
+    return Value(std::move(res));
+  }
+
+  Value EvalCall(const Expr& e) {
+    auto args = EvalArgs(e, 0);
+    if (e.name == "raise_exception") {
+      throw TemplateError(args.empty() ? "Template raised an exception"
+                                       : ToString(args[0]));
+    }
+    if (e.name == "namespace") {
+      Json::Value ns(Json::objectValue);
+      for (const auto& [key, value] : e.kwargs) {
+        ns[key] = Eval(*value).get();
+      }
+      return Value(std::move(ns));
+    }
+    if (e.name == "range") {
+      int64_t start = 0;
+      int64_t stop = 0;
+      int64_t step = 1;
+      if (args.size() == 1) {
+        stop = args[0].get().asInt64();
+      } else if (args.size() >= 2) {
+        start = args[0].get().asInt64();
+        stop = args[1].get().asInt64();
+        if (args.size() >= 3) {
+          step = args[2].get().asInt64();
+        }
+      }
+      if (step == 0) {
+        throw TemplateError("range() step can not be zero");
+      }
+      Json::Value res(Json::arrayValue);
+      for (auto i = start; step > 0 ? i < stop : i > stop; i += step) {
+        res.append(Json::Int64(i));
+      }
+      return Value(std::move(res));
+    }
+    if (e.name == "strftime_now") {
+      auto now = std::time(nullptr);
+      std::tm tm{};
+#if defined(_WIN32)
+      localtime_s(&tm, &now);
+#else
+      localtime_r(&now, &tm);
+#endif
+      char buf[128];
+      auto n = std::strftime(buf, sizeof(buf),
+                             args.empty() ? "%Y-%m-%d"
+                                          : ToString(args[0]).c_str(),
+                             &tm);
+      return Value(Json::Value(std::string(buf, n)));
+    }
+    throw TemplateError("Unknown function '" + e.name + "'");
+  }
+
+  Value EvalMethod(const Expr& e) {
+    auto obj = Eval(*e.args[0]);
+    auto args = EvalArgs(e, 1);
+    const auto& j = obj.get();
+    auto arg = [&args](size_t i) {
+      return i < args.size() ? ToString(args[i]) : std::string();
+    };
+
+    if (j.isString()) {
+      auto s = j.asString();
+      if (e.name == "strip" || e.name == "lstrip" || e.name == "rstrip") {
+        return Value(Json::Value(Strip(s, arg(0), e.name != "rstrip",
+                                       e.name != "lstrip")));
+      }
+      if (e.name == "startswith" || e.name == "endswith") {
+        std::vector<std::string> candidates;
+        if (!args.empty() && args[0].get().isArray()) {
+          for (const auto& c : args[0].get()) {
+            candidates.push_back(c.asString());
+          }
+        } else {
+          candidates.push_back(arg(0));
+        }
+        bool res = std::any_of(
+            candidates.begin(), candidates.end(), [&](const std::string& c) {
+              return c.size() <= s.size() &&
+                     (e.name == "startswith"
+                          ? s.compare(0, c.size(), c) == 0
+                          : s.compare(s.size() - c.size(), c.size(), c) == 0);
+            });
+        return Value(Json::Value(res));
+      }
+      if (e.name == "upper") {
+        return Value(Json::Value(Upper(s)));
+      }
+      if (e.name == "lower") {
+        return Value(Json::Value(Lower(s)));
+      }
+      if (e.name == "title") {
+        return Value(Json::Value(Title(s)));
+      }
+      if (e.name == "capitalize") {
+        return Value(Json::Value(Capitalize(s)));
+      }
+      if (e.name == "replace") {
+        int64_t count = args.size() > 2 ? args[2].get().asInt64() : -1;
+        return Value(Json::Value(ReplaceAll(s, arg(0), arg(1), count)));
+      }
+      if (e.name == "find") {
+        auto pos = s.find(arg(0));
+        return Value(Json::Value(
+            Json::Int64(pos == std::string::npos ? -1 : pos)));
+      }
+      if (e.name == "split") {
+        return Value(Split(s, args));
+      }
+      if (e.name == "join") {
+        return ApplyFilter("join", args.empty() ? Value() : args[0],
+                           {obj}, e);
+      }
+    } else if (j.isObject()) {
+      if (e.name == "items") {
+        Json::Value res(Json::arrayValue);
+        for (auto it = j.begin(); it != j.end(); ++it) {
+          Json::Value pair(Json::arrayValue);
+          pair.append(it.name());
+          pair.append(*it);
+          res.append(std::move(pair));
+        }
+        return Value(std::move(res));
+      }
+      if (e.name == "keys") {
+        Json::Value res(Json::arrayValue);
+        for (const auto& key : j.getMemberNames()) {
+          res.append(key);
+        }
+        return Value(std::move(res));
+      }
+      if (e.name == "values") {
+        Json::Value res(Json::arrayValue);
+        for (const auto& v : j) {
+          res.append(v);
+        }
+        return Value(std::move(res));
+      }
+      if (e.name == "get") {
+        auto key = arg(0);
+        if (auto m = j.find(key.data(), key.data() + key.size());
+            m != nullptr) {
+          return obj.Child(*m);
+        }
+        return args.size() > 1 ? args[1] : Value(Json::Value::null);
+      }
+    }
+    throw TemplateError("Unknown method '" + e.name + "'");
+  }
+
+  Json::Value Split(const std::string& s, const std::vector<Value>& args) {
+    Json::Value res(Json::arrayValue);
+    bool by_whitespace = args.empty() || args[0].get().isNull();
+    int64_t max_split = args.size() > 1 ? args[1].get().asInt64() : -1;
+    if (by_whitespace) {
+      size_t pos = 0;
+      while (pos < s.size()) {
+        while (pos < s.size() &&
+               std::isspace(static_cast<unsigned char>(s[pos]))) {
+          pos++;
+        }
+        if (pos >= s.size()) {
+          break;
+        }
+        if (max_split == 0) {
+          res.append(Strip(s.substr(pos), "", false, true));
+          break;
+        }
+        auto end = pos;
+        while (end < s.size() &&
+               !std::isspace(static_cast<unsigned char>(s[end]))) {
+          end++;
+        }
+        res.append(s.substr(pos, end - pos));
+        max_split--;
+        pos = end;
+      }
+      return res;
+    }
+    auto sep = ToString(args[0]);
+    if (sep.empty()) {
+      throw TemplateError("Empty separator");
+    }
+    size_t pos = 0;
+    size_t next;
+    while (max_split != 0 && (next = s.find(sep, pos)) != std::string::npos) {
+      res.append(s.substr(pos, next - pos));
+      pos = next + sep.size();
+      max_split--;
+    }
+    res.append(s.substr(pos));
+    return res;
+  }
+
+  Value EvalBinary(const std::string& op, const Value& a, const Value& b) {
+    const auto& x = a.get();
+    const auto& y = b.get();
+    if (op == "==") {
+      return Value(Json::Value(ValuesEqual(a, b)));
+    }
+    if (op == "!=") {
+      return Value(Json::Value(!ValuesEqual(a, b)));
+    }
+    if (op == "~") {
+      return Value(Json::Value(ToString(a) + ToString(b)));
+    }
+    if (op == "in" || op == "not in") {
+      bool res = false;
+      if (y.isString()) {
+        res = y.asString().find(ToString(a)) != std::string::npos;
+      } else if (y.isArray()) {
+        res = std::any_of(y.begin(), y.end(), [&a](const Json::Value& item) {
+          return ValuesEqual(a, Value::Ref(item));
+        });
+      } else if (y.isObject()) {
+        res = x.isString() && y.isMember(x.asString());
+      }
+      return Value(Json::Value(op == "in" ? res : !res));
+    }
+    if (op == "<" || op == ">" || op == "<=" || op == ">=") {
+      int cmp;
+      if (IsNumber(x) && IsNumber(y)) {
+        cmp = x.asDouble() < y.asDouble() ? -1 : x.asDouble() > y.asDouble();
+      } else if (x.isString() && y.isString()) {
+        cmp = x.asString().compare(y.asString());
+      } else {
+        throw TemplateError("Can not compare values of different types");
+      }
+      bool res = op == "<"    ? cmp < 0
+                 : op == ">"  ? cmp > 0
+                 : op == "<=" ? cmp <= 0
+                              : cmp >= 0;
+      return Value(Json::Value(res));
+    }
+    if (op == "+") {
+      if (x.isString() && y.isString()) {
+        return Value(Json::Value(x.asString() + y.asString()));
+      }
+      if (x.isArray() && y.isArray()) {
+        Json::Value res = x;
+        for (const auto& item : y) {
+          res.append(item);
+        }
+        return Value(std::move(res));
+      }
+    }
+    if (op == "*" && x.isString() && IsInteger(y)) {
+      std::string res;
+      for (int64_t i = 0; i < y.asInt64(); i++) {
+        res += x.asString();
+      }
+      return Value(Json::Value(res));
+    }
+    if (!IsNumber(x) || !IsNumber(y)) {
+      throw TemplateError("Unsupported operand types for '" + op + "'");
+    }
+    if (op == "/") {
+      return Value(Json::Value(x.asDouble() / y.asDouble()));
+    }
+    if (IsInteger(x) && IsInteger(y)) {
+      auto l = x.asInt64();
+      auto r = y.asInt64();
+      if ((op == "//" || op == "%") && r == 0) {
+        throw TemplateError("Division by zero");
+      }
+      int64_t res = op == "+"   ? l + r
+                    : op == "-" ? l - r
+                    : op == "*" ? l * r
+                    : op == "//"
+                        ? (l / r - ((l % r != 0) && ((l < 0) != (r < 0))))
+                        : ((l % r) + r) % r;
+      return Value(Json::Value(Json::Int64(res)));
+    }
+    auto l = x.asDouble();
+    auto r = y.asDouble();
+    double res = op == "+"    ? l + r
+                 : op == "-"  ? l - r
+                 : op == "*"  ? l * r
+                 : op == "//" ? std::floor(l / r)
+                              : l - r * std::floor(l / r);
+    return Value(Json::Value(res));
+  }
+
+  Value ApplyFilter(const std::string& name, const Value& v,
+                    const std::vector<Value>& args, const Expr& e) {
+    const auto& j = v.get();
+    if (name == "trim") {
+      return Value(Json::Value(Strip(
+          ToString(v), args.empty() ? "" : ToString(args[0]), true, true)));
+    }
+    if (name == "length" || name == "count") {
+      if (j.isString()) {
+        return Value(Json::Value(Json::UInt64(Utf8Length(j.asString()))));
+      }
+      return Value(Json::Value(Json::UInt64(
+          j.isArray() || j.isObject() ? j.size() : 0)));
+    }
+    if (name == "upper") {
+      return Value(Json::Value(Upper(ToString(v))));
+    }
+    if (name == "lower") {
+      return Value(Json::Value(Lower(ToString(v))));
+    }
+    if (name == "capitalize") {
+      return Value(Json::Value(Capitalize(ToString(v))));
+    }
+    if (name == "title") {
+      return Value(Json::Value(Title(ToString(v))));
+    }
+    if (name == "default" || name == "d") {
+      bool use_default = args.size() > 1 && Truthy(args[1]) ? !Truthy(v)
+                                                            : !v.defined();
+      if (use_default) {
+        return args.empty() ? Value(Json::Value("")) : args[0];
+      }
+      return v;
+    }
+    if (name == "tojson") {
+      auto indent = Kwarg(e, "indent");
+      if (!indent.defined() && !args.empty()) {
+        indent = args[0];
+      }
+      std::string res;
+      AppendJson(j, res,
+                 IsInteger(indent.get()) ? indent.get().asInt() : 0, 0);
+      return Value(Json::Value(res));
+    }
+    if (name == "string") {
+      return Value(Json::Value(ToString(v)));
+    }
+    if (name == "safe" || name == "e" || name == "escape") {
+      return v;
+    }
+    if (name == "int") {
+      if (IsNumber(j)) {
+        return Value(Json::Value(Json::Int64(j.asDouble())));
+      }
+      try {
+        return Value(Json::Value(Json::Int64(std::stoll(ToString(v)))));
+      } catch (const std::exception&) {
+        return Value(Json::Value(Json::Int64(0)));
+      }
+    }
+    if (name == "float") {
+      if (IsNumber(j)) {
+        return Value(Json::Value(j.asDouble()));
+      }
+      try {
+        return Value(Json::Value(std::stod(ToString(v))));
+      } catch (const std::exception&) {
+        return Value(Json::Value(0.0));
+      }
+    }
+    if (name == "abs") {
+      if (IsInteger(j)) {
+        return Value(Json::Value(Json::Int64(std::llabs(j.asInt64()))));
+      }
+      return Value(Json::Value(std::fabs(j.asDouble())));
+    }
+    if (name == "first" || name == "last") {
+      if (j.isArray()) {
+        if (j.empty()) {
+          return Value();
+        }
+        return v.Child(j[name == "first" ? 0 : j.size() - 1]);
+      }
+      auto s = ToString(v);
+      if (s.empty()) {
+        return Value();
+      }
+      return Value(Json::Value(std::string(1, name == "first" ? s.front()
+                                                               : s.back())));
+    }
+    if (name == "join") {
+      auto sep = args.empty() ? std::string() : ToString(args[0]);
+      auto attribute = Kwarg(e, "attribute");
+      std::string res;
+      bool first = true;
+      for (const auto& item : j) {
+        if (!first) {
+          res += sep;
+        }
+        first = false;
+        if (attribute.defined()) {
+          res += ToString(Value::Ref(item[ToString(attribute)]));
+        } else {
+          res += ToString(Value::Ref(item));
+        }
+      }
+      return Value(Json::Value(res));
+    }
+    if (name == "replace") {
+      if (args.size() < 2) {
+        throw TemplateError("replace expects two arguments");
+      }
+      int64_t count = args.size() > 2 ? args[2].get().asInt64() : -1;
+      return Value(Json::Value(
+          ReplaceAll(ToString(v), ToString(args[0]), ToString(args[1]),
+                     count)));
+    }
+    if (name == "list") {
+      if (j.isArray()) {
+        return v;
+      }
+      Json::Value res(Json::arrayValue);
+      if (j.isObject()) {
+        for (const auto& key : j.getMemberNames()) {
+          res.append(key);
+        }
+      } else if (j.isString()) {
+        for (char c : j.asString()) {
+          res.append(std::string(1, c));
+        }
+      }
+      return Value(std::move(res));
+    }
+    if (name == "reverse") {
+      if (j.isString()) {
+        auto s = j.asString();
+        std::reverse(s.begin(), s.end());
+        return Value(Json::Value(s));
+      }
+      Json::Value res(Json::arrayValue);
+      for (auto i = static_cast<int64_t>(j.size()) - 1; i >= 0; i--) {
+        res.append(j[static_cast<Json::ArrayIndex>(i)]);
+      }
+      return Value(std::move(res));
+    }
+    if (name == "items") {
+      Json::Value res(Json::arrayValue);
+      for (auto it = j.begin(); j.isObject() && it != j.end(); ++it) {
+        Json::Value pair(Json::arrayValue);
+        pair.append(it.name());
+        pair.append(*it);
+        res.append(std::move(pair));
+      }
+      return Value(std::move(res));
+    }
+    if (name == "selectattr" || name == "rejectattr") {
+      if (args.empty()) {
+        throw TemplateError(name + " expects an attribute name");
+      }
+      auto attribute = ToString(args[0]);
+      std::vector<Value> test_args(args.begin() + std::min<size_t>(2, args.size()),
+                                   args.end());
+      Json::Value res(Json::arrayValue);
+      for (const auto& item : j) {
+        Value attr_value;
+        if (item.isObject() && item.isMember(attribute)) {
+          attr_value = Value::Ref(item[attribute]);
+        }
+        bool match = args.size() > 1
+                         ? ApplyTest(ToString(args[1]), attr_value, test_args)
+                         : Truthy(attr_value);
+        if (match == (name == "selectattr")) {
+          res.append(item);
+        }
+      }
+      return Value(std::move(res));
+    }
+    if (name == "map") {
+      auto attribute = Kwarg(e, "attribute");
+      Json::Value res(Json::arrayValue);
+      for (const auto& item : j) {
+        if (attribute.defined()) {
+          auto key = ToString(attribute);
+          res.append(item.isObject() && item.isMember(key)
+                         ? item[key]
+                         : Kwarg(e, "default").get());
+        } else if (!args.empty()) {
+          std::vector<Value> rest(args.begin() + 1, args.end());
+          res.append(
+              ApplyFilter(ToString(args[0]), Value::Ref(item), rest, e).get());
+        } else {
+          res.append(item);
+        }
+      }
+      return Value(std::move(res));
+    }
+    throw TemplateError("Unknown filter '" + name + "'");
+  }
+
+  bool ApplyTest(const std::string& name, const Value& v,
+                 const std::vector<Value>& args) {
+    const auto& j = v.get();
+    if (name == "defined") {
+      return v.defined();
+    }
+    if (name == "undefined") {
+      return !v.defined();
+    }
+    if (!v.defined() && name != "none" && name != "false" && name != "true") {
+      return false;
+    }
+    if (name == "none") {
+      return v.defined() && j.isNull();
+    }
+    if (name == "string") {
+      return j.isString();
+    }
+    if (name == "number") {
+      return IsNumber(j);
+    }
+    if (name == "integer") {
+      return IsInteger(j);
+    }
+    if (name == "float") {
+      return j.type() == Json::realValue;
+    }
+    if (name == "boolean") {
+      return j.isBool();
+    }
+    if (name == "true") {
+      return v.defined() && j.isBool() && j.asBool();
+    }
+    if (name == "false") {
+      return v.defined() && j.isBool() && !j.asBool();
+    }
+    if (name == "mapping") {
+      return j.isObject();
+    }
+    if (name == "sequence" || name == "iterable") {
+      return j.isArray() || j.isString() || j.isObject();
+    }
+    if (name == "odd" || name == "even") {
+      return IsInteger(j) && (j.asInt64() % 2 != 0) == (name == "odd");
+    }
+    if (name == "divisibleby") {
+      auto d = args.empty() ? 0 : args[0].get().asInt64();
+      return IsInteger(j) && d != 0 && j.asInt64() % d == 0;
+    }
+    if (name == "equalto" || name == "eq" || name == "==" ||
+        name == "sameas") {
+      return !args.empty() && ValuesEqual(v, args[0]);
+    }
+    if (name == "ne" || name == "!=") {
+      return args.empty() || !ValuesEqual(v, args[0]);
+    }
+    if (name == "in") {
+      return !args.empty() &&
+             Truthy(EvalBinary("in", v, args[0]));
+    }
+    if (name == "lower") {
+      return j.isString() && j.asString() == Lower(j.asString());
+    }
+    if (name == "upper") {
+      return j.isString() && j.asString() == Upper(j.asString());
+    }
+    throw TemplateError("Unknown test '" + name + "'");
+  }
+
+  std::string& out_;
+  std::vector<std::unordered_map<std::string, Value>> scopes_;
+};
+}  // namespace
+}  // namespace jinja
+
+JinjaTemplate::JinjaTemplate() = default;
+
+JinjaTemplate::~JinjaTemplate() = default;
+
+cpp::result<std::shared_ptr<const JinjaTemplate>, std::string>
+JinjaTemplate::Compile(const std::string& source) {
+  try {
+    std::shared_ptr<JinjaTemplate> res(new JinjaTemplate());
+    res->body_ =
+        jinja::TemplateParser(jinja::SplitSegments(source)).Parse();
+    return res;
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to compile chat template: " +
+                     std::string(e.what()));
+  }
+}
+
+cpp::result<void, std::string> JinjaTemplate::Render(
+    const Json::Value& context, std::string& out) const {
+  out.clear();
+  try {
+    jinja::Renderer(context, out).Render(body_);
+    return {};
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to render chat template: " +
+                     std::string(e.what()));
+  }
+}
+
+Json::Value ChatTemplateContext(const Json::Value& messages,
+                                bool add_generation_prompt,
+                                const std::string& bos_token,
+                                const std::string& eos_token) {
+  Json::Value context;
+  context["messages"] = messages;
+  context["add_generation_prompt"] = add_generation_prompt;
+  context["bos_token"] = bos_token;
+  context["eos_token"] = eos_token;
+  return context;
+}
+}  // namespace config
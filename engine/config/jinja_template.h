@@ -0,0 +1,50 @@
+#pragma once
+
+#include <json/json.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils/result.hpp"
+
+namespace config {
+namespace jinja {
+struct Node;
+}
+
+/**
+ * A chat template compiled once into a syntax tree. Supports the part of
+ * Jinja used by the chat templates shipped in GGUF files: output
+ * expressions, if/elif/else, for loops (with loop.* and else), set
+ * (including namespace attributes), filters, tests, slicing, the common
+ * string and dict methods, raise_exception and strftime_now. Whitespace is
+ * handled like transformers does, with trim_blocks and lstrip_blocks on.
+ */
+class JinjaTemplate {
+ public:
+  ~JinjaTemplate();
+
+  JinjaTemplate(const JinjaTemplate&) = delete;
+  JinjaTemplate& operator=(const JinjaTemplate&) = delete;
+
+  static cpp::result<std::shared_ptr<const JinjaTemplate>, std::string>
+  Compile(const std::string& source);
+
+  /**
+   * Render with the members of context as variables. out is cleared first,
+   * so callers can keep one buffer and reuse its capacity.
+   */
+  cpp::result<void, std::string> Render(const Json::Value& context,
+                                        std::string& out) const;
+
+ private:
+  JinjaTemplate();
+
+  std::vector<std::unique_ptr<jinja::Node>> body_;
+};
+
+// Variables a chat template expects, as set by transformers
+Json::Value ChatTemplateContext(const Json::Value& messages,
+                                bool add_generation_prompt,
+                                const std::string& bos_token,
+                                const std::string& eos_token);
+}  // namespace config
@@ -2,10 +2,15 @@
 
 #include <json/json.h>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 #include "utils/format_utils.h"
 namespace config {
@@ -38,7 +43,7 @@ struct ModelConfig {
   bool text_model = std::numeric_limits<bool>::quiet_NaN();
   std::string id;
   std::vector<std::string> files;
-  std::size_t created;
+  std::size_t created = 0;
   std::string object;
   std::string owned_by = "";
 
@@ -61,278 +66,477 @@ struct ModelConfig {
   uint64_t size = 0;
   std::string grammar;
 
-  void FromJson(const Json::Value& json) {
-    // do now allow to update ID and model field because it is unique identifier
-    // if (json.isMember("id"))
-    //   id = json["id"].asString();
-    if (json.isMember("name"))
-      name = json["name"].asString();
-    // if (json.isMember("model"))
-    //   model = json["model"].asString();
-    if (json.isMember("version"))
-      version = json["version"].asString();
-    if (json.isMember("size"))
-      size = json["size"].asUInt64();
-
-    if (json.isMember("stop") && json["stop"].isArray()) {
-      stop.clear();
-      for (const auto& s : json["stop"]) {
-        stop.push_back(s.asString());
-      }
+  void FromJson(const Json::Value& json);
+  Json::Value ToJson() const;
+  std::string ToString() const;
+
+  // Compact form of every field, for caches. FromBinary fails on data
+  // written for a different field table.
+  std::string ToBinary() const;
+  bool FromBinary(std::string_view data);
+};
+
+namespace model_config_field {
+enum Flags : uint32_t {
+  kJsonRead = 1 << 0,
+  kJsonWrite = 1 << 1,
+  kJson = kJsonRead | kJsonWrite,
+  // Read from model.yml and kept in the YAML node by UpdateModelConfig
+  kYaml = 1 << 2,
+  // In json only when the engine is cortex.tensorrt-llm
+  kTensorrtOnly = 1 << 3,
+  // Not printed nor written to model.yml while it has its default value
+  kHideDefault = 1 << 4,
+};
+
+// Where ToString and WriteYamlFile put the field, kNone for neither
+enum class Section {
+  kNone,
+  kGeneral,
+  kInferenceRequired,
+  kInferenceOptional,
+  kLoadRequired,
+  kLoadOptional,
+};
+
+template <typename T>
+struct Descriptor {
+  using Type = T;
+  std::string_view name;
+  T ModelConfig::*member;
+  uint32_t flags;
+  Section section;
+  // Written next to the field in model.yml
+  std::string_view comment;
+};
+
+template <typename T>
+constexpr Descriptor<T> Field(std::string_view name, T ModelConfig::*member,
+                              uint32_t flags, Section section,
+                              std::string_view comment = {}) {
+  return Descriptor<T>{name, member, flags, section, comment};
+}
+}  // namespace model_config_field
+
+/**
+ * Every ModelConfig field with the formats it appears in. FromJson, ToJson,
+ * ToString, the binary form and the model.yml reader and writer all walk
+ * this table, in this order, so a field is only ever declared here.
+ */
+inline constexpr auto kModelConfigFields = [] {
+  using namespace model_config_field;
+  using M = ModelConfig;
+  constexpr auto kAll = kJson | kYaml;
+  constexpr auto kRange = "Ranges: 0 to 1";
+  return std::make_tuple(
+      Field("id", &M::id, kJsonWrite | kYaml, Section::kGeneral,
+            "Model ID unique between models (author / quantization)"),
+      // id and model are unique identifiers, they can't be updated
+      Field("model", &M::model, kJsonWrite | kYaml, Section::kGeneral,
+            "Model ID which is used for request construct - should be "
+            "unique between models (author / quantization)"),
+      Field("name", &M::name, kAll, Section::kGeneral,
+            "metadata.general.name"),
+      Field("version", &M::version, kAll, Section::kGeneral),
+      Field("files", &M::files, kAll, Section::kGeneral,
+            "Can be relative OR absolute local file path"),
+      Field("os", &M::os, kAll, Section::kGeneral),
+      Field("gpu_arch", &M::gpu_arch, kAll, Section::kGeneral),
+      Field("quantization_method", &M::quantization_method, kAll,
+            Section::kGeneral),
+      Field("precision", &M::precision, kAll, Section::kGeneral),
+      Field("trtllm_version", &M::trtllm_version, kAll | kTensorrtOnly,
+            Section::kGeneral),
+      Field("tp", &M::tp, kAll | kTensorrtOnly | kHideDefault,
+            Section::kGeneral),
+      Field("text_model", &M::text_model, kAll | kHideDefault,
+            Section::kGeneral),
+      Field("object", &M::object, kAll, Section::kGeneral),
+      Field("owned_by", &M::owned_by, kAll, Section::kGeneral),
+      Field("created", &M::created, kAll, Section::kNone),
+
+      Field("stop", &M::stop, kAll, Section::kInferenceRequired,
+            "tokenizer.ggml.eos_token_id"),
+
+      Field("size", &M::size, kAll, Section::kInferenceOptional),
+      Field("stream", &M::stream, kAll, Section::kInferenceOptional,
+            "Default true?"),
+      Field("top_p", &M::top_p, kAll, Section::kInferenceOptional, kRange),
+      Field("temperature", &M::temperature, kAll, Section::kInferenceOptional,
+            kRange),
+      Field("frequency_penalty", &M::frequency_penalty, kAll,
+            Section::kInferenceOptional, kRange),
+      Field("presence_penalty", &M::presence_penalty, kAll,
+            Section::kInferenceOptional, kRange),
+      Field("max_tokens", &M::max_tokens, kAll | kHideDefault,
+            Section::kInferenceOptional,
+            "Should be default to context length"),
+      Field("seed", &M::seed, kAll | kHideDefault,
+            Section::kInferenceOptional),
+      Field("dynatemp_range", &M::dynatemp_range, kAll,
+            Section::kInferenceOptional),
+      Field("dynatemp_exponent", &M::dynatemp_exponent, kAll,
+            Section::kInferenceOptional),
+      Field("top_k", &M::top_k, kAll, Section::kInferenceOptional),
+      Field("min_p", &M::min_p, kAll, Section::kInferenceOptional),
+      Field("tfs_z", &M::tfs_z, kAll, Section::kInferenceOptional),
+      Field("typ_p", &M::typ_p, kAll, Section::kInferenceOptional),
+      Field("repeat_last_n", &M::repeat_last_n, kAll,
+            Section::kInferenceOptional),
+      Field("repeat_penalty", &M::repeat_penalty, kAll,
+            Section::kInferenceOptional),
+      Field("mirostat", &M::mirostat, kAll, Section::kInferenceOptional),
+      Field("mirostat_tau", &M::mirostat_tau, kAll,
+            Section::kInferenceOptional),
+      Field("mirostat_eta", &M::mirostat_eta, kAll,
+            Section::kInferenceOptional),
+      Field("penalize_nl", &M::penalize_nl, kAll, Section::kInferenceOptional),
+      Field("ignore_eos", &M::ignore_eos, kAll, Section::kInferenceOptional),
+      Field("n_probs", &M::n_probs, kAll, Section::kInferenceOptional),
+      Field("min_keep", &M::min_keep, kAll, Section::kInferenceOptional),
+      Field("grammar", &M::grammar, kAll, Section::kInferenceOptional),
+
+      Field("engine", &M::engine, kAll, Section::kLoadRequired,
+            "engine to run model"),
+      Field("prompt_template", &M::prompt_template, kAll,
+            Section::kLoadRequired),
+
+      Field("ctx_len", &M::ctx_len, kAll | kHideDefault,
+            Section::kLoadOptional,
+            "llama.context_length | 0 or undefined = loaded from model"),
+      Field("n_parallel", &M::n_parallel, kAll, Section::kLoadOptional),
+      Field("ngl", &M::ngl, kAll | kHideDefault, Section::kLoadOptional,
+            "Undefined = loaded from model"),
+
+      // Split from prompt_template when it is read from model.yml
+      Field("system_template", &M::system_template, kJson, Section::kNone),
+      Field("user_template", &M::user_template, kJson, Section::kNone),
+      Field("ai_template", &M::ai_template, kJson, Section::kNone));
+}();
+
+// Calls f with the descriptor of every field, in table order
+template <typename F>
+constexpr void ForEachModelConfigField(F&& f) {
+  std::apply([&f](const auto&... field) { (f(field), ...); },
+             kModelConfigFields);
+}
+
+namespace model_config_field {
+template <typename T>
+bool IsDefault(const ModelConfig& mc, const Descriptor<T>& field) {
+  static const ModelConfig defaults;
+  if constexpr (std::is_floating_point_v<T>) {
+    if (std::isnan(defaults.*field.member)) {
+      return std::isnan(mc.*field.member);
     }
+  }
+  return mc.*field.member == defaults.*field.member;
+}
 
-    if (json.isMember("stream"))
-      stream = json["stream"].asBool();
-    if (json.isMember("top_p"))
-      top_p = json["top_p"].asFloat();
-    if (json.isMember("temperature"))
-      temperature = json["temperature"].asFloat();
-    if (json.isMember("frequency_penalty"))
-      frequency_penalty = json["frequency_penalty"].asFloat();
-    if (json.isMember("presence_penalty"))
-      presence_penalty = json["presence_penalty"].asFloat();
-    if (json.isMember("max_tokens"))
-      max_tokens = json["max_tokens"].asInt();
-    if (json.isMember("seed"))
-      seed = json["seed"].asInt();
-    if (json.isMember("dynatemp_range"))
-      dynatemp_range = json["dynatemp_range"].asFloat();
-    if (json.isMember("dynatemp_exponent"))
-      dynatemp_exponent = json["dynatemp_exponent"].asFloat();
-    if (json.isMember("top_k"))
-      top_k = json["top_k"].asInt();
-    if (json.isMember("min_p"))
-      min_p = json["min_p"].asFloat();
-    if (json.isMember("tfs_z"))
-      tfs_z = json["tfs_z"].asFloat();
-    if (json.isMember("typ_p"))
-      typ_p = json["typ_p"].asFloat();
-    if (json.isMember("repeat_last_n"))
-      repeat_last_n = json["repeat_last_n"].asInt();
-    if (json.isMember("repeat_penalty"))
-      repeat_penalty = json["repeat_penalty"].asFloat();
-    if (json.isMember("mirostat"))
-      mirostat = json["mirostat"].asBool();
-    if (json.isMember("mirostat_tau"))
-      mirostat_tau = json["mirostat_tau"].asFloat();
-    if (json.isMember("mirostat_eta"))
-      mirostat_eta = json["mirostat_eta"].asFloat();
-    if (json.isMember("penalize_nl"))
-      penalize_nl = json["penalize_nl"].asBool();
-    if (json.isMember("ignore_eos"))
-      ignore_eos = json["ignore_eos"].asBool();
-    if (json.isMember("n_probs"))
-      n_probs = json["n_probs"].asInt();
-    if (json.isMember("min_keep"))
-      min_keep = json["min_keep"].asInt();
-    if (json.isMember("ngl"))
-      ngl = json["ngl"].asInt();
-    if (json.isMember("ctx_len"))
-      ctx_len = json["ctx_len"].asInt();
-    if (json.isMember("n_parallel"))
-      n_parallel = json["n_parallel"].asInt();
-    if (json.isMember("engine"))
-      engine = json["engine"].asString();
-    if (json.isMember("prompt_template"))
-      prompt_template = json["prompt_template"].asString();
-    if (json.isMember("system_template"))
-      system_template = json["system_template"].asString();
-    if (json.isMember("user_template"))
-      user_template = json["user_template"].asString();
-    if (json.isMember("ai_template"))
-      ai_template = json["ai_template"].asString();
-    if (json.isMember("os"))
-      os = json["os"].asString();
-    if (json.isMember("gpu_arch"))
-      gpu_arch = json["gpu_arch"].asString();
-    if (json.isMember("quantization_method"))
-      quantization_method = json["quantization_method"].asString();
-    if (json.isMember("precision"))
-      precision = json["precision"].asString();
-
-    if (json.isMember("files") && json["files"].isArray()) {
-      files.clear();
-      for (const auto& file : json["files"]) {
-        files.push_back(file.asString());
-      }
+template <typename T>
+constexpr uint8_t TypeCode() {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return 1;
+  } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+    return 2;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return 3;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return 4;
+  } else if constexpr (std::is_signed_v<T>) {
+    return 5;
+  } else {
+    static_assert(std::is_unsigned_v<T>, "Unsupported ModelConfig field");
+    return 6;
+  }
+}
+
+// FNV-1a of the names and types of the table, stored in the binary form
+constexpr uint32_t TableSignature() {
+  uint32_t hash = 2166136261u;
+  auto mix = [&hash](uint8_t byte) {
+    hash = (hash ^ byte) * 16777619u;
+  };
+  ForEachModelConfigField([&mix](const auto& field) {
+    using T = typename std::decay_t<decltype(field)>::Type;
+    for (char c : field.name) {
+      mix(static_cast<uint8_t>(c));
     }
+    mix(TypeCode<T>());
+  });
+  return hash;
+}
+
+inline void PutVarint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
 
-    if (json.isMember("created"))
-      created = json["created"].asUInt64();
-    if (json.isMember("object"))
-      object = json["object"].asString();
-    if (json.isMember("owned_by"))
-      owned_by = json["owned_by"].asString();
-    if (json.isMember("text_model"))
-      text_model = json["text_model"].asBool();
-
-    if (engine == "cortex.tensorrt-llm") {
-      if (json.isMember("trtllm_version"))
-        trtllm_version = json["trtllm_version"].asString();
-      if (json.isMember("tp"))
-        tp = json["tp"].asInt();
+inline bool GetVarint(std::string_view& in, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+    auto byte = static_cast<uint8_t>(in.front());
+    in.remove_prefix(1);
+    v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
     }
   }
-  Json::Value ToJson() const {
-    Json::Value obj;
+  return false;
+}
+
+inline void PutString(std::string& out, std::string_view s) {
+  PutVarint(out, s.size());
+  out.append(s);
+}
+
+inline bool GetString(std::string_view& in, std::string& s) {
+  uint64_t size;
+  if (!GetVarint(in, size) || size > in.size()) {
+    return false;
+  }
+  s.assign(in.substr(0, size));
+  in.remove_prefix(size);
+  return true;
+}
 
-    obj["name"] = name;
-    obj["model"] = model;
-    obj["version"] = version;
-    obj["size"] = size;
+template <typename T>
+void PutValue(std::string& out, const T& value) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    PutString(out, value);
+  } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+    PutVarint(out, value.size());
+    for (const auto& s : value) {
+      PutString(out, s);
+    }
+  } else if constexpr (std::is_same_v<T, bool>) {
+    out.push_back(value ? 1 : 0);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+  } else if constexpr (std::is_signed_v<T>) {
+    // zigzag, small negative numbers like seed = -1 stay one byte
+    auto v = static_cast<int64_t>(value);
+    PutVarint(out, (static_cast<uint64_t>(v) << 1) ^
+                       static_cast<uint64_t>(v >> 63));
+  } else {
+    PutVarint(out, value);
+  }
+}
 
-    Json::Value stop_array(Json::arrayValue);
-    for (const auto& s : stop) {
-      stop_array.append(s);
+template <typename T>
+bool GetValue(std::string_view& in, T& value) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return GetString(in, value);
+  } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+    uint64_t count;
+    if (!GetVarint(in, count) || count > in.size()) {
+      return false;
+    }
+    value.resize(count);
+    for (auto& s : value) {
+      if (!GetString(in, s)) {
+        return false;
+      }
+    }
+    return true;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    if (in.empty()) {
+      return false;
+    }
+    value = in.front() != 0;
+    in.remove_prefix(1);
+    return true;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    if (in.size() < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+  } else {
+    uint64_t v;
+    if (!GetVarint(in, v)) {
+      return false;
     }
-    obj["stop"] = stop_array;
-
-    obj["stream"] = stream;
-    obj["top_p"] = top_p;
-    obj["temperature"] = temperature;
-    obj["frequency_penalty"] = frequency_penalty;
-    obj["presence_penalty"] = presence_penalty;
-    obj["max_tokens"] = max_tokens;
-    obj["seed"] = seed;
-    obj["dynatemp_range"] = dynatemp_range;
-    obj["dynatemp_exponent"] = dynatemp_exponent;
-    obj["top_k"] = top_k;
-    obj["min_p"] = min_p;
-    obj["tfs_z"] = tfs_z;
-    obj["typ_p"] = typ_p;
-    obj["repeat_last_n"] = repeat_last_n;
-    obj["repeat_penalty"] = repeat_penalty;
-    obj["mirostat"] = mirostat;
-    obj["mirostat_tau"] = mirostat_tau;
-    obj["mirostat_eta"] = mirostat_eta;
-    obj["penalize_nl"] = penalize_nl;
-    obj["ignore_eos"] = ignore_eos;
-    obj["n_probs"] = n_probs;
-    obj["min_keep"] = min_keep;
-    obj["ngl"] = ngl;
-    obj["ctx_len"] = ctx_len;
-    obj["n_parallel"] = n_parallel;
-    obj["engine"] = engine;
-    obj["prompt_template"] = prompt_template;
-    obj["system_template"] = system_template;
-    obj["user_template"] = user_template;
-    obj["ai_template"] = ai_template;
-    obj["os"] = os;
-    obj["gpu_arch"] = gpu_arch;
-    obj["quantization_method"] = quantization_method;
-    obj["precision"] = precision;
-
-    Json::Value files_array(Json::arrayValue);
-    for (const auto& file : files) {
-      files_array.append(file);
+    if constexpr (std::is_signed_v<T>) {
+      value = static_cast<T>(static_cast<int64_t>(v >> 1) ^
+                             -static_cast<int64_t>(v & 1));
+    } else {
+      value = static_cast<T>(v);
     }
-    obj["files"] = files_array;
+    return true;
+  }
+}
 
-    obj["created"] = static_cast<Json::UInt64>(created);
-    obj["object"] = object;
-    obj["owned_by"] = owned_by;
-    obj["text_model"] = text_model;
+template <typename T>
+void ReadJson(const Json::Value& json, T& value) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    value = json.asString();
+  } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+    if (!json.isArray()) {
+      return;
+    }
+    value.clear();
+    for (const auto& s : json) {
+      value.push_back(s.asString());
+    }
+  } else if constexpr (std::is_same_v<T, bool>) {
+    value = json.asBool();
+  } else if constexpr (std::is_floating_point_v<T>) {
+    value = json.asFloat();
+  } else if constexpr (std::is_signed_v<T>) {
+    value = json.asInt();
+  } else {
+    value = static_cast<T>(json.asUInt64());
+  }
+}
 
-    if (engine == "cortex.tensorrt-llm") {
-      obj["trtllm_version"] = trtllm_version;
-      obj["tp"] = tp;
+template <typename T>
+Json::Value WriteJson(const T& value) {
+  if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+    Json::Value array(Json::arrayValue);
+    for (const auto& s : value) {
+      array.append(s);
     }
+    return array;
+  } else if constexpr (std::is_unsigned_v<T> && !std::is_same_v<T, bool>) {
+    return static_cast<Json::UInt64>(value);
+  } else {
+    return value;
+  }
+}
 
-    return obj;
+template <typename T>
+std::string Print(std::string_view name, const T& value) {
+  std::string key(name);
+  if constexpr (std::is_same_v<T, std::string>) {
+    return value.empty()
+               ? ""
+               : format_utils::print_kv(key, value, format_utils::YELLOW);
+  } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+    if (value.empty()) {
+      return "";
+    }
+    std::string res = std::string(format_utils::GREEN) + key + ":" +
+                      format_utils::RESET + "\n";
+    for (const auto& s : value) {
+      res += std::string("  - ") + format_utils::YELLOW + s +
+             format_utils::RESET + "\n";
+    }
+    return res;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return format_utils::print_bool(key, value);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return format_utils::print_float(key, value);
+  } else {
+    return format_utils::print_kv(key, std::to_string(value),
+                                  format_utils::MAGENTA);
   }
-  std::string ToString() const {
-    std::ostringstream oss;
-
-    oss << format_utils::print_comment("BEGIN GENERAL GGUF METADATA");
-    if (!id.empty())
-      oss << format_utils::print_kv("id", id, format_utils::YELLOW);
-    if (!name.empty())
-      oss << format_utils::print_kv("name", name, format_utils::YELLOW);
-    if (!model.empty())
-      oss << format_utils::print_kv("model", model, format_utils::YELLOW);
-    if (!version.empty())
-      oss << format_utils::print_kv("version", version, format_utils::YELLOW);
-    if (!files.empty()) {
-      oss << format_utils::GREEN << "files:" << format_utils::RESET << "\n";
-      for (const auto& file : files) {
-        oss << "  - " << format_utils::YELLOW << file << format_utils::RESET
-            << "\n";
+}
+}  // namespace model_config_field
+
+inline void ModelConfig::FromJson(const Json::Value& json) {
+  using namespace model_config_field;
+  // tensorrt-llm fields depend on the engine, which may be in json
+  auto read = [this, &json](bool tensorrt_only) {
+    ForEachModelConfigField([this, &json, tensorrt_only](const auto& field) {
+      if ((field.flags & kJsonRead) &&
+          static_cast<bool>(field.flags & kTensorrtOnly) == tensorrt_only) {
+        const auto* value = json.find(field.name.data(),
+                                      field.name.data() + field.name.size());
+        if (value != nullptr) {
+          ReadJson(*value, this->*field.member);
+        }
       }
+    });
+  };
+  read(false);
+  if (engine == "cortex.tensorrt-llm") {
+    read(true);
+  }
+}
+
+inline Json::Value ModelConfig::ToJson() const {
+  using namespace model_config_field;
+  Json::Value obj;
+  bool tensorrt = engine == "cortex.tensorrt-llm";
+  ForEachModelConfigField([this, &obj, tensorrt](const auto& field) {
+    if ((field.flags & kJsonWrite) &&
+        (tensorrt || !(field.flags & kTensorrtOnly))) {
+      obj[std::string(field.name)] = WriteJson(this->*field.member);
     }
-    oss << format_utils::print_comment("END GENERAL GGUF METADATA");
-
-    oss << format_utils::print_comment("BEGIN INFERENCE PARAMETERS");
-    oss << format_utils::print_comment("BEGIN REQUIRED");
-    if (!stop.empty()) {
-      oss << format_utils::GREEN << "stop:" << format_utils::RESET << "\n";
-      for (const auto& s : stop) {
-        oss << "  - " << format_utils::YELLOW << s << format_utils::RESET
-            << "\n";
+  });
+  return obj;
+}
+
+inline std::string ModelConfig::ToString() const {
+  using namespace model_config_field;
+  std::ostringstream oss;
+  auto print_section = [this, &oss](Section section) {
+    ForEachModelConfigField([this, &oss, section](const auto& field) {
+      if (field.section == section &&
+          !((field.flags & kHideDefault) && IsDefault(*this, field))) {
+        oss << Print(field.name, this->*field.member);
       }
-    }
-    oss << format_utils::print_comment("END REQUIRED");
-    oss << format_utils::print_comment("BEGIN OPTIONAL");
-
-    oss << format_utils::print_float("size", size);
-    oss << format_utils::print_bool("stream", stream);
-    oss << format_utils::print_float("top_p", top_p);
-    oss << format_utils::print_float("temperature", temperature);
-    oss << format_utils::print_float("frequency_penalty", frequency_penalty);
-    oss << format_utils::print_float("presence_penalty", presence_penalty);
-    if (max_tokens != std::numeric_limits<int>::quiet_NaN())
-      oss << format_utils::print_kv("max_tokens", std::to_string(max_tokens),
-                                    format_utils::MAGENTA);
-    if (seed != -1)
-      oss << format_utils::print_kv("seed", std::to_string(seed),
-                                    format_utils::MAGENTA);
-    oss << format_utils::print_float("dynatemp_range", dynatemp_range);
-    oss << format_utils::print_float("dynatemp_exponent", dynatemp_exponent);
-    oss << format_utils::print_kv("top_k", std::to_string(top_k),
-                                  format_utils::MAGENTA);
-    oss << format_utils::print_float("min_p", min_p);
-    oss << format_utils::print_float("tfs_z", tfs_z);
-    oss << format_utils::print_float("typ_p", typ_p);
-    oss << format_utils::print_kv(
-        "repeat_last_n", std::to_string(repeat_last_n), format_utils::MAGENTA);
-    oss << format_utils::print_float("repeat_penalty", repeat_penalty);
-    oss << format_utils::print_bool("mirostat", mirostat);
-    oss << format_utils::print_float("mirostat_tau", mirostat_tau);
-    oss << format_utils::print_float("mirostat_eta", mirostat_eta);
-    oss << format_utils::print_bool("penalize_nl", penalize_nl);
-    oss << format_utils::print_bool("ignore_eos", ignore_eos);
-    oss << format_utils::print_kv("n_probs", std::to_string(n_probs),
-                                  format_utils::MAGENTA);
-    oss << format_utils::print_kv("min_keep", std::to_string(min_keep),
-                                  format_utils::MAGENTA);
+    });
+  };
 
-    oss << format_utils::print_comment("END OPTIONAL");
-    oss << format_utils::print_comment("END INFERENCE PARAMETERS");
-    oss << format_utils::print_comment("BEGIN MODEL LOAD PARAMETERS");
-    oss << format_utils::print_comment("BEGIN REQUIRED");
+  oss << format_utils::print_comment("BEGIN GENERAL GGUF METADATA");
+  print_section(Section::kGeneral);
+  oss << format_utils::print_comment("END GENERAL GGUF METADATA");
 
-    if (!engine.empty())
-      oss << format_utils::print_kv("engine", engine, format_utils::YELLOW);
-    if (!prompt_template.empty())
-      oss << format_utils::print_kv("prompt_template", prompt_template,
-                                    format_utils::YELLOW);
+  oss << format_utils::print_comment("BEGIN INFERENCE PARAMETERS");
+  oss << format_utils::print_comment("BEGIN REQUIRED");
+  print_section(Section::kInferenceRequired);
+  oss << format_utils::print_comment("END REQUIRED");
+  oss << format_utils::print_comment("BEGIN OPTIONAL");
+  print_section(Section::kInferenceOptional);
+  oss << format_utils::print_comment("END OPTIONAL");
+  oss << format_utils::print_comment("END INFERENCE PARAMETERS");
 
-    oss << format_utils::print_comment("END REQUIRED");
-    oss << format_utils::print_comment("BEGIN OPTIONAL");
+  oss << format_utils::print_comment("BEGIN MODEL LOAD PARAMETERS");
+  oss << format_utils::print_comment("BEGIN REQUIRED");
+  print_section(Section::kLoadRequired);
+  oss << format_utils::print_comment("END REQUIRED");
+  oss << format_utils::print_comment("BEGIN OPTIONAL");
+  print_section(Section::kLoadOptional);
+  oss << format_utils::print_comment("END OPTIONAL");
+  oss << format_utils::print_comment("END MODEL LOAD PARAMETERS");
 
-    if (ctx_len != std::numeric_limits<int>::quiet_NaN())
-      oss << format_utils::print_kv("ctx_len", std::to_string(ctx_len),
-                                    format_utils::MAGENTA);
-    oss << format_utils::print_kv("n_parallel", std::to_string(n_parallel),
-                                  format_utils::MAGENTA);
-    if (ngl != std::numeric_limits<int>::quiet_NaN())
-      oss << format_utils::print_kv("ngl", std::to_string(ngl),
-                                    format_utils::MAGENTA);
+  return oss.str();
+}
 
-    oss << format_utils::print_comment("END OPTIONAL");
-    oss << format_utils::print_comment("END MODEL LOAD PARAMETERS");
+inline std::string ModelConfig::ToBinary() const {
+  using namespace model_config_field;
+  std::string out;
+  out.reserve(256 + prompt_template.size() + grammar.size());
+  constexpr auto kSignature = TableSignature();
+  PutValue(out, kSignature);
+  ForEachModelConfigField(
+      [this, &out](const auto& field) { PutValue(out, this->*field.member); });
+  return out;
+}
 
-    return oss.str();
+inline bool ModelConfig::FromBinary(std::string_view data) {
+  using namespace model_config_field;
+  uint32_t signature = 0;
+  if (!GetValue(data, signature) || signature != TableSignature()) {
+    return false;
   }
-};
-
+  ModelConfig tmp;
+  bool ok = true;
+  ForEachModelConfigField([&tmp, &data, &ok](const auto& field) {
+    ok = ok && GetValue(data, tmp.*field.member);
+  });
+  if (!ok || !data.empty()) {
+    return false;
+  }
+  *this = std::move(tmp);
+  return true;
+}
 }  // namespace config
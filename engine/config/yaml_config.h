@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ctime>
+#include <ostream>
 #include <string>
 
 #include "model_config.h"
@@ -14,6 +15,8 @@ class YamlHandler {
   void ReadYamlFile(const std::string& file_path);
   void ModelConfigFromYaml();
   void SplitPromptTemplate(ModelConfig& mc);
+  void WriteYamlSection(std::ostream& out,
+                        model_config_field::Section section) const;
 
  public:
   // Method to read YAML file
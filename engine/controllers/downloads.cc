@@ -0,0 +1,13 @@
+#include "downloads.h"
+#include "utils/cortex_utils.h"
+
+void Downloads::GetMirrorHealth(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  Json::Value ret;
+  ret["object"] = "list";
+  ret["data"] = download_svc_->GetMirrorHealth();
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+#include "services/download_service.h"
+
+using namespace drogon;
+
+class Downloads : public drogon::HttpController<Downloads, false> {
+ public:
+  explicit Downloads(std::shared_ptr<DownloadService> download_svc)
+      : download_svc_(download_svc) {}
+  METHOD_LIST_BEGIN
+  METHOD_ADD(Downloads::GetMirrorHealth, "/mirrors", Get);
+
+  ADD_METHOD_TO(Downloads::GetMirrorHealth, "/v1/downloads/mirrors", Get);
+  METHOD_LIST_END
+
+  void GetMirrorHealth(const HttpRequestPtr& req,
+                       std::function<void(const HttpResponsePtr&)>&& callback);
+
+ private:
+  std::shared_ptr<DownloadService> download_svc_ = nullptr;
+};
@@ -272,8 +272,12 @@ void Engines::SetDefaultEngineVariant(
     return;
   }
 
+  // Hot-swap keeps running models and in-flight requests alive
+  auto hot_swap = (*(req->getJsonObject())).get("hot_swap", false).asBool();
   auto result =
-      engine_service_->SetDefaultEngineVariant(engine, version, variant);
+      hot_swap
+          ? engine_service_->HotSwapEngineVariant(engine, version, variant)
+          : engine_service_->SetDefaultEngineVariant(engine, version, variant);
   if (result.has_error()) {
     Json::Value res;
     res["message"] = result.error();
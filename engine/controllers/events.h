@@ -11,6 +11,7 @@ using namespace drogon;
 using Event = cortex::event::Event;
 using ExitEvent = cortex::event::ExitEvent;
 using DownloadEvent = cortex::event::DownloadEvent;
+using ModelLoadEvent = cortex::event::ModelLoadEvent;
 using EventType = cortex::event::EventType;
 using EventQueue =
     eventpp::EventQueue<EventType, void(const eventpp::AnyData<eventMaxSize>&)>;
@@ -31,6 +32,10 @@ class Events : public drogon::WebSocketController<Events, false> {
     event_queue_->appendListener(
         EventType::ExitEvent,
         [this](const ExitEvent& e) { this->broadcast(e.message); });
+
+    event_queue_->appendListener(
+        EventType::ModelLoadEvent,
+        [this](const ModelLoadEvent& e) { this->broadcast(e.ToJsonString()); });
   };
 
   void handleNewMessage(const WebSocketConnectionPtr& wsConnPtr,
@@ -2,9 +2,9 @@
 #include <drogon/HttpTypes.h>
 #include <filesystem>
 #include <optional>
-#include "config/gguf_parser.h"
 #include "config/yaml_config.h"
 #include "models.h"
+#include "services/blob_store.h"
 #include "trantor/utils/Logger.h"
 #include "utils/cortex_utils.h"
 #include "utils/file_manager_utils.h"
@@ -41,16 +41,33 @@ void Models::PullModel(const HttpRequestPtr& req,
     desired_model_name = name_value;
   }
 
+  std::optional<DownloadPriority> priority = std::nullopt;
+  auto priority_value =
+      (*(req->getJsonObject())).get("priority", "").asString();
+  if (!priority_value.empty()) {
+    priority = DownloadPriorityFromString(priority_value);
+    if (!priority.has_value()) {
+      Json::Value ret;
+      ret["message"] = "Invalid priority: " + priority_value +
+                       ", expected high, normal or low";
+      auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+      resp->setStatusCode(k400BadRequest);
+      callback(resp);
+      return;
+    }
+  }
+
   auto handle_model_input =
       [&, model_handle]() -> cpp::result<DownloadTask, std::string> {
     CTL_INF("Handle model input, model handle: " + model_handle);
     if (string_utils::StartsWith(model_handle, "https")) {
       return model_service_->HandleDownloadUrlAsync(
-          model_handle, desired_model_id, desired_model_name);
+          model_handle, desired_model_id, desired_model_name, priority);
     } else if (model_handle.find(":") != std::string::npos) {
       auto model_and_branch = string_utils::SplitBy(model_handle, ":");
       return model_service_->DownloadModelFromCortexsoAsync(
-          model_and_branch[0], model_and_branch[1], desired_model_id);
+          model_and_branch[0], model_and_branch[1], desired_model_id,
+          priority);
     }
 
     return cpp::fail("Invalid model handle or not supported!");
@@ -106,6 +123,9 @@ void Models::GetModelPullInfo(
     ret["downloadedModels"] = downloaded;
     ret["availableModels"] = avails;
     ret["downloadUrl"] = info.download_url;
+    if (info.gguf_summary.has_value()) {
+      ret["gguf"] = info.gguf_summary.value();
+    }
     auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
     resp->setStatusCode(k200OK);
     callback(resp);
@@ -157,26 +177,24 @@ void Models::ListModel(
   // Iterate through directory
 
   cortex::db::Models modellist_handler;
-  config::YamlHandler yaml_handler;
 
   auto list_entry = modellist_handler.LoadModelList();
   if (list_entry) {
     for (const auto& model_entry : list_entry.value()) {
-      try {
-        yaml_handler.ModelConfigFromFile(
-            fmu::ToAbsoluteCortexDataPath(
-                fs::path(model_entry.path_to_model_yaml))
-                .string());
-        auto model_config = yaml_handler.GetModelConfig();
-        Json::Value obj = model_config.ToJson();
-        obj["id"] = model_entry.model;
-        obj["model"] = model_entry.model;
-        data.append(std::move(obj));
-        yaml_handler.Reset();
-      } catch (const std::exception& e) {
+      auto model_config = ModelService::ReadModelConfig(
+          fmu::ToAbsoluteCortexDataPath(
+              fs::path(model_entry.path_to_model_yaml))
+              .string());
+      if (model_config.has_error()) {
         LOG_ERROR << "Failed to load yaml file for model: "
-                  << model_entry.path_to_model_yaml << ", error: " << e.what();
+                  << model_entry.path_to_model_yaml
+                  << ", error: " << model_config.error();
+        continue;
       }
+      Json::Value obj = model_config->ToJson();
+      obj["id"] = model_entry.model;
+      obj["model"] = model_entry.model;
+      data.append(std::move(obj));
     }
     ret["data"] = data;
     ret["result"] = "OK";
@@ -322,7 +340,6 @@ void Models::ImportModel(
   auto modelPath = (*(req->getJsonObject())).get("modelPath", "").asString();
   auto modelName = (*(req->getJsonObject())).get("name", "").asString();
   auto option = (*(req->getJsonObject())).get("option", "symlink").asString();
-  config::GGUFHandler gguf_handler;
   config::YamlHandler yaml_handler;
   cortex::db::Models modellist_utils_obj;
   std::string model_yaml_path = (file_manager_utils::GetModelsContainerPath() /
@@ -339,16 +356,22 @@ void Models::ImportModel(
 
     std::filesystem::create_directories(
         std::filesystem::path(model_yaml_path).parent_path());
-    gguf_handler.Parse(modelPath);
-    config::ModelConfig model_config = gguf_handler.GetModelConfig();
+    auto gguf_config = ModelService::GetGGUFModelConfig(modelPath);
+    if (gguf_config.has_error()) {
+      throw std::runtime_error(gguf_config.error());
+    }
+    config::ModelConfig model_config = gguf_config.value();
     // There are 2 options: symlink and copy
     if (option == "copy") {
-      // Copy GGUF file to the destination path
+      // Copy GGUF file to the destination path, through the blob store so
+      // a file imported before is not stored twice
       std::filesystem::path file_path =
           std::filesystem::path(model_yaml_path).parent_path() /
           std::filesystem::path(modelPath).filename();
-      std::filesystem::copy_file(
-          modelPath, file_path, std::filesystem::copy_options::update_existing);
+      auto blob = BlobStore().ImportFile(modelHandle, modelPath, file_path);
+      if (blob.has_error()) {
+        throw std::runtime_error(blob.error());
+      }
       model_config.files.push_back(file_path.string());
       auto size = std::filesystem::file_size(file_path);
       model_config.size = size;
@@ -403,46 +426,43 @@ void Models::ImportModel(
   }
 }
 
-void Models::StartModel(
-    const HttpRequestPtr& req,
-    std::function<void(const HttpResponsePtr&)>&& callback) {
-  if (!http_util::HasFieldInReq(req, callback, "model"))
-    return;
-  auto model_handle = (*(req->getJsonObject())).get("model", "").asString();
+cpp::result<StartParameterOverride, std::string>
+Models::ParseStartParameters(const Json::Value& body,
+                             const std::string& model_handle) const {
   StartParameterOverride params_override;
-  if (auto& o = (*(req->getJsonObject()))["prompt_template"]; !o.isNull()) {
+  if (auto& o = body["prompt_template"]; !o.isNull()) {
     params_override.custom_prompt_template = o.asString();
   }
 
-  if (auto& o = (*(req->getJsonObject()))["cache_enabled"]; !o.isNull()) {
+  if (auto& o = body["cache_enabled"]; !o.isNull()) {
     params_override.cache_enabled = o.asBool();
   }
 
-  if (auto& o = (*(req->getJsonObject()))["ngl"]; !o.isNull()) {
+  if (auto& o = body["ngl"]; !o.isNull()) {
     params_override.ngl = o.asInt();
   }
 
-  if (auto& o = (*(req->getJsonObject()))["n_parallel"]; !o.isNull()) {
+  if (auto& o = body["n_parallel"]; !o.isNull()) {
     params_override.n_parallel = o.asInt();
   }
 
-  if (auto& o = (*(req->getJsonObject()))["ctx_len"]; !o.isNull()) {
+  if (auto& o = body["ctx_len"]; !o.isNull()) {
     params_override.ctx_len = o.asInt();
   }
 
-  if (auto& o = (*(req->getJsonObject()))["cache_type"]; !o.isNull()) {
+  if (auto& o = body["cache_type"]; !o.isNull()) {
     params_override.cache_type = o.asString();
   }
 
-  if (auto& o = (*(req->getJsonObject()))["mmproj"]; !o.isNull()) {
+  if (auto& o = body["mmproj"]; !o.isNull()) {
     params_override.mmproj = o.asString();
   }
 
   // Support both llama_model_path and model_path for backward compatible
   // model_path has higher priority
-  if (auto& o = (*(req->getJsonObject()))["llama_model_path"]; !o.isNull()) {
+  if (auto& o = body["llama_model_path"]; !o.isNull()) {
     params_override.model_path = o.asString();
-    if (auto& mp = (*(req->getJsonObject()))["model_path"]; mp.isNull()) {
+    if (auto& mp = body["model_path"]; mp.isNull()) {
       // Bypass if model does not exist in DB and llama_model_path exists
       if (std::filesystem::exists(params_override.model_path.value()) &&
           !model_service_->HasModel(model_handle)) {
@@ -452,41 +472,46 @@ void Models::StartModel(
     }
   }
 
-  if (auto& o = (*(req->getJsonObject()))["model_path"]; !o.isNull()) {
+  if (auto& o = body["model_path"]; !o.isNull()) {
     params_override.model_path = o.asString();
   }
 
   auto model_entry = model_service_->GetDownloadedModel(model_handle);
   if (!model_entry.has_value() && !params_override.bypass_model_check()) {
-    Json::Value ret;
-    ret["message"] = "Cannot find model: " + model_handle;
-    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
-    resp->setStatusCode(drogon::k400BadRequest);
-    callback(resp);
-    return;
+    return cpp::fail("Cannot find model: " + model_handle);
   }
   std::string engine_name = params_override.bypass_model_check()
                                 ? kLlamaEngine
                                 : model_entry.value().engine;
   auto engine_validate = engine_service_->IsEngineReady(engine_name);
   if (engine_validate.has_error()) {
-    Json::Value ret;
-    ret["message"] = engine_validate.error();
-    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
-    resp->setStatusCode(drogon::k400BadRequest);
-    callback(resp);
-    return;
+    return cpp::fail(engine_validate.error());
   }
   if (!engine_validate.value()) {
+    return cpp::fail("Engine is not ready! Please install first!");
+  }
+  return params_override;
+}
+
+void Models::StartModel(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  if (!http_util::HasFieldInReq(req, callback, "model"))
+    return;
+  auto model_handle = (*(req->getJsonObject())).get("model", "").asString();
+  auto params_override =
+      ParseStartParameters(*(req->getJsonObject()), model_handle);
+  if (params_override.has_error()) {
     Json::Value ret;
-    ret["message"] = "Engine is not ready! Please install first!";
+    ret["message"] = params_override.error();
     auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
     resp->setStatusCode(drogon::k400BadRequest);
     callback(resp);
     return;
   }
 
-  auto result = model_service_->StartModel(model_handle, params_override);
+  auto result =
+      model_service_->StartModel(model_handle, params_override.value());
   if (result.has_error()) {
     Json::Value ret;
     ret["message"] = result.error();
@@ -506,6 +531,58 @@ void Models::StartModel(
   }
 }
 
+void Models::StartModelAsync(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  if (!http_util::HasFieldInReq(req, callback, "model"))
+    return;
+  auto model_handle = (*(req->getJsonObject())).get("model", "").asString();
+  auto params_override =
+      ParseStartParameters(*(req->getJsonObject()), model_handle);
+  if (params_override.has_error()) {
+    Json::Value ret;
+    ret["message"] = params_override.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(drogon::k400BadRequest);
+    callback(resp);
+    return;
+  }
+
+  auto result =
+      model_service_->StartModelAsync(model_handle, params_override.value());
+  if (result.has_error()) {
+    Json::Value ret;
+    ret["message"] = result.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(drogon::k400BadRequest);
+    callback(resp);
+  } else {
+    auto resp =
+        cortex_utils::CreateCortexHttpJsonResponse(result.value().ToJsonCpp());
+    resp->setStatusCode(k202Accepted);
+    callback(resp);
+  }
+}
+
+void Models::GetStartModelJob(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& job_id) const {
+  auto result = model_service_->GetStartModelJob(job_id);
+  if (result.has_error()) {
+    Json::Value ret;
+    ret["message"] = result.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(drogon::k404NotFound);
+    callback(resp);
+  } else {
+    auto resp =
+        cortex_utils::CreateCortexHttpJsonResponse(result.value().ToJsonCpp());
+    resp->setStatusCode(k200OK);
+    callback(resp);
+  }
+}
+
 void Models::StopModel(const HttpRequestPtr& req,
                        std::function<void(const HttpResponsePtr&)>&& callback) {
   if (!http_util::HasFieldInReq(req, callback, "model")) {
@@ -548,3 +625,54 @@ void Models::GetModelStatus(
     callback(resp);
   }
 }
+
+void Models::GetModelTensors(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& model_id) const {
+  auto result = model_service_->InspectModel(model_id);
+  if (result.has_error()) {
+    Json::Value ret;
+    ret["message"] = result.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(drogon::k400BadRequest);
+    callback(resp);
+  } else {
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(result.value());
+    resp->setStatusCode(k200OK);
+    callback(resp);
+  }
+}
+
+void Models::ApplyChatTemplate(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& model_id) const {
+  auto json_body = req->getJsonObject();
+  if (json_body == nullptr || !(*json_body)["messages"].isArray()) {
+    Json::Value ret;
+    ret["message"] = "messages must be an array";
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+    return;
+  }
+
+  // Reused across requests handled by this thread
+  thread_local std::string prompt;
+  auto result = model_service_->ApplyChatTemplate(
+      model_id, (*json_body)["messages"],
+      json_body->get("add_generation_prompt", true).asBool(), prompt);
+  Json::Value ret;
+  if (result.has_error()) {
+    ret["message"] = result.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+  } else {
+    ret["prompt"] = prompt;
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k200OK);
+    callback(resp);
+  }
+}
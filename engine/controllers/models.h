@@ -19,8 +19,12 @@ class Models : public drogon::HttpController<Models, false> {
   METHOD_ADD(Models::ImportModel, "/import", Options, Post);
   METHOD_ADD(Models::DeleteModel, "/{1}", Options, Delete);
   METHOD_ADD(Models::StartModel, "/start", Options, Post);
+  METHOD_ADD(Models::StartModelAsync, "/start/async", Options, Post);
+  METHOD_ADD(Models::GetStartModelJob, "/start/jobs/{1}", Get);
   METHOD_ADD(Models::StopModel, "/stop", Options, Post);
   METHOD_ADD(Models::GetModelStatus, "/status/{1}", Get);
+  METHOD_ADD(Models::GetModelTensors, "/{1}/tensors", Get);
+  METHOD_ADD(Models::ApplyChatTemplate, "/{1}/apply-template", Options, Post);
 
   ADD_METHOD_TO(Models::PullModel, "/v1/models/pull", Options, Post);
   ADD_METHOD_TO(Models::AbortPullModel, "/v1/models/pull", Options, Delete);
@@ -30,8 +34,14 @@ class Models : public drogon::HttpController<Models, false> {
   ADD_METHOD_TO(Models::ImportModel, "/v1/models/import", Options, Post);
   ADD_METHOD_TO(Models::DeleteModel, "/v1/models/{1}", Options, Delete);
   ADD_METHOD_TO(Models::StartModel, "/v1/models/start", Options, Post);
+  ADD_METHOD_TO(Models::StartModelAsync, "/v1/models/start/async", Options,
+                Post);
+  ADD_METHOD_TO(Models::GetStartModelJob, "/v1/models/start/jobs/{1}", Get);
   ADD_METHOD_TO(Models::StopModel, "/v1/models/stop", Options, Post);
   ADD_METHOD_TO(Models::GetModelStatus, "/v1/models/status/{1}", Get);
+  ADD_METHOD_TO(Models::GetModelTensors, "/v1/models/{1}/tensors", Get);
+  ADD_METHOD_TO(Models::ApplyChatTemplate, "/v1/models/{1}/apply-template",
+                Options, Post);
   METHOD_LIST_END
 
   explicit Models(std::shared_ptr<ModelService> model_service,
@@ -66,6 +76,13 @@ class Models : public drogon::HttpController<Models, false> {
   void StartModel(const HttpRequestPtr& req,
                   std::function<void(const HttpResponsePtr&)>&& callback);
 
+  void StartModelAsync(const HttpRequestPtr& req,
+                       std::function<void(const HttpResponsePtr&)>&& callback);
+
+  void GetStartModelJob(const HttpRequestPtr& req,
+                        std::function<void(const HttpResponsePtr&)>&& callback,
+                        const std::string& job_id) const;
+
   void StopModel(const HttpRequestPtr& req,
                  std::function<void(const HttpResponsePtr&)>&& callback);
 
@@ -73,7 +90,19 @@ class Models : public drogon::HttpController<Models, false> {
                       std::function<void(const HttpResponsePtr&)>&& callback,
                       const std::string& model_id);
 
+  void GetModelTensors(const HttpRequestPtr& req,
+                       std::function<void(const HttpResponsePtr&)>&& callback,
+                       const std::string& model_id) const;
+
+  void ApplyChatTemplate(
+      const HttpRequestPtr& req,
+      std::function<void(const HttpResponsePtr&)>&& callback,
+      const std::string& model_id) const;
+
  private:
+  cpp::result<StartParameterOverride, std::string> ParseStartParameters(
+      const Json::Value& body, const std::string& model_handle) const;
+
   std::shared_ptr<ModelService> model_service_;
   std::shared_ptr<EngineService> engine_service_;
 };
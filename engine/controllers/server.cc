@@ -9,8 +9,11 @@ using namespace inferences;
 namespace inferences {
 
 server::server(std::shared_ptr<services::InferenceService> inference_service,
-               std::shared_ptr<EngineService> engine_service)
-    : inference_svc_(inference_service), engine_service_(engine_service) {
+               std::shared_ptr<EngineService> engine_service,
+               std::shared_ptr<ModelService> model_service)
+    : inference_svc_(inference_service),
+      engine_service_(engine_service),
+      model_service_(model_service) {
 #if defined(_WIN32)
   if (bool should_use_dll_search_path = !(getenv("ENGINE_PATH"));
       should_use_dll_search_path) {
@@ -28,6 +31,28 @@ void server::ChatCompletion(
   auto json_body = req->getJsonObject();
   bool is_stream = (*json_body).get("stream", false).asBool();
   LOG_DEBUG << "request body: " << json_body->toStyledString();
+  for (const auto* field : {"max_completion_tokens", "max_tokens"}) {
+    if (json_body->isMember(field) && !(*json_body)[field].isNull() &&
+        !(*json_body)[field].isInt64()) {
+      Json::Value ret;
+      ret["message"] = std::string("'") + field + "' must be an integer";
+      ret["code"] = "invalid_request_error";
+      auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+      resp->setStatusCode(k400BadRequest);
+      callback(resp);
+      return;
+    }
+  }
+  // Reject prompts that can not fit before they reach the engine
+  if (auto r = model_service_->CheckContextLength(*json_body); r.has_error()) {
+    Json::Value ret;
+    ret["message"] = r.error();
+    ret["code"] = "context_length_exceeded";
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+    return;
+  }
   auto q = std::make_shared<services::SyncQueue>();
   auto ir = inference_svc_->HandleChatCompletion(q, json_body);
   if (ir.has_error()) {
@@ -120,6 +145,113 @@ void server::LoadModel(const HttpRequestPtr& req,
   LOG_TRACE << "Done load model";
 }
 
+void server::Tokenize(const HttpRequestPtr& req,
+                      std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto json_body = req->getJsonObject();
+  auto tokenizer = model_service_->GetTokenizer(
+      json_body ? json_body->get("model", "").asString() : "");
+  if (tokenizer.has_error()) {
+    Json::Value ret;
+    ret["message"] = tokenizer.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+    return;
+  }
+
+  auto ids = tokenizer.value()->Encode(
+      json_body->get("content", "").asString(),
+      json_body->get("add_special", false).asBool());
+  bool with_pieces = json_body->get("with_pieces", false).asBool();
+  Json::Value tokens(Json::arrayValue);
+  for (auto id : ids) {
+    if (with_pieces) {
+      Json::Value token;
+      token["id"] = id;
+      token["piece"] = tokenizer.value()->Decode({id});
+      tokens.append(token);
+    } else {
+      tokens.append(id);
+    }
+  }
+  Json::Value ret;
+  ret["tokens"] = tokens;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void server::Detokenize(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto json_body = req->getJsonObject();
+  auto tokenizer = model_service_->GetTokenizer(
+      json_body ? json_body->get("model", "").asString() : "");
+  if (tokenizer.has_error()) {
+    Json::Value ret;
+    ret["message"] = tokenizer.error();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+    return;
+  }
+
+  std::vector<int32_t> ids;
+  for (const auto& id : (*json_body)["tokens"]) {
+    if (id.isIntegral()) {
+      ids.push_back(id.asInt());
+    }
+  }
+  Json::Value ret;
+  ret["content"] = tokenizer.value()->Decode(
+      ids, json_body->get("skip_special", false).asBool());
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void server::CountTokens(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto json_body = req->getJsonObject();
+  auto model = json_body ? json_body->get("model", "").asString() : "";
+  auto bad_request = [&callback](const std::string& message) {
+    Json::Value ret;
+    ret["message"] = message;
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+  };
+  auto tokenizer = model_service_->GetTokenizer(model);
+  if (tokenizer.has_error()) {
+    bad_request(tokenizer.error());
+    return;
+  }
+
+  // Reused across requests handled by this thread
+  thread_local std::string content;
+  bool add_special = false;
+  if ((*json_body)["messages"].isArray()) {
+    auto r = model_service_->ApplyChatTemplate(
+        model, (*json_body)["messages"],
+        json_body->get("add_generation_prompt", true).asBool(), content);
+    if (r.has_error()) {
+      bad_request(r.error());
+      return;
+    }
+  } else {
+    content = json_body->get("content", "").asString();
+    add_special = json_body->get("add_special", false).asBool();
+  }
+
+  Json::Value ret;
+  ret["count"] = static_cast<Json::UInt64>(
+      tokenizer.value()->CountTokens(content, add_special));
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
 void server::ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
                               std::shared_ptr<services::SyncQueue> q) {
   auto err_or_done = std::make_shared<std::atomic_bool>(false);
@@ -18,6 +18,7 @@
 #include <string>
 #include "common/base.h"
 #include "services/inference_service.h"
+#include "services/model_service.h"
 
 #ifndef SERVER_VERBOSE
 #define SERVER_VERBOSE 1
@@ -33,7 +34,8 @@ class server : public drogon::HttpController<server, false>,
                public BaseEmbedding {
  public:
   server(std::shared_ptr<services::InferenceService> inference_service,
-         std::shared_ptr<EngineService> engine_service);
+         std::shared_ptr<EngineService> engine_service,
+         std::shared_ptr<ModelService> model_service);
   ~server();
   METHOD_LIST_BEGIN
   // list path definitions here;
@@ -43,6 +45,9 @@ class server : public drogon::HttpController<server, false>,
   METHOD_ADD(server::UnloadModel, "unloadmodel", Options, Post);
   METHOD_ADD(server::ModelStatus, "modelstatus", Options, Post);
   METHOD_ADD(server::GetModels, "models", Get);
+  METHOD_ADD(server::Tokenize, "tokenize", Options, Post);
+  METHOD_ADD(server::Detokenize, "detokenize", Options, Post);
+  METHOD_ADD(server::CountTokens, "tokenize/count", Options, Post);
 
   // cortex.python API
   METHOD_ADD(server::FineTuning, "finetuning", Options, Post);
@@ -51,6 +56,9 @@ class server : public drogon::HttpController<server, false>,
   ADD_METHOD_TO(server::ChatCompletion, "/v1/chat/completions", Options, Post);
   ADD_METHOD_TO(server::FineTuning, "/v1/fine_tuning/job", Options, Post);
   ADD_METHOD_TO(server::Embedding, "/v1/embeddings", Options, Post);
+  ADD_METHOD_TO(server::Tokenize, "/v1/tokenize", Options, Post);
+  ADD_METHOD_TO(server::Detokenize, "/v1/detokenize", Options, Post);
+  ADD_METHOD_TO(server::CountTokens, "/v1/tokenize/count", Options, Post);
 
   METHOD_LIST_END
   void ChatCompletion(
@@ -75,6 +83,15 @@ class server : public drogon::HttpController<server, false>,
       const HttpRequestPtr& req,
       std::function<void(const HttpResponsePtr&)>&& callback) override;
 
+  // Tokenize with the GGUF vocabulary of a local model, no engine involved
+  void Tokenize(const HttpRequestPtr& req,
+                std::function<void(const HttpResponsePtr&)>&& callback);
+  void Detokenize(const HttpRequestPtr& req,
+                  std::function<void(const HttpResponsePtr&)>&& callback);
+  // Token count of content, or of messages rendered with the chat template
+  void CountTokens(const HttpRequestPtr& req,
+                   std::function<void(const HttpResponsePtr&)>&& callback);
+
  private:
   void ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
                         std::shared_ptr<services::SyncQueue> q);
@@ -84,5 +101,6 @@ class server : public drogon::HttpController<server, false>,
  private:
   std::shared_ptr<services::InferenceService> inference_svc_;
   std::shared_ptr<EngineService> engine_service_;
+  std::shared_ptr<ModelService> model_service_;
 };
 };  // namespace inferences
@@ -0,0 +1,133 @@
+#include "blobs.h"
+#include <SQLiteCpp/Transaction.h>
+#include "database.h"
+
+namespace cortex::db {
+
+Blobs::Blobs() : db_(cortex::db::Database::GetInstance().db()) {
+  CreateTables();
+}
+
+Blobs::Blobs(SQLite::Database& db) : db_(db) {
+  CreateTables();
+}
+
+Blobs::~Blobs() {}
+
+void Blobs::CreateTables() {
+  db_.exec(
+      "CREATE TABLE IF NOT EXISTS blobs ("
+      "digest TEXT PRIMARY KEY,"
+      "size INTEGER);");
+  db_.exec(
+      "CREATE TABLE IF NOT EXISTS blob_references ("
+      "model_id TEXT,"
+      "path TEXT,"
+      "digest TEXT,"
+      "PRIMARY KEY (model_id, path));");
+  db_.exec(
+      "CREATE INDEX IF NOT EXISTS blob_references_digest "
+      "ON blob_references (digest);");
+}
+
+cpp::result<bool, std::string> Blobs::AddReference(
+    const BlobReference& reference, uint64_t size) {
+  try {
+    SQLite::Transaction transaction(db_);
+    SQLite::Statement insert_blob(
+        db_, "INSERT OR IGNORE INTO blobs (digest, size) VALUES (?, ?)");
+    insert_blob.bind(1, reference.digest);
+    insert_blob.bind(2, static_cast<int64_t>(size));
+    insert_blob.exec();
+
+    SQLite::Statement upsert(
+        db_,
+        "INSERT INTO blob_references (model_id, path, digest) "
+        "VALUES (?, ?, ?) "
+        "ON CONFLICT(model_id, path) DO UPDATE SET digest = excluded.digest");
+    upsert.bind(1, reference.model_id);
+    upsert.bind(2, reference.path);
+    upsert.bind(3, reference.digest);
+    upsert.exec();
+    transaction.commit();
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<std::vector<BlobReference>, std::string> Blobs::GetReferences(
+    const std::string& model_id) const {
+  try {
+    SQLite::Statement query(db_,
+                            "SELECT path, digest FROM blob_references "
+                            "WHERE model_id = ? ORDER BY path");
+    query.bind(1, model_id);
+    std::vector<BlobReference> references;
+    while (query.executeStep()) {
+      references.push_back(
+          BlobReference{.model_id = model_id,
+                        .path = query.getColumn(0).getString(),
+                        .digest = query.getColumn(1).getString()});
+    }
+    return references;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<int, std::string> Blobs::GetReferenceCount(
+    const std::string& digest) const {
+  try {
+    SQLite::Statement query(
+        db_, "SELECT COUNT(*) FROM blob_references WHERE digest = ?");
+    query.bind(1, digest);
+    query.executeStep();
+    return query.getColumn(0).getInt();
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> Blobs::DeleteReferences(
+    const std::string& model_id) {
+  try {
+    SQLite::Statement del(db_,
+                          "DELETE FROM blob_references WHERE model_id = ?");
+    del.bind(1, model_id);
+    return del.exec() > 0;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<std::vector<std::string>, std::string>
+Blobs::DeleteUnreferencedBlobs() {
+  try {
+    SQLite::Transaction transaction(db_);
+    SQLite::Statement query(
+        db_,
+        "SELECT digest FROM blobs WHERE digest NOT IN "
+        "(SELECT digest FROM blob_references)");
+    std::vector<std::string> digests;
+    while (query.executeStep()) {
+      digests.push_back(query.getColumn(0).getString());
+    }
+    SQLite::Statement del(db_, "DELETE FROM blobs WHERE digest = ?");
+    for (const auto& digest : digests) {
+      del.bind(1, digest);
+      del.exec();
+      del.reset();
+    }
+    transaction.commit();
+    return digests;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+}  // namespace cortex::db
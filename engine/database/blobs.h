@@ -0,0 +1,46 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <trantor/utils/Logger.h>
+#include <string>
+#include <vector>
+#include "utils/result.hpp"
+
+namespace cortex::db {
+// A model file linked to the blob holding its data
+struct BlobReference {
+  std::string model_id;
+  std::string path;
+  std::string digest;
+};
+
+/**
+ * Blobs of the content addressed model store and the manifest of each
+ * model, the files it links to them. A blob is referenced once per file
+ * linked to it, blobs without references are garbage.
+ */
+class Blobs {
+
+ private:
+  SQLite::Database& db_;
+
+  void CreateTables();
+
+ public:
+  Blobs();
+  Blobs(SQLite::Database& db);
+  ~Blobs();
+
+  // Add the blob if it is new and point path of the model at it
+  cpp::result<bool, std::string> AddReference(const BlobReference& reference,
+                                              uint64_t size);
+  cpp::result<std::vector<BlobReference>, std::string> GetReferences(
+      const std::string& model_id) const;
+  cpp::result<int, std::string> GetReferenceCount(
+      const std::string& digest) const;
+  cpp::result<bool, std::string> DeleteReferences(const std::string& model_id);
+
+  // Remove the blobs nothing references and return their digests
+  cpp::result<std::vector<std::string>, std::string> DeleteUnreferencedBlobs();
+};
+}  // namespace cortex::db
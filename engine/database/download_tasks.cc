@@ -0,0 +1,218 @@
+#include "download_tasks.h"
+#include <SQLiteCpp/Transaction.h>
+#include "database.h"
+#include "utils/scope_exit.h"
+
+namespace cortex::db {
+
+DownloadTasks::DownloadTasks()
+    : db_(cortex::db::Database::GetInstance().db()) {
+  CreateTables();
+}
+
+DownloadTasks::DownloadTasks(SQLite::Database& db) : db_(db) {
+  CreateTables();
+}
+
+DownloadTasks::~DownloadTasks() {}
+
+void DownloadTasks::CreateTables() {
+  db_.exec(
+      "CREATE TABLE IF NOT EXISTS download_tasks ("
+      "task_id TEXT PRIMARY KEY,"
+      "type TEXT,"
+      "priority TEXT,"
+      "status TEXT);");
+  db_.exec(
+      "CREATE TABLE IF NOT EXISTS download_items ("
+      "task_id TEXT,"
+      "position INTEGER,"
+      "item_id TEXT,"
+      "download_url TEXT,"
+      "local_path TEXT,"
+      "checksum TEXT,"
+      "bytes INTEGER,"
+      "downloaded_bytes INTEGER,"
+      "PRIMARY KEY (task_id, position));");
+}
+
+cpp::result<std::vector<DownloadTask>, std::string>
+DownloadTasks::LoadDownloadTaskList() const {
+  try {
+    db_.exec("BEGIN TRANSACTION;");
+    cortex::utils::ScopeExit se([this] { db_.exec("COMMIT;"); });
+    std::vector<DownloadTask> tasks;
+    SQLite::Statement query(db_,
+                            "SELECT task_id, type, priority, status FROM "
+                            "download_tasks ORDER BY rowid");
+    while (query.executeStep()) {
+      DownloadTask task{
+          .id = query.getColumn(0).getString(),
+          .status = DownloadTaskStatusFromString(query.getColumn(3).getString()),
+          .type = DownloadTypeFromString(query.getColumn(1).getString()),
+      };
+      if (!query.getColumn(2).isNull()) {
+        task.priority =
+            DownloadPriorityFromString(query.getColumn(2).getString());
+      }
+      tasks.push_back(std::move(task));
+    }
+
+    SQLite::Statement items_query(
+        db_,
+        "SELECT item_id, download_url, local_path, checksum, bytes, "
+        "downloaded_bytes FROM download_items WHERE task_id = ? "
+        "ORDER BY position");
+    for (auto& task : tasks) {
+      items_query.bind(1, task.id);
+      while (items_query.executeStep()) {
+        DownloadItem item{
+            .id = items_query.getColumn(0).getString(),
+            .downloadUrl = items_query.getColumn(1).getString(),
+            .localPath = items_query.getColumn(2).getString(),
+        };
+        if (!items_query.getColumn(3).isNull()) {
+          item.checksum = items_query.getColumn(3).getString();
+        }
+        if (!items_query.getColumn(4).isNull()) {
+          item.bytes =
+              static_cast<uint64_t>(items_query.getColumn(4).getInt64());
+        }
+        if (!items_query.getColumn(5).isNull()) {
+          item.downloadedBytes =
+              static_cast<uint64_t>(items_query.getColumn(5).getInt64());
+        }
+        task.items.push_back(std::move(item));
+      }
+      items_query.reset();
+    }
+    return tasks;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> DownloadTasks::UpsertDownloadTask(
+    const DownloadTask& task) {
+  try {
+    SQLite::Transaction transaction(db_);
+    SQLite::Statement upsert(
+        db_,
+        "INSERT INTO download_tasks (task_id, type, priority, status) "
+        "VALUES (?, ?, ?, ?) "
+        "ON CONFLICT(task_id) DO UPDATE SET "
+        "type = excluded.type, priority = excluded.priority, "
+        "status = excluded.status");
+    upsert.bind(1, task.id);
+    upsert.bind(2, DownloadTypeToString(task.type));
+    if (task.priority.has_value()) {
+      upsert.bind(3, DownloadPriorityToString(task.priority.value()));
+    } else {
+      upsert.bind(3);
+    }
+    upsert.bind(4, DownloadTaskStatusToString(task.status));
+    upsert.exec();
+
+    SQLite::Statement del(db_, "DELETE FROM download_items WHERE task_id = ?");
+    del.bind(1, task.id);
+    del.exec();
+
+    SQLite::Statement insert(
+        db_,
+        "INSERT INTO download_items (task_id, position, item_id, "
+        "download_url, local_path, checksum, bytes, downloaded_bytes) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+    for (size_t i = 0; i < task.items.size(); i++) {
+      const auto& item = task.items[i];
+      insert.bind(1, task.id);
+      insert.bind(2, static_cast<int>(i));
+      insert.bind(3, item.id);
+      insert.bind(4, item.downloadUrl);
+      insert.bind(5, item.localPath.string());
+      if (item.checksum.has_value()) {
+        insert.bind(6, item.checksum.value());
+      } else {
+        insert.bind(6);
+      }
+      if (item.bytes.has_value()) {
+        insert.bind(7, static_cast<int64_t>(item.bytes.value()));
+      } else {
+        insert.bind(7);
+      }
+      if (item.downloadedBytes.has_value()) {
+        insert.bind(8, static_cast<int64_t>(item.downloadedBytes.value()));
+      } else {
+        insert.bind(8);
+      }
+      insert.exec();
+      insert.reset();
+    }
+    transaction.commit();
+    CTL_INF("Saved download task: " << task.id);
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> DownloadTasks::UpdateDownloadTasks(
+    const std::vector<DownloadTask>& tasks) {
+  try {
+    SQLite::Transaction transaction(db_);
+    SQLite::Statement update_task(
+        db_, "UPDATE download_tasks SET status = ? WHERE task_id = ?");
+    SQLite::Statement update_item(
+        db_,
+        "UPDATE download_items SET bytes = ?, downloaded_bytes = ? "
+        "WHERE task_id = ? AND position = ?");
+    for (const auto& task : tasks) {
+      update_task.bind(1, DownloadTaskStatusToString(task.status));
+      update_task.bind(2, task.id);
+      auto updated = update_task.exec();
+      update_task.reset();
+      if (updated == 0) {
+        continue;
+      }
+      for (size_t i = 0; i < task.items.size(); i++) {
+        const auto& item = task.items[i];
+        update_item.bind(1, static_cast<int64_t>(item.bytes.value_or(0)));
+        update_item.bind(2,
+                         static_cast<int64_t>(item.downloadedBytes.value_or(0)));
+        update_item.bind(3, task.id);
+        update_item.bind(4, static_cast<int>(i));
+        update_item.exec();
+        update_item.reset();
+      }
+    }
+    transaction.commit();
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> DownloadTasks::DeleteDownloadTask(
+    const std::string& task_id) {
+  try {
+    SQLite::Transaction transaction(db_);
+    SQLite::Statement del_items(db_,
+                                "DELETE FROM download_items WHERE task_id = ?");
+    del_items.bind(1, task_id);
+    del_items.exec();
+    SQLite::Statement del(db_, "DELETE FROM download_tasks WHERE task_id = ?");
+    del.bind(1, task_id);
+    auto deleted = del.exec() == 1;
+    transaction.commit();
+    if (deleted) {
+      CTL_INF("Removed download task: " << task_id);
+    }
+    return deleted;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+}  // namespace cortex::db
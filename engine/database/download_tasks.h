@@ -0,0 +1,41 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <trantor/utils/Logger.h>
+#include <string>
+#include <vector>
+#include "common/download_task.h"
+#include "utils/result.hpp"
+
+namespace cortex::db {
+/**
+ * Download tasks which did not finish yet, with their items and the bytes
+ * each item had on disk when it was last saved. Rows are removed once a
+ * task completes, fails or is cancelled.
+ */
+class DownloadTasks {
+
+ private:
+  SQLite::Database& db_;
+
+  void CreateTables();
+
+ public:
+  DownloadTasks();
+  DownloadTasks(SQLite::Database& db);
+  ~DownloadTasks();
+
+  // Tasks in the order they were first added, items in task order
+  cpp::result<std::vector<DownloadTask>, std::string> LoadDownloadTaskList()
+      const;
+  cpp::result<bool, std::string> UpsertDownloadTask(const DownloadTask& task);
+
+  /**
+   * Write the status and item progress of several tasks in one transaction.
+   * Tasks without a row are skipped, they finished in the meantime.
+   */
+  cpp::result<bool, std::string> UpdateDownloadTasks(
+      const std::vector<DownloadTask>& tasks);
+  cpp::result<bool, std::string> DeleteDownloadTask(const std::string& task_id);
+};
+}  // namespace cortex::db
@@ -0,0 +1,128 @@
+#include "gguf_metadata.h"
+#include "database.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kCreateTable =
+    "CREATE TABLE IF NOT EXISTS gguf_metadata ("
+    "path TEXT PRIMARY KEY,"
+    "file_size INTEGER,"
+    "mtime INTEGER,"
+    "content_hash TEXT,"
+    "architecture TEXT,"
+    "context_length INTEGER,"
+    "chat_template TEXT,"
+    "bos_token TEXT,"
+    "eos_token TEXT,"
+    "tensor_count INTEGER,"
+    "parameter_count INTEGER,"
+    "estimated_memory_bytes INTEGER,"
+    "model_config TEXT,"
+    "tensors TEXT);";
+}  // namespace
+
+GGUFMetadata::GGUFMetadata()
+    : db_(cortex::db::Database::GetInstance().db()) {
+  db_.exec(kCreateTable);
+}
+
+GGUFMetadata::GGUFMetadata(SQLite::Database& db) : db_(db) {
+  db_.exec(kCreateTable);
+}
+
+GGUFMetadata::~GGUFMetadata() {}
+
+cpp::result<GGUFMetadataEntry, std::string> GGUFMetadata::GetEntry(
+    const std::string& path, uint64_t file_size, int64_t mtime) const {
+  try {
+    SQLite::Statement query(
+        db_,
+        "SELECT path, file_size, mtime, content_hash, architecture, "
+        "context_length, chat_template, bos_token, eos_token, tensor_count, "
+        "parameter_count, estimated_memory_bytes, model_config, tensors "
+        "FROM gguf_metadata WHERE path = ?");
+    query.bind(1, path);
+    if (!query.executeStep()) {
+      return cpp::fail("GGUF metadata not found: " + path);
+    }
+
+    GGUFMetadataEntry entry;
+    entry.path = query.getColumn(0).getString();
+    entry.file_size = static_cast<uint64_t>(query.getColumn(1).getInt64());
+    entry.mtime = query.getColumn(2).getInt64();
+    if (entry.file_size != file_size || entry.mtime != mtime) {
+      return cpp::fail("GGUF metadata is outdated: " + path);
+    }
+    entry.content_hash = query.getColumn(3).getString();
+    entry.architecture = query.getColumn(4).getString();
+    entry.context_length = query.getColumn(5).getInt64();
+    entry.chat_template = query.getColumn(6).getString();
+    entry.bos_token = query.getColumn(7).getString();
+    entry.eos_token = query.getColumn(8).getString();
+    entry.tensor_count = static_cast<uint64_t>(query.getColumn(9).getInt64());
+    entry.parameter_count =
+        static_cast<uint64_t>(query.getColumn(10).getInt64());
+    entry.estimated_memory_bytes =
+        static_cast<uint64_t>(query.getColumn(11).getInt64());
+    entry.model_config = query.getColumn(12).getString();
+    entry.tensors = query.getColumn(13).getString();
+    return entry;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> GGUFMetadata::UpsertEntry(
+    const GGUFMetadataEntry& entry) {
+  try {
+    SQLite::Statement upsert(
+        db_,
+        "INSERT INTO gguf_metadata (path, file_size, mtime, content_hash, "
+        "architecture, context_length, chat_template, bos_token, eos_token, "
+        "tensor_count, parameter_count, estimated_memory_bytes, model_config, "
+        "tensors) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(path) DO UPDATE SET "
+        "file_size = excluded.file_size, mtime = excluded.mtime, "
+        "content_hash = excluded.content_hash, "
+        "architecture = excluded.architecture, "
+        "context_length = excluded.context_length, "
+        "chat_template = excluded.chat_template, "
+        "bos_token = excluded.bos_token, eos_token = excluded.eos_token, "
+        "tensor_count = excluded.tensor_count, "
+        "parameter_count = excluded.parameter_count, "
+        "estimated_memory_bytes = excluded.estimated_memory_bytes, "
+        "model_config = excluded.model_config, tensors = excluded.tensors");
+    upsert.bind(1, entry.path);
+    upsert.bind(2, static_cast<int64_t>(entry.file_size));
+    upsert.bind(3, entry.mtime);
+    upsert.bind(4, entry.content_hash);
+    upsert.bind(5, entry.architecture);
+    upsert.bind(6, entry.context_length);
+    upsert.bind(7, entry.chat_template);
+    upsert.bind(8, entry.bos_token);
+    upsert.bind(9, entry.eos_token);
+    upsert.bind(10, static_cast<int64_t>(entry.tensor_count));
+    upsert.bind(11, static_cast<int64_t>(entry.parameter_count));
+    upsert.bind(12, static_cast<int64_t>(entry.estimated_memory_bytes));
+    upsert.bind(13, entry.model_config);
+    upsert.bind(14, entry.tensors);
+    upsert.exec();
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> GGUFMetadata::DeleteEntry(
+    const std::string& path) {
+  try {
+    SQLite::Statement del(db_, "DELETE from gguf_metadata WHERE path = ?");
+    del.bind(1, path);
+    return del.exec() == 1;
+  } catch (const std::exception& e) {
+    return cpp::fail(e.what());
+  }
+}
+}  // namespace cortex::db
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <trantor/utils/Logger.h>
+#include <cstdint>
+#include <string>
+#include "utils/result.hpp"
+
+namespace cortex::db {
+/**
+ * Parsed summary of a GGUF file. An entry is only valid while the file still
+ * has the same size and modification time.
+ */
+struct GGUFMetadataEntry {
+  std::string path;
+  uint64_t file_size = 0;
+  int64_t mtime = 0;
+  // Empty if the hash of the file is not known
+  std::string content_hash;
+
+  std::string architecture;
+  int64_t context_length = 0;
+  std::string chat_template;
+  std::string bos_token;
+  std::string eos_token;
+  uint64_t tensor_count = 0;
+  uint64_t parameter_count = 0;
+  // Memory needed for the weights alone
+  uint64_t estimated_memory_bytes = 0;
+
+  // ModelConfig derived from the metadata, as json
+  std::string model_config;
+  // Tensor table, as the json array produced by GGUFTensorInfosToJson
+  std::string tensors;
+};
+
+class GGUFMetadata {
+
+ private:
+  SQLite::Database& db_;
+
+ public:
+  GGUFMetadata();
+  GGUFMetadata(SQLite::Database& db);
+  ~GGUFMetadata();
+
+  /**
+   * Look up the entry for path. Fails if there is none or if it was recorded
+   * for a different file size or modification time.
+   */
+  cpp::result<GGUFMetadataEntry, std::string> GetEntry(
+      const std::string& path, uint64_t file_size, int64_t mtime) const;
+  cpp::result<bool, std::string> UpsertEntry(const GGUFMetadataEntry& entry);
+  cpp::result<bool, std::string> DeleteEntry(const std::string& path);
+};
+}  // namespace cortex::db
@@ -0,0 +1,84 @@
+#include "model_configs.h"
+#include "database.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kCreateTable =
+    "CREATE TABLE IF NOT EXISTS model_configs ("
+    "path TEXT PRIMARY KEY,"
+    "file_size INTEGER,"
+    "mtime INTEGER,"
+    "config BLOB);";
+}  // namespace
+
+ModelConfigs::ModelConfigs() : db_(cortex::db::Database::GetInstance().db()) {
+  db_.exec(kCreateTable);
+}
+
+ModelConfigs::ModelConfigs(SQLite::Database& db) : db_(db) {
+  db_.exec(kCreateTable);
+}
+
+ModelConfigs::~ModelConfigs() {}
+
+cpp::result<ModelConfigEntry, std::string> ModelConfigs::GetEntry(
+    const std::string& path, uint64_t file_size, int64_t mtime) const {
+  try {
+    SQLite::Statement query(db_,
+                            "SELECT file_size, mtime, config FROM "
+                            "model_configs WHERE path = ?");
+    query.bind(1, path);
+    if (!query.executeStep()) {
+      return cpp::fail("Model config not found: " + path);
+    }
+
+    ModelConfigEntry entry;
+    entry.path = path;
+    entry.file_size = static_cast<uint64_t>(query.getColumn(0).getInt64());
+    entry.mtime = query.getColumn(1).getInt64();
+    if (entry.file_size != file_size || entry.mtime != mtime) {
+      return cpp::fail("Model config is outdated: " + path);
+    }
+    const auto& config = query.getColumn(2);
+    entry.config.assign(static_cast<const char*>(config.getBlob()),
+                        config.getBytes());
+    return entry;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> ModelConfigs::UpsertEntry(
+    const ModelConfigEntry& entry) {
+  try {
+    SQLite::Statement upsert(
+        db_,
+        "INSERT INTO model_configs (path, file_size, mtime, config) "
+        "VALUES (?, ?, ?, ?) "
+        "ON CONFLICT(path) DO UPDATE SET "
+        "file_size = excluded.file_size, mtime = excluded.mtime, "
+        "config = excluded.config");
+    upsert.bind(1, entry.path);
+    upsert.bind(2, static_cast<int64_t>(entry.file_size));
+    upsert.bind(3, entry.mtime);
+    upsert.bind(4, entry.config.data(), static_cast<int>(entry.config.size()));
+    upsert.exec();
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> ModelConfigs::DeleteEntry(
+    const std::string& path) {
+  try {
+    SQLite::Statement del(db_, "DELETE from model_configs WHERE path = ?");
+    del.bind(1, path);
+    return del.exec() == 1;
+  } catch (const std::exception& e) {
+    return cpp::fail(e.what());
+  }
+}
+}  // namespace cortex::db
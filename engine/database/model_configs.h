@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <trantor/utils/Logger.h>
+#include <cstdint>
+#include <string>
+#include "utils/result.hpp"
+
+namespace cortex::db {
+/**
+ * ModelConfig of a model.yml in its binary form, see
+ * config::ModelConfig::ToBinary. An entry is only valid while the file still
+ * has the same size and modification time.
+ */
+struct ModelConfigEntry {
+  std::string path;
+  uint64_t file_size = 0;
+  int64_t mtime = 0;
+  std::string config;
+};
+
+class ModelConfigs {
+
+ private:
+  SQLite::Database& db_;
+
+ public:
+  ModelConfigs();
+  ModelConfigs(SQLite::Database& db);
+  ~ModelConfigs();
+
+  /**
+   * Look up the entry for path. Fails if there is none or if it was recorded
+   * for a different file size or modification time.
+   */
+  cpp::result<ModelConfigEntry, std::string> GetEntry(const std::string& path,
+                                                      uint64_t file_size,
+                                                      int64_t mtime) const;
+  cpp::result<bool, std::string> UpsertEntry(const ModelConfigEntry& entry);
+  cpp::result<bool, std::string> DeleteEntry(const std::string& path);
+};
+}  // namespace cortex::db
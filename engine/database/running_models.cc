@@ -0,0 +1,85 @@
+#include "running_models.h"
+#include "database.h"
+#include "utils/scope_exit.h"
+
+namespace cortex::db {
+
+RunningModels::RunningModels()
+    : db_(cortex::db::Database::GetInstance().db()) {
+  db_.exec(
+      "CREATE TABLE IF NOT EXISTS running_models ("
+      "model_id TEXT PRIMARY KEY,"
+      "engine TEXT,"
+      "start_params TEXT);");
+}
+
+RunningModels::RunningModels(SQLite::Database& db) : db_(db) {
+  db_.exec(
+      "CREATE TABLE IF NOT EXISTS running_models ("
+      "model_id TEXT PRIMARY KEY,"
+      "engine TEXT,"
+      "start_params TEXT);");
+}
+
+RunningModels::~RunningModels() {}
+
+cpp::result<std::vector<RunningModelEntry>, std::string>
+RunningModels::LoadRunningModelList() const {
+  try {
+    db_.exec("BEGIN TRANSACTION;");
+    cortex::utils::ScopeExit se([this] { db_.exec("COMMIT;"); });
+    std::vector<RunningModelEntry> entries;
+    SQLite::Statement query(
+        db_, "SELECT model_id, engine, start_params FROM running_models");
+
+    while (query.executeStep()) {
+      RunningModelEntry entry;
+      entry.model = query.getColumn(0).getString();
+      entry.engine = query.getColumn(1).getString();
+      entry.start_params = query.getColumn(2).getString();
+      entries.push_back(entry);
+    }
+    return entries;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> RunningModels::UpsertRunningModel(
+    const RunningModelEntry& entry) {
+  try {
+    SQLite::Statement upsert(
+        db_,
+        "INSERT INTO running_models (model_id, engine, start_params) "
+        "VALUES (?, ?, ?) "
+        "ON CONFLICT(model_id) DO UPDATE SET "
+        "engine = excluded.engine, start_params = excluded.start_params");
+    upsert.bind(1, entry.model);
+    upsert.bind(2, entry.engine);
+    upsert.bind(3, entry.start_params);
+    upsert.exec();
+    CTL_INF("Saved running model: " << entry.model);
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<bool, std::string> RunningModels::DeleteRunningModel(
+    const std::string& model) {
+  try {
+    SQLite::Statement del(db_,
+                          "DELETE from running_models WHERE model_id = ?");
+    del.bind(1, model);
+    if (del.exec() == 1) {
+      CTL_INF("Removed running model: " << model);
+      return true;
+    }
+    return false;
+  } catch (const std::exception& e) {
+    return cpp::fail(e.what());
+  }
+}
+}  // namespace cortex::db
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <trantor/utils/Logger.h>
+#include <string>
+#include <vector>
+#include "utils/result.hpp"
+
+namespace cortex::db {
+/**
+ * A model which was running when the server last saw it. start_params holds
+ * the effective json used to load the model so it can be reloaded as is.
+ */
+struct RunningModelEntry {
+  std::string model;
+  std::string engine;
+  std::string start_params;
+};
+
+class RunningModels {
+
+ private:
+  SQLite::Database& db_;
+
+ public:
+  RunningModels();
+  RunningModels(SQLite::Database& db);
+  ~RunningModels();
+
+  cpp::result<std::vector<RunningModelEntry>, std::string>
+  LoadRunningModelList() const;
+  cpp::result<bool, std::string> UpsertRunningModel(
+      const RunningModelEntry& entry);
+  cpp::result<bool, std::string> DeleteRunningModel(const std::string& model);
+};
+}  // namespace cortex::db
@@ -2,6 +2,7 @@
 #include <drogon/drogon.h>
 #include <memory>
 #include "controllers/configs.h"
+#include "controllers/downloads.h"
 #include "controllers/engines.h"
 #include "controllers/events.h"
 #include "controllers/hardware.h"
@@ -18,6 +19,8 @@
 #include "utils/event_processor.h"
 #include "utils/file_logger.h"
 #include "utils/file_manager_utils.h"
+#include "utils/hardware/cpu_budget.h"
+#include "utils/hardware/cpu_info.h"
 #include "utils/logging_utils.h"
 #include "utils/system_info_utils.h"
 
@@ -100,6 +103,10 @@ void RunServer(std::optional<int> port, bool ignore_cout) {
     return;
   }
 
+  // Must run before the services start their worker threads
+  cortex::hw::CpuBudget::GetInstance().Initialize(
+      cortex::hw::GetCPUInfo().cores, config.cpuPartitioning);
+
   using Event = cortex::event::Event;
   using EventQueue =
       eventpp::EventQueue<EventType,
@@ -110,18 +117,25 @@ void RunServer(std::optional<int> port, bool ignore_cout) {
 
   auto model_dir_path = file_manager_utils::GetModelsContainerPath();
   auto config_service = std::make_shared<ConfigService>();
-  auto download_service =
-      std::make_shared<DownloadService>(event_queue_ptr, config_service);
+  auto download_service = std::make_shared<DownloadService>(
+      event_queue_ptr, config_service,
+      std::make_shared<cortex::db::DownloadTasks>());
   auto engine_service = std::make_shared<EngineService>(download_service);
   auto inference_svc =
       std::make_shared<services::InferenceService>(engine_service);
   auto model_service = std::make_shared<ModelService>(
-      download_service, inference_svc, engine_service);
+      download_service, inference_svc, engine_service, event_queue_ptr);
 
   auto file_watcher_srv = std::make_shared<FileWatcherService>(
       model_dir_path.string(), model_service);
   file_watcher_srv->start();
 
+  if (config.restoreModelsOnStartup) {
+    model_service->RestoreRunningModels();
+  }
+  // After the services above registered how to finish their downloads
+  download_service->RestoreTasks();
+
   // initialize custom controllers
   auto engine_ctl = std::make_shared<Engines>(engine_service);
   auto model_ctl = std::make_shared<Models>(model_service, engine_service);
@@ -129,8 +143,10 @@ void RunServer(std::optional<int> port, bool ignore_cout) {
   auto pm_ctl = std::make_shared<ProcessManager>();
   auto hw_ctl = std::make_shared<Hardware>(engine_service, hw_service);
   auto server_ctl =
-      std::make_shared<inferences::server>(inference_svc, engine_service);
+      std::make_shared<inferences::server>(inference_svc, engine_service,
+                                           model_service);
   auto config_ctl = std::make_shared<Configs>(config_service);
+  auto download_ctl = std::make_shared<Downloads>(download_service);
 
   drogon::app().registerController(engine_ctl);
   drogon::app().registerController(model_ctl);
@@ -139,6 +155,7 @@ void RunServer(std::optional<int> port, bool ignore_cout) {
   drogon::app().registerController(server_ctl);
   drogon::app().registerController(hw_ctl);
   drogon::app().registerController(config_ctl);
+  drogon::app().registerController(download_ctl);
 
   auto upload_path = std::filesystem::temp_directory_path() / "cortex-uploads";
   drogon::app().setUploadPath(upload_path.string());
@@ -151,8 +168,16 @@ void RunServer(std::optional<int> port, bool ignore_cout) {
 #endif
   drogon::app().addListener(config.apiServerHost,
                             std::stoi(config.apiServerPort));
+  // Completion handlers block their IO thread until the engine replies, so
+  // the thread count is kept and the threads are only pinned to the IO cpus
   drogon::app().setThreadNum(drogon_thread_num);
   LOG_INFO << "Number of thread is:" << drogon::app().getThreadNum();
+  drogon::app().registerBeginningAdvice([]() {
+    for (size_t i = 0; i < drogon::app().getThreadNum(); i++) {
+      drogon::app().getIOLoop(i)->queueInLoop(
+          []() { cortex::hw::CpuBudget::GetInstance().PinCurrentThreadToIo(); });
+    }
+  });
   drogon::app().disableSigtermHandling();
 
   // CORS
@@ -0,0 +1,193 @@
+#include "blob_store.h"
+#include <algorithm>
+#include <cctype>
+#include "utils/file_io_utils.h"
+#include "utils/file_manager_utils.h"
+#include "utils/logging_utils.h"
+#include "utils/sha256_utils.h"
+
+std::mutex BlobStore::mutex_;
+std::mutex BlobStore::imports_mutex_;
+std::vector<std::future<void>> BlobStore::imports_;
+
+namespace {
+cpp::result<std::string, std::string> HashFile(
+    const std::filesystem::path& path) {
+  sha256_utils::Sha256 hasher;
+  auto res = sha256_utils::UpdateFromFile(hasher, path,
+                                          std::filesystem::file_size(path));
+  if (res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  return hasher.FinalHex();
+}
+}  // namespace
+
+BlobStore::BlobStore()
+    : BlobStore(file_manager_utils::GetCortexDataPath(),
+                std::make_shared<cortex::db::Blobs>()) {}
+
+BlobStore::BlobStore(const std::filesystem::path& data_path,
+                     std::shared_ptr<cortex::db::Blobs> blobs)
+    : data_path_(data_path),
+      blobs_path_(data_path / "models" / "blobs"),
+      blobs_(std::move(blobs)) {}
+
+std::filesystem::path BlobStore::GetBlobPath(const std::string& digest) const {
+  return blobs_path_ / ("sha256-" + digest);
+}
+
+cpp::result<std::string, std::string> BlobStore::AddFile(
+    const std::string& model_id, const std::filesystem::path& path,
+    std::optional<std::string> digest) {
+  try {
+    if (!digest.has_value()) {
+      auto hash = HashFile(path);
+      if (hash.has_error()) {
+        return cpp::fail(hash.error());
+      }
+      digest = hash.value();
+    }
+    std::transform(digest->begin(), digest->end(), digest->begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto blob = GetBlobPath(digest.value());
+    std::filesystem::create_directories(blobs_path_);
+    if (!std::filesystem::exists(blob)) {
+      std::error_code ec;
+      std::filesystem::create_hard_link(path, blob, ec);
+      if (ec) {
+        // Another filesystem, or one without hard links
+        auto tmp = blob;
+        tmp += ".tmp";
+        if (auto res = file_io_utils::CloneFile(path, tmp); res.has_error()) {
+          return cpp::fail(res.error());
+        }
+        std::filesystem::rename(tmp, blob);
+      }
+    }
+    if (!std::filesystem::equivalent(blob, path)) {
+      CTL_INF("Linking " << path.string() << " to blob " << digest.value());
+      if (auto res = Link(digest.value(), path); res.has_error()) {
+        return cpp::fail(res.error());
+      }
+    }
+    if (auto res = AddReference(model_id, path, digest.value());
+        res.has_error()) {
+      return cpp::fail(res.error());
+    }
+    return digest.value();
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to store " + path.string() + ": " + e.what());
+  }
+}
+
+cpp::result<void, std::string> BlobStore::ImportFile(
+    const std::string& model_id, const std::filesystem::path& src,
+    const std::filesystem::path& path) {
+  try {
+    std::filesystem::create_directories(path.parent_path());
+    auto tmp = path;
+    tmp += ".tmp";
+    if (auto res = file_io_utils::CloneFile(src, tmp); res.has_error()) {
+      return cpp::fail(res.error());
+    }
+    std::filesystem::rename(tmp, path);
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to import " + src.string() + ": " + e.what());
+  }
+
+  // Hashing a large file must not hold up the import
+  std::lock_guard<std::mutex> lock(imports_mutex_);
+  std::erase_if(imports_, [](const std::future<void>& import) {
+    return import.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  });
+  imports_.push_back(std::async(
+      std::launch::async,
+      [store = BlobStore(data_path_, blobs_), model_id, path]() mutable {
+        if (auto res = store.AddFile(model_id, path); res.has_error()) {
+          CTL_WRN("Failed to add imported " << path.string()
+                                            << " to the blob store: "
+                                            << res.error());
+        }
+      }));
+  return {};
+}
+
+void BlobStore::WaitForImports() {
+  std::vector<std::future<void>> imports;
+  {
+    std::lock_guard<std::mutex> lock(imports_mutex_);
+    imports.swap(imports_);
+  }
+  for (auto& import : imports) {
+    import.wait();
+  }
+}
+
+cpp::result<void, std::string> BlobStore::RemoveModel(
+    const std::string& model_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto references = blobs_->GetReferences(model_id);
+  if (references.has_error()) {
+    return cpp::fail(references.error());
+  }
+  for (const auto& reference : references.value()) {
+    std::error_code ec;
+    std::filesystem::remove(
+        file_manager_utils::GetAbsolutePath(data_path_, reference.path), ec);
+  }
+  if (auto res = blobs_->DeleteReferences(model_id); res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  return CollectGarbageLocked();
+}
+
+cpp::result<void, std::string> BlobStore::CollectGarbage() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return CollectGarbageLocked();
+}
+
+cpp::result<void, std::string> BlobStore::Link(
+    const std::string& digest, const std::filesystem::path& path) {
+  auto blob = GetBlobPath(digest);
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  std::filesystem::remove(path, ec);
+  std::filesystem::create_hard_link(blob, path, ec);
+  if (!ec) {
+    return {};
+  }
+  return file_io_utils::CloneFile(blob, path);
+}
+
+cpp::result<void, std::string> BlobStore::AddReference(
+    const std::string& model_id, const std::filesystem::path& path,
+    const std::string& digest) {
+  auto res = blobs_->AddReference(
+      cortex::db::BlobReference{
+          .model_id = model_id,
+          .path = file_manager_utils::Subtract(path, data_path_).string(),
+          .digest = digest},
+      std::filesystem::file_size(path));
+  if (res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  // The file may have been linked to another blob before
+  return CollectGarbageLocked();
+}
+
+cpp::result<void, std::string> BlobStore::CollectGarbageLocked() {
+  auto digests = blobs_->DeleteUnreferencedBlobs();
+  if (digests.has_error()) {
+    return cpp::fail(digests.error());
+  }
+  for (const auto& digest : digests.value()) {
+    CTL_INF("Removing unreferenced blob " << digest);
+    std::error_code ec;
+    std::filesystem::remove(GetBlobPath(digest), ec);
+  }
+  return {};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "database/blobs.h"
+#include "utils/result.hpp"
+
+/**
+ * Model files stored once by content, as blobs named after their SHA-256
+ * under models/blobs. Model directories hold hard links to the blobs, or
+ * reflinks where a link is not possible, so the same weights pulled under
+ * another branch or alias, pulled again or imported as a copy take no
+ * extra space. The manifest of each model in cortex.db lists the files it
+ * links, a blob goes away with the last model using it.
+ */
+class BlobStore {
+ public:
+  BlobStore();
+  BlobStore(const std::filesystem::path& data_path,
+            std::shared_ptr<cortex::db::Blobs> blobs);
+
+  std::filesystem::path GetBlobPath(const std::string& digest) const;
+
+  /**
+   * Move the file at path of model_id into the store and link it back in
+   * place. A file whose blob exists already is replaced by a link to it.
+   * digest is the SHA-256 of the file when a download verified it already,
+   * the file is hashed otherwise. Returns the digest.
+   */
+  cpp::result<std::string, std::string> AddFile(
+      const std::string& model_id, const std::filesystem::path& path,
+      std::optional<std::string> digest = std::nullopt);
+
+  /**
+   * Place a clone of src at path for model_id, src is left alone. The clone
+   * is hashed and added to the store in the background, so the import does
+   * not wait for a read of the whole file. It is replaced by a link to the
+   * blob then, if the store holds the same data already.
+   */
+  cpp::result<void, std::string> ImportFile(const std::string& model_id,
+                                            const std::filesystem::path& src,
+                                            const std::filesystem::path& path);
+
+  // Block until the files imported so far are in the store
+  static void WaitForImports();
+
+  // Remove the files linked for model_id and the blobs no model uses now
+  cpp::result<void, std::string> RemoveModel(const std::string& model_id);
+
+  cpp::result<void, std::string> CollectGarbage();
+
+ private:
+  // Replace path with a link to the blob of digest
+  cpp::result<void, std::string> Link(const std::string& digest,
+                                      const std::filesystem::path& path);
+  cpp::result<void, std::string> AddReference(const std::string& model_id,
+                                              const std::filesystem::path& path,
+                                              const std::string& digest);
+  cpp::result<void, std::string> CollectGarbageLocked();
+
+  std::filesystem::path data_path_;
+  std::filesystem::path blobs_path_;
+  std::shared_ptr<cortex::db::Blobs> blobs_;
+
+  // Instances are short lived, the store on disk is shared by all of them
+  static std::mutex mutex_;
+
+  static std::mutex imports_mutex_;
+  static std::vector<std::future<void>> imports_;
+};
@@ -9,7 +9,12 @@ ConfigService::UpdateApiServerConfiguration(const Json::Value& json) {
       config.enableCors,         config.allowedOrigins,  config.verifyProxySsl,
       config.verifyProxyHostSsl, config.proxyUrl,        config.proxyUsername,
       config.proxyPassword,      config.noProxy,         config.verifyPeerSsl,
-      config.verifyHostSsl,      config.huggingFaceToken};
+      config.verifyHostSsl,      config.huggingFaceToken,
+      config.downloadSegments,   config.downloadProgressIntervalMs,
+      config.downloadMaxRate,    config.downloadMaxRateHigh,
+      config.downloadMaxRateNormal,
+      config.downloadMaxRateLow, config.downloadDirectIo,
+      config.downloadMirrors,    config.downloadKeepArchives};
 
   std::vector<std::string> updated_fields;
   std::vector<std::string> invalid_fields;
@@ -37,7 +42,23 @@ ConfigService::UpdateApiServerConfiguration(const Json::Value& json) {
 
   config.huggingFaceToken = api_server_config.hf_token;
 
+  config.downloadSegments = api_server_config.download_segments;
+  config.downloadProgressIntervalMs =
+      api_server_config.download_progress_interval_ms;
+  config.downloadMaxRate = api_server_config.download_max_rate;
+  config.downloadMaxRateHigh = api_server_config.download_max_rate_high;
+  config.downloadMaxRateNormal = api_server_config.download_max_rate_normal;
+  config.downloadMaxRateLow = api_server_config.download_max_rate_low;
+  config.downloadDirectIo = api_server_config.download_direct_io;
+  config.downloadMirrors = api_server_config.download_mirrors;
+  config.downloadKeepArchives = api_server_config.download_keep_archives;
+
   auto result = file_manager_utils::UpdateCortexConfig(config);
+
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  for (const auto& [_, listener] : listeners_) {
+    listener(api_server_config);
+  }
   return api_server_config;
 }
 
@@ -48,5 +69,21 @@ ConfigService::GetApiServerConfiguration() {
       config.enableCors,         config.allowedOrigins,  config.verifyProxySsl,
       config.verifyProxyHostSsl, config.proxyUrl,        config.proxyUsername,
       config.proxyPassword,      config.noProxy,         config.verifyPeerSsl,
-      config.verifyHostSsl,      config.huggingFaceToken};
+      config.verifyHostSsl,      config.huggingFaceToken,
+      config.downloadSegments,   config.downloadProgressIntervalMs,
+      config.downloadMaxRate,    config.downloadMaxRateHigh,
+      config.downloadMaxRateNormal,
+      config.downloadMaxRateLow, config.downloadDirectIo,
+      config.downloadMirrors,    config.downloadKeepArchives};
+}
+
+int ConfigService::AddUpdateListener(UpdateListener listener) {
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  listeners_[next_listener_id_] = std::move(listener);
+  return next_listener_id_++;
+}
+
+void ConfigService::RemoveUpdateListener(int id) {
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  listeners_.erase(id);
 }
@@ -1,12 +1,31 @@
 #pragma once
 
+#include <functional>
+#include <mutex>
+#include <unordered_map>
 #include "common/api_server_configuration.h"
 #include "utils/result.hpp"
 
 class ConfigService {
  public:
+  using UpdateListener = std::function<void(const ApiServerConfiguration&)>;
+
   cpp::result<ApiServerConfiguration, std::string> UpdateApiServerConfiguration(
       const Json::Value& json);
 
   cpp::result<ApiServerConfiguration, std::string> GetApiServerConfiguration();
+
+  /**
+   * Run listener with the new configuration after every update, so services
+   * can apply settings that change at runtime. Returns an id for
+   * RemoveUpdateListener.
+   */
+  int AddUpdateListener(UpdateListener listener);
+
+  void RemoveUpdateListener(int id);
+
+ private:
+  std::mutex listeners_mutex_;
+  std::unordered_map<int, UpdateListener> listeners_;
+  int next_listener_id_ = 0;
 };
@@ -1,60 +1,50 @@
 #include "download_service.h"
 #include <curl/curl.h>
 #include <stdio.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <filesystem>
 #include <mutex>
 #include <optional>
 #include <ostream>
 #include <utility>
+#include "common/api_server_configuration.h"
+#include "utils/config_yaml_utils.h"
 #include "utils/curl_utils.h"
 #include "utils/format_utils.h"
+#include "utils/hardware/cpu_budget.h"
 #include "utils/logging_utils.h"
 #include "utils/result.hpp"
+#include "utils/sha256_utils.h"
 #include "utils/string_utils.h"
 
 namespace {
-size_t WriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-  size_t written = fwrite(ptr, size, nmemb, (FILE*)userdata);
-  return written;
+// Transient failures worth another attempt of the same range
+bool IsRetriable(CURLcode result, long response_code) {
+  if (response_code == 429 || response_code >= 500) {
+    return true;
+  }
+  if (result == CURLE_OK) {
+    // The connection closed before the whole range arrived
+    return true;
+  }
+  if (result == CURLE_WRITE_ERROR || result == CURLE_ABORTED_BY_CALLBACK) {
+    return false;
+  }
+  return response_code < 400;
 }
 
-cpp::result<void, std::string> ProcessCompletedTransfers(CURLM* multi_handle) {
-  CURLMsg* msg;
-  int msgs_left;
-  while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
-    if (msg->msg == CURLMSG_DONE) {
-      auto handle = msg->easy_handle;
-      auto result = msg->data.result;
-
-      char* url = nullptr;
-      curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
-
-      if (result != CURLE_OK) {
-        CTL_ERR("Transfer failed for URL: " << url << " Error: "
-                                            << curl_easy_strerror(result));
-        // download failed
-        return cpp::fail("Transfer failed for URL: " + std::string(url) +
-                         " Error: " + curl_easy_strerror(result));
-      } else {
-        long response_code;
-        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
-        if (response_code == 200) {
-          CTL_INF("Transfer completed for URL: " << url);
-        } else {
-          CTL_ERR("Transfer failed with HTTP code: " << response_code
-                                                     << " for URL: " << url);
-          // download failed
-          return cpp::fail("Transfer failed with HTTP code: " +
-                           std::to_string(response_code) +
-                           " for URL: " + std::string(url));
-        }
-      }
-    }
-  }
-  return {};
+// Only the part of a segment that did not arrive yet
+std::string RemainingRange(uint64_t offset, uint64_t length, uint64_t written) {
+  return std::to_string(offset + written) + "-" +
+         std::to_string(offset + length - 1);
 }
 
 void SetUpProxy(CURL* handle, std::shared_ptr<ConfigService> config_service) {
+  if (config_service == nullptr) {
+    return;
+  }
   auto configuration = config_service->GetApiServerConfiguration();
   if (configuration.has_value()) {
     if (!configuration->proxy_url.empty()) {
@@ -99,6 +89,7 @@ void SetUpProxy(CURL* handle, std::shared_ptr<ConfigService> config_service) {
     CTL_ERR("Failed to get configuration");
   }
 }
+
 }  // namespace
 
 cpp::result<bool, std::string> DownloadService::AddDownloadTask(
@@ -121,7 +112,11 @@ cpp::result<bool, std::string> DownloadService::AddDownloadTask(
   }
 
   if (callback.has_value()) {
-    callback.value()(task);
+    try {
+      callback.value()(task);
+    } catch (const std::exception& e) {
+      return cpp::fail(static_cast<std::string>(e.what()));
+    }
   }
   return has_task_done;
 }
@@ -185,9 +180,11 @@ cpp::result<bool, std::string> DownloadService::Download(
                                      << " - " << existing_file_size);
       CTL_INF("Download item size: " << download_item.bytes.value());
       auto missing_bytes = download_item.bytes.value() - existing_file_size;
+      // A linked blob is shared with other models, it is never appended to
       if (missing_bytes > 0 &&
           download_item.localPath.extension().string() != ".yaml" &&
-          download_item.localPath.extension().string() != ".yml") {
+          download_item.localPath.extension().string() != ".yml" &&
+          !file_io_utils::IsSharedLink(download_item.localPath)) {
         CLI_LOG("Found unfinished download! Additional "
                 << format_utils::BytesToHumanReadable(missing_bytes)
                 << " need to be downloaded.");
@@ -219,11 +216,23 @@ cpp::result<bool, std::string> DownloadService::Download(
     }
   }
 
+  if (mode == "wb") {
+    // A new file rather than a truncated one
+    std::error_code ec;
+    std::filesystem::remove(download_item.localPath, ec);
+  }
   auto file = fopen(download_item.localPath.string().c_str(), mode.c_str());
   if (!file) {
     return cpp::fail("Failed to open output file " +
                      download_item.localPath.string());
   }
+  DownloadingData dl_data{.task_id = download_id,
+                          .item_id = download_item.id,
+                          .download_service = this,
+                          .file = file};
+  if (download_item.checksum.has_value()) {
+    dl_data.hasher = std::make_unique<sha256_utils::Sha256>();
+  }
 
   curl_easy_setopt(curl, CURLOPT_URL, download_item.downloadUrl.c_str());
   auto headers = curl_utils::GetHeaders(download_item.downloadUrl);
@@ -240,7 +249,7 @@ cpp::result<bool, std::string> DownloadService::Download(
 
   SetUpProxy(curl, config_service_);
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, file);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &dl_data);
   curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
@@ -248,6 +257,16 @@ cpp::result<bool, std::string> DownloadService::Download(
     try {
       curl_off_t local_file_size =
           std::filesystem::file_size(download_item.localPath);
+      // Only the part on disk needs hashing, the rest is hashed as it arrives
+      if (dl_data.hasher != nullptr) {
+        auto r = sha256_utils::UpdateFromFile(
+            *dl_data.hasher, download_item.localPath, local_file_size);
+        if (r.has_error()) {
+          fclose(file);
+          curl_easy_cleanup(curl);
+          return cpp::fail(r.error());
+        }
+      }
       curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, local_file_size);
     } catch (const std::filesystem::filesystem_error& e) {
       CTL_ERR("Cannot get file size: " << e.what() << '\n');
@@ -263,6 +282,12 @@ cpp::result<bool, std::string> DownloadService::Download(
 
   fclose(file);
   curl_easy_cleanup(curl);
+
+  if (auto r = VerifyChecksum(download_item, dl_data); r.has_error()) {
+    std::error_code ec;
+    std::filesystem::remove(download_item.localPath, ec);
+    return cpp::fail(r.error());
+  }
   return true;
 }
 
@@ -272,6 +297,9 @@ cpp::result<std::string, std::string> DownloadService::StopTask(
   CTL_INF("Stopping task: " << task_id);
   auto cancelled = task_queue_.cancelTask(task_id);
   if (cancelled) {
+    if (download_tasks_ != nullptr) {
+      download_tasks_->DeleteDownloadTask(task_id);
+    }
     return task_id;
   }
   CTL_INF("Not found in pending task, try to find task " + task_id +
@@ -285,6 +313,7 @@ cpp::result<std::string, std::string> DownloadService::StopTask(
       std::lock_guard<std::mutex> lock(stop_mutex_);
       tasks_to_stop_.insert(task_id);
     }
+    poller_.Wakeup();
     return task_id;
   }
 
@@ -293,28 +322,61 @@ cpp::result<std::string, std::string> DownloadService::StopTask(
 }
 
 void DownloadService::InitializeWorkers() {
-  for (auto i = 0; i < MAX_CONCURRENT_TASKS; ++i) {
-    auto worker_data = std::make_unique<WorkerData>();
-    worker_data->multi_handle = curl_multi_init();
-    worker_data_.push_back(std::move(worker_data));
-
-    worker_threads_.emplace_back([this, i]() { this->WorkerThread(i); });
-    CTL_INF("Starting worker thread: " << i);
+  multi_handle_ = curl_multi_init();
+  curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+  curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(multi_handle_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+  curl_multi_setopt(multi_handle_, CURLMOPT_TIMERDATA, this);
+
+  if (config_service_ != nullptr) {
+    if (auto configuration = config_service_->GetApiServerConfiguration();
+        configuration.has_value()) {
+      SetRateLimits(configuration.value());
+      SetMirrors(configuration.value());
+    }
+    config_listener_id_ = config_service_->AddUpdateListener(
+        [this](const ApiServerConfiguration& configuration) {
+          SetRateLimits(configuration);
+          SetMirrors(configuration);
+        });
   }
+
+  writer_ = std::make_unique<file_io_utils::AsyncFileWriter>(
+      kWriteBufferSize, kWriteBuffers, [this] {
+        buffer_released_ = true;
+        poller_.Wakeup();
+      });
+  worker_thread_ = std::thread([this]() { this->WorkerThread(); });
+  progress_thread_ = std::thread([this]() { this->ProgressThread(); });
+  CTL_INF("Starting download worker thread");
 }
 
 void DownloadService::Shutdown() {
-  stop_flag_ = true;
-  task_cv_.notify_all();  // Wake up all waiting threads
+  if (config_service_ != nullptr && config_listener_id_ >= 0) {
+    config_service_->RemoveUpdateListener(config_listener_id_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    stop_flag_ = true;
+  }
+  poller_.Wakeup();
+  progress_cv_.notify_all();
 
-  for (auto& thread : worker_threads_) {
-    if (thread.joinable()) {
-      thread.join();
-    }
+  if (worker_thread_.joinable()) {
+    worker_thread_.join();
   }
+  if (progress_thread_.joinable()) {
+    progress_thread_.join();
+  }
+  writer_.reset();
+  for (auto& finalizer : finalizers_) {
+    finalizer.wait();
+  }
+  finalizers_.clear();
 
-  for (auto& worker_data : worker_data_) {
-    curl_multi_cleanup(worker_data->multi_handle);
+  if (multi_handle_ != nullptr) {
+    curl_multi_cleanup(multi_handle_);
+    multi_handle_ = nullptr;
   }
 
   // Clean up any remaining callbacks
@@ -322,90 +384,1154 @@ void DownloadService::Shutdown() {
   callbacks_.clear();
 }
 
-void DownloadService::WorkerThread(int worker_id) {
-  auto& worker_data = worker_data_[worker_id];
+void DownloadService::WorkerThread() {
+  cortex::hw::CpuBudget::GetInstance().PinCurrentThreadToBackground();
 
+  auto last_state_save = std::chrono::steady_clock::now();
   while (!stop_flag_) {
-    std::unique_lock<std::mutex> lock(task_mutex_);
+    ApplyRateLimits();
+    AdmitTasks();
+    StartWaitingTransfers();
+    DriveTransfers();
+    ProcessCompletedTransfers();
+    RestartDueTransfers();
+    CheckTransfers();
+    if ((next_resume_.has_value() &&
+         next_resume_.value() <= std::chrono::steady_clock::now()) ||
+        (buffer_released_.exchange(false) && waiting_for_buffer_ > 0)) {
+      ResumePausedTransfers();
+    }
 
-    // Wait for a task or stop signal
-    task_cv_.wait(lock, [this] {
-      auto pending_task = task_queue_.getNextPendingTask();
-      return pending_task.has_value() || stop_flag_;
+    if (auto now = std::chrono::steady_clock::now();
+        now - last_state_save >= kStateSaveInterval) {
+      for (auto& download : downloads_) {
+        SaveItemStates(*download);
+      }
+      last_state_save = now;
+    }
+
+    RetireTasks();
+    std::erase_if(finalizers_, [](const std::future<void>& finalizer) {
+      return finalizer.wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready;
     });
+  }
 
-    if (stop_flag_) {
+  // Keep what arrived so the tasks resume when they are added again
+  for (auto& download : downloads_) {
+    download->failure = ProcessDownloadFailed{
+        .message = "Download stopped",
+        .task_id = download->task.id,
+        .type = DownloadEventType::DownloadStopped,
+    };
+  }
+  RetireTasks();
+  writer_->Drain();
+  RetireTasks();
+}
+
+bool DownloadService::AdmitsMoreTasks() const {
+  if (running_transfers_ + waiting_transfers_ < kMaxConnections) {
+    return true;
+  }
+  // A more urgent task gets in while lower classes hold the connections,
+  // unless a transfer of its class or above is still waiting for one
+  auto top = task_queue_.topPriority();
+  if (!top.has_value() || downloads_.empty() ||
+      downloads_.back()->priority <= top.value()) {
+    return false;
+  }
+  for (const auto& download : downloads_) {
+    if (download->priority > top.value()) {
       break;
     }
+    if (!download->waiting.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
 
+void DownloadService::AdmitTasks() {
+  while (AdmitsMoreTasks()) {
     auto maybe_task = task_queue_.pop();
-    lock.unlock();
-
-    if (!maybe_task || maybe_task->status == DownloadTask::Status::Cancelled) {
+    if (!maybe_task.has_value()) {
+      break;
+    }
+    if (maybe_task->status == DownloadTask::Status::Cancelled) {
       continue;
     }
 
-    auto task = std::move(maybe_task.value());
-
-    // Register active task
+    auto download = std::make_unique<TaskDownload>();
+    download->task = std::move(maybe_task.value());
+    download->task.status = DownloadTask::Status::InProgress;
+    download->priority = download->task.GetPriority();
+    auto settings = GetDownloadSettings();
+    download->max_segments = settings.segments;
+    download->direct_io = settings.direct_io;
+    download->keep_archives = settings.keep_archives;
+    progress_interval_ms_ = settings.progress_interval.count();
     {
-      std::lock_guard<std::mutex> active_lock(active_tasks_mutex_);
-      active_tasks_[task.id] = std::make_shared<DownloadTask>(task);
+      std::lock_guard<std::mutex> lock(active_tasks_mutex_);
+      active_tasks_[download->task.id] =
+          std::make_shared<DownloadTask>(download->task);
+      unsaved_tasks_.insert(download->task.id);
     }
 
-    ProcessTask(task, worker_id);
+    // Items are always probed first, on every mirror. Besides byte ranges
+    // the probe returns the validators that make a later resume safe, and
+    // the latency of each mirror.
+    for (const auto& item : download->task.items) {
+      auto dl_item = std::make_unique<ItemDownload>();
+      dl_item->task = download.get();
+      dl_item->item = item;
+      dl_item->progress = std::make_shared<ItemProgress>();
+      for (const auto& url :
+           mirror_utils::SourceUrls(item.downloadUrl, settings.mirrors)) {
+        auto parts = mirror_utils::SplitUrl(url);
+        dl_item->sources.push_back(ItemSource{
+            .url = url,
+            .origin = parts.has_value() ? parts->origin : url,
+        });
+      }
+      auto initialized = ProbeItem(*download, *dl_item);
+      download->items.push_back(std::move(dl_item));
+      if (!initialized) {
+        download->failure = ProcessDownloadFailed{
+            .message = "Failed to init curl!",
+            .task_id = download->task.id,
+            .type = DownloadEventType::DownloadError,
+        };
+        break;
+      }
+    }
 
-    // Remove from active tasks
+    CTL_INF("Task admitted: " << download->task.id);
+    EmitTaskStarted(download->task);
     {
-      std::lock_guard<std::mutex> active_lock(active_tasks_mutex_);
-      active_tasks_.erase(task.id);
+      std::lock_guard<std::mutex> lock(progress_mutex_);
+      auto& progress = progress_[download->task.id];
+      for (const auto& dl_item : download->items) {
+        progress.push_back(dl_item->progress);
+      }
     }
+    progress_cv_.notify_one();
+
+    // Keep the tasks ordered by priority, FIFO within a class
+    auto position = std::find_if(
+        downloads_.begin(), downloads_.end(), [&download](const auto& other) {
+          return other->priority > download->priority;
+        });
+    downloads_.insert(position, std::move(download));
   }
 }
 
-void DownloadService::ProcessTask(DownloadTask& task, int worker_id) {
-  auto& worker_data = worker_data_[worker_id];
-  std::vector<std::pair<CURL*, FILE*>> task_handles;
+bool DownloadService::ProbeItem(TaskDownload& download,
+                                ItemDownload& dl_item) {
+  for (size_t i = 0; i < dl_item.sources.size(); i++) {
+    auto probe = std::make_shared<DownloadingData>(DownloadingData{
+        .task_id = download.task.id,
+        .item_id = dl_item.item.id,
+        .download_service = this,
+        .item = &dl_item,
+        .handle = curl_easy_init(),
+        .probe = true,
+        .source = i,
+    });
+    dl_item.probes.push_back(probe);
+    if (probe->handle == nullptr) {
+      return false;
+    }
+    SetUpCurlHandle(probe->handle, probe.get());
+    QueueTransfer(download, probe.get());
+    dl_item.probing++;
+    download.unfinished++;
+  }
+  return true;
+}
 
-  task.status = DownloadTask::Status::InProgress;
-  for (const auto& item : task.items) {
-    auto handle = curl_easy_init();
-    if (!handle) {
-      CTL_ERR("Failed to init curl!");
-      return;
+void DownloadService::QueueTransfer(TaskDownload& download,
+                                    DownloadingData* dl_data) {
+  download.waiting.push_back(dl_data);
+  waiting_transfers_++;
+}
+
+void DownloadService::StartWaitingTransfers() {
+  PreemptTransfers();
+
+  // Classes in order. Within a class one transfer per task and round, so a
+  // large task cannot take every connection before the next one gets its
+  // first
+  for (auto group = downloads_.begin();
+       group != downloads_.end() && running_transfers_ < kMaxConnections;) {
+    auto priority = (*group)->priority;
+    auto group_end = std::find_if(
+        group, downloads_.end(),
+        [priority](const auto& other) { return other->priority != priority; });
+    auto started = true;
+    while (started && running_transfers_ < kMaxConnections) {
+      started = false;
+      for (auto it = group; it != group_end; ++it) {
+        auto& download = **it;
+        if (download.waiting.empty() || download.failure.has_value() ||
+            download.running >= kMaxTaskConnections ||
+            running_transfers_ >= kMaxConnections) {
+          continue;
+        }
+        auto dl_data = download.waiting.front();
+        download.waiting.pop_front();
+        waiting_transfers_--;
+        curl_multi_add_handle(multi_handle_, dl_data->handle);
+        dl_data->active = true;
+        dl_data->started = std::chrono::steady_clock::now();
+        dl_data->last_data = dl_data->started;
+        download.running++;
+        running_transfers_++;
+        started = true;
+      }
     }
-    auto file = fopen(item.localPath.string().c_str(), "wb");
-    if (!file) {
-      CTL_ERR("Failed to open output file " + item.localPath.string());
-      curl_easy_cleanup(handle);
+    group = group_end;
+  }
+}
+
+void DownloadService::PreemptTransfers() {
+  auto free = kMaxConnections - running_transfers_;
+  for (auto& download : downloads_) {
+    if (download->failure.has_value()) {
+      continue;
+    }
+    free -= std::min(static_cast<int>(download->waiting.size()),
+                     kMaxTaskConnections - download->running);
+    // Lowest classes give up their connections first
+    for (auto victim = downloads_.rbegin();
+         free < 0 && victim != downloads_.rend() &&
+         (*victim)->priority > download->priority;
+         ++victim) {
+      for (auto& dl_item : (*victim)->items) {
+        for (auto& dl_data : dl_item->segments) {
+          // A single stream would start over, a range continues later
+          if (free >= 0 || !dl_data->active || dl_data->paused ||
+              dl_data->length == 0) {
+            continue;
+          }
+          DetachTransfer(**victim, *dl_data);
+          auto range = RemainingRange(dl_data->offset, dl_data->length,
+                                      dl_data->written);
+          curl_easy_setopt(dl_data->handle, CURLOPT_RANGE, range.c_str());
+          (*victim)->waiting.push_front(dl_data.get());
+          waiting_transfers_++;
+          free++;
+        }
+      }
+    }
+    if (free <= 0) {
+      // Lower classes must not take what this one is still missing
       return;
     }
-    auto dl_data_ptr = std::make_shared<DownloadingData>(DownloadingData{
-        .task_id = task.id,
+  }
+}
+
+void DownloadService::DriveTransfers() {
+  auto now = std::chrono::steady_clock::now();
+  auto wait = std::chrono::milliseconds(MAX_WAIT_MSECS);
+  for (const auto& deadline : {curl_timer_, next_retry_, next_resume_}) {
+    if (deadline.has_value()) {
+      wait = std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline.value() - now),
+                        std::chrono::milliseconds(0), wait);
+    }
+  }
+
+  auto running = 0;
+  for (const auto& event : poller_.Wait(static_cast<int>(wait.count()))) {
+    auto flags = (event.readable ? CURL_CSELECT_IN : 0) |
+                 (event.writable ? CURL_CSELECT_OUT : 0) |
+                 (event.error ? CURL_CSELECT_ERR : 0);
+    curl_multi_socket_action(multi_handle_, event.socket, flags, &running);
+  }
+  if (curl_timer_.has_value() &&
+      curl_timer_.value() <= std::chrono::steady_clock::now()) {
+    curl_timer_.reset();
+    curl_multi_socket_action(multi_handle_, CURL_SOCKET_TIMEOUT, 0, &running);
+  }
+}
+
+int DownloadService::SocketCallback(CURL* easy, curl_socket_t socket, int what,
+                                    void* userp, void* socketp) {
+  auto dl_srv = static_cast<DownloadService*>(userp);
+  if (what == CURL_POLL_REMOVE) {
+    dl_srv->poller_.Remove(socket);
+  } else {
+    dl_srv->poller_.Watch(socket, (what & CURL_POLL_IN) != 0,
+                          (what & CURL_POLL_OUT) != 0);
+  }
+  return 0;
+}
+
+int DownloadService::TimerCallback(CURLM* multi, long timeout_ms,
+                                   void* userp) {
+  auto dl_srv = static_cast<DownloadService*>(userp);
+  if (timeout_ms < 0) {
+    dl_srv->curl_timer_.reset();
+  } else {
+    dl_srv->curl_timer_ = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(timeout_ms);
+  }
+  return 0;
+}
+
+cpp::result<void, std::string> DownloadService::StartItem(
+    ItemDownload& dl_item) {
+  auto& download = *dl_item.task;
+  const auto& item = dl_item.item;
+  const auto& support = dl_item.support;
+
+  auto resumed = false;
+  auto extracted = item.extractPath.has_value();
+  if (support.accept_ranges && !extracted) {
+    auto saved = DownloadState::Load(item.localPath);
+    std::error_code ec;
+    if (saved.has_value() && saved->url == item.downloadUrl &&
+        saved->size == support.size && saved->etag == support.etag &&
+        saved->last_modified == support.last_modified &&
+        !saved->Validator().empty() &&
+        std::filesystem::file_size(item.localPath, ec) == saved->size &&
+        !ec && !file_io_utils::IsSharedLink(item.localPath)) {
+      dl_item.state = std::move(saved.value());
+      resumed = true;
+    } else {
+      dl_item.state = DownloadState{.url = item.downloadUrl,
+                                    .size = support.size,
+                                    .etag = support.etag,
+                                    .last_modified = support.last_modified};
+      for (const auto& [offset, length] :
+           PlanSegments(support.size, download.max_segments)) {
+        dl_item.state->segments.push_back(
+            DownloadState::Segment{.offset = offset, .length = length});
+      }
+    }
+  }
+
+  if (!extracted || download.keep_archives) {
+    auto file = file_io_utils::RandomAccessFile::Open(
+        item.localPath, !resumed, download.direct_io);
+    if (file.has_error()) {
+      return cpp::fail(file.error());
+    }
+    dl_item.file = std::move(file.value());
+  }
+  if (extracted) {
+    dl_item.extractor = std::make_unique<archive_utils::StreamingExtractor>(
+        item.extractPath.value(), item.ignoreParentDir, kExtractBufferBytes,
+        [this] {
+          buffer_released_ = true;
+          poller_.Wakeup();
+        });
+  }
+
+  std::vector<DownloadState::Segment> segments{{}};
+  if (dl_item.state.has_value()) {
+    dl_item.total = dl_item.state->size;
+    segments = dl_item.state->segments;
+    if (!resumed) {
+      if (auto r = dl_item.file->Preallocate(dl_item.total); r.has_error()) {
+        return cpp::fail(r.error());
+      }
+    }
+  }
+  if (dl_item.state.has_value() && !dl_item.state->Validator().empty()) {
+    if (auto r = dl_item.state->Save(item.localPath); r.has_error()) {
+      CTL_WRN(r.error());
+    }
+  } else {
+    DownloadState::Remove(item.localPath);
+  }
+
+  uint64_t done = 0;
+  for (const auto& segment : segments) {
+    done += segment.written;
+  }
+  dl_item.progress->total.store(dl_item.total, std::memory_order_relaxed);
+  dl_item.progress->downloaded.store(done, std::memory_order_relaxed);
+
+  if (resumed) {
+    CTL_INF("Resuming " << item.localPath.filename().string() << " at "
+                        << done << " of " << dl_item.total << " bytes");
+  } else if (segments.size() > 1) {
+    CTL_INF("Downloading " << item.localPath.filename().string() << " in "
+                           << segments.size() << " segments");
+  }
+
+  // The first byte ranges go to different mirrors, which measures each of
+  // them on real data, the rest to the best one
+  auto ranked = RankSources(dl_item, dl_item.state.has_value());
+  if (ranked.empty()) {
+    ranked.push_back(dl_item.reference);
+  }
+  size_t started = 0;
+  for (const auto& segment : segments) {
+    auto dl_data = std::make_shared<DownloadingData>(DownloadingData{
+        .task_id = download.task.id,
         .item_id = item.id,
         .download_service = this,
+        .item = &dl_item,
+        .offset = segment.offset,
+        .length = segment.length,
+        .written = segment.written,
+        .stream =
+            std::make_shared<file_io_utils::WriteStream>(segment.written),
     });
-    worker_data->downloading_data_map[item.id] = dl_data_ptr;
+    dl_item.segments.push_back(dl_data);
+    if (segment.length > 0 && item.checksum.has_value() &&
+        dl_item.prefix_hash == nullptr) {
+      dl_item.prefix_hash = std::make_unique<PrefixHash>();
+    }
+    if (segment.length > 0 && segment.written == segment.length) {
+      // Finished before the download was interrupted
+      continue;
+    }
+    if (segment.length == 0 && item.checksum.has_value()) {
+      dl_data->hasher = std::make_unique<sha256_utils::Sha256>();
+    }
+
+    dl_data->handle = curl_easy_init();
+    if (!dl_data->handle) {
+      return cpp::fail(static_cast<std::string>("Failed to init curl!"));
+    }
+    dl_data->source = ranked[started < ranked.size() ? started : 0];
+    started++;
+    SetUpCurlHandle(dl_data->handle, dl_data.get());
+    QueueTransfer(download, dl_data.get());
+    download.unfinished++;
+  }
+  return {};
+}
+
+void DownloadService::SaveItemStates(TaskDownload& download) {
+  for (auto& dl_item : download.items) {
+    if (!dl_item->state.has_value() || dl_item->file == nullptr ||
+        dl_item->state->Validator().empty()) {
+      continue;
+    }
+    // Data first, so the recorded progress never runs ahead of the disk
+    if (!dl_item->file->Sync()) {
+      CTL_WRN("Failed to sync " << dl_item->item.localPath.string());
+      continue;
+    }
+    for (size_t i = 0; i < dl_item->segments.size(); i++) {
+      dl_item->state->segments[i].written =
+          dl_item->segments[i]->stream->Durable();
+    }
+    if (auto r = dl_item->state->Save(dl_item->item.localPath);
+        r.has_error()) {
+      CTL_WRN(r.error());
+    }
+  }
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> DownloadService::PlanSegments(
+    uint64_t size, int max_segments) {
+  auto count = std::clamp<uint64_t>(size / kMinSegmentBytes, 1,
+                                    std::max(max_segments, 1));
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  uint64_t offset = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    auto length = size / count + (i < size % count ? 1 : 0);
+    ranges.emplace_back(offset, length);
+    offset += length;
+  }
+  return ranges;
+}
+
+DownloadService::DownloadSettings DownloadService::GetDownloadSettings()
+    const {
+  DownloadSettings settings{
+      .segments = config_yaml_utils::kDefaultDownloadSegments,
+      .progress_interval = std::chrono::milliseconds(
+          config_yaml_utils::kDefaultDownloadProgressIntervalMs),
+      .direct_io = config_yaml_utils::kDefaultDownloadDirectIo,
+      .keep_archives = config_yaml_utils::kDefaultDownloadKeepArchives,
+  };
+  {
+    std::lock_guard<std::mutex> lock(mirrors_mutex_);
+    settings.mirrors = mirrors_;
+  }
+  if (config_service_ == nullptr) {
+    return settings;
+  }
+  auto configuration = config_service_->GetApiServerConfiguration();
+  if (configuration.has_error()) {
+    return settings;
+  }
+  settings.segments = std::clamp(configuration->download_segments, 1,
+                                 ApiServerConfiguration::kMaxDownloadSegments);
+  settings.progress_interval = std::chrono::milliseconds(std::clamp(
+      configuration->download_progress_interval_ms,
+      ApiServerConfiguration::kMinDownloadProgressIntervalMs,
+      ApiServerConfiguration::kMaxDownloadProgressIntervalMs));
+  settings.direct_io = configuration->download_direct_io;
+  settings.keep_archives = configuration->download_keep_archives;
+  return settings;
+}
+
+void DownloadService::ProcessCompletedTransfers() {
+  CURLMsg* msg;
+  int msgs_left;
+  while ((msg = curl_multi_info_read(multi_handle_, &msgs_left))) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    auto handle = msg->easy_handle;
+    auto result = msg->data.result;
+
+    DownloadingData* dl_data = nullptr;
+    char* url = nullptr;
+    long response_code = 0;
+    curl_easy_getinfo(handle, CURLINFO_PRIVATE, &dl_data);
+    curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+    std::string effective_url = url != nullptr ? url : "";
+
+    auto& download = *dl_data->item->task;
+    curl_multi_remove_handle(multi_handle_, handle);
+    dl_data->active = false;
+    download.running--;
+    running_transfers_--;
+
+    if (dl_data->probe) {
+      auto& dl_item = *dl_data->item;
+      auto& source = dl_item.sources[dl_data->source];
+      auto& support = source.support;
+      curl_off_t content_length = -1;
+      curl_easy_getinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                        &content_length);
+      if (result != CURLE_OK) {
+        CTL_WRN("Range probe failed for " << effective_url << ": "
+                                          << curl_easy_strerror(result));
+        support = RangeSupport{};
+        mirror_health_.RecordFailure(source.origin,
+                                     curl_easy_strerror(result));
+      } else if (response_code != 200 || content_length <= 0) {
+        support.accept_ranges = false;
+        if (response_code != 200) {
+          mirror_health_.RecordFailure(
+              source.origin, "HTTP code: " + std::to_string(response_code));
+        }
+      } else {
+        support.size = static_cast<uint64_t>(content_length);
+      }
+      if (result == CURLE_OK && response_code == 200) {
+        curl_off_t latency_us = 0;
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &latency_us);
+        mirror_health_.RecordLatency(source.origin, latency_us / 1000.0);
+        mirror_health_.RecordSuccess(source.origin);
+        source.usable = true;
+      }
+      curl_easy_cleanup(handle);
+      curl_slist_free_all(dl_data->headers);
+      dl_data->handle = nullptr;
+      dl_data->headers = nullptr;
+      download.unfinished--;
+      if (--dl_item.probing > 0) {
+        continue;
+      }
+
+      // The item's own URL decides about ranges and validators, a mirror
+      // only when that one is down. Mirrors serving another size are not
+      // used.
+      auto reference = std::find_if(
+          dl_item.sources.begin(), dl_item.sources.end(),
+          [](const ItemSource& other) { return other.usable; });
+      dl_item.reference = reference != dl_item.sources.end()
+                              ? reference - dl_item.sources.begin()
+                              : 0;
+      dl_item.support = dl_item.sources[dl_item.reference].support;
+      for (auto& other : dl_item.sources) {
+        if (other.usable && other.support.size != dl_item.support.size) {
+          CTL_WRN("Not using " << other.url << ", it serves "
+                               << other.support.size << " instead of "
+                               << dl_item.support.size << " bytes");
+          other.usable = false;
+        }
+      }
+      if (auto r = StartItem(dl_item); r.has_error()) {
+        CTL_ERR(r.error());
+        download.failure = ProcessDownloadFailed{
+            .message = r.error(),
+            .task_id = download.task.id,
+            .type = DownloadEventType::DownloadError,
+        };
+      }
+      continue;
+    }
 
-    SetUpCurlHandle(handle, item, file, dl_data_ptr.get());
-    curl_multi_add_handle(worker_data->multi_handle, handle);
-    task_handles.push_back(std::make_pair(handle, file));
+    SubmitBuffer(*dl_data);
+    if (dl_data->item->changed) {
+      RestartItem(download, *dl_data->item);
+      continue;
+    }
+    auto expected_code = dl_data->length > 0 ? 206 : 200;
+    auto complete =
+        dl_data->length == 0 || dl_data->written == dl_data->length;
+    if (result == CURLE_OK && response_code == expected_code && complete) {
+      CTL_INF("Transfer completed for URL: " << effective_url);
+      SampleThroughput(*dl_data);
+      mirror_health_.RecordSuccess(
+          dl_data->item->sources[dl_data->source].origin);
+      dl_data->done = true;
+      download.unfinished--;
+      continue;
+    }
+
+    std::string error;
+    if (!dl_data->error.empty()) {
+      error = dl_data->error;
+    } else if (result != CURLE_OK) {
+      error = "Error: " + std::string(curl_easy_strerror(result));
+    } else if (response_code != expected_code) {
+      error = "HTTP code: " + std::to_string(response_code);
+    } else {
+      error = "Received " + std::to_string(dl_data->written) + " of " +
+              std::to_string(dl_data->length) + " bytes";
+    }
+
+    HandleTransferFailure(download, *dl_data, error,
+                          IsRetriable(result, response_code));
+  }
+}
+
+void DownloadService::HandleTransferFailure(TaskDownload& download,
+                                            DownloadingData& dl_data,
+                                            const std::string& error,
+                                            bool retriable) {
+  const auto& url = dl_data.item->sources[dl_data.source].url;
+  // A local write error is no fault of the mirror
+  if (!dl_data.stream->Failed()) {
+    mirror_health_.RecordFailure(dl_data.item->sources[dl_data.source].origin,
+                                 error);
+    if (FailOver(dl_data)) {
+      CTL_WRN("Transfer failed for URL: "
+              << url << " " << error << ", continuing from "
+              << dl_data.item->sources[dl_data.source].url);
+      return;
+    }
+  }
+
+  if (dl_data.retries < kMaxSegmentRetries && retriable) {
+    dl_data.retries++;
+    auto delay = std::chrono::seconds(1 << (dl_data.retries - 1));
+    CTL_WRN("Transfer failed for URL: " << url << " " << error << ", retry "
+                                        << dl_data.retries << " in "
+                                        << delay.count() << "s");
+    dl_data.retry_at = std::chrono::steady_clock::now() + delay;
+    return;
+  }
+
+  CTL_ERR("Transfer failed for URL: " << url << " " << error);
+  if (!download.failure.has_value()) {
+    download.failure = ProcessDownloadFailed{
+        .message = "Transfer failed for URL: " + url + " " + error,
+        .task_id = download.task.id,
+        .type = DownloadEventType::DownloadError,
+    };
+  }
+}
+
+bool DownloadService::FailOver(DownloadingData& dl_data) {
+  if (dl_data.failovers >= kMaxFailovers) {
+    return false;
+  }
+  auto next = PickSource(*dl_data.item, dl_data.length > 0, dl_data.source);
+  if (next == dl_data.source) {
+    return false;
+  }
+  dl_data.failovers++;
+  dl_data.source = next;
+  // Right away, the new mirror continues at offset + written
+  auto now = std::chrono::steady_clock::now();
+  dl_data.retry_at = now;
+  next_retry_ = now;
+  return true;
+}
+
+std::vector<size_t> DownloadService::RankSources(const ItemDownload& dl_item,
+                                                 bool ranged) const {
+  auto now = std::chrono::steady_clock::now();
+  // Lower is better: mirrors in their failure cooldown come last
+  std::vector<std::tuple<bool, double, size_t>> ranks;
+  for (size_t i = 0; i < dl_item.sources.size(); i++) {
+    const auto& source = dl_item.sources[i];
+    if (!source.usable || (ranged && !source.support.accept_ranges)) {
+      continue;
+    }
+    ranks.emplace_back(
+        !mirror_health_.IsAvailable(source.origin, now),
+        mirror_health_.EstimatedSeconds(source.origin, kMinSegmentBytes), i);
   }
+  std::sort(ranks.begin(), ranks.end());
+  std::vector<size_t> ranked;
+  for (const auto& rank : ranks) {
+    ranked.push_back(std::get<2>(rank));
+  }
+  return ranked;
+}
 
-  EmitTaskStarted(task);
+size_t DownloadService::PickSource(const ItemDownload& dl_item, bool ranged,
+                                   std::optional<size_t> exclude) const {
+  for (auto i : RankSources(dl_item, ranged)) {
+    if (i != exclude) {
+      return i;
+    }
+  }
+  // Without another usable source the transfer stays where it is
+  return exclude.value_or(dl_item.reference);
+}
 
-  auto result =
-      ProcessMultiDownload(task, worker_data->multi_handle, task_handles);
+void DownloadService::RestartDueTransfers() {
+  next_retry_.reset();
+  auto now = std::chrono::steady_clock::now();
+  for (auto& download : downloads_) {
+    for (auto& dl_item : download->items) {
+      if (dl_item->restarting) {
+        // The old data must not land on top of the new file
+        auto writing = std::any_of(
+            dl_item->segments.begin(), dl_item->segments.end(),
+            [](const auto& dl_data) { return !dl_data->stream->Idle(); });
+        auto hashing = dl_item->prefix_hash != nullptr &&
+                       dl_item->prefix_hash->pending.valid() &&
+                       dl_item->prefix_hash->pending.wait_for(
+                           std::chrono::seconds(0)) !=
+                           std::future_status::ready;
+        if (writing || hashing || download->failure.has_value()) {
+          continue;
+        }
+        dl_item->restarting = false;
+        dl_item->segments.clear();
+        dl_item->prefix_hash.reset();
+        dl_item->probes.clear();
+        dl_item->file.reset();
+        for (auto& source : dl_item->sources) {
+          source.support = RangeSupport{};
+          source.usable = false;
+        }
+        download->unfinished--;
+        if (!ProbeItem(*download, *dl_item)) {
+          download->failure = ProcessDownloadFailed{
+              .message = "Failed to init curl!",
+              .task_id = download->task.id,
+              .type = DownloadEventType::DownloadError,
+          };
+        }
+        continue;
+      }
+      for (auto& dl_data : dl_item->segments) {
+        if (!dl_data->retry_at.has_value()) {
+          continue;
+        }
+        if (dl_data->retry_at.value() > now) {
+          if (!next_retry_.has_value() ||
+              dl_data->retry_at.value() < next_retry_.value()) {
+            next_retry_ = dl_data->retry_at;
+          }
+          continue;
+        }
+        if (dl_data->length == 0 && !dl_data->stream->Idle()) {
+          // Starting over waits for the writes of the failed attempt
+          continue;
+        }
+        dl_data->retry_at.reset();
+        dl_data->error.clear();
+        if (dl_data->length == 0) {
+          dl_data->item->progress->downloaded.fetch_sub(
+              dl_data->written, std::memory_order_relaxed);
+          dl_data->written = 0;
+          dl_data->stream = std::make_shared<file_io_utils::WriteStream>();
+          if (dl_data->hasher != nullptr) {
+            dl_data->hasher = std::make_unique<sha256_utils::Sha256>();
+          }
+          if (dl_item->extractor != nullptr) {
+            dl_item->extractor->Reset();
+          }
+        }
+        // The source may have changed since the last attempt
+        SetUpSource(dl_data.get());
+        QueueTransfer(*download, dl_data.get());
+      }
+    }
+  }
+}
 
-  // clean up
-  for (auto& [handle, file] : task_handles) {
-    curl_multi_remove_handle(worker_data->multi_handle, handle);
-    curl_easy_cleanup(handle);
-    fclose(file);
+void DownloadService::CheckTransfers() {
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_transfer_check_ < kTransferCheckInterval) {
+    return;
   }
+  last_transfer_check_ = now;
+
+  for (auto& download : downloads_) {
+    for (auto& dl_item : download->items) {
+      HashWrittenPrefix(*dl_item);
+      for (auto& dl_data : dl_item->segments) {
+        if (!dl_data->active) {
+          continue;
+        }
+        const auto& origin = dl_item->sources[dl_data->source].origin;
+        if (now - dl_data->started >= kTransferCheckInterval) {
+          SampleThroughput(*dl_data);
+        }
+
+        if (!dl_data->paused && now - dl_data->last_data > kStallTimeout) {
+          DetachTransfer(*download, *dl_data);
+          HandleTransferFailure(*download, *dl_data, "Transfer stalled", true);
+          continue;
+        }
 
-  if (result.has_error()) {
-    if (result.error().type == DownloadEventType::DownloadStopped) {
+        // A byte range left on a much slower mirror would finish last
+        auto remaining = dl_data->length - dl_data->written;
+        if (dl_data->length == 0 || dl_data->switched ||
+            remaining < kMinSegmentBytes / 4) {
+          continue;
+        }
+        auto best = PickSource(*dl_item, true);
+        auto speed = mirror_health_.Throughput(origin);
+        auto best_speed =
+            mirror_health_.Throughput(dl_item->sources[best].origin);
+        if (best == dl_data->source || !speed.has_value() ||
+            !best_speed.has_value() ||
+            speed.value() * kSlowFactor >= best_speed.value()) {
+          continue;
+        }
+        CTL_INF("Moving " << remaining << " bytes of "
+                          << dl_item->item.localPath.filename().string()
+                          << " from " << origin << " to "
+                          << dl_item->sources[best].origin);
+        DetachTransfer(*download, *dl_data);
+        dl_data->switched = true;
+        dl_data->source = best;
+        dl_data->retry_at = now;
+        next_retry_ = now;
+      }
+    }
+  }
+}
+
+void DownloadService::HashWrittenPrefix(ItemDownload& dl_item) {
+  auto& prefix = dl_item.prefix_hash;
+  if (prefix == nullptr || dl_item.restarting) {
+    return;
+  }
+  if (prefix->pending.valid()) {
+    if (prefix->pending.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready) {
+      return;
+    }
+    if (auto r = prefix->pending.get(); r.has_error()) {
+      // The item is hashed as a whole once complete
+      CTL_WRN(r.error());
+      prefix.reset();
+      return;
+    }
+  }
+
+  // Segments are in offset order, the prefix ends in the first one that is
+  // not written completely
+  uint64_t end = 0;
+  for (const auto& dl_data : dl_item.segments) {
+    if (dl_data->offset != end) {
+      break;
+    }
+    auto durable = dl_data->stream->Durable();
+    end += durable;
+    if (durable < dl_data->length) {
+      break;
+    }
+  }
+  if (end <= prefix->hashed) {
+    return;
+  }
+  prefix->pending = std::async(
+      std::launch::async, [p = prefix.get(), path = dl_item.item.localPath,
+                           end]() -> cpp::result<void, std::string> {
+        auto r = sha256_utils::UpdateFromFileRange(*p->hasher, path,
+                                                   p->hashed, end - p->hashed);
+        if (r.has_value()) {
+          p->hashed = end;
+        }
+        return r;
+      });
+}
+
+void DownloadService::SampleThroughput(const DownloadingData& dl_data) {
+  // Rate limits would be taken for the speed of the mirror
+  if (dl_data.paused || total_bucket_.Rate() > 0 ||
+      class_buckets_[static_cast<size_t>(dl_data.item->task->priority)]
+              .Rate() > 0) {
+    return;
+  }
+  curl_off_t speed = 0;
+  curl_easy_getinfo(dl_data.handle, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+  if (speed > 0) {
+    mirror_health_.RecordThroughput(
+        dl_data.item->sources[dl_data.source].origin,
+        static_cast<double>(speed));
+  }
+}
+
+void DownloadService::DetachTransfer(TaskDownload& download,
+                                     DownloadingData& dl_data) {
+  curl_multi_remove_handle(multi_handle_, dl_data.handle);
+  dl_data.active = false;
+  download.running--;
+  running_transfers_--;
+  // Resuming would touch a handle that is off the multi handle or gone
+  ForgetPausedTransfer(dl_data);
+  SubmitBuffer(dl_data);
+}
+
+void DownloadService::ForgetPausedTransfer(DownloadingData& dl_data) {
+  if (!dl_data.paused) {
+    return;
+  }
+  std::erase(paused_transfers_, &dl_data);
+  if (dl_data.paused_on_total) {
+    waiting_for_total_[static_cast<size_t>(dl_data.item->task->priority)]--;
+  }
+  if (dl_data.paused_on_buffer) {
+    waiting_for_buffer_--;
+  }
+  dl_data.paused = false;
+  dl_data.paused_on_total = false;
+  dl_data.paused_on_buffer = false;
+}
+
+void DownloadService::RestartItem(TaskDownload& download,
+                                  ItemDownload& dl_item) {
+  CTL_WRN(dl_item.item.localPath.filename().string()
+          << " changed on the server, downloading it again");
+  for (auto& dl_data : dl_item.segments) {
+    if (dl_data->handle == nullptr) {
+      continue;
+    }
+    if (dl_data->active) {
+      DetachTransfer(download, *dl_data);
+    }
+    SubmitBuffer(*dl_data);
+    curl_easy_cleanup(dl_data->handle);
+    dl_data->handle = nullptr;
+    curl_slist_free_all(dl_data->headers);
+    dl_data->headers = nullptr;
+    dl_data->retry_at.reset();
+    if (!dl_data->done) {
+      download.unfinished--;
+    }
+  }
+  auto waiting = download.waiting.size();
+  std::erase_if(download.waiting, [&dl_item](DownloadingData* dl_data) {
+    return dl_data->item == &dl_item;
+  });
+  waiting_transfers_ -= static_cast<int>(waiting - download.waiting.size());
+
+  dl_item.changed = false;
+  dl_item.restarting = true;
+  dl_item.restarted = true;
+  dl_item.state.reset();
+  DownloadState::Remove(dl_item.item.localPath);
+  // Held until the item is probed again, so the task does not finish
+  download.unfinished++;
+}
+
+void DownloadService::RetireTasks() {
+  for (auto it = downloads_.begin(); it != downloads_.end();) {
+    auto& download = **it;
+    if (!download.failure.has_value() && IsTaskTerminated(download.task.id)) {
+      download.failure = ProcessDownloadFailed{
+          .message = "Download stopped",
+          .task_id = download.task.id,
+          .type = DownloadEventType::DownloadStopped,
+      };
+    }
+    if (!download.failure.has_value() && download.unfinished > 0) {
+      ++it;
+      continue;
+    }
+
+    if (!download.detached) {
+      std::erase_if(paused_transfers_,
+                    [this, &download](DownloadingData* dl_data) {
+                      if (dl_data->item->task != &download) {
+                        return false;
+                      }
+                      if (dl_data->paused_on_total) {
+                        waiting_for_total_[static_cast<size_t>(
+                            download.priority)]--;
+                      }
+                      if (dl_data->paused_on_buffer) {
+                        waiting_for_buffer_--;
+                      }
+                      return true;
+                    });
+      for (auto& dl_item : download.items) {
+        auto transfers = dl_item->segments;
+        transfers.insert(transfers.end(), dl_item->probes.begin(),
+                         dl_item->probes.end());
+        for (auto& dl_data : transfers) {
+          if (dl_data->handle != nullptr) {
+            curl_multi_remove_handle(multi_handle_, dl_data->handle);
+            curl_easy_cleanup(dl_data->handle);
+            dl_data->handle = nullptr;
+          }
+          curl_slist_free_all(dl_data->headers);
+          dl_data->headers = nullptr;
+          dl_data->active = false;
+          dl_data->retry_at.reset();
+          SubmitBuffer(*dl_data);
+        }
+      }
+      running_transfers_ -= download.running;
+      waiting_transfers_ -= static_cast<int>(download.waiting.size());
+      download.running = 0;
+      download.waiting.clear();
+      download.detached = true;
+    }
+
+    // The files stay open until the writer is done with them
+    auto writing = false;
+    for (auto& dl_item : download.items) {
+      for (auto& dl_data : dl_item->segments) {
+        if (!dl_data->stream->Idle()) {
+          writing = true;
+        } else if (dl_data->stream->Failed() &&
+                   !download.failure.has_value()) {
+          download.failure = ProcessDownloadFailed{
+              .message = "Failed to write " + dl_item->item.localPath.string(),
+              .task_id = download.task.id,
+              .type = DownloadEventType::DownloadError,
+          };
+        }
+      }
+    }
+    if (writing) {
+      ++it;
+      continue;
+    }
+
+    if (download.failure.has_value()) {
+      // Keep what arrived so adding the task again resumes it
+      SaveItemStates(download);
+    }
+    for (auto& dl_item : download.items) {
+      dl_item->file.reset();
+    }
+
+    // Hashing a large file must not stall the other transfers
+    finalizers_.push_back(std::async(
+        std::launch::async,
+        [this, finished = std::move(*it)]() mutable {
+          FinalizeTask(std::move(finished));
+        }));
+    it = downloads_.erase(it);
+  }
+}
+
+void DownloadService::FinalizeTask(std::unique_ptr<TaskDownload> download) {
+  auto& task = download->task;
+  auto& failure = download->failure;
+  {
+    // No progress event may follow the final one
+    std::lock_guard<std::mutex> lock(progress_mutex_);
+    progress_.erase(task.id);
+  }
+  {
+    // A download faster than the progress interval has not been counted yet
+    std::lock_guard<std::mutex> lock(active_tasks_mutex_);
+    if (auto it = active_tasks_.find(task.id); it != active_tasks_.end()) {
+      auto& items = it->second->items;
+      for (size_t i = 0; i < items.size() && i < download->items.size(); i++) {
+        const auto& progress = *download->items[i]->progress;
+        items[i].bytes = progress.total.load(std::memory_order_relaxed);
+        items[i].downloadedBytes =
+            progress.downloaded.load(std::memory_order_relaxed);
+        items[i].bytesPerSecond.reset();
+        items[i].etaSeconds.reset();
+      }
+    }
+  }
+  if (!failure.has_value()) {
+    for (auto& dl_item : download->items) {
+      const auto& item = dl_item->item;
+      if (dl_item->segments.empty()) {
+        continue;
+      }
+      auto& dl_data = *dl_item->segments.front();
+      cpp::result<void, std::string> r;
+      if (item.checksum.has_value() && dl_data.hasher == nullptr) {
+        // Ranges arrive out of order. The prefix every range reached was
+        // hashed while they downloaded, the rest is read now.
+        uint64_t hashed = 0;
+        if (auto& prefix = dl_item->prefix_hash; prefix != nullptr) {
+          auto pending = prefix->pending.valid()
+                             ? prefix->pending.get()
+                             : cpp::result<void, std::string>{};
+          if (pending.has_value()) {
+            dl_data.hasher = std::move(prefix->hasher);
+            hashed = prefix->hashed;
+          } else {
+            CTL_WRN(pending.error());
+          }
+          prefix.reset();
+        }
+        if (dl_data.hasher == nullptr) {
+          dl_data.hasher = std::make_unique<sha256_utils::Sha256>();
+        }
+        r = sha256_utils::UpdateFromFileRange(*dl_data.hasher, item.localPath,
+                                              hashed, dl_item->total - hashed);
+      }
+      if (r.has_value()) {
+        r = VerifyChecksum(item, dl_data);
+      }
+      if (r.has_value() && dl_item->extractor != nullptr) {
+        r = FinishExtraction(*download, *dl_item);
+      }
+      if (r.has_error()) {
+        CTL_ERR(r.error());
+        std::error_code ec;
+        std::filesystem::remove(item.localPath, ec);
+        DownloadState::Remove(item.localPath);
+        failure = ProcessDownloadFailed{
+            .message = r.error(),
+            .task_id = task.id,
+            .type = DownloadEventType::DownloadError,
+        };
+        break;
+      }
+    }
+  }
+
+  if (download_tasks_ != nullptr) {
+    // A task stopped by the shutdown rather than by a client is resumed on
+    // the next start, every other outcome ends its row
+    std::optional<DownloadTask> interrupted;
+    {
+      std::lock_guard<std::mutex> lock(active_tasks_mutex_);
+      auto it = active_tasks_.find(task.id);
+      if (stop_flag_ && failure.has_value() &&
+          failure->type == DownloadEventType::DownloadStopped &&
+          it != active_tasks_.end() &&
+          it->second->status != DownloadTask::Status::Cancelled) {
+        interrupted = *it->second;
+      }
+    }
+    auto r = interrupted.has_value()
+                 ? download_tasks_->UpdateDownloadTasks({interrupted.value()})
+                 : download_tasks_->DeleteDownloadTask(task.id);
+    if (r.has_error()) {
+      CTL_WRN("Failed to save download task " << task.id << ": "
+                                              << r.error());
+    }
+  }
+
+  if (failure.has_value()) {
+    if (failure->type == DownloadEventType::DownloadStopped) {
       RemoveTaskFromStopList(task.id);
       EmitTaskStopped(task.id);
     } else {
@@ -413,72 +1539,507 @@ void DownloadService::ProcessTask(DownloadTask& task, int worker_id) {
     }
   } else {
     // success
+    for (const auto& item : task.items) {
+      DownloadState::Remove(item.localPath);
+    }
     // if the download has error, we are not run the callback
-    ExecuteCallback(task);
-    EmitTaskCompleted(task.id);
-    {
-      std::lock_guard<std::mutex> lock(event_emit_map_mutex);
-      event_emit_map_.erase(task.id);
+    if (auto r = ExecuteCallback(task); r.has_error()) {
+      CTL_ERR("Failed to finish download task " << task.id << ": "
+                                                 << r.error());
+      EmitTaskError(task.id);
+    } else {
+      EmitTaskCompleted(task.id);
     }
   }
 
-  worker_data->downloading_data_map.clear();
+  std::lock_guard<std::mutex> lock(active_tasks_mutex_);
+  active_tasks_.erase(task.id);
 }
 
-cpp::result<void, ProcessDownloadFailed> DownloadService::ProcessMultiDownload(
-    DownloadTask& task, CURLM* multi_handle,
-    const std::vector<std::pair<CURL*, FILE*>>& handles) {
-  auto still_running = 0;
-  do {
-    curl_multi_perform(multi_handle, &still_running);
-    curl_multi_wait(multi_handle, nullptr, 0, MAX_WAIT_MSECS, nullptr);
+cpp::result<void, std::string> DownloadService::FinishExtraction(
+    TaskDownload& download, ItemDownload& dl_item) {
+  const auto& item = dl_item.item;
+  if (auto r = dl_item.extractor->Finish(); r.has_error()) {
+    return r;
+  }
+  dl_item.file.reset();
+  // An archive kept inside the destination moves along with it
+  auto relative = item.localPath.lexically_relative(item.extractPath.value());
+  if (download.keep_archives && !relative.empty() &&
+      *relative.begin() != "..") {
+    std::error_code ec;
+    auto kept = dl_item.extractor->Staging() / relative;
+    std::filesystem::create_directories(kept.parent_path(), ec);
+    std::filesystem::rename(item.localPath, kept, ec);
+    if (ec) {
+      CTL_WRN("Failed to keep " << item.localPath.string() << ": "
+                                << ec.message());
+    }
+  }
+  return dl_item.extractor->Commit();
+}
 
-    auto result = ProcessCompletedTransfers(multi_handle);
-    if (result.has_error()) {
-      return cpp::fail(ProcessDownloadFailed{
-          .message = result.error(),
-          .task_id = task.id,
-          .type = DownloadEventType::DownloadError,
-      });
+size_t DownloadService::RangeHeaderCallback(char* buffer, size_t size,
+                                            size_t nitems, void* userdata) {
+  auto support = static_cast<RangeSupport*>(userdata);
+  std::string raw(buffer, size * nitems);
+  auto header_value = [&raw]() {
+    auto value = raw.substr(raw.find(':') + 1);
+    string_utils::Trim(value);
+    return value;
+  };
+  auto line = raw;
+  std::transform(line.begin(), line.end(), line.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (string_utils::StartsWith(line, "http/")) {
+    // Headers of a redirect response do not describe the final one
+    *support = RangeSupport{};
+  } else if (string_utils::StartsWith(line, "accept-ranges:")) {
+    support->accept_ranges = line.find("bytes") != std::string::npos;
+  } else if (string_utils::StartsWith(line, "etag:")) {
+    support->etag = header_value();
+  } else if (string_utils::StartsWith(line, "last-modified:")) {
+    support->last_modified = header_value();
+  }
+  return size * nitems;
+}
+
+size_t DownloadService::WriteCallback(char* ptr, size_t size, size_t nmemb,
+                                     void* userdata) {
+  auto dl_data = static_cast<DownloadingData*>(userdata);
+  size_t written = fwrite(ptr, size, nmemb, dl_data->file);
+  if (dl_data->hasher != nullptr) {
+    dl_data->hasher->Update(ptr, written * size);
+  }
+  return written;
+}
+
+size_t DownloadService::WriteAtCallback(char* ptr, size_t size, size_t nmemb,
+                                       void* userdata) {
+  auto dl_data = static_cast<DownloadingData*>(userdata);
+  auto bytes = size * nmemb;
+  if (dl_data->length > 0) {
+    long response_code = 0;
+    curl_easy_getinfo(dl_data->handle, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code == 200 && !dl_data->item->restarted) {
+      // If-Range did not match, so this is the new file from its first byte
+      dl_data->item->changed = true;
+      dl_data->error = "File changed on the server";
+      return 0;
     }
+    if (response_code != 206) {
+      // A full body would overwrite the other segments
+      dl_data->error = "HTTP code " + std::to_string(response_code) +
+                       " for a range request";
+      return 0;
+    }
+    if (dl_data->written + bytes > dl_data->length) {
+      dl_data->error = "Server sent more than the requested range";
+      return 0;
+    }
+  }
+  if (dl_data->stream->Failed()) {
+    dl_data->error = "Failed to write the output file";
+    return 0;
+  }
+  auto extractor = dl_data->item->extractor.get();
+  if (extractor != nullptr) {
+    if (auto error = extractor->Error(); error.has_value()) {
+      dl_data->error = error.value();
+      return 0;
+    }
+  }
+  dl_data->last_data = std::chrono::steady_clock::now();
+  auto dl_srv = dl_data->download_service;
+  // curl keeps the data and delivers it again once resumed, so the file and
+  // the extractor take all of it or nothing
+  if (!dl_srv->AcquireBandwidth(*dl_data)) {
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  if (extractor != nullptr && !extractor->HasSpace(bytes)) {
+    dl_srv->WaitForBuffer(*dl_data);
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  if (dl_data->item->file == nullptr) {
+    dl_data->written += bytes;
+  } else if (!dl_srv->BufferWrite(*dl_data, ptr, bytes)) {
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  if (extractor != nullptr) {
+    extractor->Write(ptr, bytes);
+  }
+  if (dl_data->hasher != nullptr) {
+    dl_data->hasher->Update(ptr, bytes);
+  }
+  dl_data->item->progress->downloaded.fetch_add(bytes,
+                                                std::memory_order_relaxed);
+  dl_srv->class_buckets_[static_cast<size_t>(dl_data->item->task->priority)]
+      .Consume(bytes);
+  dl_srv->total_bucket_.Consume(bytes);
+  return bytes;
+}
 
-    if (IsTaskTerminated(task.id) || stop_flag_) {
-      CTL_INF("IsTaskTerminated " + std::to_string(IsTaskTerminated(task.id)));
-      CTL_INF("stop_flag_ " + std::to_string(stop_flag_));
-      return cpp::fail(ProcessDownloadFailed{
-          .message = result.error(),
-          .task_id = task.id,
-          .type = DownloadEventType::DownloadStopped,
-      });
+bool DownloadService::AcquireBandwidth(DownloadingData& dl_data) {
+  auto now = std::chrono::steady_clock::now();
+  auto priority = static_cast<size_t>(dl_data.item->task->priority);
+  auto on_total = false;
+  if (class_buckets_[priority].HasTokens(now)) {
+    // Lower classes leave the shared bandwidth to higher ones waiting for it
+    on_total = !total_bucket_.HasTokens(now) ||
+               std::any_of(waiting_for_total_.begin(),
+                           waiting_for_total_.begin() + priority,
+                           [](int waiting) { return waiting > 0; });
+    if (!on_total) {
+      return true;
+    }
+  }
+  dl_data.paused = true;
+  dl_data.paused_on_total = on_total;
+  waiting_for_total_[priority] += on_total ? 1 : 0;
+  paused_transfers_.push_back(&dl_data);
+
+  // Wake up when the buckets it waits for have refilled
+  auto delay = std::max({class_buckets_[priority].Delay(now),
+                         total_bucket_.Delay(now),
+                         std::chrono::milliseconds(1)});
+  if (!next_resume_.has_value() || now + delay < next_resume_.value()) {
+    next_resume_ = now + delay;
+  }
+  return false;
+}
+
+bool DownloadService::BufferWrite(DownloadingData& dl_data, const char* data,
+                                  size_t size) {
+  auto& buffers = writer_->Buffers();
+  auto capacity = buffers.BufferSize();
+  // Take the buffer the data spills into up front, so a full pool pauses
+  // the transfer before anything was copied
+  char* next = nullptr;
+  if (dl_data.buffer == nullptr || size > capacity - dl_data.buffer_end) {
+    next = buffers.TryAcquire();
+    if (next == nullptr) {
+      WaitForBuffer(dl_data);
+      return false;
+    }
+  }
+
+  while (size > 0) {
+    if (dl_data.buffer == nullptr) {
+      // curl hands over at most CURL_MAX_WRITE_SIZE at once, far below a
+      // buffer, so waiting for a second one is not expected
+      dl_data.buffer = next != nullptr ? std::exchange(next, nullptr)
+                                       : buffers.Acquire();
+      auto position = dl_data.offset + dl_data.written;
+      dl_data.buffer_offset = position / file_io_utils::kDirectIoAlignment *
+                              file_io_utils::kDirectIoAlignment;
+      dl_data.buffer_begin = dl_data.buffer_end =
+          static_cast<size_t>(position - dl_data.buffer_offset);
+    }
+    auto chunk = std::min(size, capacity - dl_data.buffer_end);
+    std::memcpy(dl_data.buffer + dl_data.buffer_end, data, chunk);
+    dl_data.buffer_end += chunk;
+    dl_data.written += chunk;
+    data += chunk;
+    size -= chunk;
+    if (dl_data.buffer_end == capacity) {
+      SubmitBuffer(dl_data);
+    }
+  }
+  if (next != nullptr) {
+    buffers.Release(next);
+  }
+  return true;
+}
+
+void DownloadService::WaitForBuffer(DownloadingData& dl_data) {
+  dl_data.paused = true;
+  dl_data.paused_on_buffer = true;
+  waiting_for_buffer_++;
+  paused_transfers_.push_back(&dl_data);
+}
+
+void DownloadService::SubmitBuffer(DownloadingData& dl_data) {
+  if (dl_data.buffer == nullptr) {
+    return;
+  }
+  writer_->Submit(file_io_utils::AsyncFileWriter::Write{
+      .file = dl_data.item->file.get(),
+      .stream = dl_data.stream,
+      .buffer = std::exchange(dl_data.buffer, nullptr),
+      .begin = dl_data.buffer_begin,
+      .end = dl_data.buffer_end,
+      .offset = dl_data.buffer_offset,
+      .position = dl_data.written,
+  });
+}
+
+void DownloadService::SetMirrors(const ApiServerConfiguration& configuration) {
+  std::lock_guard<std::mutex> lock(mirrors_mutex_);
+  mirrors_ = configuration.download_mirrors;
+}
+
+Json::Value DownloadService::GetMirrorHealth() const {
+  return mirror_health_.ToJson();
+}
+
+void DownloadService::ResumePausedTransfers() {
+  next_resume_.reset();
+
+  auto paused = std::move(paused_transfers_);
+  paused_transfers_.clear();
+  waiting_for_total_.fill(0);
+  waiting_for_buffer_ = 0;
+  std::stable_sort(paused.begin(), paused.end(),
+                   [](DownloadingData* a, DownloadingData* b) {
+                     return a->item->task->priority < b->item->task->priority;
+                   });
+  for (auto dl_data : paused) {
+    dl_data->paused = false;
+    dl_data->paused_on_total = false;
+    dl_data->paused_on_buffer = false;
+    // Resuming delivers the held data right away, the write callback pauses
+    // the transfer again when there is still no bandwidth for it
+    curl_easy_pause(dl_data->handle, CURLPAUSE_CONT);
+  }
+}
+
+void DownloadService::ApplyRateLimits() {
+  std::optional<RateLimits> limits;
+  {
+    std::lock_guard<std::mutex> lock(rate_limits_mutex_);
+    limits.swap(pending_rate_limits_);
+  }
+  if (!limits.has_value()) {
+    return;
+  }
+  total_bucket_.SetRate(limits->total);
+  for (size_t i = 0; i < kDownloadPriorityCount; i++) {
+    class_buckets_[i].SetRate(limits->classes[i]);
+  }
+  // New limits may let paused transfers continue
+  next_resume_ = std::chrono::steady_clock::now();
+}
+
+void DownloadService::SetRateLimits(
+    const ApiServerConfiguration& configuration) {
+  auto to_bytes = [](int kib) {
+    return static_cast<uint64_t>(std::max(kib, 0)) * 1024;
+  };
+  {
+    std::lock_guard<std::mutex> lock(rate_limits_mutex_);
+    pending_rate_limits_ = RateLimits{
+        .total = to_bytes(configuration.download_max_rate),
+        .classes = {to_bytes(configuration.download_max_rate_high),
+                    to_bytes(configuration.download_max_rate_normal),
+                    to_bytes(configuration.download_max_rate_low)},
+    };
+  }
+  poller_.Wakeup();
+}
+
+int DownloadService::ProgressCallback(void* ptr, curl_off_t dltotal,
+                                      curl_off_t dlnow, curl_off_t ultotal,
+                                      curl_off_t ulnow) {
+  auto downloading_data = static_cast<DownloadingData*>(ptr);
+  if (downloading_data == nullptr || downloading_data->item == nullptr) {
+    return 0;
+  }
+
+  // Single stream items only learn their size once the response arrives
+  if (downloading_data->item->total == 0 && dltotal > 0) {
+    downloading_data->item->progress->total.store(
+        static_cast<uint64_t>(dltotal), std::memory_order_relaxed);
+  }
+  return 0;
+}
+
+void DownloadService::ProgressThread() {
+  std::unique_lock<std::mutex> lock(progress_mutex_);
+  auto last_save = std::chrono::steady_clock::now();
+  while (!stop_flag_) {
+    progress_cv_.wait(lock,
+                      [this]() { return stop_flag_ || !progress_.empty(); });
+    progress_cv_.wait_for(
+        lock, std::chrono::milliseconds(progress_interval_ms_.load()),
+        [this]() { return stop_flag_.load(); });
+    if (stop_flag_) {
+      break;
+    }
+    EmitProgress();
+
+    if (auto now = std::chrono::steady_clock::now();
+        now - last_save >= kStateSaveInterval) {
+      // Finishing tasks must not wait for SQLite
+      lock.unlock();
+      SaveTasks();
+      lock.lock();
+      last_save = now;
     }
-  } while (still_running);
+  }
+}
+
+void DownloadService::SaveTasks() {
+  if (download_tasks_ == nullptr) {
+    return;
+  }
+  std::vector<DownloadTask> tasks;
+  {
+    std::lock_guard<std::mutex> lock(active_tasks_mutex_);
+    for (const auto& task_id : unsaved_tasks_) {
+      if (auto it = active_tasks_.find(task_id); it != active_tasks_.end()) {
+        tasks.push_back(*it->second);
+      }
+    }
+    unsaved_tasks_.clear();
+  }
+  if (tasks.empty()) {
+    return;
+  }
+  if (auto r = download_tasks_->UpdateDownloadTasks(tasks); r.has_error()) {
+    CTL_WRN("Failed to save download tasks: " << r.error());
+  }
+}
+
+void DownloadService::EmitProgress() {
+  auto now = std::chrono::steady_clock::now();
+  for (auto& [task_id, items] : progress_) {
+    auto changed = false;
+    for (auto& progress : items) {
+      auto downloaded = progress->downloaded.load(std::memory_order_relaxed);
+      auto& samples = progress->samples;
+      changed |= samples.empty() || samples.back().second != downloaded;
+      samples.emplace_back(now, downloaded);
+      // Keep one sample at or before the window start to measure from
+      while (samples.size() > 2 && samples[1].first <= now - kSpeedWindow) {
+        samples.pop_front();
+      }
+    }
+    if (!changed) {
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(active_tasks_mutex_);
+    auto task_it = active_tasks_.find(task_id);
+    if (task_it == active_tasks_.end()) {
+      continue;
+    }
+    unsaved_tasks_.insert(task_id);
+    auto& task = *task_it->second;
+    for (size_t i = 0; i < items.size() && i < task.items.size(); i++) {
+      auto& item = task.items[i];
+      const auto& progress = *items[i];
+      const auto& [start, start_bytes] = progress.samples.front();
+      const auto& [end, end_bytes] = progress.samples.back();
+      auto total = progress.total.load(std::memory_order_relaxed);
+
+      item.bytes = total;
+      item.downloadedBytes = end_bytes;
+      auto elapsed = std::chrono::duration<double>(end - start).count();
+      if (elapsed <= 0) {
+        continue;
+      }
+      auto speed = static_cast<uint64_t>((end_bytes - start_bytes) / elapsed);
+      item.bytesPerSecond = speed;
+      if (speed > 0 && total > end_bytes) {
+        item.etaSeconds = (total - end_bytes) / speed;
+      } else {
+        item.etaSeconds.reset();
+      }
+    }
+    event_queue_->enqueue(
+        EventType::DownloadEvent,
+        DownloadEvent{.type_ = DownloadEventType::DownloadUpdated,
+                      .download_task_ = task});
+  }
+}
+
+cpp::result<void, std::string> DownloadService::VerifyChecksum(
+    const DownloadItem& item, DownloadingData& dl_data) {
+  if (!item.checksum.has_value() || dl_data.hasher == nullptr) {
+    return {};
+  }
+  auto actual = dl_data.hasher->FinalHex();
+  dl_data.hasher.reset();
+  if (!sha256_utils::ChecksumEquals(actual, item.checksum.value())) {
+    return cpp::fail("Checksum mismatch for " +
+                     item.localPath.filename().string() + ": expected " +
+                     item.checksum.value() + ", got " + actual);
+  }
+  CTL_INF("Checksum verified for " << item.localPath.filename().string());
   return {};
 }
 
-void DownloadService::SetUpCurlHandle(CURL* handle, const DownloadItem& item,
-                                      FILE* file, DownloadingData* dl_data) {
+void DownloadService::SetUpCurlHandle(CURL* handle, DownloadingData* dl_data) {
   SetUpProxy(handle, config_service_);
-  curl_easy_setopt(handle, CURLOPT_URL, item.downloadUrl.c_str());
-  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(handle, CURLOPT_WRITEDATA, file);
+  curl_easy_setopt(handle, CURLOPT_PRIVATE, dl_data);
   curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
-  curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
-  curl_easy_setopt(handle, CURLOPT_XFERINFODATA, dl_data);
+  if (dl_data->probe) {
+    curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, RangeHeaderCallback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA,
+                     &dl_data->item->sources[dl_data->source].support);
+  } else {
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteAtCallback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, dl_data);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, dl_data);
+  }
+  SetUpSource(dl_data);
+}
+
+void DownloadService::SetUpSource(DownloadingData* dl_data) {
+  auto handle = dl_data->handle;
+  const auto& dl_item = *dl_data->item;
+  const auto& source = dl_item.sources[dl_data->source];
+  curl_easy_setopt(handle, CURLOPT_URL, source.url.c_str());
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, nullptr);
+  curl_slist_free_all(dl_data->headers);
+  dl_data->headers = nullptr;
+
+  if (dl_data->length > 0) {
+    auto range = RemainingRange(dl_data->offset, dl_data->length,
+                                dl_data->written);
+    curl_easy_setopt(handle, CURLOPT_RANGE, range.c_str());
+    // A file that changed on the server comes back whole, with a 200, and
+    // the item starts over instead of mixing it with the bytes already on
+    // disk. Mirrors have validators of their own.
+    auto validator =
+        dl_data->source == dl_item.reference
+            ? dl_item.state->Validator()
+            : DownloadState{.etag = source.support.etag,
+                            .last_modified = source.support.last_modified}
+                  .Validator();
+    if (!validator.empty()) {
+      dl_data->headers = curl_slist_append(dl_data->headers,
+                                           ("If-Range: " + validator).c_str());
+    }
+  }
 
-  auto headers = curl_utils::GetHeaders(item.downloadUrl);
+  // Tokens only go to the hosts they belong to
+  auto headers = curl_utils::GetHeaders(source.url);
   if (headers) {
-    curl_slist* curl_headers = nullptr;
     for (const auto& [key, value] : headers.value()) {
-      curl_headers =
-          curl_slist_append(curl_headers, (key + ": " + value).c_str());
+      dl_data->headers =
+          curl_slist_append(dl_data->headers, (key + ": " + value).c_str());
     }
-    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, curl_headers);
+  }
+  if (dl_data->headers != nullptr) {
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, dl_data->headers);
   }
 }
 
 cpp::result<DownloadTask, std::string> DownloadService::AddTask(
     DownloadTask& task, std::function<void(const DownloadTask&)> callback) {
+  task.status = DownloadTask::Status::Pending;
+  if (download_tasks_ != nullptr) {
+    // Only progress is written behind, a queued task must survive a crash
+    if (auto r = download_tasks_->UpsertDownloadTask(task); r.has_error()) {
+      CTL_WRN("Failed to save download task " << task.id << ": "
+                                              << r.error());
+    }
+  }
+
   {  // adding item to callback map
     std::lock_guard<std::mutex> lock(callbacks_mutex_);
     callbacks_[task.id] = std::move(callback);
@@ -490,10 +2051,61 @@ cpp::result<DownloadTask, std::string> DownloadService::AddTask(
     CTL_INF("Task added to queue: " << task.id);
   }
 
-  task_cv_.notify_one();
+  poller_.Wakeup();
   return task;
 }
 
+void DownloadService::RegisterTaskRestorer(DownloadType type,
+                                           TaskRestorer restorer) {
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  restorers_[type] = std::move(restorer);
+}
+
+void DownloadService::RestoreTasks() {
+  if (download_tasks_ == nullptr) {
+    return;
+  }
+  auto tasks = download_tasks_->LoadDownloadTaskList();
+  if (tasks.has_error()) {
+    CTL_WRN("Failed to load download tasks: " << tasks.error());
+    return;
+  }
+
+  for (auto& task : tasks.value()) {
+    TaskRestorer restorer;
+    {
+      std::lock_guard<std::mutex> lock(callbacks_mutex_);
+      if (auto it = restorers_.find(task.type); it != restorers_.end()) {
+        restorer = it->second;
+      }
+    }
+    cpp::result<OnDownloadTaskSuccessfully, std::string> callback =
+        cpp::fail("No restorer for " + DownloadTypeToString(task.type) +
+                  " downloads");
+    if (task.status != DownloadTask::Status::Pending &&
+        task.status != DownloadTask::Status::InProgress) {
+      callback = cpp::fail("Task already " +
+                           DownloadTaskStatusToString(task.status));
+    } else if (restorer) {
+      callback = restorer(task);
+    }
+    if (callback.has_error()) {
+      CTL_WRN("Dropping download task " << task.id << ": "
+                                        << callback.error());
+      download_tasks_->DeleteDownloadTask(task.id);
+      continue;
+    }
+
+    CTL_INF("Restoring download task: " << task.id);
+    // Clients see the saved progress before the task is admitted again
+    event_queue_->enqueue(
+        EventType::DownloadEvent,
+        DownloadEvent{.type_ = DownloadEventType::DownloadUpdated,
+                      .download_task_ = task});
+    AddTask(task, callback.value());
+  }
+}
+
 bool DownloadService::IsTaskTerminated(const std::string& task_id) {
   // can use shared mutex lock here?
   std::lock_guard<std::mutex> lock(stop_mutex_);
@@ -513,6 +2125,7 @@ void DownloadService::EmitTaskStarted(const DownloadTask& task) {
 }
 
 void DownloadService::EmitTaskStopped(const std::string& task_id) {
+  std::lock_guard<std::mutex> lock(active_tasks_mutex_);
   if (auto it = active_tasks_.find(task_id); it != active_tasks_.end()) {
     event_queue_->enqueue(
         EventType::DownloadEvent,
@@ -522,6 +2135,7 @@ void DownloadService::EmitTaskStopped(const std::string& task_id) {
 }
 
 void DownloadService::EmitTaskError(const std::string& task_id) {
+  std::lock_guard<std::mutex> lock(active_tasks_mutex_);
   if (auto it = active_tasks_.find(task_id); it != active_tasks_.end()) {
     event_queue_->enqueue(
         EventType::DownloadEvent,
@@ -543,11 +2157,19 @@ void DownloadService::EmitTaskCompleted(const std::string& task_id) {
   }
 }
 
-void DownloadService::ExecuteCallback(const DownloadTask& task) {
+cpp::result<void, std::string> DownloadService::ExecuteCallback(
+    const DownloadTask& task) {
   std::lock_guard<std::mutex> lock(callbacks_mutex_);
   auto it = callbacks_.find(task.id);
-  if (it != callbacks_.end()) {
-    it->second(task);
-    callbacks_.erase(it);
+  if (it == callbacks_.end()) {
+    return {};
+  }
+  auto callback = std::move(it->second);
+  callbacks_.erase(it);
+  try {
+    callback(task);
+  } catch (const std::exception& e) {
+    return cpp::fail(static_cast<std::string>(e.what()));
   }
+  return {};
 }
@@ -2,14 +2,31 @@
 
 #include <curl/curl.h>
 #include <eventpp/eventqueue.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
+#include <list>
 #include <optional>
 #include <thread>
 #include <unordered_set>
+#include "common/download_state.h"
 #include "common/download_task_queue.h"
 #include "common/event.h"
+#include "database/download_tasks.h"
+#include "utils/archive_utils.h"
+#include "utils/async_file_writer.h"
 #include "services/config_service.h"
+#include "utils/config_yaml_utils.h"
+#include "utils/file_io_utils.h"
+#include "utils/mirror_utils.h"
+#include "utils/rate_limit_utils.h"
 #include "utils/result.hpp"
+#include "utils/sha256_utils.h"
+#include "utils/socket_poller.h"
 
 struct ProcessDownloadFailed {
   std::string message;
@@ -19,50 +36,435 @@ struct ProcessDownloadFailed {
 
 class DownloadService {
  private:
-  static constexpr int MAX_CONCURRENT_TASKS = 4;
+  // Transfers running at once across all tasks, and within a single task
+  static constexpr int kMaxConnections = 16;
+  static constexpr int kMaxTaskConnections = 8;
+
+  // Received data waits in these buffers until the writer thread puts it on
+  // disk, which bounds the memory of the disk stage
+  static constexpr size_t kWriteBufferSize = 1 << 20;
+  static constexpr size_t kWriteBuffers = 64;
+
+  // Received archive data not read by the extractor yet
+  static constexpr size_t kExtractBufferBytes = 8 << 20;
 
   std::shared_ptr<ConfigService> config_service_;
 
+  // Attempts for one segment before the whole task fails
+  static constexpr int kMaxSegmentRetries = 3;
+
+  // Moves of one transfer to another mirror after it failed or stalled
+  static constexpr int kMaxFailovers = 8;
+
+  // A transfer receiving nothing for this long is given up on its mirror
+  static constexpr auto kStallTimeout = std::chrono::seconds(20);
+
+  // How often running transfers are sampled for throughput and stalls. A
+  // byte range moves to another mirror once that mirror is kSlowFactor
+  // times as fast.
+  static constexpr auto kTransferCheckInterval = std::chrono::seconds(1);
+  static constexpr double kSlowFactor = 4;
+
+  // How much progress a crash can lose at most
+  static constexpr auto kStateSaveInterval = std::chrono::seconds(2);
+
+  // Span the transfer rate of a progress event is measured over
+  static constexpr auto kSpeedWindow = std::chrono::seconds(5);
+
+  struct ItemDownload;
+  struct TaskDownload;
+
+  /**
+   * Bytes of one item, counted by the transfers of the event loop without
+   * taking a lock and read by the progress aggregator.
+   */
+  struct ItemProgress {
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> downloaded{0};
+    // (time, downloaded) samples within kSpeedWindow, aggregator only
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint64_t>>
+        samples;
+  };
+
+  // Receive rate caps in bytes per second, 0 for unlimited
+  struct RateLimits {
+    uint64_t total;
+    std::array<uint64_t, kDownloadPriorityCount> classes;
+  };
+
+  // Download settings read from the configuration when a task is admitted
+  struct DownloadSettings {
+    int segments;
+    std::chrono::milliseconds progress_interval;
+    bool direct_io;
+    std::vector<std::string> mirrors;
+    bool keep_archives;
+  };
+
+  // What the HEAD request of an item found out about its server
+  struct RangeSupport {
+    bool accept_ranges = false;
+    uint64_t size = 0;
+    std::string etag;
+    std::string last_modified;
+  };
+
+  // A URL an item can be fetched from, its own or a mirror of it
+  struct ItemSource {
+    std::string url;
+    // Host key of the mirror health
+    std::string origin;
+    RangeSupport support;
+    // Answered the probe with the whole file
+    bool usable = false;
+  };
+
   struct DownloadingData {
     std::string task_id;
     std::string item_id;
     DownloadService* download_service;
+    FILE* file = nullptr;
+    // Set when the item has a checksum, fed from the write callback
+    std::unique_ptr<sha256_utils::Sha256> hasher = nullptr;
+
+    // Transfers of the event loop write into item->file at
+    // offset + written. length is 0 when the whole body is requested.
+    ItemDownload* item = nullptr;
+    CURL* handle = nullptr;
+    curl_slist* headers = nullptr;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    uint64_t written = 0;
+    int retries = 0;
+    std::optional<std::chrono::steady_clock::time_point> retry_at;
+    std::string error;
+    // Probe transfers only fetch the headers of the item
+    bool probe = false;
+    // On the multi handle
+    bool active = false;
+    // Paused for bandwidth, on_total when waiting for the shared budget and
+    // on_buffer when waiting for a free write buffer
+    bool paused = false;
+    bool paused_on_total = false;
+    bool paused_on_buffer = false;
+
+    // Received data not handed to the writer yet. The first byte of the
+    // pool buffer belongs at file offset buffer_offset, which is aligned
+    // so full buffers qualify for direct I/O.
+    char* buffer = nullptr;
+    size_t buffer_begin = 0;
+    size_t buffer_end = 0;
+    uint64_t buffer_offset = 0;
+    // How much of written reached the file
+    std::shared_ptr<file_io_utils::WriteStream> stream;
+
+    // Index into item->sources of the URL this transfer fetches
+    size_t source = 0;
+    int failovers = 0;
+    // Moved to a faster mirror once already
+    bool switched = false;
+    // The whole range arrived
+    bool done = false;
+    // Added to the multi handle, and last data from the server
+    std::chrono::steady_clock::time_point started{};
+    std::chrono::steady_clock::time_point last_data{};
   };
 
-  // Each worker represents a thread. Each worker will have its own multi_handle
-  struct WorkerData {
-    CURLM* multi_handle;
-    std::unordered_map<std::string, std::shared_ptr<DownloadingData>>
-        downloading_data_map;
+  /**
+   * Hash of the part of a segmented item that every byte range reached, from
+   * offset 0 on. It is extended off the event loop while the ranges still
+   * download, so only the rest is read once the item completes.
+   */
+  struct PrefixHash {
+    std::unique_ptr<sha256_utils::Sha256> hasher =
+        std::make_unique<sha256_utils::Sha256>();
+    uint64_t hashed = 0;
+    // Hashes up to a new end, started and collected by the event loop only
+    std::future<cpp::result<void, std::string>> pending;
   };
-  std::vector<std::unique_ptr<WorkerData>> worker_data_;
 
-  std::vector<std::thread> worker_threads_;
+  // One file, downloaded by a single transfer or by one per byte range
+  struct ItemDownload {
+    TaskDownload* task = nullptr;
+    DownloadItem item;
+    std::unique_ptr<file_io_utils::RandomAccessFile> file;
+    std::shared_ptr<ItemProgress> progress;
+    // Size from the range probe, 0 for single stream downloads
+    uint64_t total = 0;
+    // Every source is probed, support is what the reference source returned
+    // and what the others have to match
+    std::vector<ItemSource> sources;
+    std::vector<std::shared_ptr<DownloadingData>> probes;
+    int probing = 0;
+    size_t reference = 0;
+    RangeSupport support;
+    std::vector<std::shared_ptr<DownloadingData>> segments;
+    // Set for segmented items with a checksum
+    std::unique_ptr<PrefixHash> prefix_hash;
+    // Persisted progress, only for servers that accept ranges
+    std::optional<DownloadState> state;
+    // Set for items with an extractPath, which download as a single stream
+    std::unique_ptr<archive_utils::StreamingExtractor> extractor;
+    // A byte range came back as the whole file, which changed on the server
+    // since the probe. The item starts over from offset 0 once the writes of
+    // its stopped transfers are done, a second time fails it.
+    bool changed = false;
+    bool restarting = false;
+    bool restarted = false;
+  };
+
+  // A task admitted to the event loop
+  struct TaskDownload {
+    DownloadTask task;
+    std::vector<std::unique_ptr<ItemDownload>> items;
+    // Transfers waiting for a free connection
+    std::deque<DownloadingData*> waiting;
+    // Transfers on the multi handle
+    int running = 0;
+    // Probes and segments not finished yet, wherever they are
+    int unfinished = 0;
+    int max_segments = 1;
+    DownloadPriority priority = DownloadPriority::Normal;
+    bool direct_io = false;
+    bool keep_archives = false;
+    std::optional<ProcessDownloadFailed> failure;
+    // Transfers removed while the last writes of the task complete
+    bool detached = false;
+  };
 
   // Store all download tasks in a queue
   DownloadTaskQueue task_queue_;
 
-  // Flag to stop Download service. Will stop all worker threads
+  // Flag to stop Download service. Will stop the event loop
   std::atomic<bool> stop_flag_{false};
 
-  // Track active tasks across all workers
+  // Track active tasks of the event loop
   std::mutex active_tasks_mutex_;
   std::unordered_map<std::string, std::shared_ptr<DownloadTask>> active_tasks_;
 
-  // sync primitives
-  std::condition_variable task_cv_;
-  std::mutex task_mutex_;
+  // Event loop state, only touched by worker_thread_
+  std::list<std::unique_ptr<TaskDownload>> downloads_;
+  int running_transfers_ = 0;
+  int waiting_transfers_ = 0;
+  std::optional<std::chrono::steady_clock::time_point> curl_timer_;
+  std::optional<std::chrono::steady_clock::time_point> next_retry_;
+  std::chrono::steady_clock::time_point last_transfer_check_{};
+  socket_utils::SocketPoller poller_;
+
+  // Bandwidth shaping of the event loop. Transfers without tokens are
+  // paused from their write callback and resumed once the buckets refill.
+  rate_limit_utils::TokenBucket total_bucket_;
+  std::array<rate_limit_utils::TokenBucket, kDownloadPriorityCount>
+      class_buckets_;
+  std::vector<DownloadingData*> paused_transfers_;
+  std::array<int, kDownloadPriorityCount> waiting_for_total_{};
+  std::optional<std::chrono::steady_clock::time_point> next_resume_;
+  int waiting_for_buffer_ = 0;
+
+  // Writes the received data on its own thread. buffer_released_ is set
+  // from there whenever a buffer returned to the pool.
+  std::unique_ptr<file_io_utils::AsyncFileWriter> writer_;
+  std::atomic<bool> buffer_released_{false};
+
+  // Shared by all tasks, so a mirror that failed one download is avoided by
+  // the next
+  mirror_utils::MirrorHealth mirror_health_;
+  // host=url pairs from the config API, read when a task is admitted
+  mutable std::mutex mirrors_mutex_;
+  std::vector<std::string> mirrors_;
+
+  // Limits from the config API, applied by the event loop
+  std::mutex rate_limits_mutex_;
+  std::optional<RateLimits> pending_rate_limits_;
+  int config_listener_id_ = -1;
+
+  // Checksums and callbacks of finished tasks, off the event loop
+  std::vector<std::future<void>> finalizers_;
+
+  // Persisted queue, nullptr when tasks only live in memory. Progress is
+  // written behind in batches, see SaveTasks
+  std::shared_ptr<cortex::db::DownloadTasks> download_tasks_;
+  // Admitted tasks whose status or progress changed since the last batch,
+  // guarded by active_tasks_mutex_
+  std::unordered_set<std::string> unsaved_tasks_;
+
+  // Progress of the admitted tasks by task id, items in task order
+  std::mutex progress_mutex_;
+  std::condition_variable progress_cv_;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<ItemProgress>>>
+      progress_;
+  std::atomic<int64_t> progress_interval_ms_{
+      config_yaml_utils::kDefaultDownloadProgressIntervalMs};
+  std::thread progress_thread_;
 
-  void WorkerThread(int worker_id);
+  /**
+   * Emit one coalesced DownloadUpdated event per changed task every
+   * progress interval, with the rate and remaining time of each item.
+   */
+  void ProgressThread();
 
-  void ProcessTask(DownloadTask& task, int worker_id);
+  void EmitProgress();
 
-  cpp::result<void, ProcessDownloadFailed> ProcessMultiDownload(
-      DownloadTask& task, CURLM* multi_handle,
-      const std::vector<std::pair<CURL*, FILE*>>& handles);
+  // Write the changed admitted tasks to download_tasks_ in one batch
+  void SaveTasks();
 
-  void SetUpCurlHandle(CURL* handle, const DownloadItem& item, FILE* file,
-                       DownloadingData* dl_data);
+  /**
+   * Move pending tasks into the event loop while connections are free. Each
+   * admitted task starts with one probe per item.
+   */
+  void AdmitTasks();
+
+  bool AdmitsMoreTasks() const;
+
+  /**
+   * Add waiting transfers to the multi handle, one per task in turn, within
+   * the global and per-task connection limits.
+   */
+  void StartWaitingTransfers();
+
+  /**
+   * Move running byte ranges of lower priority tasks back to waiting while
+   * higher priority transfers wait for a connection.
+   */
+  void PreemptTransfers();
+
+  /**
+   * Take bandwidth for a write of dl_data, or register it as paused when
+   * its class or the total budget is used up.
+   */
+  bool AcquireBandwidth(DownloadingData& dl_data);
+
+  void ResumePausedTransfers();
+
+  /**
+   * Copy received data into the write buffer of dl_data, handing full
+   * buffers to the writer. Registers the transfer as paused when no buffer
+   * is free.
+   */
+  bool BufferWrite(DownloadingData& dl_data, const char* data, size_t size);
+
+  // Pause dl_data until a write buffer or extractor space is released
+  void WaitForBuffer(DownloadingData& dl_data);
+
+  // Hand the partly filled buffer of dl_data to the writer
+  void SubmitBuffer(DownloadingData& dl_data);
+
+  void ApplyRateLimits();
+
+  /**
+   * Wait for socket activity or a curl timeout and let curl act on it.
+   */
+  void DriveTransfers();
+
+  /**
+   * Open the output file of a probed item and queue its transfers. Items
+   * larger than two segments are split into byte ranges when the server
+   * advertises Accept-Ranges, and a partial file with a matching sidecar
+   * state is resumed instead of downloaded again. Archives extracted on the
+   * fly need their bytes in order and use a single stream.
+   */
+  cpp::result<void, std::string> StartItem(ItemDownload& dl_item);
+
+  /**
+   * Check the finished transfers. Segments failing with a transient error
+   * are scheduled for a retry that resumes where they stopped.
+   */
+  void ProcessCompletedTransfers();
+
+  // Queue the transfers whose retry time has come
+  void RestartDueTransfers();
+
+  // Queue a range probe on every source of the item, false when curl fails
+  bool ProbeItem(TaskDownload& download, ItemDownload& dl_item);
+
+  /**
+   * Stop every transfer of an item whose file changed on the server and
+   * drop its saved state. RestartDueTransfers probes it again once the
+   * writer is done with the old data.
+   */
+  void RestartItem(TaskDownload& download, ItemDownload& dl_item);
+
+  /**
+   * Sample the throughput of the running transfers for the mirror health.
+   * Stalled transfers fail over, byte ranges on a much slower mirror move
+   * to the fastest one.
+   */
+  void CheckTransfers();
+
+  // Hash the newly written prefix of a segmented item in the background
+  void HashWrittenPrefix(ItemDownload& dl_item);
+
+  // Average speed of a transfer as a throughput sample of its source
+  void SampleThroughput(const DownloadingData& dl_data);
+
+  // Take a running transfer off the multi handle, paused or not
+  void DetachTransfer(TaskDownload& download, DownloadingData& dl_data);
+
+  // Drop a transfer from the paused ones, which only resume when running
+  void ForgetPausedTransfer(DownloadingData& dl_data);
+
+  /**
+   * Move a failed transfer to another mirror or schedule a retry on its own,
+   * or fail the task once neither is left.
+   */
+  void HandleTransferFailure(TaskDownload& download, DownloadingData& dl_data,
+                             const std::string& error, bool retriable);
+
+  /**
+   * Continue dl_data on the best other source from where it stopped. False
+   * when the item has no other source left.
+   */
+  bool FailOver(DownloadingData& dl_data);
+
+  /**
+   * Usable sources of an item by the expected time for a segment, mirrors
+   * without recent failures first. ranged only keeps sources that serve
+   * byte ranges.
+   */
+  std::vector<size_t> RankSources(const ItemDownload& dl_item,
+                                  bool ranged) const;
+
+  // Best ranked source other than exclude, or exclude without one
+  size_t PickSource(const ItemDownload& dl_item, bool ranged,
+                    std::optional<size_t> exclude = std::nullopt) const;
+
+  /**
+   * Sync the partial files and record the bytes each segment has on disk
+   * in the sidecar state files. Data still with the writer is not counted.
+   */
+  void SaveItemStates(TaskDownload& download);
+
+  /**
+   * Remove finished, failed and stopped tasks from the event loop, once the
+   * writer completed their last buffers.
+   */
+  void RetireTasks();
+
+  void QueueTransfer(TaskDownload& download, DownloadingData* dl_data);
+
+  /**
+   * Verify checksums, then emit the final event and run the callback of a
+   * task that left the event loop.
+   */
+  void FinalizeTask(std::unique_ptr<TaskDownload> download);
+
+  // Wait for the extractor of a verified item and move its files in
+  cpp::result<void, std::string> FinishExtraction(TaskDownload& download,
+                                                  ItemDownload& dl_item);
+
+  void SetUpCurlHandle(CURL* handle, DownloadingData* dl_data);
+
+  // Point the handle of dl_data at its source, with range and headers
+  void SetUpSource(DownloadingData* dl_data);
+
+  DownloadSettings GetDownloadSettings() const;
+
+  /**
+   * Compare the streamed hash of a finished item with its expected checksum.
+   * Items without a checksum always pass.
+   */
+  static cpp::result<void, std::string> VerifyChecksum(
+      const DownloadItem& item, DownloadingData& dl_data);
 
   void EmitTaskStarted(const DownloadTask& task);
 
@@ -76,6 +478,14 @@ class DownloadService {
   using OnDownloadTaskSuccessfully =
       std::function<void(const DownloadTask& task)>;
 
+  /**
+   * Rebuild the callback of a task saved by an earlier run, or fail when the
+   * task cannot be restored.
+   */
+  using TaskRestorer =
+      std::function<cpp::result<OnDownloadTaskSuccessfully, std::string>(
+          const DownloadTask& task)>;
+
   using DownloadEventType = cortex::event::DownloadEventType;
   using DownloadEvent = cortex::event::DownloadEvent;
   using EventType = cortex::event::EventType;
@@ -85,9 +495,13 @@ class DownloadService {
 
   explicit DownloadService() = default;
 
-  explicit DownloadService(std::shared_ptr<EventQueue> event_queue,
-                           std::shared_ptr<ConfigService> config_service)
-      : event_queue_{event_queue}, config_service_{config_service} {
+  explicit DownloadService(
+      std::shared_ptr<EventQueue> event_queue,
+      std::shared_ptr<ConfigService> config_service,
+      std::shared_ptr<cortex::db::DownloadTasks> download_tasks = nullptr)
+      : config_service_{config_service},
+        download_tasks_{download_tasks},
+        event_queue_{event_queue} {
     InitializeWorkers();
   };
 
@@ -98,7 +512,7 @@ class DownloadService {
   DownloadService& operator=(const DownloadService&) = delete;
 
   /**
-   * Adding new download task to the queue. Asynchronously. This function should 
+   * Adding new download task to the queue. Asynchronously. This function should
    * be used by HTTP API.
    */
   cpp::result<DownloadTask, std::string> AddTask(
@@ -121,6 +535,37 @@ class DownloadService {
 
   cpp::result<std::string, std::string> StopTask(const std::string& task_id);
 
+  void RegisterTaskRestorer(DownloadType type, TaskRestorer restorer);
+
+  /**
+   * Queue the pending and in progress tasks saved by an earlier run again,
+   * with the callbacks of the registered restorers. Partial files resume
+   * from their sidecar state. Tasks of a type without restorer are dropped.
+   */
+  void RestoreTasks();
+
+  // Smallest byte range worth its own connection
+  static constexpr uint64_t kMinSegmentBytes = 4 << 20;
+
+  /**
+   * Split size bytes into at most max_segments contiguous (offset, length)
+   * ranges of at least kMinSegmentBytes each.
+   */
+  static std::vector<std::pair<uint64_t, uint64_t>> PlanSegments(
+      uint64_t size, int max_segments);
+
+  /**
+   * Apply the download_max_rate* caps of configuration to the running and
+   * future transfers. Called for every update of the config API.
+   */
+  void SetRateLimits(const ApiServerConfiguration& configuration);
+
+  // Mirror the tasks admitted from now on with download_mirrors
+  void SetMirrors(const ApiServerConfiguration& configuration);
+
+  // Latency, throughput and failures of every download host used so far
+  Json::Value GetMirrorHealth() const;
+
  private:
   void InitializeWorkers();
 
@@ -132,11 +577,12 @@ class DownloadService {
 
   std::shared_ptr<EventQueue> event_queue_;
 
-  CURLM* multi_handle_;
+  // A single multi handle drives every transfer of the service from
+  // worker_thread_, through curl_multi_socket_action
+  CURLM* multi_handle_ = nullptr;
   std::thread worker_thread_;
 
   std::mutex queue_mutex_;
-  std::condition_variable queue_condition_;
 
   // stop tasks
   std::unordered_set<std::string> tasks_to_stop_;
@@ -145,94 +591,34 @@ class DownloadService {
   // callbacks
   std::unordered_map<std::string, std::function<void(const DownloadTask&)>>
       callbacks_;
+  std::unordered_map<DownloadType, TaskRestorer> restorers_;
   std::mutex callbacks_mutex_;
 
-  std::unordered_map<std::string,
-                     std::chrono::time_point<std::chrono::steady_clock>>
-      event_emit_map_;
-  std::mutex event_emit_map_mutex;
-
   void WorkerThread();
 
   bool IsTaskTerminated(const std::string& task_id);
 
   void RemoveTaskFromStopList(const std::string& task_id);
 
-  void ExecuteCallback(const DownloadTask& task);
+  // Run the callback of a finished task, failing if it threw
+  cpp::result<void, std::string> ExecuteCallback(const DownloadTask& task);
 
   constexpr static auto MAX_WAIT_MSECS = 1000;
 
+  static int SocketCallback(CURL* easy, curl_socket_t socket, int what,
+                            void* userp, void* socketp);
+
+  static int TimerCallback(CURLM* multi, long timeout_ms, void* userp);
+
+  static size_t RangeHeaderCallback(char* buffer, size_t size, size_t nitems,
+                                    void* userdata);
+
+  static size_t WriteCallback(char* ptr, size_t size, size_t nmemb,
+                              void* userdata);
+
+  static size_t WriteAtCallback(char* ptr, size_t size, size_t nmemb,
+                                void* userdata);
+
   static int ProgressCallback(void* ptr, curl_off_t dltotal, curl_off_t dlnow,
-                              curl_off_t ultotal, curl_off_t ulnow) {
-    auto downloading_data = static_cast<DownloadingData*>(ptr);
-    if (downloading_data == nullptr) {
-      return 0;
-    }
-
-    auto dl_srv = downloading_data->download_service;
-    if (dl_srv == nullptr) {
-      return 0;
-    }
-
-    // Lock during the update and event emission
-    std::lock_guard<std::mutex> lock(dl_srv->active_tasks_mutex_);
-
-    // Find and update the task
-    if (auto task_it = dl_srv->active_tasks_.find(downloading_data->task_id);
-        task_it != dl_srv->active_tasks_.end()) {
-      auto& task = task_it->second;
-      // Find the specific item in the task
-      for (auto& item : task->items) {
-        if (item.id != downloading_data->item_id) {
-          // not the item we are looking for
-          continue;
-        }
-
-        item.bytes = dltotal;
-        item.downloadedBytes = dlnow;
-
-        if (item.bytes == 0 || item.bytes == item.downloadedBytes) {
-          break;
-        }
-
-        // Emit the event
-        {
-          std::lock_guard<std::mutex> event_lock(dl_srv->event_emit_map_mutex);
-          // find the task id in event_emit_map
-          // if not found, add it to the map
-          auto should_emit_event{false};
-          if (dl_srv->event_emit_map_.find(task->id) !=
-              dl_srv->event_emit_map_.end()) {
-            auto last_event_time = dl_srv->event_emit_map_[task->id];
-            auto current_time = std::chrono::steady_clock::now();
-
-            auto time_since_last_event =
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                    current_time - last_event_time)
-                    .count();
-            if (time_since_last_event >= 1000) {
-              // if the time since last event is more than 1 sec, emit the event
-              should_emit_event = true;
-            }
-          } else {
-            // if the task id is not found in the map, emit
-            should_emit_event = true;
-          }
-
-          if (should_emit_event) {
-            dl_srv->event_queue_->enqueue(
-                EventType::DownloadEvent,
-                DownloadEvent{.type_ = DownloadEventType::DownloadUpdated,
-                              .download_task_ = *task});
-            dl_srv->event_emit_map_[task->id] =
-                std::chrono::steady_clock::now();
-          }
-        }
-
-        break;
-      }
-    }
-
-    return 0;
-  }
+                              curl_off_t ultotal, curl_off_t ulnow);
 };
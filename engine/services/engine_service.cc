@@ -1,13 +1,17 @@
 #include "engine_service.h"
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <optional>
+#include <thread>
 #include "algorithm"
+#include "database/running_models.h"
 #include "utils/archive_utils.h"
 #include "utils/engine_constants.h"
 #include "utils/engine_matcher_utils.h"
 #include "utils/file_manager_utils.h"
 #include "utils/github_release_utils.h"
+#include "utils/hardware/cpu_budget.h"
 #include "utils/logging_utils.h"
 #include "utils/result.hpp"
 #include "utils/semantic_version_utils.h"
@@ -272,21 +276,31 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
   if (selected_variant == std::nullopt) {
     return cpp::fail("Failed to find a suitable variant for " + engine);
   }
-  if (IsEngineLoaded(engine)) {
-    CTL_INF("Engine " << engine << " is already loaded, unloading it");
-    auto unload_res = UnloadEngine(engine);
-    if (unload_res.has_error()) {
-      CTL_INF("Failed to unload engine: " << unload_res.error());
-      return cpp::fail(unload_res.error());
-    } else {
-      CTL_INF("Engine " << engine << " unloaded successfully");
-    }
-  }
   auto normalize_version = "v" + selected_variant->version;
 
   auto variant_folder_name = engine_matcher_utils::GetVariantFromNameAndVersion(
       selected_variant->name, engine, selected_variant->version);
 
+  // A loaded engine keeps serving while another variant or version is
+  // downloaded, OnEngineDownloaded hot-swaps to it. Only a reinstall of the
+  // loaded variant itself overwrites the library in use.
+  if (IsEngineLoaded(engine)) {
+    auto loaded = GetDefaultEngineVariant(engine);
+    auto reinstall = loaded.has_value() &&
+                     loaded->version == normalize_version &&
+                     loaded->variant == variant_folder_name.value();
+    if (loaded.has_error() || reinstall) {
+      CTL_INF("Engine " << engine << " is already loaded, unloading it");
+      auto unload_res = UnloadEngine(engine);
+      if (unload_res.has_error()) {
+        CTL_INF("Failed to unload engine: " << unload_res.error());
+        return cpp::fail(unload_res.error());
+      } else {
+        CTL_INF("Engine " << engine << " unloaded successfully");
+      }
+    }
+  }
+
   auto variant_folder_path = file_manager_utils::GetEnginesContainerPath() /
                              engine / variant_folder_name.value() /
                              normalize_version;
@@ -294,23 +308,56 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
   auto variant_path = variant_folder_path / selected_variant->name;
   std::filesystem::create_directories(variant_folder_path);
   CTL_INF("variant_folder_path: " + variant_folder_path.string());
-  auto on_finished = [this, engine, selected_variant, variant_folder_path,
-                      normalize_version](const DownloadTask& finishedTask) {
-    // try to unzip the downloaded file
-    CTL_INF("Engine zip path: " << finishedTask.items[0].localPath.string());
-    CTL_INF("Version: " + normalize_version);
+  auto on_finished = OnEngineDownloaded(engine, selected_variant->name,
+                                        normalize_version, variant_folder_path);
 
-    auto extract_path = finishedTask.items[0].localPath.parent_path();
+  auto downloadTask{
+      DownloadTask{.id = engine,
+                   .type = DownloadType::Engine,
+                   .items = {DownloadItem{
+                       .id = engine,
+                       .downloadUrl = selected_variant->browser_download_url,
+                       .localPath = variant_path,
+                       .extractPath = variant_folder_path,
+                       .ignoreParentDir = true,
+                   }}}};
 
-    archive_utils::ExtractArchive(finishedTask.items[0].localPath.string(),
-                                  extract_path.string(), true);
+  auto add_task_result = download_service_->AddTask(downloadTask, on_finished);
+  if (res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  return {};
+}
+
+DownloadService::OnDownloadTaskSuccessfully EngineService::OnEngineDownloaded(
+    const std::string& engine, const std::string& variant_name,
+    const std::string& normalize_version,
+    const std::filesystem::path& variant_folder_path) {
+  return [this, engine, variant_name, normalize_version,
+          variant_folder_path](const DownloadTask& finishedTask) {
+    // Archives extracted while downloading are already in place
+    auto extracted = finishedTask.items[0].extractPath.has_value();
+    if (!extracted) {
+      // try to unzip the downloaded file
+      CTL_INF("Engine zip path: " << finishedTask.items[0].localPath.string());
+      CTL_INF("Version: " + normalize_version);
+
+      auto extract_path = finishedTask.items[0].localPath.parent_path();
+
+      archive_utils::ExtractArchive(finishedTask.items[0].localPath.string(),
+                                    extract_path.string(), true);
+    }
 
     auto variant = engine_matcher_utils::GetVariantFromNameAndVersion(
-        selected_variant->name, engine, normalize_version);
+        variant_name, engine, normalize_version);
     CTL_INF("Extracted variant: " + variant.value());
-    // set as default
+    // set as default, running models are moved to the new variant
     auto res =
-        SetDefaultEngineVariant(engine, normalize_version, variant.value());
+        HotSwapEngineVariant(engine, normalize_version, variant.value());
+    if (res.has_error()) {
+      CTL_WRN("Hot-swap failed, unload engine instead: " << res.error());
+      res = SetDefaultEngineVariant(engine, normalize_version, variant.value());
+    }
     if (res.has_error()) {
       CTL_ERR("Failed to set default engine variant: " << res.error());
     } else {
@@ -319,7 +366,7 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
 
     // remove other engines
     auto engine_directories = file_manager_utils::GetEnginesContainerPath() /
-                              engine / selected_variant->name;
+                              engine / variant_name;
 
     for (const auto& entry : std::filesystem::directory_iterator(
              variant_folder_path.parent_path())) {
@@ -334,28 +381,33 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
     }
 
     // remove the downloaded file
-    try {
-      std::filesystem::remove(finishedTask.items[0].localPath);
-    } catch (const std::exception& e) {
-      CTL_WRN("Could not delete file: " << e.what());
+    if (!extracted) {
+      try {
+        std::filesystem::remove(finishedTask.items[0].localPath);
+      } catch (const std::exception& e) {
+        CTL_WRN("Could not delete file: " << e.what());
+      }
     }
     CTL_INF("Finished!");
   };
+}
 
-  auto downloadTask{
-      DownloadTask{.id = engine,
-                   .type = DownloadType::Engine,
-                   .items = {DownloadItem{
-                       .id = engine,
-                       .downloadUrl = selected_variant->browser_download_url,
-                       .localPath = variant_path,
-                   }}}};
-
-  auto add_task_result = download_service_->AddTask(downloadTask, on_finished);
-  if (res.has_error()) {
-    return cpp::fail(res.error());
-  }
-  return {};
+void EngineService::RegisterDownloadRestorer() {
+  download_service_->RegisterTaskRestorer(
+      DownloadType::Engine,
+      [this](const DownloadTask& task)
+          -> cpp::result<DownloadService::OnDownloadTaskSuccessfully,
+                         std::string> {
+        if (task.items.empty()) {
+          return cpp::fail(static_cast<std::string>("Task has no items"));
+        }
+        // The archive path encodes everything the callback needs
+        auto variant_path = task.items[0].localPath;
+        auto variant_folder_path = variant_path.parent_path();
+        return OnEngineDownloaded(task.id, variant_path.filename().string(),
+                                  variant_folder_path.filename().string(),
+                                  variant_folder_path);
+      });
 }
 
 cpp::result<bool, std::string> EngineService::DownloadCuda(
@@ -407,12 +459,17 @@ cpp::result<bool, std::string> EngineService::DownloadCuda(
   auto downloadCudaToolkitTask{DownloadTask{
       .id = download_id,
       .type = DownloadType::CudaToolkit,
-      .items = {DownloadItem{.id = download_id,
-                             .downloadUrl = cuda_toolkit_url,
-                             .localPath = cuda_toolkit_local_path}},
+      .items = {DownloadItem{
+          .id = download_id,
+          .downloadUrl = cuda_toolkit_url,
+          .localPath = cuda_toolkit_local_path,
+          .extractPath = file_manager_utils::GetCudaToolkitPath(engine)}},
   }};
 
   auto on_finished = [engine](const DownloadTask& finishedTask) {
+    if (finishedTask.items[0].extractPath.has_value()) {
+      return;
+    }
     auto engine_path = file_manager_utils::GetCudaToolkitPath(engine);
     archive_utils::ExtractArchive(finishedTask.items[0].localPath.string(),
                                   engine_path.string());
@@ -531,6 +588,136 @@ EngineService::SetDefaultEngineVariant(const std::string& engine,
   };
 }
 
+cpp::result<DefaultEngineVariant, std::string>
+EngineService::HotSwapEngineVariant(const std::string& engine,
+                                    const std::string& version,
+                                    const std::string& variant) {
+  auto ne = NormalizeEngine(engine);
+  if (!IsEngineLoaded(ne)) {
+    return SetDefaultEngineVariant(engine, version, variant);
+  }
+
+  auto is_installed = IsEngineVariantReady(engine, version, variant);
+  if (is_installed.has_error()) {
+    return cpp::fail(is_installed.error());
+  }
+  if (!is_installed.value()) {
+    return cpp::fail("Engine variant " + version + "-" + variant +
+                     " is not installed yet!");
+  }
+
+  auto normalized_version = string_utils::RemoveSubstring(version, "v");
+  DefaultEngineVariant new_variant{
+      .engine = engine,
+      .version = "v" + normalized_version,
+      .variant = variant,
+  };
+
+  EngineHandle old_handle;
+  {
+    std::lock_guard<std::mutex> load_lock(engine_load_mutex_);
+    auto current = GetLoadedEngine(ne);
+    if (current.has_error()) {
+      return cpp::fail(current.error());
+    }
+    old_handle = current.value();
+
+    CTL_INF("Hot-swapping engine " << ne << " to " << new_variant.version
+                                   << "-" << variant);
+    auto new_handle = LoadEngineLibrary(ne, new_variant);
+    if (new_handle.has_error()) {
+      return cpp::fail(new_handle.error());
+    }
+
+    // Start the running models on the new instance before routing to it
+    auto old_engine = std::get<EngineI*>(old_handle->engine);
+    auto new_engine = std::get<EngineI*>(new_handle.value()->engine);
+    std::vector<std::string> running_models;
+    if (old_engine->IsSupported("GetModels")) {
+      old_engine->GetModels(
+          std::make_shared<Json::Value>(Json::objectValue),
+          [&running_models](Json::Value status, Json::Value res) {
+            for (const auto& m : res["data"]) {
+              running_models.push_back(m["id"].asString());
+            }
+          });
+    }
+
+    std::unordered_map<std::string, std::string> start_params;
+    if (!running_models.empty()) {
+      cortex::db::RunningModels running_models_db;
+      auto entries = running_models_db.LoadRunningModelList();
+      if (entries.has_error()) {
+        RetireEngine(ne, std::move(new_handle.value()));
+        return cpp::fail("Could not read running models: " + entries.error());
+      }
+      for (const auto& e : entries.value()) {
+        start_params[e.model] = e.start_params;
+      }
+    }
+
+    for (const auto& model : running_models) {
+      auto it = start_params.find(model);
+      if (it == start_params.end()) {
+        // Nothing to restart it with, it goes down with the old instance
+        CTL_WRN("Could not find start parameters of running model "
+                << model << ", it is not moved to the new engine variant");
+        continue;
+      }
+      // The same cpu reservation and pinning as a model start
+      auto load_params = json_helper::ParseJsonString(it->second);
+      auto cpus = cortex::hw::ReserveEngineCpus(model, load_params);
+      Json::Value stt;
+      Json::Value res;
+      {
+        cortex::hw::ScopedThreadAffinity affinity(cpus);
+        new_engine->LoadModel(
+            std::make_shared<Json::Value>(load_params),
+            [&stt, &res](Json::Value status, Json::Value r) {
+              stt = status;
+              res = r;
+            });
+      }
+      if (stt["status_code"].asInt() != 200) {
+        CTL_ERR("Failed to start model " << model << " on new engine variant: "
+                                         << res["message"].asString());
+        RetireEngine(ne, std::move(new_handle.value()));
+        return cpp::fail("Failed to start model " + model +
+                         " on new engine variant, hot-swap aborted: " +
+                         res["message"].asString());
+      }
+      CTL_INF("Model " << model << " started on new engine variant");
+    }
+
+    {
+      std::unique_lock<std::shared_mutex> lock(engines_mutex_);
+      engines_[ne] = std::move(new_handle.value());
+    }
+  }
+  CTL_INF("Engine " << ne << " is now served by " << new_variant.version << "-"
+                    << variant);
+
+  // Only llama.cpp keeps its default variant in the config
+  if (ne == kLlamaRepo) {
+    auto config = file_manager_utils::GetCortexConfig();
+    config.llamacppVersion = new_variant.version;
+    config.llamacppVariant = variant;
+    if (auto result = file_manager_utils::UpdateCortexConfig(config);
+        result.has_error()) {
+      CTL_WRN("Failed to persist default engine variant: " << result.error());
+    }
+  }
+
+  // Old instance is not reachable anymore, drain and unload it
+  RetireEngine(ne, std::move(old_handle));
+
+  return DefaultEngineVariant{
+      .engine = engine,
+      .version = normalized_version,
+      .variant = variant,
+  };
+}
+
 cpp::result<bool, std::string> EngineService::IsEngineVariantReady(
     const std::string& engine, const std::string& version,
     const std::string& variant) {
@@ -632,17 +819,20 @@ EngineService::GetInstalledEngineVariants(const std::string& engine) const {
 
 bool EngineService::IsEngineLoaded(const std::string& engine) const {
   auto ne = NormalizeEngine(engine);
+  std::shared_lock<std::shared_mutex> lock(engines_mutex_);
   return engines_.find(ne) != engines_.end();
 }
 
-cpp::result<EngineV, std::string> EngineService::GetLoadedEngine(
-    const std::string& engine_name) {
+cpp::result<EngineService::EngineHandle, std::string>
+EngineService::GetLoadedEngine(const std::string& engine_name) const {
   auto ne = NormalizeEngine(engine_name);
-  if (engines_.find(ne) == engines_.end()) {
+  std::shared_lock<std::shared_mutex> lock(engines_mutex_);
+  auto it = engines_.find(ne);
+  if (it == engines_.end()) {
     return cpp::fail("Engine " + engine_name + " is not loaded yet!");
   }
 
-  return engines_[ne].engine;
+  return it->second;
 }
 
 cpp::result<void, std::string> EngineService::LoadEngine(
@@ -654,6 +844,13 @@ cpp::result<void, std::string> EngineService::LoadEngine(
     return {};
   }
 
+  std::lock_guard<std::mutex> load_lock(engine_load_mutex_);
+  // Another thread might have loaded the engine while we were waiting
+  if (IsEngineLoaded(ne)) {
+    CTL_INF("Engine " << ne << " is already loaded");
+    return {};
+  }
+
   CTL_INF("Loading engine: " << ne);
 
   auto selected_engine_variant = GetDefaultEngineVariant(ne);
@@ -662,8 +859,24 @@ cpp::result<void, std::string> EngineService::LoadEngine(
     return cpp::fail(selected_engine_variant.error());
   }
 
+  auto info = LoadEngineLibrary(ne, selected_engine_variant.value());
+  if (info.has_error()) {
+    return cpp::fail(info.error());
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(engines_mutex_);
+    engines_[ne] = std::move(info.value());
+  }
+  CTL_DBG("Loaded engine: " << ne);
+  return {};
+}
+
+cpp::result<EngineService::EngineHandle, std::string>
+EngineService::LoadEngineLibrary(
+    const std::string& ne, const DefaultEngineVariant& selected_variant) {
   CTL_INF("Selected engine variant: "
-          << json_helper::DumpJsonString(selected_engine_variant->ToJson()));
+          << json_helper::DumpJsonString(selected_variant.ToJson()));
 
   auto user_defined_engine_path = getenv("ENGINE_PATH");
   CTL_DBG("user defined engine path: " << user_defined_engine_path);
@@ -671,12 +884,10 @@ cpp::result<void, std::string> EngineService::LoadEngine(
     if (user_defined_engine_path != nullptr) {
       return std::filesystem::path(user_defined_engine_path +
                                    GetEnginePath(ne)) /
-             selected_engine_variant->variant /
-             selected_engine_variant->version;
+             selected_variant.variant / selected_variant.version;
     } else {
       return file_manager_utils::GetEnginesContainerPath() / ne /
-             selected_engine_variant->variant /
-             selected_engine_variant->version;
+             selected_variant.variant / selected_variant.version;
     }
   }();
 
@@ -690,6 +901,8 @@ cpp::result<void, std::string> EngineService::LoadEngine(
 
   CTL_INF("Engine path: " << engine_dir_path.string());
 
+  // The engine is only published to engines_ once it is fully initialized
+  auto info = std::make_shared<EngineInfo>();
   try {
 #if defined(_WIN32)
     // TODO(?) If we only allow to load an engine at a time, the logic is simpler.
@@ -701,11 +914,11 @@ cpp::result<void, std::string> EngineService::LoadEngine(
     // Do nothing, llamacpp can re-use tensorrt-llm dependencies (need to be tested careful)
     // 3. Add dll directory if met other conditions
 
-    auto add_dll = [this](const std::string& e_type, const std::string& p) {
+    auto add_dll = [&info](const std::string& e_type, const std::string& p) {
       auto ws = std::wstring(p.begin(), p.end());
       if (auto cookie = AddDllDirectory(ws.c_str()); cookie != 0) {
         CTL_DBG("Added dll directory: " << p);
-        engines_[e_type].cookie = cookie;
+        info->cookie = cookie;
       } else {
         CTL_WRN("Could not add dll directory: " << p);
       }
@@ -714,7 +927,7 @@ cpp::result<void, std::string> EngineService::LoadEngine(
       if (auto cuda_cookie = AddDllDirectory(cuda_path.c_str());
           cuda_cookie != 0) {
         CTL_DBG("Added cuda dll directory: " << p);
-        engines_[e_type].cuda_cookie = cuda_cookie;
+        info->cuda_cookie = cuda_cookie;
       } else {
         CTL_WRN("Could not add cuda dll directory: " << p);
       }
@@ -722,15 +935,16 @@ cpp::result<void, std::string> EngineService::LoadEngine(
 
     if (bool should_use_dll_search_path = !(getenv("ENGINE_PATH"));
         should_use_dll_search_path) {
-      if (IsEngineLoaded(kLlamaRepo) && ne == kTrtLlmRepo &&
+      if (auto llama = GetLoadedEngine(kLlamaRepo);
+          llama.has_value() && ne == kTrtLlmRepo &&
           should_use_dll_search_path) {
         // Remove llamacpp dll directory
-        if (!RemoveDllDirectory(engines_[kLlamaRepo].cookie)) {
+        if (!RemoveDllDirectory(llama.value()->cookie)) {
           CTL_WRN("Could not remove dll directory: " << kLlamaRepo);
         } else {
           CTL_DBG("Removed dll directory: " << kLlamaRepo);
         }
-        if (!RemoveDllDirectory(engines_[kLlamaRepo].cuda_cookie)) {
+        if (!RemoveDllDirectory(llama.value()->cuda_cookie)) {
           CTL_WRN("Could not remove cuda dll directory: " << kLlamaRepo);
         } else {
           CTL_DBG("Removed cuda dll directory: " << kLlamaRepo);
@@ -744,7 +958,7 @@ cpp::result<void, std::string> EngineService::LoadEngine(
       }
     }
 #endif
-    engines_[ne].dl =
+    info->dl =
         std::make_unique<cortex_cpp::dylib>(engine_dir_path.string(), "engine");
 #if defined(__linux__)
     const char* name = "LD_LIBRARY_PATH";
@@ -766,14 +980,13 @@ cpp::result<void, std::string> EngineService::LoadEngine(
 
   } catch (const cortex_cpp::dylib::load_error& e) {
     CTL_ERR("Could not load engine: " << e.what());
-    engines_.erase(ne);
     return cpp::fail("Could not load engine " + ne + ": " + e.what());
   }
 
-  auto func = engines_[ne].dl->get_function<EngineI*()>("get_engine");
-  engines_[ne].engine = func();
+  auto func = info->dl->get_function<EngineI*()>("get_engine");
+  info->engine = func();
 
-  auto& en = std::get<EngineI*>(engines_[ne].engine);
+  auto& en = std::get<EngineI*>(info->engine);
   if (ne == kLlamaRepo) {  //fix for llamacpp engine first
     auto config = file_manager_utils::GetCortexConfig();
     if (en->IsSupported("SetFileLogger")) {
@@ -790,39 +1003,187 @@ cpp::result<void, std::string> EngineService::LoadEngine(
       CTL_WRN("Method SetLogLevel is not supported yet");
     }
   }
-  CTL_DBG("Loaded engine: " << ne);
-  return {};
+
+  return info;
 }
 
 cpp::result<void, std::string> EngineService::UnloadEngine(
     const std::string& engine) {
   auto ne = NormalizeEngine(engine);
-  if (!IsEngineLoaded(ne)) {
-    return cpp::fail("Engine " + ne + " is not loaded yet!");
+
+  EngineHandle handle;
+  {
+    std::lock_guard<std::mutex> load_lock(engine_load_mutex_);
+    std::unique_lock<std::shared_mutex> lock(engines_mutex_);
+    auto it = engines_.find(ne);
+    if (it == engines_.end()) {
+      return cpp::fail("Engine " + ne + " is not loaded yet!");
+    }
+    handle = std::move(it->second);
+    engines_.erase(it);
+  }
+
+  // Drain without engine_load_mutex_, other engines can load and unload
+  // meanwhile
+  if (auto r = ReleaseEngine(ne, handle); r.has_error()) {
+    // Still serving, so it stays loaded unless it was loaded again meanwhile
+    std::lock_guard<std::mutex> load_lock(engine_load_mutex_);
+    std::unique_lock<std::shared_mutex> lock(engines_mutex_);
+    if (engines_.find(ne) == engines_.end()) {
+      engines_[ne] = std::move(handle);
+      return cpp::fail(r.error());
+    }
+    lock.unlock();
+    {
+      std::lock_guard<std::mutex> release_lock(release_mutex_);
+      retired_engines_.push_back(
+          RetiredEngine{.name = ne, .handle = std::move(handle)});
+    }
+    release_cv_.notify_one();
+    return cpp::fail(r.error());
+  }
+
+  // The models of the engine went with it. Their entries stay, so a restart
+  // after hardware activation or shutdown restores them.
+  cortex::db::RunningModels running_models;
+  auto entries = running_models.LoadRunningModelList();
+  if (entries.has_error()) {
+    CTL_WRN("Failed to load running models: " << entries.error());
+    return {};
+  }
+  for (const auto& e : entries.value()) {
+    if (NormalizeEngine(e.engine) == ne) {
+      cortex::hw::CpuBudget::GetInstance().ReleaseEngineCpus(e.model);
+    }
+  }
+  return {};
+}
+
+cpp::result<void, std::string> EngineService::ReleaseEngine(
+    const std::string& ne, EngineHandle& handle) {
+  // New requests can not get the engine anymore, wait for in-flight ones
+  if (!WaitForEngineDrained(ne, handle, kEngineDrainTimeout)) {
+    return cpp::fail("Engine " + ne + " is still serving " +
+                     std::to_string(handle.use_count() - 1) +
+                     " request(s), try again later");
   }
-  EngineI* e = std::get<EngineI*>(engines_[ne].engine);
+  DestroyEngine(ne, std::move(handle));
+  return {};
+}
+
+void EngineService::RetireEngine(const std::string& ne, EngineHandle handle) {
+  if (auto r = ReleaseEngine(ne, handle); r.has_error()) {
+    CTL_WRN(r.error() << ", unloading it once drained");
+    {
+      std::lock_guard<std::mutex> lock(release_mutex_);
+      retired_engines_.push_back(
+          RetiredEngine{.name = ne, .handle = std::move(handle)});
+    }
+    release_cv_.notify_one();
+  }
+}
+
+void EngineService::DestroyEngine(const std::string& ne, EngineHandle handle) {
+  EngineI* e = std::get<EngineI*>(handle->engine);
   delete e;
 #if defined(_WIN32)
-  if (!RemoveDllDirectory(engines_[ne].cookie)) {
+  if (!RemoveDllDirectory(handle->cookie)) {
     CTL_WRN("Could not remove dll directory: " << ne);
   } else {
     CTL_DBG("Removed dll directory: " << ne);
   }
-  if (!RemoveDllDirectory(engines_[ne].cuda_cookie)) {
+  if (!RemoveDllDirectory(handle->cuda_cookie)) {
     CTL_WRN("Could not remove cuda dll directory: " << ne);
   } else {
     CTL_DBG("Removed cuda dll directory: " << ne);
   }
 #endif
-  engines_.erase(ne);
+  // Releasing the last handle unloads the library
+  handle.reset();
   CTL_DBG("Unloaded engine " + ne);
-  return {};
 }
 
-std::vector<EngineV> EngineService::GetLoadedEngines() {
-  std::vector<EngineV> loaded_engines;
+bool EngineService::WaitForEngineDrained(
+    const std::string& engine, const EngineHandle& handle,
+    std::chrono::milliseconds timeout) const {
+  constexpr auto kPollInterval = std::chrono::milliseconds(10);
+  constexpr auto kLogInterval = std::chrono::seconds(5);
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto last_log = std::chrono::steady_clock::now();
+  while (handle.use_count() > 1) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return false;
+    }
+    if (now - last_log >= kLogInterval) {
+      CTL_INF("Waiting for " << handle.use_count() - 1
+                             << " in-flight request(s) on engine " << engine);
+      last_log = now;
+    }
+    std::this_thread::sleep_for(kPollInterval);
+  }
+  return true;
+}
+
+EngineService::~EngineService() {
+  {
+    std::lock_guard<std::mutex> lock(release_mutex_);
+    stop_release_ = true;
+  }
+  release_cv_.notify_one();
+  release_thread_.join();
+}
+
+void EngineService::ReleaseHandle(EngineHandle handle) {
+  {
+    std::lock_guard<std::mutex> lock(release_mutex_);
+    released_handles_.push_back(std::move(handle));
+  }
+  release_cv_.notify_one();
+}
+
+void EngineService::RunReleaseThread() {
+  constexpr auto kPollInterval = std::chrono::milliseconds(100);
+  std::unique_lock<std::mutex> lock(release_mutex_);
+  while (!stop_release_) {
+    auto woken = [this] {
+      return stop_release_ || !released_handles_.empty();
+    };
+    if (retired_engines_.empty()) {
+      release_cv_.wait(lock, woken);
+    } else {
+      release_cv_.wait_for(lock, kPollInterval, woken);
+    }
+    auto handles = std::move(released_handles_);
+    released_handles_.clear();
+    lock.unlock();
+    handles.clear();
+    lock.lock();
+
+    std::vector<RetiredEngine> drained;
+    for (auto it = retired_engines_.begin(); it != retired_engines_.end();) {
+      if (it->handle.use_count() == 1) {
+        drained.push_back(std::move(*it));
+        it = retired_engines_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    lock.unlock();
+    for (auto& retired : drained) {
+      DestroyEngine(retired.name, std::move(retired.handle));
+    }
+    lock.lock();
+  }
+}
+
+std::vector<EngineService::EngineHandle> EngineService::GetLoadedEngines()
+    const {
+  std::shared_lock<std::shared_mutex> lock(engines_mutex_);
+  std::vector<EngineHandle> loaded_engines;
+  loaded_engines.reserve(engines_.size());
   for (const auto& [key, value] : engines_) {
-    loaded_engines.push_back(value.engine);
+    loaded_engines.push_back(value);
   }
   return loaded_engines;
 }
@@ -869,17 +1230,8 @@ cpp::result<EngineUpdateResult, std::string> EngineService::UpdateEngine(
   }
   CTL_INF("Default variant: " << default_variant->variant
                               << ", version: " + default_variant->version);
-
-  if (IsEngineLoaded(ne)) {
-    CTL_INF("Engine " << ne << " is already loaded, unloading it");
-    auto unload_res = UnloadEngine(ne);
-    if (unload_res.has_error()) {
-      CTL_INF("Failed to unload engine: " << unload_res.error());
-      return cpp::fail(unload_res.error());
-    } else {
-      CTL_INF("Engine " << ne << " unloaded successfully");
-    }
-  }
+  // The loaded engine keeps serving while the new version is downloaded, it
+  // is hot-swapped once the download finishes
 
   auto latest_version = GetLatestEngineVersion(ne);
   if (latest_version.has_error()) {
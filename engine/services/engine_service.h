@@ -1,8 +1,13 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 #include "common/engine_servicei.h"
 #include "cortex-common/EngineI.h"
@@ -42,6 +47,7 @@ class EngineService : public EngineServiceI {
   using EngineRelease = github_release_utils::GitHubRelease;
   using EngineVariant = github_release_utils::GitHubAsset;
 
+ public:
   struct EngineInfo {
     std::unique_ptr<cortex_cpp::dylib> dl;
     EngineV engine;
@@ -51,7 +57,39 @@ class EngineService : public EngineServiceI {
 #endif
   };
 
-  std::unordered_map<std::string, EngineInfo> engines_{};
+  /**
+   * Reference counted handle to a loaded engine. Callers must keep the handle
+   * alive for as long as they use the engine, including asynchronous
+   * callbacks. UnloadEngine waits until every handle has been released.
+   */
+  using EngineHandle = std::shared_ptr<EngineInfo>;
+
+ private:
+  // Readers only take a shared lock to copy a handle. Load and unload are
+  // serialized by engine_load_mutex_ and hold the exclusive lock just long
+  // enough to publish or remove an entry. Unload waits for the engine to
+  // drain after giving both locks up.
+  std::unordered_map<std::string, EngineHandle> engines_{};
+  mutable std::shared_mutex engines_mutex_;
+  std::mutex engine_load_mutex_;
+
+  // Longest UnloadEngine waits for in-flight requests
+  static constexpr auto kEngineDrainTimeout = std::chrono::seconds(30);
+
+  struct RetiredEngine {
+    std::string name;
+    EngineHandle handle;
+  };
+
+  // Handles given up by engine callbacks, and replaced engines still serving
+  // requests. Both are released on release_thread_, never on a thread of
+  // the engine itself.
+  std::mutex release_mutex_;
+  std::condition_variable release_cv_;
+  std::vector<EngineHandle> released_handles_;
+  std::vector<RetiredEngine> retired_engines_;
+  bool stop_release_ = false;
+  std::thread release_thread_;
 
  public:
   const std::vector<std::string_view> kSupportEngines = {
@@ -60,7 +98,19 @@ class EngineService : public EngineServiceI {
   explicit EngineService(std::shared_ptr<DownloadService> download_service)
       : download_service_{download_service},
         hw_inf_{.sys_inf = system_info_utils::GetSystemInfo(),
-                .cuda_driver_version = system_info_utils::GetCudaVersion()} {}
+                .cuda_driver_version = system_info_utils::GetCudaVersion()} {
+    RegisterDownloadRestorer();
+    release_thread_ = std::thread([this] { RunReleaseThread(); });
+  }
+
+  ~EngineService();
+
+  /**
+   * Drop a handle held by an engine callback. The last reference unloads the
+   * library, which must not happen while the engine thread that ran the
+   * callback still executes code inside it.
+   */
+  void ReleaseHandle(EngineHandle handle);
 
   std::vector<EngineInfo> GetEngineInfoList() const;
 
@@ -93,6 +143,17 @@ class EngineService : public EngineServiceI {
       const std::string& engine, const std::string& version,
       const std::string& variant);
 
+  /**
+   * Switch the default variant of a loaded engine without downtime. The new
+   * variant is loaded side by side with the current one and every running
+   * model is started on it. Then new requests are routed to it. The old
+   * instance is unloaded once its in-flight requests have drained. If the
+   * engine is not loaded, this behaves like SetDefaultEngineVariant.
+   */
+  cpp::result<DefaultEngineVariant, std::string> HotSwapEngineVariant(
+      const std::string& engine, const std::string& version,
+      const std::string& variant);
+
   cpp::result<DefaultEngineVariant, std::string> GetDefaultEngineVariant(
       const std::string& engine);
 
@@ -101,10 +162,10 @@ class EngineService : public EngineServiceI {
 
   bool IsEngineLoaded(const std::string& engine) const;
 
-  cpp::result<EngineV, std::string> GetLoadedEngine(
-      const std::string& engine_name);
+  cpp::result<EngineHandle, std::string> GetLoadedEngine(
+      const std::string& engine_name) const;
 
-  std::vector<EngineV> GetLoadedEngines();
+  std::vector<EngineHandle> GetLoadedEngines() const;
 
   cpp::result<void, std::string> LoadEngine(const std::string& engine_name);
 
@@ -128,6 +189,18 @@ class EngineService : public EngineServiceI {
   cpp::result<bool, std::string> DownloadCuda(const std::string& engine,
                                               bool async = false);
 
+  /**
+   * Extract a downloaded variant archive, which lives in
+   * <engine>/<variant>/<version>/, and make it the default variant.
+   */
+  DownloadService::OnDownloadTaskSuccessfully OnEngineDownloaded(
+      const std::string& engine, const std::string& variant_name,
+      const std::string& normalize_version,
+      const std::filesystem::path& variant_folder_path);
+
+  // Lets engine downloads saved by an earlier run resume with their callback
+  void RegisterDownloadRestorer();
+
   std::string GetMatchedVariant(const std::string& engine,
                                 const std::vector<std::string>& variants);
 
@@ -135,6 +208,32 @@ class EngineService : public EngineServiceI {
       const std::string& engine, const std::string& version,
       const std::string& variant);
 
+  cpp::result<EngineHandle, std::string> LoadEngineLibrary(
+      const std::string& engine, const DefaultEngineVariant& variant);
+
+  /**
+   * Wait for in-flight requests, then delete the engine and unload its
+   * library. The handle must already be removed from engines_. Fails and
+   * leaves the handle alone when requests outlive kEngineDrainTimeout.
+   */
+  cpp::result<void, std::string> ReleaseEngine(const std::string& engine,
+                                               EngineHandle& handle);
+
+  // ReleaseEngine, or on the release thread once drained if that times out
+  void RetireEngine(const std::string& engine, EngineHandle handle);
+
+  void DestroyEngine(const std::string& engine, EngineHandle handle);
+
+  /**
+   * Block until no handle other than the given one references the engine,
+   * at most for timeout. False on timeout.
+   */
+  bool WaitForEngineDrained(const std::string& engine,
+                            const EngineHandle& handle,
+                            std::chrono::milliseconds timeout) const;
+
+  void RunReleaseThread();
+
   std::shared_ptr<DownloadService> download_service_;
 
   struct HardwareInfo {
@@ -3,6 +3,7 @@
 #include <string>
 #include <thread>
 #include "services/model_service.h"
+#include "utils/hardware/cpu_budget.h"
 #include "utils/logging_utils.h"
 
 #ifdef __APPLE__
@@ -56,7 +57,10 @@ class FileWatcherService {
     }
 
     running_ = true;
-    watch_thread_ = std::thread(&FileWatcherService::WatcherThread, this);
+    watch_thread_ = std::thread([this]() {
+      cortex::hw::CpuBudget::GetInstance().PinCurrentThreadToBackground();
+      WatcherThread();
+    });
   }
 
   void stop() {
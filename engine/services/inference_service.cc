@@ -1,6 +1,8 @@
 #include "inference_service.h"
 #include <drogon/HttpTypes.h>
+#include "database/running_models.h"
 #include "utils/engine_constants.h"
+#include "utils/hardware/cpu_budget.h"
 #include "utils/function_calling/common.h"
 
 namespace services {
@@ -13,6 +15,16 @@ cpp::result<void, InferResult> InferenceService::HandleChatCompletion(
     engine_type = (*(json_body)).get("engine", kLlamaRepo).asString();
   }
   function_calling_utils::PreprocessRequest(json_body);
+  auto format_res =
+      json_schema_utils::ApplyResponseFormat(*json_body, grammar_cache_);
+  if (format_res.has_error()) {
+    Json::Value res;
+    res["message"] = format_res.error();
+    Json::Value stt;
+    stt["status_code"] = drogon::k400BadRequest;
+    LOG_WARN << format_res.error();
+    return cpp::fail(std::make_pair(stt, res));
+  }
   auto tool_choice = json_body->get("tool_choice", Json::Value::null);
   auto engine_result = engine_service_->GetLoadedEngine(engine_type);
   if (engine_result.has_error()) {
@@ -24,12 +36,22 @@ cpp::result<void, InferResult> InferenceService::HandleChatCompletion(
     return cpp::fail(std::make_pair(stt, res));
   }
 
-  auto engine = std::get<EngineI*>(engine_result.value());
+  // Keep the engine alive until the last response has been delivered
+  auto engine_handle = engine_result.value();
+  auto engine = std::get<EngineI*>(engine_handle->engine);
+  bool is_stream = json_body->get("stream", false).asBool();
   engine->HandleChatCompletion(
-      json_body, [q, tool_choice](Json::Value status, Json::Value res) {
+      json_body,
+      [q, tool_choice, is_stream, engine_handle,
+       engine_service = engine_service_](Json::Value status,
+                                         Json::Value res) mutable {
         if (!tool_choice.isNull()) {
           res["tool_choice"] = tool_choice;
         }
+        if (!is_stream || status["is_done"].asBool() ||
+            status["has_error"].asBool()) {
+          engine_service->ReleaseHandle(std::move(engine_handle));
+        }
         q->push(std::make_pair(status, res));
       });
   return {};
@@ -53,10 +75,15 @@ cpp::result<void, InferResult> InferenceService::HandleEmbedding(
     LOG_WARN << "Engine is not loaded yet";
     return cpp::fail(std::make_pair(stt, res));
   }
-  auto engine = std::get<EngineI*>(engine_result.value());
-  engine->HandleEmbedding(json_body, [q](Json::Value status, Json::Value res) {
-    q->push(std::make_pair(status, res));
-  });
+  auto engine_handle = engine_result.value();
+  auto engine = std::get<EngineI*>(engine_handle->engine);
+  engine->HandleEmbedding(
+      json_body,
+      [q, engine_handle, engine_service = engine_service_](
+          Json::Value status, Json::Value res) mutable {
+        engine_service->ReleaseHandle(std::move(engine_handle));
+        q->push(std::make_pair(status, res));
+      });
   return {};
 }
 
@@ -81,9 +108,13 @@ InferResult InferenceService::LoadModel(
     return std::make_pair(stt, r);
   }
 
-  // might need mutex here
   auto engine_result = engine_service_->GetLoadedEngine(engine_type);
-  auto engine = std::get<EngineI*>(engine_result.value());
+  if (engine_result.has_error()) {
+    r["message"] = engine_result.error();
+    stt["status_code"] = drogon::k500InternalServerError;
+    return std::make_pair(stt, r);
+  }
+  auto engine = std::get<EngineI*>(engine_result.value()->engine);
   engine->LoadModel(json_body, [&stt, &r](Json::Value status, Json::Value res) {
     stt = status;
     r = res;
@@ -110,12 +141,21 @@ InferResult InferenceService::UnloadModel(const std::string& engine_name,
   json_body["model"] = model_id;
 
   LOG_TRACE << "Start unload model";
-  auto engine = std::get<EngineI*>(engine_result.value());
+  auto engine = std::get<EngineI*>(engine_result.value()->engine);
   engine->UnloadModel(std::make_shared<Json::Value>(json_body),
                       [&r, &stt](Json::Value status, Json::Value res) {
                         stt = status;
                         r = res;
                       });
+  if (stt["status_code"].asInt() == drogon::k200OK) {
+    // The model is gone whoever asked, it must not come back on restart
+    cortex::hw::CpuBudget::GetInstance().ReleaseEngineCpus(model_id);
+    cortex::db::RunningModels running_models;
+    if (auto res = running_models.DeleteRunningModel(model_id);
+        res.has_error()) {
+      LOG_WARN << "Failed to remove running model entry: " << res.error();
+    }
+  }
   return std::make_pair(stt, r);
 }
 
@@ -141,7 +181,7 @@ InferResult InferenceService::GetModelStatus(
   }
 
   LOG_TRACE << "Start to get model status";
-  auto engine = std::get<EngineI*>(engine_result.value());
+  auto engine = std::get<EngineI*>(engine_result.value()->engine);
   engine->GetModelStatus(json_body,
                          [&stt, &r](Json::Value status, Json::Value res) {
                            stt = status;
@@ -165,7 +205,7 @@ InferResult InferenceService::GetModels(
   LOG_TRACE << "Start to get models";
   Json::Value resp_data(Json::arrayValue);
   for (const auto& loaded_engine : loaded_engines) {
-    auto e = std::get<EngineI*>(loaded_engine);
+    auto e = std::get<EngineI*>(loaded_engine->engine);
     if (e->IsSupported("GetModels")) {
       e->GetModels(json_body,
                    [&resp_data](Json::Value status, Json::Value res) {
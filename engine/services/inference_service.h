@@ -1,9 +1,12 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include "services/engine_service.h"
+#include "utils/json_schema_utils.h"
 #include "utils/result.hpp"
 
 namespace services {
@@ -25,6 +28,18 @@ struct SyncQueue {
     return res;
   }
 
+  // Empty when nothing arrived within timeout
+  std::optional<InferResult> wait_and_pop_for(
+      std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> l(mtx);
+    if (!cond.wait_for(l, timeout, [this] { return !q.empty(); })) {
+      return std::nullopt;
+    }
+    auto res = q.front();
+    q.pop();
+    return res;
+  }
+
   std::mutex mtx;
   std::condition_variable cond;
   std::queue<InferResult> q;
@@ -57,5 +72,8 @@ class InferenceService {
                      const std::string& field);
 
   std::shared_ptr<EngineService> engine_service_;
+  // Grammars compiled from response_format schemas, clients tend to send
+  // the same few schemas over and over
+  json_schema_utils::GrammarCache grammar_cache_{64};
 };
 }  // namespace services
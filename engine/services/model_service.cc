@@ -1,42 +1,213 @@
 #include "model_service.h"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <optional>
 #include <ostream>
+#include <unordered_set>
+#include "blob_store.h"
 #include "config/gguf_parser.h"
+#include "config/gguf_remote.h"
+#include "config/gguf_tokenizer.h"
+#include "config/jinja_template.h"
 #include "config/yaml_config.h"
+#include "database/gguf_metadata.h"
+#include "database/model_configs.h"
 #include "database/models.h"
+#include "database/running_models.h"
 #include "hardware_service.h"
 #include "httplib.h"
 #include "utils/cli_selection_utils.h"
 #include "utils/engine_constants.h"
+#include "utils/file_io_utils.h"
 #include "utils/file_manager_utils.h"
+#include "utils/gguf_split_utils.h"
+#include "utils/hardware/cpu_budget.h"
 #include "utils/huggingface_utils.h"
+#include "utils/json_helper.h"
 #include "utils/logging_utils.h"
 #include "utils/result.hpp"
 #include "utils/string_utils.h"
 
 namespace {
-void ParseGguf(const DownloadItem& ggufDownloadItem,
+uint64_t GetCurrentTimeMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void SaveRunningModel(const std::string& model_handle,
+                      const Json::Value& json_data) {
+  cortex::db::RunningModels running_models;
+  auto res = running_models.UpsertRunningModel(cortex::db::RunningModelEntry{
+      .model = model_handle,
+      .engine = json_data.get("engine", kLlamaEngine).asString(),
+      .start_params = json_helper::DumpJsonString(json_data)});
+  if (res.has_error()) {
+    CTL_WRN("Failed to save running model: " << res.error());
+  }
+}
+
+/**
+ * Check that the shards form one complete split set: every shard agrees on
+ * the shard count, shard numbers follow the file order, and together the
+ * shards hold the announced number of distinct tensors.
+ */
+cpp::result<void, std::string> ValidateGGUFSplits(
+    const std::vector<std::filesystem::path>& shards) {
+  try {
+    std::unordered_set<std::string> tensor_names;
+    int64_t expected_tensors = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+      config::GGUFHandler gguf_handler;
+      gguf_handler.Parse(shards[i].string(),
+                         config::GGUFHandler::ParseMode::Lazy);
+      const auto& split = gguf_handler.GetSplitInfo();
+      if (!split) {
+        return cpp::fail(shards[i].filename().string() +
+                         " is not a shard of a split model");
+      }
+      if (split->count != static_cast<int>(shards.size())) {
+        return cpp::fail(shards[i].filename().string() + " expects " +
+                         std::to_string(split->count) + " shards, found " +
+                         std::to_string(shards.size()));
+      }
+      if (split->no != static_cast<int>(i)) {
+        return cpp::fail(shards[i].filename().string() + " is shard " +
+                         std::to_string(split->no + 1) + ", expected " +
+                         std::to_string(i + 1));
+      }
+      if (i == 0) {
+        expected_tensors = split->tensors_count;
+      }
+      for (const auto& t : gguf_handler.GetTensorInfos()) {
+        if (!tensor_names.insert(t.name).second) {
+          return cpp::fail("Tensor " + t.name +
+                           " is present in more than one shard");
+        }
+      }
+    }
+    if (expected_tensors > 0 &&
+        static_cast<int64_t>(tensor_names.size()) != expected_tensors) {
+      return cpp::fail("Shards hold " + std::to_string(tensor_names.size()) +
+                       " tensors, expected " +
+                       std::to_string(expected_tensors));
+    }
+    return {};
+  } catch (const std::exception& e) {
+    return cpp::fail(std::string("Failed to read shard: ") + e.what());
+  }
+}
+
+/**
+ * Download items for a GGUF file url. The shard of a split model expands to
+ * every shard of the set, in order, so they download together as one task.
+ * The first item always carries model_id.
+ */
+std::vector<DownloadItem> GetGgufDownloadItems(
+    url_parser::Url url, const std::string& model_id,
+    const std::filesystem::path& local_dir) {
+  auto file_name = url.pathParams.back();
+  std::vector<std::string> file_names{file_name};
+  if (auto split = gguf_split_utils::ParseSplitFileName(file_name); split) {
+    file_names = gguf_split_utils::GetSplitFileNames(*split);
+  }
+
+  // Checksums are best effort, downloads of urls outside Hugging Face or
+  // failed listings are simply not verified
+  // url path: author/model/resolve/branch/[dir/]file
+  std::unordered_map<std::string, std::string> checksums;
+  std::string directory;
+  if (url.host == kHuggingFaceHost && url.pathParams.size() >= 5) {
+    for (size_t i = 4; i + 1 < url.pathParams.size(); i++) {
+      directory += (directory.empty() ? "" : "/") + url.pathParams[i];
+    }
+    auto res = huggingface_utils::GetLfsChecksums(
+        url.pathParams[0], url.pathParams[1], url.pathParams[3], directory);
+    if (res.has_value()) {
+      checksums = std::move(res.value());
+    } else {
+      CTL_WRN(res.error());
+    }
+  }
+
+  std::vector<DownloadItem> items;
+  for (const auto& name : file_names) {
+    url.pathParams.back() = name;
+    std::optional<std::string> checksum = std::nullopt;
+    auto repo_path = directory.empty() ? name : directory + "/" + name;
+    if (auto it = checksums.find(repo_path); it != checksums.end()) {
+      checksum = it->second;
+    }
+    items.push_back(DownloadItem{
+        .id = items.empty() ? model_id : name,
+        .downloadUrl = url_parser::FromUrl(url),
+        .localPath = local_dir / name,
+        .checksum = checksum,
+    });
+  }
+  return items;
+}
+
+// Remember the SHA-256 of a GGUF model file in the metadata index
+void RecordGGUFContentHash(const std::filesystem::path& path,
+                           const std::string& digest) {
+  if (path.extension() != ".gguf") {
+    return;
+  }
+  if (auto r = ModelService::GetGGUFMetadata(path.string(), digest);
+      r.has_error()) {
+    CTL_WRN(r.error());
+  }
+}
+
+// items holds the first shard first when the model is split
+void ParseGguf(const std::vector<DownloadItem>& items,
                std::optional<std::string> author,
                std::optional<std::string> name,
                std::optional<std::uint64_t> size) {
   namespace fs = std::filesystem;
   namespace fmu = file_manager_utils;
-  config::GGUFHandler gguf_handler;
+  const auto& ggufDownloadItem = items[0];
+  if (items.size() > 1) {
+    std::vector<fs::path> shards;
+    for (const auto& item : items) {
+      shards.push_back(item.localPath);
+    }
+    // Fails the download task, so the model is never registered
+    if (auto r = ValidateGGUFSplits(shards); r.has_error()) {
+      throw std::runtime_error("Invalid split model " + ggufDownloadItem.id +
+                               ": " + r.error());
+    }
+  }
+
   config::YamlHandler yaml_handler;
-  gguf_handler.Parse(ggufDownloadItem.localPath.string());
+  auto gguf_config =
+      ModelService::GetGGUFModelConfig(ggufDownloadItem.localPath.string());
+  if (gguf_config.has_error()) {
+    throw std::runtime_error(gguf_config.error());
+  }
+
+  // The download verified these against the checksums of the repository
+  for (const auto& item : items) {
+    if (item.checksum.has_value()) {
+      RecordGGUFContentHash(item.localPath, item.checksum.value());
+    }
+  }
 
-  config::ModelConfig model_config = gguf_handler.GetModelConfig();
+  config::ModelConfig model_config = gguf_config.value();
   model_config.id =
       ggufDownloadItem.localPath.parent_path().filename().string();
   // use relative path for files
-  auto file_rel_path =
-      fmu::ToRelativeCortexDataPath(fs::path(ggufDownloadItem.localPath));
-  model_config.files = {file_rel_path.string()};
+  model_config.files.clear();
+  for (const auto& item : items) {
+    model_config.files.push_back(
+        fmu::ToRelativeCortexDataPath(fs::path(item.localPath)).string());
+  }
   model_config.model = ggufDownloadItem.id;
   model_config.name =
-      name.has_value() ? name.value() : gguf_handler.GetModelConfig().name;
+      name.has_value() ? name.value() : gguf_config.value().name;
   model_config.size = size.value_or(0);
   yaml_handler.UpdateModelConfig(model_config);
 
@@ -101,23 +272,165 @@ cpp::result<DownloadTask, std::string> GetDownloadTask(
         .pathParams = {"cortexso", modelId, "resolve", branch, path}};
 
     auto local_path = model_container_path / path;
+    std::optional<std::string> checksum = std::nullopt;
+    if (value.isMember("lfs") && value["lfs"].isMember("oid")) {
+      checksum = value["lfs"]["oid"].asString();
+    }
     download_items.push_back(
         DownloadItem{.id = path,
                      .downloadUrl = download_url.ToFullPath(),
-                     .localPath = local_path});
+                     .localPath = local_path,
+                     .checksum = checksum});
   }
 
   return DownloadTask{.id = branch == "main" ? modelId : modelId + "-" + branch,
                       .type = DownloadType::Model,
                       .items = download_items};
 }
+// Summary of a remote GGUF file read from its header only, std::nullopt if
+// the server does not allow range requests or the file is not a GGUF
+std::optional<Json::Value> GetRemoteGGUFSummary(const std::string& url) {
+  config::GGUFHandler gguf_handler;
+  auto res = config::ParseRemoteGGUF(url, gguf_handler);
+  if (res.has_error()) {
+    CTL_WRN("Could not read GGUF header of " << url << ": " << res.error());
+    return std::nullopt;
+  }
+  auto report = config::GGUFTensorReport(gguf_handler.GetTensorInfos());
+  Json::Value summary;
+  summary["architecture"] = gguf_handler.GetArchitecture();
+  summary["context_length"] =
+      Json::Value::Int64(gguf_handler.GetContextLength());
+  summary["chat_template"] = gguf_handler.GetModelConfig().prompt_template;
+  summary["parameter_count"] = report["parameter_count"];
+  summary["bits_per_weight"] = report["bits_per_weight"];
+  summary["quantization"] = report["quantization"];
+  // Weights only, the KV cache depends on the context size picked at start
+  summary["estimated_memory_bytes"] = report["bytes"];
+  return summary;
+}
+
+// Moves downloaded model files into the blob store. A checksum the download
+// verified is the digest, files without one are hashed.
+void AddToBlobStore(const std::string& model_id,
+                    const std::vector<DownloadItem>& items) {
+  BlobStore blob_store;
+  for (const auto& item : items) {
+    auto res = blob_store.AddFile(model_id, item.localPath, item.checksum);
+    if (res.has_error()) {
+      CTL_WRN("Failed to add " << item.localPath.string()
+                               << " to the blob store: " << res.error());
+      continue;
+    }
+    // Linking to a blob that existed already gives the file another mtime
+    RecordGGUFContentHash(item.localPath, res.value());
+  }
+}
+
+// The weights of a cortexso model are in Git LFS, the small files are
+// rewritten in place and stay out of the store
+void AddLfsFilesToBlobStore(const std::string& model_id,
+                            const std::vector<DownloadItem>& items) {
+  std::vector<DownloadItem> lfs_items;
+  std::copy_if(items.begin(), items.end(), std::back_inserter(lfs_items),
+               [](const DownloadItem& item) {
+                 return item.checksum.has_value();
+               });
+  AddToBlobStore(model_id, lfs_items);
+}
+
+// Adds a gguf model pulled from a Hugging Face url to the model list
+DownloadService::OnDownloadTaskSuccessfully OnGgufModelDownloaded(
+    const std::string& author, std::optional<std::string> name) {
+  return [author, name](const DownloadTask& finishedTask) {
+    // Sum downloadedBytes from all items
+    uint64_t model_size = 0;
+    for (const auto& item : finishedTask.items) {
+      model_size = model_size + item.bytes.value_or(0);
+    }
+    ParseGguf(finishedTask.items, author, name, model_size);
+    AddToBlobStore(finishedTask.items[0].id, finishedTask.items);
+  };
+}
+
+// Adds a model pulled from a cortexso branch to the model list
+DownloadService::OnDownloadTaskSuccessfully OnCortexsoModelDownloaded(
+    const std::string& unique_model_id, const std::string& branch) {
+  return [unique_model_id, branch](const DownloadTask& finishedTask) {
+    const DownloadItem* model_yml_item = nullptr;
+
+    for (const auto& item : finishedTask.items) {
+      if (item.localPath.filename().string() == "model.yml") {
+        model_yml_item = &item;
+      }
+    }
+
+    if (model_yml_item == nullptr) {
+      CTL_WRN("model.yml not found in the downloaded files for " +
+              unique_model_id);
+      return;
+    }
+    CTL_INF("Adding model to modellist with branch: " << branch);
+    config::YamlHandler yaml_handler;
+    yaml_handler.ModelConfigFromFile(model_yml_item->localPath.string());
+    auto mc = yaml_handler.GetModelConfig();
+    mc.model = unique_model_id;
+    yaml_handler.UpdateModelConfig(mc);
+    yaml_handler.WriteYamlFile(model_yml_item->localPath.string());
+
+    auto rel =
+        file_manager_utils::ToRelativeCortexDataPath(model_yml_item->localPath);
+    CTL_INF("path_to_model_yaml: " << rel.string());
+
+    cortex::db::Models modellist_utils_obj;
+    cortex::db::ModelEntry model_entry{.model = unique_model_id,
+                                       .author_repo_id = "cortexso",
+                                       .branch_name = branch,
+                                       .path_to_model_yaml = rel.string(),
+                                       .model_alias = unique_model_id};
+    auto result = modellist_utils_obj.AddModelEntry(model_entry);
+    if (result.has_error()) {
+      CTL_ERR("Error adding model to modellist: " + result.error());
+    }
+    AddLfsFilesToBlobStore(unique_model_id, finishedTask.items);
+  };
+}
+
+/**
+ * Callback of a model download saved by an earlier run. The url of the
+ * model.yml of a cortexso task names its branch, the url of a gguf task its
+ * author. The name given to a gguf pull is not saved, the model keeps the
+ * name from its metadata.
+ */
+cpp::result<DownloadService::OnDownloadTaskSuccessfully, std::string>
+RestoreModelDownload(const DownloadTask& task) {
+  for (const auto& item : task.items) {
+    if (item.localPath.filename().string() != "model.yml") {
+      continue;
+    }
+    // https://huggingface.co/cortexso/<model>/resolve/<branch>/model.yml
+    auto url_obj = url_parser::FromUrlString(item.downloadUrl);
+    if (url_obj.has_error() || url_obj->pathParams.size() < 5) {
+      return cpp::fail("Unexpected model.yml url: " + item.downloadUrl);
+    }
+    return OnCortexsoModelDownloaded(task.id, url_obj->pathParams[3]);
+  }
+
+  if (task.items.empty()) {
+    return cpp::fail(static_cast<std::string>("Task has no items"));
+  }
+  auto url_obj = url_parser::FromUrlString(task.items[0].downloadUrl);
+  if (url_obj.has_error() || url_obj->pathParams.empty()) {
+    return cpp::fail("Unexpected model url: " + task.items[0].downloadUrl);
+  }
+  return OnGgufModelDownloaded(url_obj->pathParams[0], std::nullopt);
+}
 }  // namespace
 
 void ModelService::ForceIndexingModelList() {
   CTL_INF("Force indexing model list");
 
   cortex::db::Models modellist_handler;
-  config::YamlHandler yaml_handler;
 
   auto list_entry = modellist_handler.LoadModelList();
   if (list_entry.has_error()) {
@@ -130,15 +443,10 @@ void ModelService::ForceIndexingModelList() {
 
   CTL_DBG("Database model size: " + std::to_string(list_entry.value().size()));
   for (const auto& model_entry : list_entry.value()) {
-    try {
-      yaml_handler.ModelConfigFromFile(
-          fmu::ToAbsoluteCortexDataPath(
-              fs::path(model_entry.path_to_model_yaml))
-              .string());
-      auto model_config = yaml_handler.GetModelConfig();
-      Json::Value obj = model_config.ToJson();
-      yaml_handler.Reset();
-    } catch (const std::exception& e) {
+    auto model_config = ReadModelConfig(
+        fmu::ToAbsoluteCortexDataPath(fs::path(model_entry.path_to_model_yaml))
+            .string());
+    if (model_config.has_error()) {
       // remove in db
       auto remove_result =
           modellist_handler.DeleteModelEntry(model_entry.model);
@@ -238,31 +546,28 @@ std::optional<config::ModelConfig> ModelService::GetDownloadedModel(
     const std::string& modelId) const {
 
   cortex::db::Models modellist_handler;
-  config::YamlHandler yaml_handler;
   auto model_entry = modellist_handler.GetModelInfo(modelId);
   if (!model_entry.has_value()) {
     return std::nullopt;
   }
 
-  try {
-    config::YamlHandler yaml_handler;
-    namespace fs = std::filesystem;
-    namespace fmu = file_manager_utils;
-    yaml_handler.ModelConfigFromFile(
-        fmu::ToAbsoluteCortexDataPath(
-            fs::path(model_entry.value().path_to_model_yaml))
-            .string());
-    return yaml_handler.GetModelConfig();
-  } catch (const std::exception& e) {
-    LOG_ERROR << "Error reading yaml file '" << model_entry->path_to_model_yaml
-              << "': " << e.what();
+  namespace fs = std::filesystem;
+  namespace fmu = file_manager_utils;
+  auto model_config = ReadModelConfig(
+      fmu::ToAbsoluteCortexDataPath(
+          fs::path(model_entry.value().path_to_model_yaml))
+          .string());
+  if (model_config.has_error()) {
+    LOG_ERROR << model_config.error();
     return std::nullopt;
   }
+  return model_config.value();
 }
 
 cpp::result<DownloadTask, std::string> ModelService::HandleDownloadUrlAsync(
     const std::string& url, std::optional<std::string> temp_model_id,
-    std::optional<std::string> temp_name) {
+    std::optional<std::string> temp_name,
+    std::optional<DownloadPriority> priority) {
   auto url_obj = url_parser::FromUrlString(url);
   if (url_obj.has_error()) {
     return cpp::fail("Invalid url: " + url);
@@ -278,7 +583,8 @@ cpp::result<DownloadTask, std::string> ModelService::HandleDownloadUrlAsync(
   auto file_name{url_obj->pathParams.back()};
 
   if (author == "cortexso") {
-    return DownloadModelFromCortexsoAsync(model_id, url_obj->pathParams[3]);
+    return DownloadModelFromCortexsoAsync(model_id, url_obj->pathParams[3],
+                                          std::nullopt, priority);
   }
 
   if (url_obj->pathParams.size() < 5) {
@@ -311,25 +617,14 @@ cpp::result<DownloadTask, std::string> ModelService::HandleDownloadUrlAsync(
     std::filesystem::create_directories(local_path.parent_path());
   }
 
-  auto download_url = url_parser::FromUrl(url_obj.value());
-  // this assume that the model being downloaded is a single gguf file
-  auto downloadTask{DownloadTask{.id = model_id,
-                                 .type = DownloadType::Model,
-                                 .items = {DownloadItem{
-                                     .id = unique_model_id,
-                                     .downloadUrl = download_url,
-                                     .localPath = local_path,
-                                 }}}};
+  auto downloadTask{DownloadTask{
+      .id = model_id,
+      .type = DownloadType::Model,
+      .items = GetGgufDownloadItems(url_obj.value(), unique_model_id,
+                                    local_path.parent_path()),
+      .priority = priority}};
 
-  auto on_finished = [author, temp_name](const DownloadTask& finishedTask) {
-    // Sum downloadedBytes from all items
-    uint64_t model_size = 0;
-    for (const auto& item : finishedTask.items) {
-      model_size = model_size + item.bytes.value_or(0);
-    }
-    auto gguf_download_item = finishedTask.items[0];
-    ParseGguf(gguf_download_item, author, temp_name, model_size);
-  };
+  auto on_finished = OnGgufModelDownloaded(author, temp_name);
 
   downloadTask.id = unique_model_id;
   return download_service_->AddTask(downloadTask, on_finished);
@@ -384,15 +679,11 @@ cpp::result<std::string, std::string> ModelService::HandleUrl(
     std::filesystem::create_directories(local_path.parent_path());
   }
 
-  auto download_url = url_parser::FromUrl(url_obj.value());
-  // this assume that the model being downloaded is a single gguf file
-  auto downloadTask{DownloadTask{.id = model_id,
-                                 .type = DownloadType::Model,
-                                 .items = {DownloadItem{
-                                     .id = unique_model_id,
-                                     .downloadUrl = download_url,
-                                     .localPath = local_path,
-                                 }}}};
+  auto downloadTask{DownloadTask{
+      .id = model_id,
+      .type = DownloadType::Model,
+      .items = GetGgufDownloadItems(url_obj.value(), unique_model_id,
+                                    local_path.parent_path())}};
 
   auto on_finished = [author](const DownloadTask& finishedTask) {
     // Sum downloadedBytes from all items
@@ -400,8 +691,7 @@ cpp::result<std::string, std::string> ModelService::HandleUrl(
     for (const auto& item : finishedTask.items) {
       model_size = model_size + item.bytes.value_or(0);
     }
-    auto gguf_download_item = finishedTask.items[0];
-    ParseGguf(gguf_download_item, author, std::nullopt, model_size);
+    ParseGguf(finishedTask.items, author, std::nullopt, model_size);
   };
 
   auto result = download_service_->AddDownloadTask(downloadTask, on_finished);
@@ -421,7 +711,8 @@ bool ModelService::HasModel(const std::string& id) const {
 cpp::result<DownloadTask, std::string>
 ModelService::DownloadModelFromCortexsoAsync(
     const std::string& name, const std::string& branch,
-    std::optional<std::string> temp_model_id) {
+    std::optional<std::string> temp_model_id,
+    std::optional<DownloadPriority> priority) {
 
   auto download_task = GetDownloadTask(name, branch);
   if (download_task.has_error()) {
@@ -441,49 +732,11 @@ ModelService::DownloadModelFromCortexsoAsync(
     return cpp::fail("Please delete the model before downloading again");
   }
 
-  auto on_finished = [unique_model_id,
-                      branch](const DownloadTask& finishedTask) {
-    const DownloadItem* model_yml_item = nullptr;
-    auto need_parse_gguf = true;
-
-    for (const auto& item : finishedTask.items) {
-      if (item.localPath.filename().string() == "model.yml") {
-        model_yml_item = &item;
-      }
-    }
-
-    if (model_yml_item == nullptr) {
-      CTL_WRN("model.yml not found in the downloaded files for " +
-              unique_model_id);
-      return;
-    }
-    auto url_obj = url_parser::FromUrlString(model_yml_item->downloadUrl);
-    CTL_INF("Adding model to modellist with branch: " << branch);
-    config::YamlHandler yaml_handler;
-    yaml_handler.ModelConfigFromFile(model_yml_item->localPath.string());
-    auto mc = yaml_handler.GetModelConfig();
-    mc.model = unique_model_id;
-    yaml_handler.UpdateModelConfig(mc);
-    yaml_handler.WriteYamlFile(model_yml_item->localPath.string());
-
-    auto rel =
-        file_manager_utils::ToRelativeCortexDataPath(model_yml_item->localPath);
-    CTL_INF("path_to_model_yaml: " << rel.string());
-
-    cortex::db::Models modellist_utils_obj;
-    cortex::db::ModelEntry model_entry{.model = unique_model_id,
-                                       .author_repo_id = "cortexso",
-                                       .branch_name = branch,
-                                       .path_to_model_yaml = rel.string(),
-                                       .model_alias = unique_model_id};
-    auto result = modellist_utils_obj.AddModelEntry(model_entry);
-    if (result.has_error()) {
-      CTL_ERR("Error adding model to modellist: " + result.error());
-    }
-  };
+  auto on_finished = OnCortexsoModelDownloaded(unique_model_id, branch);
 
   auto task = download_task.value();
   task.id = unique_model_id;
+  task.priority = priority;
   return download_service_->AddTask(task, on_finished);
 }
 
@@ -533,6 +786,7 @@ cpp::result<std::string, std::string> ModelService::DownloadModelFromCortexso(
     if (result.has_error()) {
       CTL_ERR("Error adding model to modellist: " + result.error());
     }
+    AddLfsFilesToBlobStore(model_id, finishedTask.items);
   };
 
   auto result =
@@ -557,18 +811,16 @@ ModelService::DownloadHuggingFaceGgufModel(
     return cpp::fail("Model not found");
   }
 
-  if (!repo_info->gguf.has_value()) {
-    return cpp::fail(
-        "Not a GGUF model. Currently, only GGUF single file is "
-        "supported.");
-  }
-
+  // Split models are offered by their first shard
   std::vector<std::string> options{};
   for (const auto& sibling : repo_info->siblings) {
-    if (string_utils::EndsWith(sibling.rfilename, ".gguf")) {
+    if (gguf_split_utils::IsSelectableGGUF(sibling.rfilename)) {
       options.push_back(sibling.rfilename);
     }
   }
+  if (options.empty()) {
+    return cpp::fail("Not a GGUF model.");
+  }
   auto selection = cli_selection_utils::PrintSelection(options);
   std::cout << "Selected: " << selection.value() << std::endl;
 
@@ -584,6 +836,15 @@ cpp::result<void, std::string> ModelService::DeleteModel(
   cortex::db::Models modellist_handler;
   config::YamlHandler yaml_handler;
 
+  {
+    std::lock_guard<std::mutex> lock(chat_templates_mutex_);
+    chat_templates_.erase(model_handle);
+  }
+  {
+    std::lock_guard<std::mutex> lock(tokenizers_mutex_);
+    tokenizers_.erase(model_handle);
+  }
+
   auto result = StopModel(model_handle);
   if (result.has_error()) {
     CTL_INF("Failed to stop model " << model_handle
@@ -604,14 +865,17 @@ cpp::result<void, std::string> ModelService::DeleteModel(
     auto mc = yaml_handler.GetModelConfig();
     // Remove yaml file
     std::filesystem::remove(yaml_fp);
+    cortex::db::ModelConfigs().DeleteEntry(yaml_fp.string());
     // Remove model files if they are not imported locally
     if (model_entry.value().branch_name != "imported") {
       if (mc.files.size() > 0) {
         if (mc.engine == kLlamaRepo || mc.engine == kLlamaEngine) {
+          cortex::db::GGUFMetadata gguf_metadata;
           for (auto& file : mc.files) {
             std::filesystem::path gguf_p(
                 fmu::ToAbsoluteCortexDataPath(fs::path(file)));
             std::filesystem::remove(gguf_p);
+            gguf_metadata.DeleteEntry(gguf_p.string());
           }
         } else {
           std::filesystem::path f(
@@ -622,6 +886,12 @@ cpp::result<void, std::string> ModelService::DeleteModel(
         CTL_WRN("model config files are empty!");
       }
     }
+    // Also removes the copies of imported models
+    if (auto r = BlobStore().RemoveModel(model_entry.value().model);
+        r.has_error()) {
+      CTL_WRN("Failed to release blobs of " << model_handle << ": "
+                                            << r.error());
+    }
 
     // update model.list
     if (modellist_handler.DeleteModelEntry(model_handle)) {
@@ -637,13 +907,21 @@ cpp::result<void, std::string> ModelService::DeleteModel(
 
 cpp::result<StartModelResult, std::string> ModelService::StartModel(
     const std::string& model_handle,
-    const StartParameterOverride& params_override) {
+    const StartParameterOverride& params_override,
+    const OnStartPhase& on_phase) {
   namespace fs = std::filesystem;
   namespace fmu = file_manager_utils;
   cortex::db::Models modellist_handler;
   config::YamlHandler yaml_handler;
 
+  auto notify = [&on_phase](ModelStartJob::Phase phase) {
+    if (on_phase) {
+      on_phase(phase);
+    }
+  };
+
   try {
+    notify(ModelStartJob::Phase::Prefetching);
     Json::Value json_data;
     // Currently we don't support download vision models, so we need to bypass check
     if (!params_override.bypass_model_check()) {
@@ -671,6 +949,7 @@ cpp::result<StartModelResult, std::string> ModelService::StartModel(
       json_data["user_prompt"] = mc.user_template;
       json_data["ai_prompt"] = mc.ai_template;
     } else {
+      std::lock_guard<std::mutex> lock(bypass_stop_check_mutex_);
       bypass_stop_check_set_.insert(model_handle);
     }
 
@@ -697,6 +976,9 @@ cpp::result<StartModelResult, std::string> ModelService::StartModel(
     ASSIGN_IF_PRESENT(json_data, params_override, model_path);
 #undef ASSIGN_IF_PRESENT
 
+    // The weights load from the page cache while the engine gets ready
+    PrefetchModelFile(json_data["model_path"].asString());
+
     CTL_INF(json_data.toStyledString());
     // TODO(sang) move this into another function
     // Calculate ram/vram needed to load model
@@ -795,17 +1077,36 @@ cpp::result<StartModelResult, std::string> ModelService::StartModel(
     }
 
     assert(!!inference_svc_);
-    auto ir =
-        inference_svc_->LoadModel(std::make_shared<Json::Value>(json_data));
+    notify(ModelStartJob::Phase::EngineLoading);
+    auto cpus = cortex::hw::ReserveEngineCpus(model_handle, json_data);
+    auto ir = [&] {
+      // Engine threads created while loading inherit the model's cpus
+      cortex::hw::ScopedThreadAffinity affinity(cpus);
+      return inference_svc_->LoadModel(
+          std::make_shared<Json::Value>(json_data));
+    }();
     auto status = std::get<0>(ir)["status_code"].asInt();
     auto data = std::get<1>(ir);
     if (status == httplib::StatusCode::OK_200) {
+      notify(ModelStartJob::Phase::Warmup);
+      SetRunningContextLength(model_handle, json_data, true);
+      WarmPromptCaches(model_handle);
+      // A synchronous start answers once the model is loaded, only start
+      // jobs wait for the first decode
+      if (on_phase) {
+        WarmUpModel(json_data);
+      }
+      SaveRunningModel(model_handle, json_data);
       return StartModelResult{.success = true, .warning = warning};
     } else if (status == httplib::StatusCode::Conflict_409) {
       CTL_INF("Model '" + model_handle + "' is already loaded");
+      SetRunningContextLength(model_handle, json_data, false);
+      WarmPromptCaches(model_handle);
+      SaveRunningModel(model_handle, json_data);
       return StartModelResult{.success = true, .warning = warning};
     } else {
       // only report to user the error
+      cortex::hw::CpuBudget::GetInstance().ReleaseEngineCpus(model_handle);
       CTL_ERR("Model failed to start with status code: " << status);
       return cpp::fail("Model failed to start: " + data["message"].asString());
     }
@@ -823,8 +1124,12 @@ cpp::result<bool, std::string> ModelService::StopModel(
   config::YamlHandler yaml_handler;
 
   try {
-    auto bypass_check = (bypass_stop_check_set_.find(model_handle) !=
-                         bypass_stop_check_set_.end());
+    bool bypass_check = false;
+    {
+      std::lock_guard<std::mutex> lock(bypass_stop_check_mutex_);
+      bypass_check = (bypass_stop_check_set_.find(model_handle) !=
+                      bypass_stop_check_set_.end());
+    }
     std::string engine_name = "";
     if (!bypass_check) {
       auto model_entry = modellist_handler.GetModelInfo(model_handle);
@@ -848,8 +1153,13 @@ cpp::result<bool, std::string> ModelService::StopModel(
     auto data = std::get<1>(ir);
     if (status == httplib::StatusCode::OK_200) {
       if (bypass_check) {
+        std::lock_guard<std::mutex> lock(bypass_stop_check_mutex_);
         bypass_stop_check_set_.erase(model_handle);
       }
+      {
+        std::lock_guard<std::mutex> lock(running_ctx_lens_mutex_);
+        running_ctx_lens_.erase(model_handle);
+      }
       return true;
     } else {
       CTL_ERR("Model failed to stop with status code: " << status);
@@ -901,6 +1211,667 @@ cpp::result<bool, std::string> ModelService::GetModelStatus(
   }
 }
 
+cpp::result<cortex::db::GGUFMetadataEntry, std::string>
+ModelService::GetGGUFMetadata(const std::string& path,
+                              const std::optional<std::string>& content_hash) {
+  namespace fs = std::filesystem;
+  try {
+    auto file_size = fs::file_size(path);
+    auto mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     fs::last_write_time(path).time_since_epoch())
+                     .count();
+    cortex::db::GGUFMetadata gguf_metadata;
+    if (auto entry = gguf_metadata.GetEntry(path, file_size, mtime); entry) {
+      if (content_hash && entry->content_hash != content_hash.value()) {
+        entry->content_hash = content_hash.value();
+        if (auto r = gguf_metadata.UpsertEntry(entry.value()); r.has_error()) {
+          CTL_WRN("Failed to save GGUF metadata: " << r.error());
+        }
+      }
+      return entry.value();
+    }
+
+    config::GGUFHandler gguf_handler;
+    gguf_handler.Parse(path, config::GGUFHandler::ParseMode::Lazy);
+    const auto& tensors = gguf_handler.GetTensorInfos();
+    uint64_t parameter_count = 0;
+    uint64_t tensor_bytes = 0;
+    for (const auto& t : tensors) {
+      parameter_count += t.ElementCount();
+      tensor_bytes += t.ByteSize();
+    }
+    const auto& mc = gguf_handler.GetModelConfig();
+    cortex::db::GGUFMetadataEntry entry{
+        .path = path,
+        .file_size = file_size,
+        .mtime = mtime,
+        .content_hash = content_hash.value_or(""),
+        .architecture = gguf_handler.GetArchitecture(),
+        .context_length = gguf_handler.GetContextLength(),
+        .chat_template = mc.prompt_template,
+        .bos_token = gguf_handler.GetBosToken(),
+        .eos_token = gguf_handler.GetEosToken(),
+        .tensor_count = tensors.size(),
+        .parameter_count = parameter_count,
+        .estimated_memory_bytes = tensor_bytes,
+        .model_config = json_helper::DumpJsonString(mc.ToJson()),
+        .tensors =
+            json_helper::DumpJsonString(config::GGUFTensorInfosToJson(tensors)),
+    };
+    if (auto r = gguf_metadata.UpsertEntry(entry); r.has_error()) {
+      CTL_WRN("Failed to save GGUF metadata: " << r.error());
+    }
+    return entry;
+  } catch (const std::exception& e) {
+    return cpp::fail("Fail to read GGUF metadata of '" + path +
+                     "': " + e.what());
+  }
+}
+
+cpp::result<config::ModelConfig, std::string> ModelService::ReadModelConfig(
+    const std::string& yaml_path) {
+  namespace fs = std::filesystem;
+  try {
+    auto file_size = fs::file_size(yaml_path);
+    auto mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     fs::last_write_time(yaml_path).time_since_epoch())
+                     .count();
+    cortex::db::ModelConfigs model_configs;
+    if (auto entry = model_configs.GetEntry(yaml_path, file_size, mtime);
+        entry) {
+      config::ModelConfig mc;
+      // Entries written by an older field table are parsed again
+      if (mc.FromBinary(entry->config)) {
+        return mc;
+      }
+    }
+
+    config::YamlHandler yaml_handler;
+    yaml_handler.ModelConfigFromFile(yaml_path);
+    const auto& mc = yaml_handler.GetModelConfig();
+    cortex::db::ModelConfigEntry entry{.path = yaml_path,
+                                       .file_size = file_size,
+                                       .mtime = mtime,
+                                       .config = mc.ToBinary()};
+    if (auto r = model_configs.UpsertEntry(entry); r.has_error()) {
+      CTL_WRN("Failed to save model config: " << r.error());
+    }
+    return mc;
+  } catch (const std::exception& e) {
+    return cpp::fail("Error reading yaml file '" + yaml_path +
+                     "': " + e.what());
+  }
+}
+
+cpp::result<config::ModelConfig, std::string>
+ModelService::GetGGUFModelConfig(const std::string& path) {
+  auto entry = GetGGUFMetadata(path);
+  if (entry.has_error()) {
+    return cpp::fail(entry.error());
+  }
+  config::ModelConfig mc;
+  mc.FromJson(json_helper::ParseJsonString(entry->model_config));
+  // id and model are not restored by FromJson
+  mc.id = mc.name;
+  mc.model = mc.name;
+  mc.created = std::time(nullptr);
+  return mc;
+}
+
+cpp::result<void, std::string> ModelService::ApplyChatTemplate(
+    const std::string& model_handle, const Json::Value& messages,
+    bool add_generation_prompt, std::string& out) {
+  auto chat_template = GetChatTemplate(model_handle);
+  if (chat_template.has_error()) {
+    return cpp::fail(chat_template.error());
+  }
+  return chat_template->tmpl->Render(
+      config::ChatTemplateContext(messages, add_generation_prompt,
+                                  chat_template->bos_token,
+                                  chat_template->eos_token),
+      out);
+}
+
+cpp::result<std::shared_ptr<const config::GGUFTokenizer>, std::string>
+ModelService::GetTokenizer(const std::string& model_handle) {
+  {
+    std::lock_guard<std::mutex> lock(tokenizers_mutex_);
+    if (auto it = tokenizers_.find(model_handle); it != tokenizers_.end()) {
+      if (it->second == nullptr) {
+        return cpp::fail("Model '" + model_handle +
+                         "' has no supported tokenizer");
+      }
+      return it->second;
+    }
+  }
+
+  auto path = GetGGUFPath(model_handle);
+  if (path.has_error()) {
+    return cpp::fail(path.error());
+  }
+  config::GGUFHandler gguf_handler;
+  try {
+    gguf_handler.Parse(path.value(), config::GGUFHandler::ParseMode::Vocab);
+  } catch (const std::exception& e) {
+    return cpp::fail("Fail to read GGUF file of '" + model_handle +
+                     "': " + e.what());
+  }
+  auto tokenizer = config::GGUFTokenizer::Create(gguf_handler.GetVocab());
+  if (tokenizer.has_error()) {
+    // Remember the failure, chat completions look the tokenizer up every time
+    std::lock_guard<std::mutex> lock(tokenizers_mutex_);
+    tokenizers_[model_handle] = nullptr;
+    return cpp::fail(tokenizer.error());
+  }
+
+  std::lock_guard<std::mutex> lock(tokenizers_mutex_);
+  tokenizers_[model_handle] = tokenizer.value();
+  return tokenizer.value();
+}
+
+cpp::result<void, std::string> ModelService::CheckContextLength(
+    const Json::Value& request) {
+  auto model_handle = request.get("model", "").asString();
+  const auto& messages = request["messages"];
+  if (model_handle.empty() || !messages.isArray()) {
+    return {};
+  }
+  const auto& max_tokens = request.isMember("max_completion_tokens")
+                               ? request["max_completion_tokens"]
+                               : request["max_tokens"];
+  if (!max_tokens.isNull() && !max_tokens.isInt64()) {
+    return {};
+  }
+  // Building the caches reads the GGUF file, that is left to the model start
+  if (!HasPromptCaches(model_handle)) {
+    return {};
+  }
+  auto tokenizer = GetTokenizer(model_handle);
+  if (tokenizer.has_error()) {
+    return {};
+  }
+  // The model yml may have changed, or been overridden, since the start
+  int64_t ctx_len = 0;
+  {
+    std::lock_guard<std::mutex> lock(running_ctx_lens_mutex_);
+    if (auto it = running_ctx_lens_.find(model_handle);
+        it != running_ctx_lens_.end()) {
+      ctx_len = it->second;
+    }
+  }
+  if (ctx_len <= 0) {
+    return {};
+  }
+
+  thread_local std::string prompt;
+  if (ApplyChatTemplate(model_handle, messages, true, prompt).has_error()) {
+    return {};
+  }
+  // The rendered template already has the BOS token if the model wants one
+  auto prompt_tokens =
+      static_cast<int64_t>(tokenizer.value()->CountTokens(prompt, false));
+  auto completion_tokens = max_tokens.isNull() ? 0 : max_tokens.asInt64();
+  auto requested = prompt_tokens + std::max<int64_t>(completion_tokens, 0);
+  if (requested > ctx_len) {
+    return cpp::fail("This model's maximum context length is " +
+                     std::to_string(ctx_len) +
+                     " tokens. However, you requested " +
+                     std::to_string(requested) + " tokens (" +
+                     std::to_string(prompt_tokens) + " in the messages, " +
+                     std::to_string(completion_tokens) +
+                     " in the completion). Please reduce the length of the "
+                     "messages or completion.");
+  }
+  return {};
+}
+
+cpp::result<std::string, std::string> ModelService::GetGGUFPath(
+    const std::string& model_handle) const {
+  namespace fs = std::filesystem;
+  namespace fmu = file_manager_utils;
+  auto mc = GetDownloadedModel(model_handle);
+  if (!mc) {
+    return cpp::fail("Model not found: " + model_handle);
+  }
+  // Split models keep the metadata in the first shard
+  auto file = std::find_if(mc->files.begin(), mc->files.end(),
+                           [](const std::string& f) {
+                             return fs::path(f).extension() == ".gguf";
+                           });
+  if (file == mc->files.end()) {
+    return cpp::fail("Model '" + model_handle + "' is not a GGUF model");
+  }
+  return fmu::ToAbsoluteCortexDataPath(fs::path(*file)).string();
+}
+
+cpp::result<ModelService::CompiledChatTemplate, std::string>
+ModelService::GetChatTemplate(const std::string& model_handle) {
+  {
+    std::lock_guard<std::mutex> lock(chat_templates_mutex_);
+    if (auto it = chat_templates_.find(model_handle);
+        it != chat_templates_.end()) {
+      return it->second;
+    }
+  }
+
+  auto path = GetGGUFPath(model_handle);
+  if (path.has_error()) {
+    return cpp::fail(path.error());
+  }
+
+  // The raw template is not part of the metadata index, read the header
+  auto res = [&]() -> cpp::result<CompiledChatTemplate, std::string> {
+    config::GGUFHandler gguf_handler;
+    try {
+      gguf_handler.Parse(path.value(), config::GGUFHandler::ParseMode::Lazy);
+    } catch (const std::exception& e) {
+      return cpp::fail("Fail to read GGUF file of '" + model_handle +
+                       "': " + e.what());
+    }
+    if (gguf_handler.GetChatTemplate().empty()) {
+      return cpp::fail("Model '" + model_handle + "' has no chat template");
+    }
+    auto tmpl =
+        config::JinjaTemplate::Compile(gguf_handler.GetChatTemplate());
+    if (tmpl.has_error()) {
+      return cpp::fail(tmpl.error());
+    }
+    return CompiledChatTemplate{
+        .tmpl = tmpl.value(),
+        .bos_token = gguf_handler.GetBosToken(),
+        .eos_token = gguf_handler.GetEosToken(),
+    };
+  }();
+
+  // Failures are remembered too, the file does not change until the model is
+  // deleted
+  std::lock_guard<std::mutex> lock(chat_templates_mutex_);
+  chat_templates_.try_emplace(model_handle, res);
+  return res;
+}
+
+void ModelService::WarmPromptCaches(const std::string& model_handle) {
+  if (auto r = GetTokenizer(model_handle); r.has_error()) {
+    CTL_INF("Context length of '" << model_handle
+                                  << "' is not checked: " << r.error());
+    return;
+  }
+  if (auto r = GetChatTemplate(model_handle); r.has_error()) {
+    CTL_INF("Context length of '" << model_handle
+                                  << "' is not checked: " << r.error());
+  }
+}
+
+void ModelService::SetRunningContextLength(const std::string& model_handle,
+                                           const Json::Value& load_params,
+                                           bool replace) {
+  const auto& ctx_len = load_params["ctx_len"];
+  if (!ctx_len.isIntegral()) {
+    // The engine picks one, which is not known here
+    return;
+  }
+  std::lock_guard<std::mutex> lock(running_ctx_lens_mutex_);
+  if (replace) {
+    running_ctx_lens_[model_handle] = ctx_len.asInt64();
+  } else {
+    running_ctx_lens_.try_emplace(model_handle, ctx_len.asInt64());
+  }
+}
+
+void ModelService::PrefetchModelFile(const std::string& model_path) {
+  if (model_path.empty()) {
+    return;
+  }
+  if (!file_io_utils::PrefetchFile(model_path)) {
+    CTL_DBG("Could not prefetch " << model_path);
+  }
+}
+
+void ModelService::WarmUpModel(const Json::Value& load_params) {
+  auto model_handle = load_params["model"].asString();
+  auto body = std::make_shared<Json::Value>();
+  (*body)["model"] = model_handle;
+  (*body)["engine"] = load_params.get("engine", kLlamaEngine);
+  auto embedding = load_params.get("embedding", false).asBool();
+  if (embedding) {
+    (*body)["input"] = "Hello";
+  } else {
+    Json::Value message;
+    message["role"] = "user";
+    message["content"] = "Hello";
+    (*body)["messages"].append(message);
+    (*body)["max_tokens"] = 1;
+    (*body)["stream"] = false;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto q = std::make_shared<services::SyncQueue>();
+  auto ir = embedding ? inference_svc_->HandleEmbedding(q, body)
+                      : inference_svc_->HandleChatCompletion(q, body);
+  if (ir.has_error()) {
+    CTL_WRN("Could not warm up '" << model_handle << "': "
+                                  << std::get<1>(ir.error())["message"]);
+    return;
+  }
+  // The engine keeps working on it after a timeout, the queue outlives us
+  auto res = q->wait_and_pop_for(kWarmupTimeout);
+  if (!res.has_value()) {
+    CTL_WRN("Warmup of '" << model_handle << "' did not finish in "
+                          << kWarmupTimeout.count() << "s");
+    return;
+  }
+  if (res->first["has_error"].asBool()) {
+    CTL_WRN("Warmup of '" << model_handle
+                          << "' failed: " << res->second.toStyledString());
+    return;
+  }
+  CTL_INF("Warmed up '" << model_handle << "' in "
+                        << std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count()
+                        << "ms");
+}
+
+bool ModelService::HasPromptCaches(const std::string& model_handle) {
+  std::scoped_lock lock(tokenizers_mutex_, chat_templates_mutex_);
+  return tokenizers_.count(model_handle) > 0 &&
+         chat_templates_.count(model_handle) > 0;
+}
+
+cpp::result<Json::Value, std::string> ModelService::InspectModel(
+    const std::string& model_handle) const {
+  namespace fs = std::filesystem;
+  namespace fmu = file_manager_utils;
+  auto mc = GetDownloadedModel(model_handle);
+  if (!mc) {
+    return cpp::fail("Model not found: " + model_handle);
+  }
+
+  try {
+    std::vector<config::GGUFTensorInfo> tensors;
+    std::string architecture;
+    for (const auto& file : mc->files) {
+      auto path = fmu::ToAbsoluteCortexDataPath(fs::path(file));
+      if (path.extension() != ".gguf") {
+        continue;
+      }
+      auto entry = GetGGUFMetadata(path.string());
+      if (entry.has_error()) {
+        return cpp::fail(entry.error());
+      }
+      if (architecture.empty()) {
+        architecture = entry->architecture;
+      }
+      auto infos = config::GGUFTensorInfosFromJson(
+          json_helper::ParseJsonString(entry->tensors));
+      tensors.insert(tensors.end(), std::make_move_iterator(infos.begin()),
+                     std::make_move_iterator(infos.end()));
+    }
+    if (tensors.empty()) {
+      return cpp::fail("Model '" + model_handle +
+                       "' does not have any GGUF tensors");
+    }
+
+    auto res = config::GGUFTensorReport(tensors);
+    res["model"] = model_handle;
+    res["architecture"] = architecture;
+    return res;
+  } catch (const std::exception& e) {
+    return cpp::fail("Fail to inspect model with ID '" + model_handle +
+                     "': " + e.what());
+  }
+}
+
+ModelService::~ModelService() {
+  {
+    std::lock_guard<std::mutex> lock(start_jobs_mutex_);
+    stop_start_workers_ = true;
+  }
+  start_jobs_cv_.notify_all();
+  for (auto& worker : start_workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+void ModelService::RegisterDownloadRestorer() {
+  download_service_->RegisterTaskRestorer(DownloadType::Model,
+                                          RestoreModelDownload);
+}
+
+void ModelService::InitializeStartWorkers() {
+  // Async start is only available when running as a server
+  if (!event_queue_) {
+    return;
+  }
+  for (int i = 0; i < kMaxConcurrentStartJobs; ++i) {
+    start_workers_.emplace_back(&ModelService::StartWorkerThread, this);
+  }
+}
+
+cpp::result<ModelStartJob, std::string> ModelService::StartModelAsync(
+    const std::string& model_handle,
+    const StartParameterOverride& params_override) {
+  if (start_workers_.empty()) {
+    return cpp::fail("Asynchronous model start is not available");
+  }
+
+  ModelStartJob job;
+  {
+    std::lock_guard<std::mutex> lock(start_jobs_mutex_);
+    for (const auto& [id, j] : start_jobs_) {
+      if (j.model == model_handle && !j.IsFinished()) {
+        CTL_INF("Model '" << model_handle
+                          << "' is already being started, job: " << id);
+        return j;
+      }
+    }
+
+    job = EnqueueStartJobNoLock(PendingStart{
+        .model_handle = model_handle, .params_override = params_override});
+  }
+  start_jobs_cv_.notify_one();
+
+  event_queue_->enqueue(cortex::event::EventType::ModelLoadEvent,
+                        cortex::event::ModelLoadEvent{.job_ = job});
+  return job;
+}
+
+ModelStartJob ModelService::EnqueueStartJobNoLock(PendingStart pending) {
+  static std::atomic<uint64_t> job_counter{0};
+  auto now = GetCurrentTimeMs();
+  ModelStartJob job{
+      .id = "start-" + std::to_string(now) + "-" +
+            std::to_string(job_counter++),
+      .model = pending.model_handle,
+      .phase = ModelStartJob::Phase::Queued,
+      .created_at = now,
+      .updated_at = now};
+  start_jobs_[job.id] = job;
+  pending.job_id = job.id;
+  pending_starts_.push_back(std::move(pending));
+  return job;
+}
+
+cpp::result<ModelStartJob, std::string> ModelService::GetStartModelJob(
+    const std::string& job_id) const {
+  std::lock_guard<std::mutex> lock(start_jobs_mutex_);
+  if (auto it = start_jobs_.find(job_id); it != start_jobs_.end()) {
+    return it->second;
+  }
+  return cpp::fail("Start job not found: " + job_id);
+}
+
+void ModelService::RestoreRunningModels() {
+  if (start_workers_.empty()) {
+    CTL_WRN("Asynchronous model start is not available, skip restoring");
+    return;
+  }
+
+  cortex::db::RunningModels running_models;
+  auto entries = running_models.LoadRunningModelList();
+  if (entries.has_error()) {
+    CTL_WRN("Failed to load running models: " << entries.error());
+    return;
+  }
+
+  for (const auto& entry : entries.value()) {
+    auto start_params = json_helper::ParseJsonString(entry.start_params);
+    if (!start_params.isObject()) {
+      CTL_WRN("Invalid start parameters for model '" << entry.model
+                                                     << "', skip restoring");
+      running_models.DeleteRunningModel(entry.model);
+      continue;
+    }
+
+    ModelStartJob job;
+    {
+      std::lock_guard<std::mutex> lock(start_jobs_mutex_);
+      job = EnqueueStartJobNoLock(PendingStart{.model_handle = entry.model,
+                                               .start_params = start_params});
+    }
+    start_jobs_cv_.notify_one();
+    CTL_INF("Restoring model '" << entry.model << "', job: " << job.id);
+    event_queue_->enqueue(cortex::event::EventType::ModelLoadEvent,
+                          cortex::event::ModelLoadEvent{.job_ = job});
+  }
+}
+
+cpp::result<StartModelResult, std::string> ModelService::RestoreModel(
+    const std::string& model_handle, const Json::Value& start_params,
+    const OnStartPhase& on_phase) {
+  try {
+    on_phase(ModelStartJob::Phase::Prefetching);
+    auto const& mp = start_params["model_path"].asString();
+    if (!mp.empty() && !std::filesystem::exists(mp)) {
+      cortex::db::RunningModels running_models;
+      running_models.DeleteRunningModel(model_handle);
+      return cpp::fail("Model file does not exist anymore: " + mp);
+    }
+    PrefetchModelFile(mp);
+    // Models started from a raw path are not in the model list
+    if (!HasModel(model_handle)) {
+      std::lock_guard<std::mutex> lock(bypass_stop_check_mutex_);
+      bypass_stop_check_set_.insert(model_handle);
+    }
+
+    assert(!!inference_svc_);
+    on_phase(ModelStartJob::Phase::EngineLoading);
+    auto load_params = start_params;
+    auto cpus = cortex::hw::ReserveEngineCpus(model_handle, load_params);
+    auto ir = [&] {
+      cortex::hw::ScopedThreadAffinity affinity(cpus);
+      return inference_svc_->LoadModel(
+          std::make_shared<Json::Value>(load_params));
+    }();
+    auto status = std::get<0>(ir)["status_code"].asInt();
+    auto data = std::get<1>(ir);
+    if (status == httplib::StatusCode::OK_200 ||
+        status == httplib::StatusCode::Conflict_409) {
+      on_phase(ModelStartJob::Phase::Warmup);
+      SetRunningContextLength(model_handle, load_params,
+                              status == httplib::StatusCode::OK_200);
+      WarmPromptCaches(model_handle);
+      if (status == httplib::StatusCode::OK_200) {
+        WarmUpModel(load_params);
+      }
+      return StartModelResult{.success = true};
+    }
+    cortex::hw::CpuBudget::GetInstance().ReleaseEngineCpus(model_handle);
+    CTL_ERR("Model failed to restore with status code: " << status);
+    return cpp::fail("Model failed to start: " + data["message"].asString());
+  } catch (const std::exception& e) {
+    return cpp::fail("Fail to restore model with ID '" + model_handle +
+                     "': " + e.what());
+  }
+}
+
+void ModelService::StartWorkerThread() {
+  while (true) {
+    PendingStart pending;
+    {
+      std::unique_lock<std::mutex> lock(start_jobs_mutex_);
+      start_jobs_cv_.wait(lock, [this] {
+        return stop_start_workers_ || !pending_starts_.empty();
+      });
+      if (stop_start_workers_) {
+        return;
+      }
+      pending = std::move(pending_starts_.front());
+      pending_starts_.pop_front();
+    }
+
+    auto on_phase = [this, &pending](ModelStartJob::Phase phase) {
+      UpdateStartJob(pending.job_id, phase);
+    };
+    auto result = pending.start_params.has_value()
+                      ? RestoreModel(pending.model_handle,
+                                     *pending.start_params, on_phase)
+                      : StartModel(pending.model_handle,
+                                   pending.params_override, on_phase);
+    if (result.has_error()) {
+      CTL_WRN("Failed to start model '" << pending.model_handle
+                                        << "': " << result.error());
+      UpdateStartJob(pending.job_id, ModelStartJob::Phase::Failed,
+                     result.error());
+      continue;
+    }
+    if (!result.value().success) {
+      UpdateStartJob(pending.job_id, ModelStartJob::Phase::Failed,
+                     "Model failed to start");
+      continue;
+    }
+
+    // The engine has returned from LoadModel, make sure it reports the model
+    // as loaded before announcing it is ready
+    if (!pending.params_override.bypass_model_check() &&
+        HasModel(pending.model_handle)) {
+      if (auto st = GetModelStatus(pending.model_handle); st.has_error()) {
+        CTL_WRN("Model '" << pending.model_handle
+                          << "' started but status is unavailable: "
+                          << st.error());
+      }
+    }
+    UpdateStartJob(pending.job_id, ModelStartJob::Phase::Ready, std::nullopt,
+                   result.value().warning);
+  }
+}
+
+void ModelService::UpdateStartJob(const std::string& job_id,
+                                  ModelStartJob::Phase phase,
+                                  std::optional<std::string> error,
+                                  std::optional<std::string> warning) {
+  ModelStartJob job;
+  {
+    std::lock_guard<std::mutex> lock(start_jobs_mutex_);
+    auto it = start_jobs_.find(job_id);
+    if (it == start_jobs_.end()) {
+      return;
+    }
+    it->second.phase = phase;
+    it->second.error = std::move(error);
+    if (warning) {
+      it->second.warning = std::move(warning);
+    }
+    it->second.updated_at = GetCurrentTimeMs();
+    job = it->second;
+
+    if (job.IsFinished()) {
+      finished_start_jobs_.push_back(job_id);
+      while (finished_start_jobs_.size() > kMaxFinishedStartJobs) {
+        start_jobs_.erase(finished_start_jobs_.front());
+        finished_start_jobs_.pop_front();
+      }
+    }
+  }
+
+  CTL_INF("Start job " << job_id << " (" << job.model
+                       << "): " << ModelStartPhaseToString(phase));
+  event_queue_->enqueue(cortex::event::EventType::ModelLoadEvent,
+                        cortex::event::ModelLoadEvent{.job_ = job});
+}
+
 cpp::result<ModelPullInfo, std::string> ModelService::GetModelPullInfo(
     const std::string& input) {
   if (input.empty()) {
@@ -930,10 +1901,18 @@ cpp::result<ModelPullInfo, std::string> ModelService::GetModelPullInfo(
           .available_models = {},
           .download_url = url_parser::FromUrl(url_obj.value())};
     }
+    auto download_url = url_parser::FromUrl(url_obj.value());
+    // Shards only hold a part of the tensor table, skip them
+    std::optional<Json::Value> gguf_summary = std::nullopt;
+    if (string_utils::EndsWith(file_name, ".gguf") &&
+        !gguf_split_utils::ParseSplitFileName(file_name).has_value()) {
+      gguf_summary = GetRemoteGGUFSummary(download_url);
+    }
     return ModelPullInfo{.id = author + ":" + model_id + ":" + file_name,
                          .downloaded_models = {},
                          .available_models = {},
-                         .download_url = url_parser::FromUrl(url_obj.value())};
+                         .download_url = download_url,
+                         .gguf_summary = gguf_summary};
   }
 
   if (input.find(":") != std::string::npos) {
@@ -963,18 +1942,15 @@ cpp::result<ModelPullInfo, std::string> ModelService::GetModelPullInfo(
         return cpp::fail("Model not found");
       }
 
-      if (!repo_info->gguf.has_value()) {
-        return cpp::fail(
-            "Not a GGUF model. Currently, only GGUF single file is "
-            "supported.");
-      }
-
       std::vector<std::string> options{};
       for (const auto& sibling : repo_info->siblings) {
-        if (string_utils::EndsWith(sibling.rfilename, ".gguf")) {
+        if (gguf_split_utils::IsSelectableGGUF(sibling.rfilename)) {
           options.push_back(sibling.rfilename);
         }
       }
+      if (options.empty()) {
+        return cpp::fail("Not a GGUF model.");
+      }
 
       return ModelPullInfo{
           .id = author + ":" + model_name,
@@ -1,10 +1,21 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include "common/engine_servicei.h"
+#include "common/event.h"
+#include "common/model_start_job.h"
+#include "config/gguf_tokenizer.h"
+#include "config/jinja_template.h"
 #include "config/model_config.h"
+#include "database/gguf_metadata.h"
+#include "database/model_configs.h"
 #include "database/models.h"
 #include "services/download_service.h"
 #include "services/inference_service.h"
@@ -16,6 +27,8 @@ struct ModelPullInfo {
   std::vector<std::string> available_models;
   std::string model_source;
   std::string download_url;
+  // Read from the GGUF header with range requests, for single file urls
+  std::optional<Json::Value> gguf_summary;
 };
 
 struct StartParameterOverride {
@@ -40,6 +53,11 @@ struct StartModelResult {
 
 class ModelService {
  public:
+  using EventQueue =
+      eventpp::EventQueue<cortex::event::EventType,
+                          void(const eventpp::AnyData<eventMaxSize>&)>;
+  using OnStartPhase = std::function<void(ModelStartJob::Phase)>;
+
   void ForceIndexingModelList();
 
   explicit ModelService(std::shared_ptr<DownloadService> download_service)
@@ -48,10 +66,21 @@ class ModelService {
   explicit ModelService(
       std::shared_ptr<DownloadService> download_service,
       std::shared_ptr<services::InferenceService> inference_service,
-      std::shared_ptr<EngineServiceI> engine_svc)
+      std::shared_ptr<EngineServiceI> engine_svc,
+      std::shared_ptr<EventQueue> event_queue = nullptr)
       : download_service_{download_service},
         inference_svc_(inference_service),
-        engine_svc_(engine_svc) {};
+        engine_svc_(engine_svc),
+        event_queue_{event_queue} {
+    RegisterDownloadRestorer();
+    InitializeStartWorkers();
+  };
+
+  ~ModelService();
+
+  ModelService(const ModelService&) = delete;
+
+  ModelService& operator=(const ModelService&) = delete;
 
   /**
    * Return model id if download successfully
@@ -66,7 +95,8 @@ class ModelService {
 
   cpp::result<DownloadTask, std::string> DownloadModelFromCortexsoAsync(
       const std::string& name, const std::string& branch = "main",
-      std::optional<std::string> temp_model_id = std::nullopt);
+      std::optional<std::string> temp_model_id = std::nullopt,
+      std::optional<DownloadPriority> priority = std::nullopt);
 
   std::optional<config::ModelConfig> GetDownloadedModel(
       const std::string& modelId) const;
@@ -77,15 +107,92 @@ class ModelService {
    */
   cpp::result<void, std::string> DeleteModel(const std::string& model_handle);
 
+  /**
+   * Start a model synchronously. on_phase, if provided, is invoked every time
+   * the start moves to a new phase.
+   */
   cpp::result<StartModelResult, std::string> StartModel(
+      const std::string& model_handle,
+      const StartParameterOverride& params_override,
+      const OnStartPhase& on_phase = nullptr);
+
+  /**
+   * Queue a model start and return immediately. Progress is published as
+   * ModelLoadEvent through the event queue and can be polled with
+   * GetStartModelJob. If the model is already being started, the existing job
+   * is returned.
+   */
+  cpp::result<ModelStartJob, std::string> StartModelAsync(
       const std::string& model_handle,
       const StartParameterOverride& params_override);
 
+  cpp::result<ModelStartJob, std::string> GetStartModelJob(
+      const std::string& job_id) const;
+
+  /**
+   * Reload the models which were running when the server was last stopped.
+   * The loads are queued on the async start workers and run in parallel.
+   */
+  void RestoreRunningModels();
+
   cpp::result<bool, std::string> StopModel(const std::string& model_handle);
 
   cpp::result<bool, std::string> GetModelStatus(
       const std::string& model_handle);
 
+  /**
+   * Summary of a GGUF file from the metadata index in cortex.db. The file is
+   * only parsed when the index has no entry for its current size and
+   * modification time. content_hash is the SHA-256 of the file when it is
+   * known, from a verified download or the blob store, and is recorded with
+   * the entry.
+   */
+  static cpp::result<cortex::db::GGUFMetadataEntry, std::string>
+  GetGGUFMetadata(const std::string& path,
+                  const std::optional<std::string>& content_hash =
+                      std::nullopt);
+
+  /**
+   * ModelConfig of a model.yml. Its binary form is kept in cortex.db, the
+   * YAML is only parsed again when the file size or modification time
+   * changed.
+   */
+  static cpp::result<config::ModelConfig, std::string> ReadModelConfig(
+      const std::string& yaml_path);
+
+  // Model config derived from the GGUF metadata, see GetGGUFMetadata
+  static cpp::result<config::ModelConfig, std::string> GetGGUFModelConfig(
+      const std::string& path);
+
+  /**
+   * Read the GGUF tensor table of a local model and summarize it: parameter
+   * count, quantization mix and sizes per layer.
+   */
+  cpp::result<Json::Value, std::string> InspectModel(
+      const std::string& model_handle) const;
+
+  /**
+   * Render the chat template of a local GGUF model. The template is compiled
+   * on first use and cached per model, out is cleared and reused.
+   */
+  cpp::result<void, std::string> ApplyChatTemplate(
+      const std::string& model_handle, const Json::Value& messages,
+      bool add_generation_prompt, std::string& out);
+
+  // Tokenizer of a local GGUF model, built on first use and cached per model
+  cpp::result<std::shared_ptr<const config::GGUFTokenizer>, std::string>
+  GetTokenizer(const std::string& model_handle);
+
+  /**
+   * Fail if the messages of a chat completion request, rendered with the
+   * model's chat template, plus the requested completion tokens do not fit
+   * the model's context length. Requests which can not be measured, e.g. for
+   * models without a GGUF tokenizer, pass. Only the tokenizer and chat
+   * template cached when the model started are used, the GGUF file is never
+   * read on the caller's thread.
+   */
+  cpp::result<void, std::string> CheckContextLength(const Json::Value& request);
+
   cpp::result<ModelPullInfo, std::string> GetModelPullInfo(
       const std::string& model_handle);
 
@@ -93,7 +200,8 @@ class ModelService {
 
   cpp::result<DownloadTask, std::string> HandleDownloadUrlAsync(
       const std::string& url, std::optional<std::string> temp_model_id,
-      std::optional<std::string> temp_name);
+      std::optional<std::string> temp_name,
+      std::optional<DownloadPriority> priority = std::nullopt);
 
   bool HasModel(const std::string& id) const;
 
@@ -112,8 +220,99 @@ class ModelService {
   cpp::result<std::string, std::string> HandleCortexsoModel(
       const std::string& modelName);
 
+  struct CompiledChatTemplate {
+    std::shared_ptr<const config::JinjaTemplate> tmpl;
+    std::string bos_token;
+    std::string eos_token;
+  };
+
+  cpp::result<CompiledChatTemplate, std::string> GetChatTemplate(
+      const std::string& model_handle);
+
+  // Build the tokenizer and chat template of a started model ahead of the
+  // first chat completion
+  void WarmPromptCaches(const std::string& model_handle);
+
+  // Remember the ctx_len a model was loaded with. A model that was loaded
+  // already keeps the one it runs with unless replace is set.
+  void SetRunningContextLength(const std::string& model_handle,
+                               const Json::Value& load_params, bool replace);
+
+  // Start reading the weights into the page cache ahead of the engine
+  void PrefetchModelFile(const std::string& model_path);
+
+  /**
+   * Run one short decode on a freshly loaded model, so the first request
+   * does not pay for faulting in the weights and setting up the compute
+   * buffers. Failures are logged, the model is loaded either way.
+   */
+  void WarmUpModel(const Json::Value& load_params);
+
+  bool HasPromptCaches(const std::string& model_handle);
+
+  // Absolute path of the first GGUF file of a local model
+  cpp::result<std::string, std::string> GetGGUFPath(
+      const std::string& model_handle) const;
+
+  struct PendingStart {
+    std::string job_id;
+    std::string model_handle;
+    StartParameterOverride params_override;
+    // Set when restoring a model from a previous run
+    std::optional<Json::Value> start_params;
+  };
+
+  // Lets model downloads saved by an earlier run resume with their callback
+  void RegisterDownloadRestorer();
+
+  void InitializeStartWorkers();
+
+  void StartWorkerThread();
+
+  cpp::result<StartModelResult, std::string> RestoreModel(
+      const std::string& model_handle, const Json::Value& start_params,
+      const OnStartPhase& on_phase);
+
+  // start_jobs_mutex_ must be held by the caller
+  ModelStartJob EnqueueStartJobNoLock(PendingStart pending);
+
+  void UpdateStartJob(const std::string& job_id, ModelStartJob::Phase phase,
+                      std::optional<std::string> error = std::nullopt,
+                      std::optional<std::string> warning = std::nullopt);
+
   std::shared_ptr<DownloadService> download_service_;
   std::shared_ptr<services::InferenceService> inference_svc_;
   std::unordered_set<std::string> bypass_stop_check_set_;
+  std::mutex bypass_stop_check_mutex_;
   std::shared_ptr<EngineServiceI> engine_svc_ = nullptr;
+  std::shared_ptr<EventQueue> event_queue_ = nullptr;
+
+  // Asynchronous model start
+  static constexpr int kMaxConcurrentStartJobs = 4;
+  static constexpr auto kWarmupTimeout = std::chrono::seconds(60);
+  static constexpr size_t kMaxFinishedStartJobs = 100;
+
+  std::deque<PendingStart> pending_starts_;
+  std::unordered_map<std::string, ModelStartJob> start_jobs_;
+  // Finished job ids, oldest first. Used to bound start_jobs_
+  std::deque<std::string> finished_start_jobs_;
+  mutable std::mutex start_jobs_mutex_;
+  std::condition_variable start_jobs_cv_;
+  bool stop_start_workers_ = false;
+  std::vector<std::thread> start_workers_;
+
+  // Compiled chat templates by model handle, or why the model has none
+  std::unordered_map<std::string,
+                     cpp::result<CompiledChatTemplate, std::string>>
+      chat_templates_;
+  std::mutex chat_templates_mutex_;
+
+  // ctx_len of the running models, from their load parameters
+  std::unordered_map<std::string, int64_t> running_ctx_lens_;
+  std::mutex running_ctx_lens_mutex_;
+
+  // nullptr for models whose vocabulary is not supported
+  std::unordered_map<std::string, std::shared_ptr<const config::GGUFTokenizer>>
+      tokenizers_;
+  std::mutex tokenizers_mutex_;
 };
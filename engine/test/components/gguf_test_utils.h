@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Builders for the little endian GGUF files the parser tests read
+namespace gguf_test_utils {
+inline void WriteU32(std::string& data, uint32_t v) {
+  data.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+inline void WriteU64(std::string& data, uint64_t v) {
+  data.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+inline void WriteF32(std::string& data, float v) {
+  data.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+inline void WriteString(std::string& data, const std::string& str) {
+  WriteU64(data, str.size());
+  data += str;
+}
+
+// Magic, version 3, then the tensor and metadata counts
+inline void WriteHeader(std::string& data, uint64_t tensor_count,
+                        uint64_t kv_count) {
+  WriteU32(data, 0x46554747);
+  WriteU32(data, 3);
+  WriteU64(data, tensor_count);
+  WriteU64(data, kv_count);
+}
+
+inline void WriteFile(const std::string& path, const std::string& data) {
+  std::ofstream file(path, std::ios::binary);
+  file.write(data.data(), data.size());
+}
+}  // namespace gguf_test_utils
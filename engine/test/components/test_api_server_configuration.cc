@@ -130,3 +130,36 @@ TEST_F(ApiServerConfigurationTest, NulloptParameters) {
 
   EXPECT_FALSE(config.cors);
 }
+
+// Test download segments range validation
+TEST_F(ApiServerConfigurationTest, DownloadSegmentsRange) {
+  EXPECT_EQ(config.download_segments, 4);
+
+  std::vector<std::string> updated_fields;
+  std::vector<std::string> invalid_fields;
+  config.UpdateFromJson(parseJson(R"({"download_segments": 8})"),
+                        &updated_fields, &invalid_fields);
+  EXPECT_EQ(config.download_segments, 8);
+  EXPECT_EQ(config.ToJson()["download_segments"].asInt(), 8);
+
+  for (const auto* json : {R"({"download_segments": 0})",
+                           R"({"download_segments": 17})",
+                           R"({"download_segments": "2"})"}) {
+    config.UpdateFromJson(parseJson(json), &updated_fields, &invalid_fields);
+  }
+  EXPECT_EQ(config.download_segments, 8);
+  EXPECT_EQ(updated_fields.size(), 1);
+  EXPECT_EQ(invalid_fields.size(), 3);
+}
+
+// Test download progress interval range validation
+TEST_F(ApiServerConfigurationTest, DownloadProgressIntervalRange) {
+  EXPECT_EQ(config.download_progress_interval_ms, 1000);
+
+  config.UpdateFromJson(
+      parseJson(R"({"download_progress_interval_ms": 250})"));
+  EXPECT_EQ(config.download_progress_interval_ms, 250);
+
+  config.UpdateFromJson(parseJson(R"({"download_progress_interval_ms": 10})"));
+  EXPECT_EQ(config.download_progress_interval_ms, 250);
+}
@@ -0,0 +1,162 @@
+#include <archive.h>
+#include <archive_entry.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "gtest/gtest.h"
+#include "utils/archive_utils.h"
+
+namespace {
+struct Entry {
+  std::string path;
+  std::string data;
+};
+
+// A gzipped tar holding entries, the kind of archive engines ship in
+std::string MakeTarGz(const std::vector<Entry>& entries) {
+  std::string buffer(1 << 20, '\0');
+  size_t used = 0;
+  auto a = archive_write_new();
+  archive_write_add_filter_gzip(a);
+  archive_write_set_format_pax_restricted(a);
+  archive_write_open_memory(a, buffer.data(), buffer.size(), &used);
+  for (const auto& e : entries) {
+    auto entry = archive_entry_new();
+    archive_entry_set_pathname(entry, e.path.c_str());
+    archive_entry_set_size(entry, e.data.size());
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0755);
+    archive_write_header(a, entry);
+    archive_write_data(a, e.data.data(), e.data.size());
+    archive_entry_free(entry);
+  }
+  archive_write_close(a);
+  archive_write_free(a);
+  buffer.resize(used);
+  return buffer;
+}
+
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+// Feed data in chunks the size curl hands to the download service
+void Stream(archive_utils::StreamingExtractor& extractor,
+            const std::string& data) {
+  for (size_t i = 0; i < data.size(); i += 16384) {
+    auto size = std::min<size_t>(16384, data.size() - i);
+    while (!extractor.HasSpace(size)) {
+      std::this_thread::yield();
+    }
+    extractor.Write(data.data() + i, size);
+  }
+}
+}  // namespace
+
+class StreamingExtractorTest : public ::testing::Test {
+ protected:
+  std::filesystem::path destination_ =
+      std::filesystem::temp_directory_path() / "streaming_extractor_test";
+
+  void SetUp() override { std::filesystem::remove_all(destination_); }
+
+  void TearDown() override { std::filesystem::remove_all(destination_); }
+};
+
+TEST_F(StreamingExtractorTest, MergesIntoDestinationOnCommit) {
+  std::filesystem::create_directories(destination_ / "engine");
+  std::ofstream(destination_ / "kept") << "old";
+  std::ofstream(destination_ / "engine" / "readme") << "old";
+  std::string library(200000, 'x');
+  auto archive = MakeTarGz({{"engine/bin/engine.so", library},
+                            {"engine/readme", "hello"},
+                            {"../escape", "outside"}});
+  {
+    archive_utils::StreamingExtractor extractor(destination_, false, 64 << 10,
+                                                nullptr);
+    Stream(extractor, archive);
+    // Nothing is visible before the archive is complete
+    EXPECT_EQ(ReadFile(destination_ / "engine" / "readme"), "old");
+    ASSERT_TRUE(extractor.Finish().has_value());
+    ASSERT_TRUE(extractor.Commit().has_value());
+  }
+  // Files the archive does not have stay, like libraries extracted before
+  EXPECT_EQ(ReadFile(destination_ / "kept"), "old");
+  EXPECT_EQ(ReadFile(destination_ / "engine" / "bin" / "engine.so"), library);
+  EXPECT_EQ(ReadFile(destination_ / "engine" / "readme"), "hello");
+  EXPECT_FALSE(std::filesystem::exists(destination_.parent_path() / "escape"));
+  EXPECT_FALSE(std::filesystem::exists(
+      archive_utils::StreamingExtractor::StagingPath(destination_)));
+}
+
+TEST_F(StreamingExtractorTest, IgnoresParentDirectory) {
+  auto archive = MakeTarGz({{"engine/bin/engine.so", "library"}});
+  archive_utils::StreamingExtractor extractor(destination_, true, 64 << 10,
+                                              nullptr);
+  Stream(extractor, archive);
+  ASSERT_TRUE(extractor.Finish().has_value());
+  ASSERT_TRUE(extractor.Commit().has_value());
+  EXPECT_EQ(ReadFile(destination_ / "engine.so"), "library");
+}
+
+TEST_F(StreamingExtractorTest, KeepsZipLayout) {
+  std::string buffer(1 << 16, '\0');
+  size_t used = 0;
+  auto a = archive_write_new();
+  archive_write_set_format_zip(a);
+  archive_write_open_memory(a, buffer.data(), buffer.size(), &used);
+  auto entry = archive_entry_new();
+  archive_entry_set_pathname(entry, "cuda/bin/cudart.dll");
+  archive_entry_set_size(entry, 7);
+  archive_entry_set_filetype(entry, AE_IFREG);
+  archive_entry_set_perm(entry, 0644);
+  archive_write_header(a, entry);
+  archive_write_data(a, "library", 7);
+  archive_entry_free(entry);
+  archive_write_close(a);
+  archive_write_free(a);
+  buffer.resize(used);
+
+  // Only tar entries are flattened
+  archive_utils::StreamingExtractor extractor(destination_, true, 64 << 10,
+                                              nullptr);
+  Stream(extractor, buffer);
+  ASSERT_TRUE(extractor.Finish().has_value());
+  ASSERT_TRUE(extractor.Commit().has_value());
+  EXPECT_EQ(ReadFile(destination_ / "cuda" / "bin" / "cudart.dll"), "library");
+}
+
+TEST_F(StreamingExtractorTest, KeepsDestinationOnTruncatedArchive) {
+  std::filesystem::create_directories(destination_);
+  std::ofstream(destination_ / "stale") << "old";
+  std::string library(200000, '\0');
+  for (size_t i = 0; i < library.size(); i++) {
+    library[i] = static_cast<char>((i * 31) ^ (i >> 7));
+  }
+  auto archive = MakeTarGz({{"engine.so", library}});
+  {
+    archive_utils::StreamingExtractor extractor(destination_, false, 64 << 10,
+                                                nullptr);
+    Stream(extractor, archive.substr(0, archive.size() / 2));
+    EXPECT_TRUE(extractor.Finish().has_error());
+  }
+  EXPECT_EQ(ReadFile(destination_ / "stale"), "old");
+  EXPECT_FALSE(std::filesystem::exists(
+      archive_utils::StreamingExtractor::StagingPath(destination_)));
+}
+
+TEST_F(StreamingExtractorTest, ResetStartsOver) {
+  auto archive = MakeTarGz({{"engine.so", std::string(100000, 'y')}});
+  archive_utils::StreamingExtractor extractor(destination_, false, 64 << 10,
+                                              nullptr);
+  // A restarted transfer sends the archive again from the first byte
+  Stream(extractor, archive.substr(0, 30000));
+  extractor.Reset();
+  Stream(extractor, archive);
+  ASSERT_TRUE(extractor.Finish().has_value());
+  ASSERT_TRUE(extractor.Commit().has_value());
+  EXPECT_EQ(ReadFile(destination_ / "engine.so"), std::string(100000, 'y'));
+}
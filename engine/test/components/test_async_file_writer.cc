@@ -0,0 +1,140 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "gtest/gtest.h"
+#include "utils/async_file_writer.h"
+
+namespace {
+constexpr size_t kBufferSize = 64 << 10;
+
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+std::string MakeData(size_t size) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<char>((i * 31) ^ (i >> 12));
+  }
+  return data;
+}
+
+// Write data at offset in pool buffers the way the download service does,
+// each buffer starting at an aligned file offset
+void WriteStream(file_io_utils::AsyncFileWriter& writer,
+                 file_io_utils::RandomAccessFile& file,
+                 const std::shared_ptr<file_io_utils::WriteStream>& stream,
+                 const std::string& data, uint64_t offset) {
+  size_t position = 0;
+  while (position < data.size()) {
+    auto buffer = writer.Buffers().Acquire();
+    auto file_position = offset + position;
+    auto buffer_offset = file_position / file_io_utils::kDirectIoAlignment *
+                         file_io_utils::kDirectIoAlignment;
+    auto begin = static_cast<size_t>(file_position - buffer_offset);
+    auto end = std::min(kBufferSize, begin + (data.size() - position));
+    std::memcpy(buffer + begin, data.data() + position, end - begin);
+    position += end - begin;
+    writer.Submit(file_io_utils::AsyncFileWriter::Write{
+        .file = &file,
+        .stream = stream,
+        .buffer = buffer,
+        .begin = begin,
+        .end = end,
+        .offset = buffer_offset,
+        .position = position,
+    });
+  }
+}
+}  // namespace
+
+class AsyncFileWriterTest : public ::testing::Test {
+ protected:
+  std::filesystem::path path_ =
+      std::filesystem::temp_directory_path() / "async_file_writer_test.bin";
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  void WriteAndCheck(bool direct) {
+    auto file = file_io_utils::RandomAccessFile::Open(path_, true, direct);
+    ASSERT_TRUE(file.has_value()) << file.error();
+
+    // More data than the pool holds, at an unaligned offset
+    auto data = MakeData(20 * kBufferSize + 12345);
+    const uint64_t offset = 100;
+    std::atomic<int> completed{0};
+    {
+      file_io_utils::AsyncFileWriter writer(kBufferSize, 4,
+                                            [&completed] { completed++; });
+      auto stream = std::make_shared<file_io_utils::WriteStream>();
+      WriteStream(writer, *file.value(), stream, data, offset);
+      writer.Drain();
+      EXPECT_TRUE(stream->Idle());
+      EXPECT_FALSE(stream->Failed());
+      EXPECT_EQ(stream->Durable(), data.size());
+    }
+    EXPECT_EQ(completed, 21);
+    file.value().reset();
+
+    auto written = ReadFile(path_);
+    ASSERT_EQ(written.size(), offset + data.size());
+    EXPECT_EQ(written.substr(offset), data);
+  }
+};
+
+TEST_F(AsyncFileWriterTest, WritesThroughPageCache) {
+  WriteAndCheck(false);
+}
+
+TEST_F(AsyncFileWriterTest, WritesWithDirectIo) {
+  // Filesystems without O_DIRECT fall back to buffered writes
+  WriteAndCheck(true);
+}
+
+TEST_F(AsyncFileWriterTest, BufferPoolIsBounded) {
+  file_io_utils::BufferPool pool(kBufferSize, 2);
+  auto first = pool.TryAcquire();
+  auto second = pool.TryAcquire();
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(first) %
+                file_io_utils::kDirectIoAlignment,
+            0);
+  EXPECT_EQ(pool.TryAcquire(), nullptr);
+  pool.Release(first);
+  EXPECT_EQ(pool.TryAcquire(), first);
+  pool.Release(first);
+  pool.Release(second);
+}
+
+TEST_F(AsyncFileWriterTest, FallsBackWhenRingRejectsWrites) {
+  auto file = file_io_utils::RandomAccessFile::Open(path_, true);
+  ASSERT_TRUE(file.has_value()) << file.error();
+  auto data = MakeData(8 * kBufferSize + 777);
+  {
+    file_io_utils::AsyncFileWriter writer(kBufferSize, 4, nullptr);
+#if defined(CORTEX_HAS_IO_URING)
+    // An unknown opcode fails with -EINVAL, like IORING_OP_WRITE before 5.6
+    if (!writer.SetRingWriteOpcode(0xff)) {
+      GTEST_SKIP() << "io_uring is not available";
+    }
+#endif
+    auto stream = std::make_shared<file_io_utils::WriteStream>();
+    WriteStream(writer, *file.value(), stream, data, 0);
+    writer.Drain();
+    // Writes after the ring was dropped go through pwrite
+    auto next = std::make_shared<file_io_utils::WriteStream>();
+    WriteStream(writer, *file.value(), next, data, data.size());
+    writer.Drain();
+    for (const auto& s : {stream, next}) {
+      EXPECT_FALSE(s->Failed());
+      EXPECT_EQ(s->Durable(), data.size());
+    }
+  }
+  file.value().reset();
+  EXPECT_EQ(ReadFile(path_), data + data);
+}
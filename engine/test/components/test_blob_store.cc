@@ -0,0 +1,132 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "gtest/gtest.h"
+#include "services/blob_store.h"
+#include "utils/file_io_utils.h"
+
+namespace {
+constexpr const auto kTestDb = "./test.db";
+
+void WriteFile(const std::filesystem::path& path, const std::string& data) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream(path, std::ios::binary) << data;
+}
+
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+}  // namespace
+
+class BlobStoreTest : public ::testing::Test {
+ protected:
+  BlobStoreTest()
+      : db_(kTestDb, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+        blobs_(std::make_shared<cortex::db::Blobs>(db_)),
+        store_(data_path_, blobs_) {}
+
+  void SetUp() override {
+    db_.exec("DELETE FROM blobs");
+    db_.exec("DELETE FROM blob_references");
+    std::filesystem::remove_all(data_path_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(data_path_); }
+
+  std::filesystem::path data_path_ =
+      std::filesystem::temp_directory_path() / "blob_store_test";
+  SQLite::Database db_;
+  std::shared_ptr<cortex::db::Blobs> blobs_;
+  BlobStore store_;
+};
+
+TEST_F(BlobStoreTest, DeduplicatesIdenticalFiles) {
+  auto main = data_path_ / "models" / "model" / "main" / "model.gguf";
+  auto alias = data_path_ / "models" / "model" / "q4" / "model.gguf";
+  WriteFile(main, "weights");
+  WriteFile(alias, "weights");
+
+  auto digest = store_.AddFile("model:main", main);
+  ASSERT_TRUE(digest.has_value()) << digest.error();
+  EXPECT_EQ(digest.value(),
+            "9a129038d9a00aed0cf6a7ea059ca50a813449061ab87848cf1a13eafdf33b2c");
+  auto blob = store_.GetBlobPath(digest.value());
+  EXPECT_TRUE(std::filesystem::equivalent(blob, main));
+
+  // A verified checksum is used as is
+  ASSERT_EQ(store_.AddFile("model:q4", alias, digest.value()).value(),
+            digest.value());
+  EXPECT_TRUE(std::filesystem::equivalent(blob, alias));
+  EXPECT_EQ(ReadFile(alias), "weights");
+  EXPECT_EQ(blobs_->GetReferenceCount(digest.value()).value(), 2);
+
+  ASSERT_TRUE(store_.RemoveModel("model:main").has_value());
+  EXPECT_FALSE(std::filesystem::exists(main));
+  EXPECT_TRUE(std::filesystem::exists(blob));
+
+  ASSERT_TRUE(store_.RemoveModel("model:q4").has_value());
+  EXPECT_FALSE(std::filesystem::exists(alias));
+  EXPECT_FALSE(std::filesystem::exists(blob));
+  EXPECT_EQ(blobs_->GetReferenceCount(digest.value()).value(), 0);
+}
+
+TEST_F(BlobStoreTest, ImportsWithoutTouchingSource) {
+  auto source = data_path_ / "outside" / "model.gguf";
+  WriteFile(source, "imported weights");
+  auto first = data_path_ / "models" / "imported" / "a.gguf";
+  auto second = data_path_ / "models" / "imported" / "b.gguf";
+
+  auto res = store_.ImportFile("a", source, first);
+  ASSERT_TRUE(res.has_value()) << res.error();
+  // The clone is in place right away, the store takes it over later
+  EXPECT_EQ(ReadFile(first), "imported weights");
+  ASSERT_TRUE(store_.ImportFile("b", source, second).has_value());
+  BlobStore::WaitForImports();
+  EXPECT_FALSE(std::filesystem::equivalent(source, first));
+  EXPECT_TRUE(std::filesystem::equivalent(first, second));
+  EXPECT_EQ(ReadFile(second), "imported weights");
+
+  // Replacing a stored file does not change the blob under it
+  std::filesystem::remove(second);
+  WriteFile(second, "edited");
+  EXPECT_EQ(ReadFile(first), "imported weights");
+
+  ASSERT_TRUE(store_.RemoveModel("a").has_value());
+  ASSERT_TRUE(store_.RemoveModel("b").has_value());
+  EXPECT_EQ(ReadFile(source), "imported weights");
+  EXPECT_TRUE(std::filesystem::is_empty(data_path_ / "models" / "blobs"));
+}
+
+TEST_F(BlobStoreTest, ReplacedFileReleasesOldBlob) {
+  auto path = data_path_ / "models" / "model" / "model.gguf";
+  WriteFile(path, "v1");
+  auto v1 = store_.AddFile("model", path).value();
+
+  // A pull of a new revision writes a new file at the same path
+  auto file = file_io_utils::RandomAccessFile::Open(path, true);
+  ASSERT_TRUE(file.has_value());
+  ASSERT_TRUE(file.value()->WriteAt("v2", 2, 0));
+  file.value().reset();
+  EXPECT_EQ(ReadFile(store_.GetBlobPath(v1)), "v1");
+
+  auto v2 = store_.AddFile("model", path).value();
+  EXPECT_NE(v1, v2);
+  EXPECT_FALSE(std::filesystem::exists(store_.GetBlobPath(v1)));
+  EXPECT_EQ(ReadFile(store_.GetBlobPath(v2)), "v2");
+}
+
+TEST_F(BlobStoreTest, CloneFileCopiesData) {
+  auto source = data_path_ / "source.bin";
+  auto copy = data_path_ / "copy.bin";
+  std::string data(3 << 20, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i * 7);
+  }
+  WriteFile(source, data);
+  WriteFile(copy, "old");
+  ASSERT_TRUE(file_io_utils::CloneFile(source, copy).has_value());
+  EXPECT_TRUE(ReadFile(copy) == data);
+}
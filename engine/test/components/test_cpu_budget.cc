@@ -0,0 +1,103 @@
+#include <algorithm>
+#include "gtest/gtest.h"
+#include "utils/hardware/cpu_budget.h"
+
+namespace {
+bool Disjoint(const cortex::hw::CpuSet& a, const cortex::hw::CpuSet& b) {
+  return std::none_of(a.begin(), a.end(), [&b](int c) {
+    return std::find(b.begin(), b.end(), c) != b.end();
+  });
+}
+}  // namespace
+
+class CpuBudgetTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // 8 cores with two threads each, numbered k and k + 8 like Linux on x86:
+    // 1 io, 1 background, 6 engine cores
+    std::vector<cortex::hw::CpuSet> cores;
+    for (int c = 0; c < 8; c++) {
+      cores.push_back({c, c + 8});
+    }
+    budget_.Initialize(cores, false);
+  }
+
+  void TearDown() override {
+    for (const auto& model : {"a", "b", "c", "d"}) {
+      budget_.ReleaseEngineCpus(model);
+    }
+  }
+
+  cortex::hw::CpuBudget& budget_ = cortex::hw::CpuBudget::GetInstance();
+};
+
+TEST_F(CpuBudgetTest, SplitsPoolByRequestedThreads) {
+  auto a = budget_.AllocateEngineCpus("a", 2);
+  auto b = budget_.AllocateEngineCpus("b", 3);
+  // Whole cores, with both of their threads
+  EXPECT_EQ(a, (cortex::hw::CpuSet{2, 10, 3, 11}));
+  EXPECT_EQ(budget_.GetThreadCount(a), 2);
+  EXPECT_EQ(b.size(), 6u);
+  EXPECT_EQ(budget_.GetThreadCount(b), 3);
+  EXPECT_TRUE(Disjoint(a, b));
+
+  // Only one core is left, the model gets it rather than shared ones
+  auto c = budget_.AllocateEngineCpus("c", 2);
+  EXPECT_EQ(c, (cortex::hw::CpuSet{7, 15}));
+  EXPECT_TRUE(Disjoint(a, c));
+  EXPECT_TRUE(Disjoint(b, c));
+}
+
+TEST_F(CpuBudgetTest, DefaultsToFreeCores) {
+  // A lone model without cpu_threads runs on the whole pool
+  auto a = budget_.AllocateEngineCpus("a", std::nullopt);
+  EXPECT_EQ(budget_.GetThreadCount(a), 6);
+  budget_.ReleaseEngineCpus("a");
+
+  budget_.AllocateEngineCpus("a", 2);
+  auto b = budget_.AllocateEngineCpus("b", std::nullopt);
+  EXPECT_EQ(b, (cortex::hw::CpuSet{4, 12, 5, 13, 6, 14, 7, 15}));
+  EXPECT_EQ(budget_.GetThreadCount(b), 4);
+}
+
+TEST_F(CpuBudgetTest, SharesPoolOnceExhausted) {
+  budget_.AllocateEngineCpus("a", 6);
+  budget_.AllocateEngineCpus("b", 1);
+  auto c = budget_.AllocateEngineCpus("c", 1);
+  EXPECT_EQ(c.size(), 12u);
+  EXPECT_EQ(budget_.GetThreadCount(c), 6);
+}
+
+TEST_F(CpuBudgetTest, ReusesReleasedCpus) {
+  auto a = budget_.AllocateEngineCpus("a", 2);
+  budget_.AllocateEngineCpus("b", 2);
+  budget_.ReleaseEngineCpus("a");
+  EXPECT_EQ(budget_.AllocateEngineCpus("c", 2), a);
+  // Allocating again replaces the previous slice of a model
+  auto d = budget_.AllocateEngineCpus("d", 1);
+  EXPECT_EQ(budget_.AllocateEngineCpus("d", 1), d);
+}
+
+TEST(CpuTopologyTest, ParsesCpuLists) {
+  EXPECT_EQ(cortex::hw::detail::ParseCpuList("0,8"),
+            (cortex::hw::CpuSet{0, 8}));
+  EXPECT_EQ(cortex::hw::detail::ParseCpuList("0-2,8-9\n"),
+            (cortex::hw::CpuSet{0, 1, 2, 8, 9}));
+  EXPECT_TRUE(cortex::hw::detail::ParseCpuList("x").empty());
+}
+
+TEST(CpuTopologyTest, GroupsEveryCpuIntoOneCore) {
+  cortex::hw::CpuSet cpus;
+  for (int c = 0; c < 4; c++) {
+    cpus.push_back(c);
+  }
+  // Either the real siblings or adjacent pairs, never a cpu twice
+  auto cores = cortex::hw::detail::GroupCoreSiblings(cpus, 2);
+  cortex::hw::CpuSet grouped;
+  for (const auto& core : cores) {
+    EXPECT_FALSE(core.empty());
+    grouped.insert(grouped.end(), core.begin(), core.end());
+  }
+  std::sort(grouped.begin(), grouped.end());
+  EXPECT_EQ(grouped, cpus);
+}
@@ -0,0 +1,605 @@
+#include <httplib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "services/download_service.h"
+#include "utils/sha256_utils.h"
+
+class DownloadServiceTest : public ::testing::Test {
+ protected:
+  static constexpr auto kETag = "\"v1\"";
+
+  void SetUp() override {
+    // Four full segments plus a remainder spread over the first ones
+    data_.resize(4 * DownloadService::kMinSegmentBytes + 3);
+    for (size_t i = 0; i < data_.size(); i++) {
+      data_[i] = static_cast<char>((i * 31) ^ (i >> 12));
+    }
+
+    server_.Get("/ranged", [this](const httplib::Request& req,
+                                  httplib::Response& res) {
+      if (req.has_header("Range")) {
+        range_requests_++;
+        if (req.get_header_value("If-Range") == kETag) {
+          validated_requests_++;
+        }
+      }
+      res.set_header("Accept-Ranges", "bytes");
+      res.set_header("ETag", kETag);
+      res.set_content(data_, "application/octet-stream");
+    });
+    server_.Get("/changing", [this](const httplib::Request& req,
+                                    httplib::Response& res) {
+      // Replaced on the server as soon as the first range is asked for
+      if (req.has_header("Range")) {
+        replaced_ = true;
+      }
+      auto etag = replaced_ ? "\"v2\"" : kETag;
+      res.set_header("Accept-Ranges", "bytes");
+      res.set_header("ETag", etag);
+      if (req.has_header("If-Range") &&
+          req.get_header_value("If-Range") != etag) {
+        // A stale validator gets the whole new file instead of the range
+        res.status = 200;
+      } else if (req.has_header("Range")) {
+        range_requests_++;
+      }
+      std::string content(data_);
+      if (replaced_) {
+        std::reverse(content.begin(), content.end());
+      }
+      res.set_content(content, "application/octet-stream");
+    });
+    server_.Get("/flaky", [this](const httplib::Request& req,
+                                 httplib::Response& res) {
+      if (req.has_header("Range")) {
+        range_requests_++;
+        // Every segment but the first fails once
+        if (req.get_header_value("Range").rfind("bytes=0-", 0) != 0 &&
+            !failed_.exchange(true)) {
+          res.status = 503;
+          return;
+        }
+      }
+      res.set_header("Accept-Ranges", "bytes");
+      res.set_content(data_, "application/octet-stream");
+    });
+    server_.Get("/plain", [this](const httplib::Request& req,
+                                 httplib::Response& res) {
+      if (req.has_header("Range")) {
+        range_requests_++;
+      }
+      // No length and no Accept-Ranges, so a single stream is used
+      res.set_chunked_content_provider(
+          "application/octet-stream",
+          [this](size_t offset, httplib::DataSink& sink) {
+            auto size = std::min<size_t>(1 << 20, data_.size() - offset);
+            sink.write(data_.data() + offset, size);
+            if (offset + size == data_.size()) {
+              sink.done();
+            }
+            return true;
+          });
+    });
+    server_.Get("/throttled", [this](const httplib::Request&,
+                                     httplib::Response& res) {
+      // About two seconds in total, so progress events are due meanwhile
+      res.set_chunked_content_provider(
+          "application/octet-stream",
+          [this](size_t offset, httplib::DataSink& sink) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto size = std::min(data_.size() / 20 + 1, data_.size() - offset);
+            sink.write(data_.data() + offset, size);
+            if (offset + size == data_.size()) {
+              sink.done();
+            }
+            return true;
+          });
+    });
+    port_ = server_.bind_to_any_port("127.0.0.1");
+    ASSERT_GT(port_, 0);
+    server_thread_ = std::thread([this] { server_.listen_after_bind(); });
+    server_.wait_until_ready();
+  }
+
+  void TearDown() override {
+    server_.stop();
+    server_thread_.join();
+    std::filesystem::remove(path_);
+    DownloadState::Remove(path_);
+  }
+
+  bool Download(const std::string& route,
+                std::optional<std::string> checksum = std::nullopt) {
+    DownloadService service(std::make_shared<DownloadService::EventQueue>(),
+                            nullptr);
+    DownloadTask task{
+        .id = route,
+        .type = DownloadType::Miscellaneous,
+        .items = {DownloadItem{
+            .id = "item",
+            .downloadUrl = "http://127.0.0.1:" + std::to_string(port_) + "/" +
+                           route,
+            .localPath = path_,
+            .checksum = checksum,
+        }}};
+    std::promise<void> done;
+    service.AddTask(task, [&done](const DownloadTask&) { done.set_value(); });
+    return done.get_future().wait_for(std::chrono::seconds(30)) ==
+           std::future_status::ready;
+  }
+
+  // What a download stopped after the first segment and a bit leaves behind
+  DownloadState WritePartialDownload(const std::string& etag,
+                                     const std::string& route = "ranged") {
+    DownloadState state{
+        .url = "http://127.0.0.1:" + std::to_string(port_) + "/" + route,
+        .size = data_.size(),
+        .etag = etag};
+    for (const auto& [offset, length] :
+         DownloadService::PlanSegments(data_.size(), 4)) {
+      state.segments.push_back(
+          DownloadState::Segment{.offset = offset, .length = length});
+    }
+    state.segments[0].written = state.segments[0].length;
+    state.segments[1].written = 1000;
+
+    std::string partial(data_.size(), 'x');
+    auto done = state.segments[1].offset + state.segments[1].written;
+    std::copy(data_.begin(), data_.begin() + done, partial.begin());
+    std::ofstream(path_, std::ios::binary) << partial;
+    EXPECT_TRUE(state.Save(path_).has_value());
+    return state;
+  }
+
+  std::string ReadOutput() {
+    std::ifstream file(path_, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+  }
+
+  std::string data_;
+  httplib::Server server_;
+  std::thread server_thread_;
+  int port_ = 0;
+  std::atomic<int> range_requests_{0};
+  std::atomic<int> validated_requests_{0};
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> replaced_{false};
+  std::filesystem::path path_ =
+      std::filesystem::temp_directory_path() / "test_download_service.bin";
+};
+
+TEST_F(DownloadServiceTest, PlansSegmentsOfMinimumSize) {
+  constexpr auto kMin = DownloadService::kMinSegmentBytes;
+  using Ranges = std::vector<std::pair<uint64_t, uint64_t>>;
+  EXPECT_EQ(DownloadService::PlanSegments(kMin, 4), (Ranges{{0, kMin}}));
+  EXPECT_EQ(DownloadService::PlanSegments(2 * kMin + 1, 4),
+            (Ranges{{0, kMin + 1}, {kMin + 1, kMin}}));
+  EXPECT_EQ(DownloadService::PlanSegments(100 * kMin, 4).size(), 4u);
+  EXPECT_EQ(DownloadService::PlanSegments(100 * kMin, 0).size(), 1u);
+}
+
+TEST_F(DownloadServiceTest, DownloadsRangesInParallel) {
+  ASSERT_TRUE(Download("ranged"));
+  EXPECT_EQ(range_requests_, 4);
+  EXPECT_TRUE(ReadOutput() == data_);
+}
+
+TEST_F(DownloadServiceTest, RetriesFailedSegment) {
+  ASSERT_TRUE(Download("flaky"));
+  EXPECT_EQ(range_requests_, 5);
+  EXPECT_TRUE(ReadOutput() == data_);
+}
+
+TEST_F(DownloadServiceTest, FallsBackToSingleStream) {
+  sha256_utils::Sha256 hasher;
+  hasher.Update(data_.data(), data_.size());
+  ASSERT_TRUE(Download("plain", hasher.FinalHex()));
+  EXPECT_EQ(range_requests_, 0);
+  EXPECT_TRUE(ReadOutput() == data_);
+}
+
+TEST_F(DownloadServiceTest, ResumesFromSavedState) {
+  WritePartialDownload(kETag);
+  ASSERT_TRUE(Download("ranged"));
+  // The finished segment is skipped, the others continue with If-Range
+  EXPECT_EQ(range_requests_, 3);
+  EXPECT_EQ(validated_requests_, 3);
+  EXPECT_TRUE(ReadOutput() == data_);
+  EXPECT_FALSE(std::filesystem::exists(DownloadState::SidecarPath(path_)));
+}
+
+TEST_F(DownloadServiceTest, RestartsWhenRemoteFileChanged) {
+  WritePartialDownload("\"v0\"");
+  ASSERT_TRUE(Download("ranged"));
+  EXPECT_EQ(range_requests_, 4);
+  EXPECT_TRUE(ReadOutput() == data_);
+}
+
+TEST_F(DownloadServiceTest, RestartsWhenRangeComesBackWhole) {
+  WritePartialDownload(kETag, "changing");
+  ASSERT_TRUE(Download("changing"));
+  // Only the ranges of the second attempt match the new validator
+  EXPECT_EQ(range_requests_, 4);
+  std::string replaced(data_.rbegin(), data_.rend());
+  EXPECT_TRUE(ReadOutput() == replaced);
+  EXPECT_FALSE(std::filesystem::exists(DownloadState::SidecarPath(path_)));
+}
+
+TEST_F(DownloadServiceTest, RejectsInconsistentState) {
+  auto state = WritePartialDownload(kETag);
+  EXPECT_TRUE(DownloadState::Load(path_).has_value());
+
+  auto json = state.ToJson();
+  json["segments"][1]["offset"] = Json::Value::UInt64(1);
+  EXPECT_TRUE(DownloadState::FromJson(json).has_error());
+  json = state.ToJson();
+  json["segments"][2]["written"] = Json::Value::UInt64(data_.size());
+  EXPECT_TRUE(DownloadState::FromJson(json).has_error());
+  json = state.ToJson();
+  json["size"] = Json::Value::UInt64(data_.size() + 1);
+  EXPECT_TRUE(DownloadState::FromJson(json).has_error());
+}
+
+TEST_F(DownloadServiceTest, RunsMoreTasksThanConnections) {
+  DownloadService service(std::make_shared<DownloadService::EventQueue>(),
+                          nullptr);
+  // Four segments each, so the tasks share the global connection limit
+  constexpr int kTasks = 6;
+  std::vector<std::filesystem::path> paths;
+  std::vector<std::promise<void>> done(kTasks);
+  for (int i = 0; i < kTasks; i++) {
+    auto path = path_;
+    path += "." + std::to_string(i);
+    paths.push_back(path);
+    DownloadTask task{
+        .id = "task-" + std::to_string(i),
+        .type = DownloadType::Miscellaneous,
+        .items = {DownloadItem{
+            .id = "item",
+            .downloadUrl =
+                "http://127.0.0.1:" + std::to_string(port_) + "/ranged",
+            .localPath = path,
+        }}};
+    service.AddTask(task,
+                    [&done, i](const DownloadTask&) { done[i].set_value(); });
+  }
+
+  for (int i = 0; i < kTasks; i++) {
+    ASSERT_EQ(done[i].get_future().wait_for(std::chrono::seconds(30)),
+              std::future_status::ready);
+  }
+  EXPECT_EQ(range_requests_, 4 * kTasks);
+  for (const auto& path : paths) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    EXPECT_TRUE(buffer.str() == data_);
+    std::filesystem::remove(path);
+  }
+}
+
+TEST_F(DownloadServiceTest, EmitsCoalescedProgressEvents) {
+  using cortex::event::DownloadEvent;
+  using cortex::event::DownloadEventType;
+  auto event_queue = std::make_shared<DownloadService::EventQueue>();
+  std::vector<DownloadEvent> events;
+  event_queue->appendListener(
+      cortex::event::EventType::DownloadEvent,
+      [&events](const DownloadEvent& e) { events.push_back(e); });
+  {
+    DownloadService service(event_queue, nullptr);
+    DownloadTask task{
+        .id = "throttled",
+        .type = DownloadType::Miscellaneous,
+        .items = {DownloadItem{
+            .id = "item",
+            .downloadUrl =
+                "http://127.0.0.1:" + std::to_string(port_) + "/throttled",
+            .localPath = path_,
+        }}};
+    std::promise<void> done;
+    service.AddTask(task, [&done](const DownloadTask&) { done.set_value(); });
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(30)),
+              std::future_status::ready);
+  }
+  event_queue->process();
+
+  // One update per second at most, each with the rate of the last seconds
+  ASSERT_GE(events.size(), 3u);
+  EXPECT_EQ(events.front().type_, DownloadEventType::DownloadStarted);
+  EXPECT_EQ(events.back().type_, DownloadEventType::DownloadSuccess);
+  auto updates = 0;
+  uint64_t last = 0;
+  for (const auto& e : events) {
+    if (e.type_ != DownloadEventType::DownloadUpdated) {
+      continue;
+    }
+    updates++;
+    const auto& item = e.download_task_.items[0];
+    EXPECT_GE(item.downloadedBytes.value_or(0), last);
+    last = item.downloadedBytes.value_or(0);
+    if (updates > 1) {
+      EXPECT_GT(item.bytesPerSecond.value_or(0), 0u);
+    }
+  }
+  EXPECT_GE(updates, 1);
+  EXPECT_LE(updates, 4);
+  EXPECT_EQ(events.back().download_task_.items[0].downloadedBytes,
+            data_.size());
+  EXPECT_TRUE(ReadOutput() == data_);
+}
+
+TEST_F(DownloadServiceTest, ShapesBandwidthByPriority) {
+  DownloadService service(std::make_shared<DownloadService::EventQueue>(),
+                          nullptr);
+  ApiServerConfiguration configuration;
+  // The low class needs four seconds for data_, the high one is unlimited
+  configuration.download_max_rate_low = 4 * 1024;
+  service.SetRateLimits(configuration);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::promise<std::chrono::steady_clock::time_point>> done(2);
+  std::vector<std::filesystem::path> paths;
+  for (auto type : {DownloadType::Model, DownloadType::Engine}) {
+    auto i = paths.size();
+    auto path = path_;
+    path += "." + std::to_string(i);
+    paths.push_back(path);
+    DownloadTask task{
+        .id = "task-" + std::to_string(i),
+        .type = type,
+        .items = {DownloadItem{
+            .id = "item",
+            .downloadUrl =
+                "http://127.0.0.1:" + std::to_string(port_) + "/ranged",
+            .localPath = path,
+        }}};
+    service.AddTask(task, [&done, i](const DownloadTask&) {
+      done[i].set_value(std::chrono::steady_clock::now());
+    });
+  }
+
+  auto low = done[0].get_future();
+  auto high = done[1].get_future();
+  ASSERT_EQ(low.wait_for(std::chrono::seconds(30)), std::future_status::ready);
+  ASSERT_EQ(high.wait_for(std::chrono::seconds(30)),
+            std::future_status::ready);
+  auto low_end = low.get();
+  EXPECT_LT(high.get(), low_end);
+  EXPECT_GE(low_end - start, std::chrono::seconds(3));
+  for (const auto& path : paths) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    EXPECT_TRUE(buffer.str() == data_);
+    std::filesystem::remove(path);
+  }
+}
+
+TEST_F(DownloadServiceTest, RestoresInterruptedTask) {
+  using cortex::event::DownloadEvent;
+  using cortex::event::DownloadEventType;
+  SQLite::Database db("./test.db",
+                      SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+  auto download_tasks = std::make_shared<cortex::db::DownloadTasks>(db);
+  db.exec("DELETE FROM download_tasks");
+  db.exec("DELETE FROM download_items");
+
+  DownloadTask task{
+      .id = "restored",
+      .type = DownloadType::Miscellaneous,
+      .items = {DownloadItem{
+          .id = "item",
+          .downloadUrl =
+              "http://127.0.0.1:" + std::to_string(port_) + "/ranged",
+          .localPath = path_,
+      }}};
+  {
+    DownloadService service(std::make_shared<DownloadService::EventQueue>(),
+                            nullptr, download_tasks);
+    // Four seconds for data_, so the shutdown interrupts the download
+    ApiServerConfiguration configuration;
+    configuration.download_max_rate = 4 * 1024;
+    service.SetRateLimits(configuration);
+    service.AddTask(task, [](const DownloadTask&) { FAIL(); });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+
+  auto saved = download_tasks->LoadDownloadTaskList();
+  ASSERT_TRUE(saved);
+  ASSERT_EQ(saved.value().size(), 1u);
+  EXPECT_EQ(saved.value()[0].status, DownloadTask::Status::InProgress);
+  auto downloaded = saved.value()[0].items[0].downloadedBytes.value_or(0);
+  EXPECT_GT(downloaded, 0u);
+  EXPECT_LT(downloaded, data_.size());
+  validated_requests_ = 0;
+
+  auto event_queue = std::make_shared<DownloadService::EventQueue>();
+  std::vector<DownloadEvent> events;
+  event_queue->appendListener(
+      cortex::event::EventType::DownloadEvent,
+      [&events](const DownloadEvent& e) { events.push_back(e); });
+  {
+    DownloadService service(event_queue, nullptr, download_tasks);
+    std::promise<void> done;
+    service.RegisterTaskRestorer(
+        DownloadType::Miscellaneous,
+        [&done](const DownloadTask&)
+            -> cpp::result<DownloadService::OnDownloadTaskSuccessfully,
+                           std::string> {
+          return [&done](const DownloadTask&) { done.set_value(); };
+        });
+    service.RestoreTasks();
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(30)),
+              std::future_status::ready);
+  }
+  event_queue->process();
+
+  // The unfinished ranges continue from the partial file
+  EXPECT_GT(validated_requests_, 0);
+  EXPECT_TRUE(ReadOutput() == data_);
+  ASSERT_FALSE(events.empty());
+  EXPECT_EQ(events.front().type_, DownloadEventType::DownloadUpdated);
+  EXPECT_EQ(events.front().download_task_.items[0].downloadedBytes, downloaded);
+  EXPECT_EQ(events.back().type_, DownloadEventType::DownloadSuccess);
+  saved = download_tasks->LoadDownloadTaskList();
+  ASSERT_TRUE(saved);
+  EXPECT_TRUE(saved.value().empty());
+}
+
+TEST_F(DownloadServiceTest, FailsOverFromBrokenMirror) {
+  // The mirror serves a few bytes of every range, then drops the connection
+  httplib::Server mirror;
+  std::atomic<int> mirror_requests{0};
+  mirror.Get("/ranged", [this, &mirror_requests](const httplib::Request& req,
+                                                 httplib::Response& res) {
+    if (req.has_header("Range")) {
+      mirror_requests++;
+    }
+    res.set_header("Accept-Ranges", "bytes");
+    res.set_header("ETag", kETag);
+    auto sent = std::make_shared<size_t>(0);
+    res.set_content_provider(
+        data_.size(), "application/octet-stream",
+        [this, sent](size_t offset, size_t length, httplib::DataSink& sink) {
+          if (*sent >= (64 << 10)) {
+            return false;
+          }
+          auto size = std::min<size_t>(length, 16 << 10);
+          sink.write(data_.data() + offset, size);
+          *sent += size;
+          return true;
+        });
+  });
+  auto mirror_port = mirror.bind_to_any_port("127.0.0.1");
+  ASSERT_GT(mirror_port, 0);
+  std::thread mirror_thread([&mirror] { mirror.listen_after_bind(); });
+  mirror.wait_until_ready();
+
+  {
+    DownloadService service(std::make_shared<DownloadService::EventQueue>(),
+                            nullptr);
+    ApiServerConfiguration configuration;
+    configuration.download_mirrors = {
+        "127.0.0.1=http://localhost:" + std::to_string(mirror_port)};
+    service.SetMirrors(configuration);
+    DownloadTask task{
+        .id = "mirrored",
+        .type = DownloadType::Miscellaneous,
+        .items = {DownloadItem{
+            .id = "item",
+            .downloadUrl =
+                "http://127.0.0.1:" + std::to_string(port_) + "/ranged",
+            .localPath = path_,
+        }}};
+    std::promise<void> done;
+    service.AddTask(task, [&done](const DownloadTask&) { done.set_value(); });
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(30)),
+              std::future_status::ready);
+
+    // Ranges that broke on the mirror continued from the origin
+    auto health = service.GetMirrorHealth();
+    ASSERT_EQ(health.size(), 2u);
+    for (const auto& host : health) {
+      if (host["host"].asString() ==
+          "http://localhost:" + std::to_string(mirror_port)) {
+        EXPECT_GT(host["failures"].asUInt64(), 0u);
+      } else {
+        EXPECT_EQ(host["failures"].asUInt64(), 0u);
+      }
+    }
+  }
+  mirror.stop();
+  mirror_thread.join();
+
+  EXPECT_GT(mirror_requests, 0);
+  EXPECT_TRUE(ReadOutput() == data_);
+}
+
+TEST_F(DownloadServiceTest, ReplacesFileLinkedToBlob) {
+  // A model file linked to a blob, with a leftover state as if resumable
+  auto blob = path_;
+  blob += ".blob";
+  WritePartialDownload(kETag);
+  std::filesystem::rename(path_, blob);
+  std::filesystem::create_hard_link(blob, path_);
+  auto shared = ReadOutput();
+
+  ASSERT_TRUE(Download("ranged"));
+  EXPECT_EQ(range_requests_, 4);
+  EXPECT_TRUE(ReadOutput() == data_);
+  EXPECT_EQ(std::filesystem::hard_link_count(path_), 1u);
+
+  // The synchronous download replaces it as well
+  std::filesystem::remove(path_);
+  std::filesystem::create_hard_link(blob, path_);
+  DownloadService service(std::make_shared<DownloadService::EventQueue>(),
+                          nullptr);
+  DownloadTask task{
+      .id = "sync",
+      .type = DownloadType::Miscellaneous,
+      .items = {DownloadItem{
+          .id = "item",
+          .downloadUrl =
+              "http://127.0.0.1:" + std::to_string(port_) + "/ranged",
+          .localPath = path_,
+      }}};
+  ASSERT_TRUE(service.AddDownloadTask(task).value_or(false));
+  EXPECT_TRUE(ReadOutput() == data_);
+
+  std::ifstream file(blob, std::ios::binary);
+  std::stringstream blob_data;
+  blob_data << file.rdbuf();
+  EXPECT_TRUE(blob_data.str() == shared);
+  std::filesystem::remove(blob);
+}
+
+TEST_F(DownloadServiceTest, FailsTaskWhenCallbackThrows) {
+  using cortex::event::DownloadEvent;
+  using cortex::event::DownloadEventType;
+  auto event_queue = std::make_shared<DownloadService::EventQueue>();
+  std::vector<DownloadEventType> events;
+  event_queue->appendListener(
+      cortex::event::EventType::DownloadEvent,
+      [&events](const DownloadEvent& e) { events.push_back(e.type_); });
+  {
+    DownloadService service(event_queue, nullptr);
+    DownloadTask task{
+        .id = "rejected",
+        .type = DownloadType::Miscellaneous,
+        .items = {DownloadItem{
+            .id = "item",
+            .downloadUrl =
+                "http://127.0.0.1:" + std::to_string(port_) + "/ranged",
+            .localPath = path_,
+        }}};
+    std::promise<void> done;
+    service.AddTask(task, [&done](const DownloadTask&) {
+      done.set_value();
+      throw std::runtime_error("Invalid split model");
+    });
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(30)),
+              std::future_status::ready);
+
+    auto sync_result = service.AddDownloadTask(
+        task, [](const DownloadTask&) {
+          throw std::runtime_error("Invalid split model");
+        });
+    ASSERT_TRUE(sync_result.has_error());
+    EXPECT_EQ(sync_result.error(), "Invalid split model");
+  }
+  event_queue->process();
+  ASSERT_FALSE(events.empty());
+  EXPECT_EQ(events.back(), DownloadEventType::DownloadError);
+}
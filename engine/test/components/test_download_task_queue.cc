@@ -134,3 +134,20 @@ TEST_F(DownloadTaskQueueTest, ConcurrentPushAndPop) {
   EXPECT_EQ(poppedTasks.load(), numTasks * 4);
   EXPECT_FALSE(queue.pop().has_value());
 }
+
+TEST_F(DownloadTaskQueueTest, PopsHigherPriorityFirst) {
+  queue.push(CreateDownloadTask("model1"));
+  auto engine = CreateDownloadTask("engine");
+  engine.type = DownloadType::Engine;
+  queue.push(engine);
+  auto urgent = CreateDownloadTask("model2");
+  urgent.priority = DownloadPriority::Normal;
+  queue.push(urgent);
+
+  EXPECT_EQ(queue.topPriority(), DownloadPriority::High);
+  EXPECT_EQ(queue.pop()->id, "engine");
+  EXPECT_EQ(queue.pop()->id, "model2");
+  EXPECT_TRUE(queue.cancelTask("model1"));
+  EXPECT_FALSE(queue.topPriority().has_value());
+  EXPECT_TRUE(queue.empty());
+}
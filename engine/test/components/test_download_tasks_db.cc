@@ -0,0 +1,101 @@
+#include "database/download_tasks.h"
+#include "gtest/gtest.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kTestDb = "./test.db";
+}
+class DownloadTasksTestSuite : public ::testing::Test {
+ public:
+  DownloadTasksTestSuite()
+      : db_(kTestDb, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+        download_tasks_(db_) {}
+  void SetUp() {
+    try {
+      db_.exec("DELETE FROM download_tasks");
+      db_.exec("DELETE FROM download_items");
+    } catch (const std::exception& e) {}
+  }
+
+ protected:
+  SQLite::Database db_;
+  cortex::db::DownloadTasks download_tasks_;
+
+  DownloadTask MakeTask(const std::string& id) {
+    return DownloadTask{
+        .id = id,
+        .status = DownloadTask::Status::Pending,
+        .type = DownloadType::Model,
+        .items = {DownloadItem{.id = "model.yml",
+                               .downloadUrl = "https://host/" + id + "/yml",
+                               .localPath = "/models/" + id + "/model.yml"},
+                  DownloadItem{.id = "model.gguf",
+                               .downloadUrl = "https://host/" + id + "/gguf",
+                               .localPath = "/models/" + id + "/model.gguf",
+                               .checksum = "abc"}},
+    };
+  }
+};
+
+TEST_F(DownloadTasksTestSuite, TestUpsertAndLoad) {
+  auto task = MakeTask("tinyllama:1b");
+  task.priority = DownloadPriority::High;
+  EXPECT_TRUE(download_tasks_.UpsertDownloadTask(task).value());
+  EXPECT_TRUE(download_tasks_.UpsertDownloadTask(MakeTask("phi:mini")).value());
+
+  auto tasks = download_tasks_.LoadDownloadTaskList();
+  ASSERT_TRUE(tasks);
+  ASSERT_EQ(tasks.value().size(), 2);
+  const auto& loaded = tasks.value()[0];
+  EXPECT_EQ(loaded.id, "tinyllama:1b");
+  EXPECT_EQ(loaded.type, DownloadType::Model);
+  EXPECT_EQ(loaded.status, DownloadTask::Status::Pending);
+  EXPECT_EQ(loaded.priority, DownloadPriority::High);
+  ASSERT_EQ(loaded.items.size(), 2);
+  EXPECT_EQ(loaded.items[0].id, "model.yml");
+  EXPECT_EQ(loaded.items[1].localPath, task.items[1].localPath);
+  EXPECT_FALSE(loaded.items[0].checksum.has_value());
+  EXPECT_EQ(loaded.items[1].checksum, "abc");
+  EXPECT_FALSE(loaded.items[1].downloadedBytes.has_value());
+  EXPECT_FALSE(tasks.value()[1].priority.has_value());
+
+  // Adding a task again keeps its place in the list
+  EXPECT_TRUE(download_tasks_.UpsertDownloadTask(task).value());
+  tasks = download_tasks_.LoadDownloadTaskList();
+  ASSERT_TRUE(tasks);
+  EXPECT_EQ(tasks.value()[0].id, "tinyllama:1b");
+}
+
+TEST_F(DownloadTasksTestSuite, TestUpdateProgress) {
+  auto task = MakeTask("tinyllama:1b");
+  EXPECT_TRUE(download_tasks_.UpsertDownloadTask(task).value());
+
+  task.status = DownloadTask::Status::InProgress;
+  task.items[1].bytes = 1000;
+  task.items[1].downloadedBytes = 400;
+  // A task finished in the meantime is not written back
+  EXPECT_TRUE(
+      download_tasks_.UpdateDownloadTasks({task, MakeTask("gone")}).value());
+
+  auto tasks = download_tasks_.LoadDownloadTaskList();
+  ASSERT_TRUE(tasks);
+  ASSERT_EQ(tasks.value().size(), 1);
+  EXPECT_EQ(tasks.value()[0].status, DownloadTask::Status::InProgress);
+  EXPECT_EQ(tasks.value()[0].items[1].bytes, 1000);
+  EXPECT_EQ(tasks.value()[0].items[1].downloadedBytes, 400);
+}
+
+TEST_F(DownloadTasksTestSuite, TestDeleteDownloadTask) {
+  EXPECT_TRUE(
+      download_tasks_.UpsertDownloadTask(MakeTask("tinyllama:1b")).value());
+  EXPECT_TRUE(download_tasks_.DeleteDownloadTask("tinyllama:1b").value());
+  EXPECT_FALSE(download_tasks_.DeleteDownloadTask("tinyllama:1b").value());
+
+  auto tasks = download_tasks_.LoadDownloadTaskList();
+  ASSERT_TRUE(tasks);
+  EXPECT_TRUE(tasks.value().empty());
+  SQLite::Statement items(db_, "SELECT COUNT(*) FROM download_items");
+  ASSERT_TRUE(items.executeStep());
+  EXPECT_EQ(items.getColumn(0).getInt(), 0);
+}
+}  // namespace cortex::db
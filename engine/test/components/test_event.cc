@@ -47,3 +47,26 @@ TEST_F(EventTest, EventFromString) {
   auto ev = cortex::event::GetDownloadEventFromJson(root);
   EXPECT_EQ(ev.type_, cortex::event::DownloadEventType::DownloadStarted);
 }
+
+TEST_F(EventTest, ModelLoadEventToJson) {
+  ModelStartJob job{.id = "start-1",
+                    .model = "tinyllama:gguf",
+                    .phase = ModelStartJob::Phase::EngineLoading,
+                    .created_at = 1,
+                    .updated_at = 2};
+  cortex::event::ModelLoadEvent ev{.job_ = job};
+  auto root = json_helper::ParseJsonString(ev.ToJsonString());
+  EXPECT_EQ(root["type"].asString(), "ModelLoadEngineLoading");
+  EXPECT_EQ(root["job"]["id"].asString(), "start-1");
+  EXPECT_EQ(root["job"]["model"].asString(), "tinyllama:gguf");
+  EXPECT_EQ(root["job"]["phase"].asString(), "engine-loading");
+  EXPECT_TRUE(root["job"]["error"].isNull());
+
+  job.phase = ModelStartJob::Phase::Failed;
+  job.error = "Model failed to start";
+  EXPECT_TRUE(job.IsFinished());
+  ev.job_ = job;
+  root = json_helper::ParseJsonString(ev.ToJsonString());
+  EXPECT_EQ(root["type"].asString(), "ModelLoadFailed");
+  EXPECT_EQ(root["job"]["error"].asString(), "Model failed to start");
+}
@@ -0,0 +1,76 @@
+#include "database/gguf_metadata.h"
+#include "gtest/gtest.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kTestDb = "./test.db";
+}
+class GGUFMetadataTestSuite : public ::testing::Test {
+ public:
+  GGUFMetadataTestSuite()
+      : db_(kTestDb, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+        gguf_metadata_(db_) {}
+  void SetUp() {
+    try {
+      db_.exec("DELETE FROM gguf_metadata");
+    } catch (const std::exception& e) {}
+  }
+
+ protected:
+  SQLite::Database db_;
+  cortex::db::GGUFMetadata gguf_metadata_;
+
+  const cortex::db::GGUFMetadataEntry kTestEntry{
+      .path = "/models/tinyllama.gguf",
+      .file_size = 1024,
+      .mtime = 1700000000,
+      .architecture = "llama",
+      .context_length = 4096,
+      .chat_template = "{prompt}",
+      .bos_token = "<s>",
+      .eos_token = "</s>",
+      .tensor_count = 3,
+      .parameter_count = 3136,
+      .estimated_memory_bytes = 2808,
+      .model_config = R"({"name":"tinyllama"})",
+      .tensors = "[]"};
+};
+
+TEST_F(GGUFMetadataTestSuite, TestUpsertAndGet) {
+  EXPECT_TRUE(gguf_metadata_.UpsertEntry(kTestEntry).value());
+
+  auto entry = gguf_metadata_.GetEntry(kTestEntry.path, kTestEntry.file_size,
+                                       kTestEntry.mtime);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(entry->architecture, kTestEntry.architecture);
+  EXPECT_EQ(entry->context_length, kTestEntry.context_length);
+  EXPECT_EQ(entry->eos_token, kTestEntry.eos_token);
+  EXPECT_EQ(entry->parameter_count, kTestEntry.parameter_count);
+  EXPECT_EQ(entry->model_config, kTestEntry.model_config);
+
+  EXPECT_TRUE(gguf_metadata_.DeleteEntry(kTestEntry.path).value());
+  EXPECT_FALSE(gguf_metadata_.DeleteEntry(kTestEntry.path).value());
+}
+
+TEST_F(GGUFMetadataTestSuite, TestOutdatedEntryIsMiss) {
+  EXPECT_TRUE(gguf_metadata_.UpsertEntry(kTestEntry).value());
+
+  EXPECT_TRUE(gguf_metadata_
+                  .GetEntry(kTestEntry.path, kTestEntry.file_size + 1,
+                            kTestEntry.mtime)
+                  .has_error());
+  EXPECT_TRUE(gguf_metadata_
+                  .GetEntry(kTestEntry.path, kTestEntry.file_size,
+                            kTestEntry.mtime + 1)
+                  .has_error());
+
+  // Re-indexing the changed file replaces the entry
+  auto updated = kTestEntry;
+  updated.mtime = kTestEntry.mtime + 1;
+  EXPECT_TRUE(gguf_metadata_.UpsertEntry(updated).value());
+  EXPECT_TRUE(
+      gguf_metadata_.GetEntry(updated.path, updated.file_size, updated.mtime));
+
+  EXPECT_TRUE(gguf_metadata_.DeleteEntry(kTestEntry.path).value());
+}
+}  // namespace cortex::db
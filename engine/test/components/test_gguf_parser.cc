@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 #include "config/gguf_parser.h"
 #include "config/yaml_config.h"
+#include "test/components/gguf_test_utils.h"
 #include <fstream>
 #include <cstdio>
 #include <vector>
@@ -155,4 +156,178 @@ ctx_len: 4096
         }
         FAIL() << "Exception thrown: " << e.what();
     }
-}
\ No newline at end of file
+}
+TEST_F(GGUFParserTest, LazyParseSkipsArrays) {
+    using namespace gguf_test_utils;
+    std::string gguf_path = getTempFilePath("mock_lazy-model", ".gguf");
+    std::string data;
+    WriteHeader(data, 0, 5);
+
+    // Float array before the keys we need, must be skipped as a block
+    WriteString(data, "tokenizer.ggml.scores");
+    WriteU32(data, 9);
+    WriteU32(data, 6);
+    WriteU64(data, 3);
+    for (float f : {0.1f, 0.2f, 0.3f}) {
+        WriteF32(data, f);
+    }
+
+    WriteString(data, "tokenizer.ggml.tokens");
+    WriteU32(data, 9);
+    WriteU32(data, 8);
+    WriteU64(data, 3);
+    WriteString(data, "<unk>");
+    WriteString(data, "<s>");
+    WriteString(data, "</s>");
+
+    WriteString(data, "tokenizer.ggml.eos_token_id");
+    WriteU32(data, 4);
+    WriteU32(data, 2);
+
+    WriteString(data, "general.name");
+    WriteU32(data, 8);
+    WriteString(data, "lazy model");
+
+    WriteString(data, "llama.context_length");
+    WriteU32(data, 4);
+    WriteU32(data, 2048);
+    WriteFile(gguf_path, data);
+
+    gguf_handler->Parse(gguf_path, config::GGUFHandler::ParseMode::Lazy);
+    const config::ModelConfig& gguf_config = gguf_handler->GetModelConfig();
+    EXPECT_EQ(gguf_config.name, "lazy-model");
+    EXPECT_EQ(gguf_config.ctx_len, 2048);
+    ASSERT_EQ(gguf_config.stop.size(), 1);
+    EXPECT_EQ(gguf_config.stop[0], "</s>");
+
+    std::remove(gguf_path.c_str());
+}
+
+TEST_F(GGUFParserTest, LazyParseRejectsTruncatedFile) {
+    std::string gguf_path = getTempFilePath("mock_truncated-model", ".gguf");
+    {
+        std::ofstream file(gguf_path, std::ios::binary);
+        uint32_t magic = 0x46554747;
+        uint32_t version = 3;
+        uint64_t tensor_count = 0;
+        uint64_t kv_count = 1;
+        uint64_t key_length = 100;
+        file.write(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.write(reinterpret_cast<char*>(&version), sizeof(version));
+        file.write(reinterpret_cast<char*>(&tensor_count), sizeof(tensor_count));
+        file.write(reinterpret_cast<char*>(&kv_count), sizeof(kv_count));
+        file.write(reinterpret_cast<char*>(&key_length), sizeof(key_length));
+    }
+
+    EXPECT_THROW(
+        gguf_handler->Parse(gguf_path, config::GGUFHandler::ParseMode::Lazy),
+        std::runtime_error);
+
+    std::remove(gguf_path.c_str());
+}
+
+TEST_F(GGUFParserTest, ParseTensorInfos) {
+    using namespace gguf_test_utils;
+    std::string gguf_path = getTempFilePath("mock_tensors-model", ".gguf");
+    std::string data;
+    WriteHeader(data, 3, 1);
+
+    WriteString(data, "general.architecture");
+    WriteU32(data, 8);
+    WriteString(data, "llama");
+
+    // name, n_dims, dims, ggml type, offset
+    WriteString(data, "token_embd.weight");
+    WriteU32(data, 2);
+    WriteU64(data, 64);
+    WriteU64(data, 32);
+    WriteU32(data, 8);  // Q8_0
+    WriteU64(data, 0);
+
+    WriteString(data, "blk.0.attn_q.weight");
+    WriteU32(data, 2);
+    WriteU64(data, 256);
+    WriteU64(data, 4);
+    WriteU32(data, 12);  // Q4_K
+    WriteU64(data, 2176);
+
+    WriteString(data, "blk.0.attn_norm.weight");
+    WriteU32(data, 1);
+    WriteU64(data, 64);
+    WriteU32(data, 0);  // F32
+    WriteU64(data, 2752);
+    WriteFile(gguf_path, data);
+
+    gguf_handler->Parse(gguf_path, config::GGUFHandler::ParseMode::Lazy);
+    EXPECT_EQ(gguf_handler->GetArchitecture(), "llama");
+    const auto& tensors = gguf_handler->GetTensorInfos();
+    ASSERT_EQ(tensors.size(), 3);
+    EXPECT_EQ(tensors[1].name, "blk.0.attn_q.weight");
+    EXPECT_EQ(tensors[1].ElementCount(), 1024);
+    EXPECT_EQ(tensors[1].ByteSize(), 4 * 144);
+    EXPECT_EQ(gguf_handler->GetTensorDataOffset() % 32, 0);
+
+    auto report = config::GGUFTensorReport(tensors);
+    EXPECT_EQ(report["parameter_count"].asUInt64(), 2048 + 1024 + 64);
+    EXPECT_EQ(report["bytes"].asUInt64(), 64 * 34 + 4 * 144 + 64 * 4);
+    EXPECT_EQ(report["quantization"].size(), 3);
+    ASSERT_EQ(report["layers"].size(), 2);
+    EXPECT_EQ(report["layers"][0]["name"].asString(), "token_embd");
+    EXPECT_EQ(report["layers"][1]["name"].asString(), "blk.0");
+    EXPECT_EQ(report["layers"][1]["tensor_count"].asUInt64(), 2);
+
+    std::remove(gguf_path.c_str());
+}
+
+TEST_F(GGUFParserTest, ChatTemplateHasNoLeadingBos) {
+    using namespace gguf_test_utils;
+    // The engine adds BOS when it tokenizes, the template must not repeat it
+    const std::vector<std::pair<std::string, std::string>> templates = {
+        // Mistral, BOS from the context
+        {"{{ bos_token }}{% for message in messages %}"
+         "{% if message['role'] == 'user' %}"
+         "{{ '[INST] ' + message['content'] + ' [/INST]' }}"
+         "{% endif %}{% endfor %}",
+         "[INST] {prompt} [/INST]"},
+        // Llama 3 style, BOS spelled out
+        {"<s>{% for message in messages %}"
+         "{{ '<|start_header_id|>' + message['role'] + '<|end_header_id|>' + "
+         "message['content'] }}{% endfor %}",
+         "<|start_header_id|>system<|end_header_id|>{system_message}"
+         "<|start_header_id|>user<|end_header_id|>{prompt}"},
+    };
+    for (const auto& [jinja, expected] : templates) {
+        std::string gguf_path = getTempFilePath("mock_bos-model", ".gguf");
+        std::string data;
+        WriteHeader(data, 0, 4);
+
+        WriteString(data, "tokenizer.ggml.tokens");
+        WriteU32(data, 9);
+        WriteU32(data, 8);
+        WriteU64(data, 3);
+        WriteString(data, "<unk>");
+        WriteString(data, "<s>");
+        WriteString(data, "</s>");
+
+        WriteString(data, "tokenizer.ggml.bos_token_id");
+        WriteU32(data, 4);
+        WriteU32(data, 1);
+
+        WriteString(data, "tokenizer.ggml.eos_token_id");
+        WriteU32(data, 4);
+        WriteU32(data, 2);
+
+        WriteString(data, "tokenizer.chat_template");
+        WriteU32(data, 8);
+        WriteString(data, jinja);
+        WriteFile(gguf_path, data);
+
+        gguf_handler->Parse(gguf_path);
+        const auto& prompt_template =
+            gguf_handler->GetModelConfig().prompt_template;
+        EXPECT_FALSE(prompt_template.starts_with("<s>")) << prompt_template;
+        EXPECT_EQ(prompt_template, expected);
+
+        std::remove(gguf_path.c_str());
+    }
+}
@@ -0,0 +1,122 @@
+#include <httplib.h>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "config/gguf_remote.h"
+#include "gtest/gtest.h"
+#include "test/components/gguf_test_utils.h"
+
+namespace {
+std::string MockGGUF() {
+  using namespace gguf_test_utils;
+  std::string data;
+  WriteHeader(data, 1, 3);
+
+  WriteString(data, "general.architecture");
+  WriteU32(data, 8);
+  WriteString(data, "llama");
+
+  // Large array so the header does not fit in the first request
+  WriteString(data, "tokenizer.ggml.scores");
+  WriteU32(data, 9);
+  WriteU32(data, 6);
+  WriteU64(data, 4096);
+  data.append(4096 * sizeof(float), '\0');
+
+  WriteString(data, "llama.context_length");
+  WriteU32(data, 4);
+  WriteU32(data, 2048);
+
+  WriteString(data, "blk.0.attn_q.weight");
+  WriteU32(data, 2);
+  WriteU64(data, 64);
+  WriteU64(data, 64);
+  WriteU32(data, 0);  // F32
+  WriteU64(data, 0);
+
+  // Tensor data, never fetched
+  data.append(32 + 64 * 64 * sizeof(float), '\0');
+  return data;
+}
+}  // namespace
+
+class GGUFRemoteTest : public ::testing::Test {
+ protected:
+  void SetUp() override { data_ = MockGGUF(); }
+
+  cpp::result<std::string, std::string> Fetch(uint64_t offset,
+                                              uint64_t length) {
+    requested_ += length;
+    fetches_++;
+    if (offset >= data_.size()) {
+      return std::string{};
+    }
+    return data_.substr(offset, length);
+  }
+
+  std::string data_;
+  uint64_t requested_ = 0;
+  int fetches_ = 0;
+};
+
+TEST_F(GGUFRemoteTest, GrowsRangeUntilHeaderIsComplete) {
+  config::GGUFHandler handler;
+  auto res = config::ParseRemoteGGUF(
+      [this](uint64_t offset, uint64_t length) {
+        return Fetch(offset, length);
+      },
+      handler, 256);
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_GT(fetches_, 1);
+  EXPECT_LT(requested_, data_.size());
+  EXPECT_EQ(handler.GetArchitecture(), "llama");
+  EXPECT_EQ(handler.GetContextLength(), 2048);
+  ASSERT_EQ(handler.GetTensorInfos().size(), 1);
+  EXPECT_EQ(handler.GetTensorInfos()[0].ElementCount(), 64 * 64);
+}
+
+TEST_F(GGUFRemoteTest, FailsWhenHeaderExceedsLimit) {
+  config::GGUFHandler handler;
+  auto res = config::ParseRemoteGGUF(
+      [this](uint64_t offset, uint64_t length) {
+        return Fetch(offset, length);
+      },
+      handler, 256, 1024);
+  EXPECT_TRUE(res.has_error());
+  EXPECT_LE(requested_, 1024);
+}
+
+TEST_F(GGUFRemoteTest, RejectsNonGGUF) {
+  data_ = std::string(4096, 'x');
+  config::GGUFHandler handler;
+  auto res = config::ParseRemoteGGUF(
+      [this](uint64_t offset, uint64_t length) {
+        return Fetch(offset, length);
+      },
+      handler, 256);
+  EXPECT_TRUE(res.has_error());
+  EXPECT_EQ(fetches_, 1);
+}
+
+TEST_F(GGUFRemoteTest, ParseOverHttpRange) {
+  httplib::Server server;
+  server.Get("/model.gguf",
+             [this](const httplib::Request&, httplib::Response& res) {
+               res.set_content(data_, "application/octet-stream");
+             });
+  auto port = server.bind_to_any_port("127.0.0.1");
+  ASSERT_GT(port, 0);
+  std::thread t([&server] { server.listen_after_bind(); });
+  server.wait_until_ready();
+
+  config::GGUFHandler handler;
+  auto res = config::ParseRemoteGGUF(
+      "http://127.0.0.1:" + std::to_string(port) + "/model.gguf", handler,
+      256);
+  server.stop();
+  t.join();
+
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_EQ(handler.GetArchitecture(), "llama");
+  EXPECT_EQ(handler.GetContextLength(), 2048);
+}
@@ -0,0 +1,34 @@
+#include "gtest/gtest.h"
+#include "utils/gguf_split_utils.h"
+
+class GGUFSplitUtilsTestSuite : public ::testing::Test {};
+
+TEST_F(GGUFSplitUtilsTestSuite, ParseSplitFileName) {
+  auto split = gguf_split_utils::ParseSplitFileName(
+      "Meta-Llama-3.1-70B-Q4_K_M-00002-of-00005.gguf");
+  ASSERT_TRUE(split.has_value());
+  EXPECT_EQ(split->prefix, "Meta-Llama-3.1-70B-Q4_K_M");
+  EXPECT_EQ(split->index, 2);
+  EXPECT_EQ(split->count, 5);
+
+  EXPECT_FALSE(gguf_split_utils::ParseSplitFileName("model.gguf"));
+  EXPECT_FALSE(
+      gguf_split_utils::ParseSplitFileName("model-00003-of-00002.gguf"));
+  EXPECT_FALSE(gguf_split_utils::ParseSplitFileName("model-1-of-2.gguf"));
+}
+
+TEST_F(GGUFSplitUtilsTestSuite, GetSplitFileNames) {
+  auto names = gguf_split_utils::GetSplitFileNames(
+      {.prefix = "model", .index = 1, .count = 3});
+  ASSERT_EQ(names.size(), 3);
+  EXPECT_EQ(names[0], "model-00001-of-00003.gguf");
+  EXPECT_EQ(names[2], "model-00003-of-00003.gguf");
+}
+
+TEST_F(GGUFSplitUtilsTestSuite, IsSelectableGGUF) {
+  EXPECT_TRUE(gguf_split_utils::IsSelectableGGUF("model.gguf"));
+  EXPECT_TRUE(gguf_split_utils::IsSelectableGGUF("model-00001-of-00003.gguf"));
+  EXPECT_FALSE(
+      gguf_split_utils::IsSelectableGGUF("model-00002-of-00003.gguf"));
+  EXPECT_FALSE(gguf_split_utils::IsSelectableGGUF("README.md"));
+}
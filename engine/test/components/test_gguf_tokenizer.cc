@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "config/gguf_tokenizer.h"
+#include "gtest/gtest.h"
+#include "test/components/gguf_test_utils.h"
+
+namespace {
+constexpr int32_t kNormal = 1;
+constexpr int32_t kControl = 3;
+constexpr int32_t kByte = 6;
+
+config::GGUFVocab SpmVocab() {
+  config::GGUFVocab vocab;
+  vocab.model = "llama";
+  auto add = [&vocab](const std::string& text, float score, int32_t type) {
+    vocab.tokens.push_back(text);
+    vocab.scores.push_back(score);
+    vocab.token_types.push_back(type);
+  };
+  add("<unk>", 0, 2);
+  add("<s>", 0, kControl);
+  add("</s>", 0, kControl);
+  add("<0x0A>", 0, kByte);
+  for (const auto* piece :
+       {"\xe2\x96\x81", "h", "e", "l", "o", "w", "r", "d"}) {
+    add(piece, -10, kNormal);
+  }
+  add("ll", -1, kNormal);
+  add("\xe2\x96\x81h", -2, kNormal);
+  add("\xe2\x96\x81he", -3, kNormal);
+  add("llo", -4, kNormal);
+  add("\xe2\x96\x81hello", -5, kNormal);
+  add("\xe2\x96\x81w", -6, kNormal);
+  vocab.bos_id = 1;
+  vocab.eos_id = 2;
+  return vocab;
+}
+
+config::GGUFVocab BpeVocab(const std::string& pre) {
+  config::GGUFVocab vocab;
+  vocab.model = "gpt2";
+  vocab.pre = pre;
+  // Ġ is how the GPT-2 byte encoder spells a space
+  for (const auto* piece :
+       {"h", "e", "l", "o", "w", "r", "d", "1", "2", "3", "4", "'", "s", "I",
+        "\xc4\xa0", "\xc4\x8a", "he", "ll", "hell", "hello", "\xc4\xa0w",
+        "or", "\xc4\xa0wor", "\xc4\xa0world", "<|eot|>"}) {
+    vocab.tokens.push_back(piece);
+    vocab.token_types.push_back(kNormal);
+  }
+  vocab.token_types.back() = kControl;
+  vocab.merges = {"h e",          "l l",           "he ll",
+                  "hell o",       "\xc4\xa0 w",    "o r",
+                  "\xc4\xa0w or", "\xc4\xa0wor l", "\xc4\xa0worl d"};
+  vocab.tokens.push_back("\xc4\xa0worl");
+  vocab.token_types.push_back(kNormal);
+  vocab.eos_id = 24;
+  return vocab;
+}
+
+std::vector<std::string> Pieces(const config::GGUFTokenizer& tokenizer,
+                                const std::vector<int32_t>& ids) {
+  std::vector<std::string> res;
+  for (auto id : ids) {
+    res.emplace_back(tokenizer.TokenText(id));
+  }
+  return res;
+}
+}  // namespace
+
+class GGUFTokenizerTest : public ::testing::Test {};
+
+TEST_F(GGUFTokenizerTest, EncodesSentencePieceByScore) {
+  auto tokenizer = config::GGUFTokenizer::Create(SpmVocab());
+  ASSERT_TRUE(tokenizer.has_value()) << tokenizer.error();
+  const auto& t = *tokenizer.value();
+
+  auto ids = t.Encode("hello world\n", true);
+  EXPECT_EQ(Pieces(t, ids),
+            (std::vector<std::string>{"<s>", "\xe2\x96\x81hello",
+                                      "\xe2\x96\x81w", "o", "r", "l", "d",
+                                      "<0x0A>"}));
+  EXPECT_EQ(t.Decode(ids, true), "hello world\n");
+  EXPECT_EQ(t.Decode(ids, false), "<s>hello world\n");
+  EXPECT_EQ(t.CountTokens("hello world\n", false), ids.size() - 1);
+
+  // Special tokens are matched in the text, the space prefix is added after
+  // every one of them
+  ids = t.Encode("hello</s>hello", false);
+  EXPECT_EQ(Pieces(t, ids),
+            (std::vector<std::string>{"\xe2\x96\x81hello", "</s>",
+                                      "\xe2\x96\x81hello"}));
+}
+
+TEST_F(GGUFTokenizerTest, EncodesByteLevelBpeByMergeRank) {
+  auto tokenizer = config::GGUFTokenizer::Create(BpeVocab("llama-bpe"));
+  ASSERT_TRUE(tokenizer.has_value()) << tokenizer.error();
+  const auto& t = *tokenizer.value();
+
+  auto ids = t.Encode("hello world<|eot|>", true);
+  EXPECT_EQ(Pieces(t, ids),
+            (std::vector<std::string>{"hello", "\xc4\xa0world", "<|eot|>"}));
+  EXPECT_EQ(t.Decode(ids, true), "hello world");
+
+  // llama 3 keeps at most three digits together and splits contractions
+  ids = t.Encode("I's 1234\n", false);
+  EXPECT_EQ(Pieces(t, ids),
+            (std::vector<std::string>{"I", "'", "s", "\xc4\xa0", "1", "2", "3",
+                                      "4", "\xc4\x8a"}));
+  EXPECT_EQ(t.Decode(ids), "I's 1234\n");
+}
+
+TEST_F(GGUFTokenizerTest, RejectsUnknownVocabularies) {
+  config::GGUFVocab vocab;
+  EXPECT_TRUE(config::GGUFTokenizer::Create(vocab).has_error());
+  vocab.model = "bert";
+  vocab.tokens = {"a"};
+  EXPECT_TRUE(config::GGUFTokenizer::Create(vocab).has_error());
+}
+
+TEST_F(GGUFTokenizerTest, ReadsVocabularyFromGGUF) {
+  using namespace gguf_test_utils;
+  std::string data;
+  WriteHeader(data, 0, 4);
+  WriteString(data, "tokenizer.ggml.model");
+  WriteU32(data, 8);
+  WriteString(data, "llama");
+  WriteString(data, "tokenizer.ggml.tokens");
+  WriteU32(data, 9);
+  WriteU32(data, 8);
+  WriteU64(data, 3);
+  for (const auto* token : {"<s>", "\xe2\x96\x81", "a"}) {
+    WriteString(data, token);
+  }
+  WriteString(data, "tokenizer.ggml.scores");
+  WriteU32(data, 9);
+  WriteU32(data, 6);
+  WriteU64(data, 3);
+  for (float score : {0.0f, -1.0f, -2.0f}) {
+    WriteF32(data, score);
+  }
+  WriteString(data, "tokenizer.ggml.add_bos_token");
+  WriteU32(data, 7);
+  data.push_back('\0');
+
+  auto path = std::filesystem::temp_directory_path() / "test_tokenizer.gguf";
+  WriteFile(path.string(), data);
+
+  config::GGUFHandler handler;
+  handler.Parse(path.string(), config::GGUFHandler::ParseMode::Vocab);
+  std::filesystem::remove(path);
+
+  const auto& vocab = handler.GetVocab();
+  EXPECT_EQ(vocab.model, "llama");
+  EXPECT_EQ(vocab.tokens.size(), 3u);
+  EXPECT_EQ(vocab.scores, (std::vector<float>{0.0f, -1.0f, -2.0f}));
+  EXPECT_EQ(vocab.add_bos, false);
+
+  auto tokenizer = config::GGUFTokenizer::Create(vocab);
+  ASSERT_TRUE(tokenizer.has_value()) << tokenizer.error();
+  EXPECT_EQ(tokenizer.value()->Encode("a", true),
+            (std::vector<int32_t>{1, 2}));
+}
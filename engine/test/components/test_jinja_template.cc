@@ -0,0 +1,182 @@
+#include <string>
+#include "config/jinja_template.h"
+#include "gtest/gtest.h"
+
+namespace {
+Json::Value Message(const std::string& role, const std::string& content) {
+  Json::Value msg;
+  msg["role"] = role;
+  msg["content"] = content;
+  return msg;
+}
+
+Json::Value Conversation() {
+  Json::Value messages(Json::arrayValue);
+  messages.append(Message("system", "You are helpful."));
+  messages.append(Message("user", "Hi"));
+  messages.append(Message("assistant", "Hello!"));
+  messages.append(Message("user", "How are you?"));
+  return messages;
+}
+
+std::string Render(const std::string& source, const Json::Value& context) {
+  auto tmpl = config::JinjaTemplate::Compile(source);
+  EXPECT_TRUE(tmpl.has_value()) << tmpl.error();
+  std::string out;
+  auto res = tmpl.value()->Render(context, out);
+  EXPECT_TRUE(res.has_value()) << res.error();
+  return out;
+}
+}  // namespace
+
+class JinjaTemplateTest : public ::testing::Test {};
+
+TEST_F(JinjaTemplateTest, RendersChatML) {
+  std::string source =
+      "{% for message in messages %}"
+      "{{'<|im_start|>' + message['role'] + '\\n' + message['content'] + "
+      "'<|im_end|>' + '\\n'}}"
+      "{% endfor %}"
+      "{% if add_generation_prompt %}{{ '<|im_start|>assistant\\n' }}"
+      "{% endif %}";
+  auto out = Render(source, config::ChatTemplateContext(Conversation(), true,
+                                                        "<s>", "</s>"));
+  EXPECT_EQ(out,
+            "<|im_start|>system\nYou are helpful.<|im_end|>\n"
+            "<|im_start|>user\nHi<|im_end|>\n"
+            "<|im_start|>assistant\nHello!<|im_end|>\n"
+            "<|im_start|>user\nHow are you?<|im_end|>\n"
+            "<|im_start|>assistant\n");
+}
+
+TEST_F(JinjaTemplateTest, RendersLlama3StyleTemplate) {
+  std::string source =
+      "{% set loop_messages = messages %}"
+      "{% for message in loop_messages %}"
+      "{% set content = '<|start_header_id|>' + message['role'] + "
+      "'<|end_header_id|>\n\n'+ message['content'] | trim + '<|eot_id|>' %}"
+      "{% if loop.index0 == 0 %}{% set content = bos_token + content %}"
+      "{% endif %}"
+      "{{ content }}"
+      "{% endfor %}"
+      "{% if add_generation_prompt %}"
+      "{{ '<|start_header_id|>assistant<|end_header_id|>\n\n' }}"
+      "{% endif %}";
+  Json::Value messages(Json::arrayValue);
+  messages.append(Message("user", "  Hi  "));
+  auto out = Render(source, config::ChatTemplateContext(
+                                messages, true, "<|begin_of_text|>", ""));
+  EXPECT_EQ(out,
+            "<|begin_of_text|><|start_header_id|>user<|end_header_id|>\n\n"
+            "Hi<|eot_id|><|start_header_id|>assistant<|end_header_id|>\n\n");
+}
+
+TEST_F(JinjaTemplateTest, RendersMistralStyleTemplate) {
+  std::string source = R"({%- if messages[0]['role'] == 'system' %}
+    {%- set system_message = messages[0]['content'] %}
+    {%- set loop_messages = messages[1:] %}
+{%- else %}
+    {%- set loop_messages = messages %}
+{%- endif %}
+
+{{- bos_token }}
+{%- for message in loop_messages %}
+    {%- if (message['role'] == 'user') != (loop.index0 % 2 == 0) %}
+        {{- raise_exception('Conversation roles must alternate') }}
+    {%- endif %}
+    {%- if message['role'] == 'user' %}
+        {%- if loop.first and system_message is defined %}
+            {{- ' [INST] ' + system_message + '\n\n' + message['content'] + ' [/INST]' }}
+        {%- else %}
+            {{- ' [INST] ' + message['content'] + ' [/INST]' }}
+        {%- endif %}
+    {%- elif message['role'] == 'assistant' %}
+        {{- ' ' + message['content'] + eos_token}}
+    {%- endif %}
+{%- endfor %}
+)";
+  auto out = Render(source, config::ChatTemplateContext(Conversation(), false,
+                                                        "<s>", "</s>"));
+  EXPECT_EQ(out,
+            "<s> [INST] You are helpful.\n\nHi [/INST] Hello!</s>"
+            " [INST] How are you? [/INST]");
+
+  Json::Value bad(Json::arrayValue);
+  bad.append(Message("assistant", "Hello!"));
+  auto tmpl = config::JinjaTemplate::Compile(source);
+  ASSERT_TRUE(tmpl.has_value());
+  std::string buffer;
+  auto res = tmpl.value()->Render(
+      config::ChatTemplateContext(bad, false, "<s>", "</s>"), buffer);
+  ASSERT_TRUE(res.has_error());
+  EXPECT_NE(res.error().find("Conversation roles must alternate"),
+            std::string::npos);
+}
+
+TEST_F(JinjaTemplateTest, NamespaceCarriesStateOutOfLoops) {
+  std::string source =
+      "{%- set ns = namespace(found=false, count=0) -%}\n"
+      "{%- for message in messages if message.role == 'user' -%}\n"
+      "  {%- set ns.count = ns.count + 1 -%}\n"
+      "  {%- if 'How' in message.content %}{% set ns.found = true %}"
+      "{% endif -%}\n"
+      "{%- endfor -%}\n"
+      "{{ ns.count }} {{ ns.found }}";
+  EXPECT_EQ(Render(source, config::ChatTemplateContext(Conversation(), false,
+                                                       "", "")),
+            "2 True");
+}
+
+TEST_F(JinjaTemplateTest, AppliesBlockWhitespaceControl) {
+  std::string source =
+      "<start>\n"
+      "  {% if true %}\n"
+      "  yes\n"
+      "  {% endif %}\n"
+      "{# comment #}\n"
+      "<end>\n";
+  EXPECT_EQ(Render(source, Json::Value()), "<start>\n  yes\n<end>");
+}
+
+TEST_F(JinjaTemplateTest, SupportsFiltersTestsAndMethods) {
+  Json::Value context;
+  context["tools"] = Json::Value(Json::arrayValue);
+  Json::Value tool;
+  tool["name"] = "get_weather";
+  tool["required"] = Json::Value(Json::arrayValue);
+  tool["required"].append("city");
+  context["tools"].append(tool);
+  context["text"] = "  Hello World  ";
+  context["number"] = 3;
+
+  EXPECT_EQ(Render("{{ tools | length }}|{{ tools[0].name | upper }}|"
+                   "{{ tools | map(attribute='name') | join(', ') }}",
+                   context),
+            "1|GET_WEATHER|get_weather");
+  EXPECT_EQ(Render("{{ tools[0].required | tojson }}", context), "[\"city\"]");
+  EXPECT_EQ(Render("{{ text.strip().lower() }}|{{ text.split() | last }}|"
+                   "{{ text | trim | replace('World', 'there') }}",
+                   context),
+            "hello world|World|Hello there");
+  EXPECT_EQ(Render("{{ missing | default('none') }}|"
+                   "{{ missing is not defined }}|{{ number is odd }}|"
+                   "{{ number is string }}",
+                   context),
+            "none|True|True|False");
+  EXPECT_EQ(Render("{{ number // 2 }} {{ number / 2 }} {{ -number % 2 }} "
+                   "{{ 'yes' if number > 2 else 'no' }}",
+                   context),
+            "1 1.5 1 yes");
+  EXPECT_EQ(Render("{% for k, v in {'a': 1}.items() %}{{ k }}={{ v }}"
+                   "{% endfor %}{{ [1, 2, 3][::-1] }}",
+                   context),
+            "a=1[3, 2, 1]");
+}
+
+TEST_F(JinjaTemplateTest, ReportsCompileErrors) {
+  EXPECT_TRUE(config::JinjaTemplate::Compile("{% if x %}").has_error());
+  EXPECT_TRUE(config::JinjaTemplate::Compile("{{ x ").has_error());
+  EXPECT_TRUE(
+      config::JinjaTemplate::Compile("{% macro foo() %}{% endmacro %}")
+          .has_error());
+}
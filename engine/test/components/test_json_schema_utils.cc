@@ -0,0 +1,146 @@
+#include <string>
+#include "gtest/gtest.h"
+#include "utils/json_helper.h"
+#include "utils/json_schema_utils.h"
+
+namespace {
+std::string Compile(const std::string& schema) {
+  auto res = json_schema_utils::SchemaToGrammar(
+      json_helper::ParseJsonString(schema));
+  EXPECT_TRUE(res.has_value()) << res.error();
+  return res.value_or("");
+}
+
+bool HasRule(const std::string& grammar, const std::string& rule) {
+  return grammar.find(rule + "\n") != std::string::npos;
+}
+}  // namespace
+
+class JsonSchemaUtilsTest : public ::testing::Test {};
+
+TEST_F(JsonSchemaUtilsTest, CompilesObjectsWithRequiredAndOptional) {
+  auto grammar = Compile(R"({
+    "type": "object",
+    "properties": {
+      "age": {"type": "integer"},
+      "name": {"type": "string"},
+      "tags": {"type": "array", "items": {"type": "string"}, "maxItems": 3}
+    },
+    "required": ["name"]
+  })");
+  EXPECT_TRUE(HasRule(grammar,
+                      "root ::= \"{\" space root-name-kv ( \",\" space "
+                      "( root-age-kv root-age-rest | root-tags-kv ) )? "
+                      "\"}\" space"))
+      << grammar;
+  EXPECT_TRUE(HasRule(grammar,
+                      "root-name-kv ::= \"\\\"name\\\"\" space \":\" space "
+                      "string"))
+      << grammar;
+  EXPECT_TRUE(HasRule(grammar,
+                      "root-age-rest ::= ( \",\" space root-tags-kv )?"))
+      << grammar;
+  EXPECT_TRUE(HasRule(grammar,
+                      "root-tags ::= \"[\" space ( string ( \",\" space "
+                      "string ){0,2} )? \"]\" space"))
+      << grammar;
+  EXPECT_TRUE(HasRule(grammar, "integer ::= (\"-\"? integral-part) space"));
+  EXPECT_TRUE(HasRule(grammar, "space ::= | \" \" | \"\\n\" [ \\t]{0,20}"));
+}
+
+TEST_F(JsonSchemaUtilsTest, CompilesEnumsAnyOfAndFormats) {
+  auto grammar = Compile(R"({
+    "type": "object",
+    "properties": {
+      "color": {"enum": ["red", "green", 3]},
+      "when": {"type": "string", "format": "date-time"},
+      "id": {"anyOf": [{"type": "string", "format": "uuid"},
+                       {"type": "null"}]},
+      "code": {"type": "string", "minLength": 2, "maxLength": 4}
+    },
+    "required": ["code", "color", "id", "when"],
+    "additionalProperties": false
+  })");
+  EXPECT_TRUE(HasRule(grammar,
+                      "root-color ::= ( \"\\\"red\\\"\" | "
+                      "\"\\\"green\\\"\" | \"3\" ) space"))
+      << grammar;
+  EXPECT_TRUE(HasRule(grammar, "root-id ::= uuid | null")) << grammar;
+  EXPECT_TRUE(
+      HasRule(grammar, "root-when-kv ::= \"\\\"when\\\"\" space \":\" space "
+                       "date-time-string"))
+      << grammar;
+  EXPECT_TRUE(HasRule(grammar, "date-time ::= date \"T\" time")) << grammar;
+  EXPECT_TRUE(HasRule(grammar,
+                      "root-code ::= \"\\\"\" char{2,4} \"\\\"\" space"))
+      << grammar;
+}
+
+TEST_F(JsonSchemaUtilsTest, ResolvesLocalRefs) {
+  auto grammar = Compile(R"({
+    "$defs": {
+      "node": {
+        "type": "object",
+        "properties": {
+          "children": {"type": "array", "items": {"$ref": "#/$defs/node"}}
+        }
+      }
+    },
+    "$ref": "#/$defs/node"
+  })");
+  EXPECT_TRUE(HasRule(grammar, "root ::= ref-node")) << grammar;
+  EXPECT_TRUE(HasRule(grammar,
+                      "ref-node-children ::= \"[\" space ( ref-node "
+                      "( \",\" space ref-node )* )? \"]\" space"))
+      << grammar;
+
+  EXPECT_TRUE(json_schema_utils::SchemaToGrammar(
+                  json_helper::ParseJsonString(R"({"$ref": "#/$defs/x"})"))
+                  .has_error());
+  EXPECT_TRUE(json_schema_utils::SchemaToGrammar(
+                  json_helper::ParseJsonString(R"({"type": "tuple"})"))
+                  .has_error());
+}
+
+TEST_F(JsonSchemaUtilsTest, AppliesResponseFormatThroughCache) {
+  json_schema_utils::GrammarCache cache(2);
+  auto request = json_helper::ParseJsonString(R"({
+    "response_format": {
+      "type": "json_schema",
+      "json_schema": {"name": "a", "schema": {"type": "boolean"}}
+    }
+  })");
+  ASSERT_TRUE(json_schema_utils::ApplyResponseFormat(request, cache));
+  EXPECT_EQ(request["grammar"].asString(),
+            "boolean ::= (\"true\" | \"false\") space\n"
+            "root ::= boolean\n"
+            "space ::= | \" \" | \"\\n\" [ \\t]{0,20}\n");
+  EXPECT_EQ(cache.Size(), 1u);
+
+  // Same schema again is a cache hit, a grammar in the request wins
+  request.removeMember("grammar");
+  ASSERT_TRUE(json_schema_utils::ApplyResponseFormat(request, cache));
+  EXPECT_EQ(cache.Size(), 1u);
+  request["grammar"] = "root ::= \"x\"";
+  ASSERT_TRUE(json_schema_utils::ApplyResponseFormat(request, cache));
+  EXPECT_EQ(request["grammar"].asString(), "root ::= \"x\"");
+
+  // Least recently used schema goes first
+  for (const auto* type : {"null", "integer"}) {
+    Json::Value schema;
+    schema["type"] = type;
+    ASSERT_TRUE(cache.GetOrCompile(schema));
+  }
+  EXPECT_EQ(cache.Size(), 2u);
+
+  auto object_request = json_helper::ParseJsonString(
+      R"({"response_format": {"type": "json_object"}})");
+  ASSERT_TRUE(json_schema_utils::ApplyResponseFormat(object_request, cache));
+  EXPECT_NE(object_request["grammar"].asString().find("root ::= object"),
+            std::string::npos);
+
+  auto bad_request = json_helper::ParseJsonString(
+      R"({"response_format": {"type": "json_schema", "json_schema": {}}})");
+  EXPECT_TRUE(
+      json_schema_utils::ApplyResponseFormat(bad_request, cache).has_error());
+}
@@ -0,0 +1,92 @@
+#include "gtest/gtest.h"
+#include "utils/mirror_utils.h"
+
+class MirrorUtilsTest : public ::testing::Test {};
+
+TEST_F(MirrorUtilsTest, SplitUrl) {
+  auto parts = mirror_utils::SplitUrl(
+      "https://user@Mirror.Example.com:8443/org/model/file.gguf?download=1");
+  ASSERT_TRUE(parts.has_value());
+  EXPECT_EQ(parts->origin, "https://user@Mirror.Example.com:8443");
+  EXPECT_EQ(parts->host, "mirror.example.com");
+  EXPECT_EQ(parts->rest, "/org/model/file.gguf?download=1");
+
+  EXPECT_EQ(mirror_utils::SplitUrl("http://[::1]:80/a")->host, "[::1]");
+  EXPECT_FALSE(mirror_utils::SplitUrl("not a url").has_value());
+}
+
+TEST_F(MirrorUtilsTest, MatchesHost) {
+  EXPECT_TRUE(mirror_utils::MatchesHost("huggingface.co", "huggingface.co"));
+  EXPECT_FALSE(mirror_utils::MatchesHost("huggingface.co", "hf.co"));
+  EXPECT_TRUE(mirror_utils::MatchesHost("*.hf.co", "cdn-lfs.hf.co"));
+  EXPECT_FALSE(mirror_utils::MatchesHost("*.hf.co", "hf.co"));
+  EXPECT_FALSE(mirror_utils::MatchesHost("*.hf.co", "nothf.co"));
+}
+
+TEST_F(MirrorUtilsTest, SourceUrls) {
+  std::vector<std::string> mirrors{
+      "huggingface.co = https://hf-mirror.com/",
+      "*.github.com=https://gh.example.com",
+      "huggingface.co=http://10.0.0.2:8080",
+      "huggingface.co=https://hf-mirror.com",
+      "no separator",
+  };
+  auto urls = mirror_utils::SourceUrls(
+      "https://huggingface.co/org/model/resolve/main/a.gguf?x=1", mirrors);
+  ASSERT_EQ(urls.size(), 3);
+  EXPECT_EQ(urls[0],
+            "https://huggingface.co/org/model/resolve/main/a.gguf?x=1");
+  EXPECT_EQ(urls[1], "https://hf-mirror.com/org/model/resolve/main/a.gguf?x=1");
+  EXPECT_EQ(urls[2], "http://10.0.0.2:8080/org/model/resolve/main/a.gguf?x=1");
+
+  // Hosts without mirrors keep their single source
+  EXPECT_EQ(mirror_utils::SourceUrls("https://github.com/a/b", mirrors).size(),
+            1);
+  EXPECT_EQ(
+      mirror_utils::SourceUrls("https://api.github.com/a/b", mirrors).back(),
+      "https://gh.example.com/a/b");
+}
+
+TEST_F(MirrorUtilsTest, FailingHostCoolsDown) {
+  mirror_utils::MirrorHealth health;
+  auto now = mirror_utils::MirrorHealth::Clock::now();
+  const std::string origin = "https://hf-mirror.com";
+  EXPECT_TRUE(health.IsAvailable(origin, now));
+
+  health.RecordFailure(origin, "Couldn't connect to server", now);
+  EXPECT_FALSE(health.IsAvailable(origin, now));
+  EXPECT_TRUE(health.IsAvailable(origin, now + std::chrono::seconds(5)));
+
+  // Failures in a row back off longer
+  health.RecordFailure(origin, "Couldn't connect to server", now);
+  EXPECT_FALSE(health.IsAvailable(origin, now + std::chrono::seconds(5)));
+  EXPECT_TRUE(health.IsAvailable(origin, now + std::chrono::seconds(10)));
+
+  health.RecordSuccess(origin);
+  auto json = health.ToJson(now + std::chrono::seconds(10));
+  ASSERT_EQ(json.size(), 1);
+  EXPECT_EQ(json[0]["host"].asString(), origin);
+  EXPECT_TRUE(json[0]["available"].asBool());
+  EXPECT_EQ(json[0]["successes"].asUInt64(), 1);
+  EXPECT_EQ(json[0]["failures"].asUInt64(), 2);
+  EXPECT_EQ(json[0]["consecutiveFailures"].asInt(), 0);
+  EXPECT_EQ(json[0]["lastError"].asString(), "Couldn't connect to server");
+}
+
+TEST_F(MirrorUtilsTest, EstimatesFromLatencyAndThroughput) {
+  mirror_utils::MirrorHealth health;
+  EXPECT_EQ(health.EstimatedSeconds("http://a", 1 << 20), 0);
+
+  health.RecordLatency("http://a", 200);
+  EXPECT_DOUBLE_EQ(health.EstimatedSeconds("http://a", 1 << 20), 0.2);
+
+  health.RecordThroughput("http://a", 1 << 20);
+  health.RecordThroughput("http://b", 4 << 20);
+  EXPECT_DOUBLE_EQ(health.EstimatedSeconds("http://a", 1 << 20), 1.2);
+  EXPECT_DOUBLE_EQ(health.EstimatedSeconds("http://b", 1 << 20), 0.25);
+
+  // Samples are smoothed rather than replacing the average
+  health.RecordThroughput("http://b", 0);
+  EXPECT_LT(health.Throughput("http://b").value(), 4 << 20);
+  EXPECT_GT(health.Throughput("http://b").value(), 0);
+}
@@ -0,0 +1,103 @@
+#include <cmath>
+#include <string>
+#include "config/model_config.h"
+#include "gtest/gtest.h"
+
+namespace {
+config::ModelConfig SampleConfig() {
+  config::ModelConfig mc;
+  mc.id = "tinyllama:1b";
+  mc.model = "tinyllama:1b";
+  mc.name = "tinyllama";
+  mc.version = "1.0";
+  mc.files = {"models/tinyllama/model.gguf"};
+  mc.stop = {"</s>", "<|im_end|>"};
+  mc.top_p = 0.9f;
+  mc.temperature = 0.7f;
+  mc.max_tokens = 4096;
+  mc.seed = -7;
+  mc.stream = true;
+  mc.engine = "llama-cpp";
+  mc.prompt_template = "{system_message}<|user|>{prompt}<|assistant|>";
+  mc.ctx_len = 2048;
+  mc.ngl = 33;
+  mc.created = 1700000000;
+  mc.size = 1ull << 33;
+  mc.grammar = "root ::= \"yes\" | \"no\"";
+  return mc;
+}
+}  // namespace
+
+class ModelConfigTest : public ::testing::Test {};
+
+TEST_F(ModelConfigTest, JsonRoundTripKeepsEveryField) {
+  auto mc = SampleConfig();
+  auto json = mc.ToJson();
+  EXPECT_EQ(json["stop"].size(), 2u);
+  EXPECT_EQ(json["size"].asUInt64(), 1ull << 33);
+  EXPECT_EQ(json["grammar"].asString(), mc.grammar);
+  // tensorrt-llm only fields
+  EXPECT_FALSE(json.isMember("tp"));
+
+  config::ModelConfig parsed;
+  parsed.FromJson(json);
+  // id and model are identifiers, FromJson leaves them alone
+  EXPECT_TRUE(parsed.id.empty());
+  EXPECT_TRUE(parsed.model.empty());
+  EXPECT_EQ(parsed.name, mc.name);
+  EXPECT_EQ(parsed.stop, mc.stop);
+  EXPECT_EQ(parsed.files, mc.files);
+  EXPECT_FLOAT_EQ(parsed.top_p, mc.top_p);
+  EXPECT_EQ(parsed.seed, -7);
+  EXPECT_EQ(parsed.size, mc.size);
+  EXPECT_EQ(parsed.grammar, mc.grammar);
+
+  Json::Value trt;
+  trt["engine"] = "cortex.tensorrt-llm";
+  trt["tp"] = 2;
+  parsed.FromJson(trt);
+  EXPECT_EQ(parsed.tp, 2);
+  EXPECT_EQ(parsed.ToJson()["tp"].asInt(), 2);
+}
+
+TEST_F(ModelConfigTest, BinaryRoundTrip) {
+  auto mc = SampleConfig();
+  auto data = mc.ToBinary();
+
+  config::ModelConfig parsed;
+  ASSERT_TRUE(parsed.FromBinary(data));
+  EXPECT_EQ(parsed.id, mc.id);
+  EXPECT_EQ(parsed.model, mc.model);
+  EXPECT_EQ(parsed.stop, mc.stop);
+  EXPECT_EQ(parsed.files, mc.files);
+  EXPECT_EQ(parsed.seed, -7);
+  EXPECT_EQ(parsed.created, mc.created);
+  EXPECT_EQ(parsed.size, mc.size);
+  EXPECT_TRUE(std::isnan(parsed.frequency_penalty));
+  EXPECT_EQ(parsed.prompt_template, mc.prompt_template);
+  EXPECT_EQ(parsed.grammar, mc.grammar);
+  // NaN floats never compare equal, compare the text
+  EXPECT_EQ(parsed.ToJson().toStyledString(), mc.ToJson().toStyledString());
+
+  // Truncated or foreign data is rejected and leaves the config untouched
+  config::ModelConfig untouched;
+  EXPECT_FALSE(untouched.FromBinary(data.substr(0, data.size() - 1)));
+  EXPECT_FALSE(untouched.FromBinary(data + "x"));
+  EXPECT_FALSE(untouched.FromBinary("not a model config"));
+  EXPECT_TRUE(untouched.name.empty());
+}
+
+TEST_F(ModelConfigTest, ToStringHidesUnsetFields) {
+  config::ModelConfig mc;
+  mc.name = "tinyllama";
+  mc.top_k = 20;
+  auto str = mc.ToString();
+  EXPECT_NE(str.find("tinyllama"), std::string::npos);
+  EXPECT_NE(str.find("top_k"), std::string::npos);
+  EXPECT_EQ(str.find("top_p"), std::string::npos);
+  EXPECT_EQ(str.find("max_tokens"), std::string::npos);
+  EXPECT_EQ(str.find("seed"), std::string::npos);
+
+  mc.seed = 42;
+  EXPECT_NE(mc.ToString().find("seed"), std::string::npos);
+}
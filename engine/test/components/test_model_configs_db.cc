@@ -0,0 +1,53 @@
+#include "config/model_config.h"
+#include "database/model_configs.h"
+#include "gtest/gtest.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kTestDb = "./test.db";
+}
+class ModelConfigsTestSuite : public ::testing::Test {
+ public:
+  ModelConfigsTestSuite()
+      : db_(kTestDb, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+        model_configs_(db_) {}
+  void SetUp() {
+    try {
+      db_.exec("DELETE FROM model_configs");
+    } catch (const std::exception& e) {}
+  }
+
+ protected:
+  SQLite::Database db_;
+  cortex::db::ModelConfigs model_configs_;
+};
+
+TEST_F(ModelConfigsTestSuite, TestStoresBinaryConfig) {
+  config::ModelConfig mc;
+  mc.model = "tinyllama:1b";
+  mc.stop = {"</s>"};
+  mc.seed = -1;
+  const ModelConfigEntry entry{.path = "/models/tinyllama/model.yml",
+                               .file_size = 512,
+                               .mtime = 1700000000,
+                               .config = mc.ToBinary()};
+  EXPECT_TRUE(model_configs_.UpsertEntry(entry).value());
+
+  auto res = model_configs_.GetEntry(entry.path, entry.file_size, entry.mtime);
+  ASSERT_TRUE(res);
+  // The blob keeps embedded zero bytes
+  EXPECT_EQ(res->config, entry.config);
+  config::ModelConfig parsed;
+  ASSERT_TRUE(parsed.FromBinary(res->config));
+  EXPECT_EQ(parsed.model, mc.model);
+  EXPECT_EQ(parsed.stop, mc.stop);
+
+  EXPECT_TRUE(model_configs_
+                  .GetEntry(entry.path, entry.file_size, entry.mtime + 1)
+                  .has_error());
+  EXPECT_TRUE(model_configs_.DeleteEntry(entry.path).value());
+  EXPECT_TRUE(
+      model_configs_.GetEntry(entry.path, entry.file_size, entry.mtime)
+          .has_error());
+}
+}  // namespace cortex::db
@@ -0,0 +1,29 @@
+#include <chrono>
+#include "gtest/gtest.h"
+#include "utils/rate_limit_utils.h"
+
+class RateLimitUtilsTest : public ::testing::Test {};
+
+TEST_F(RateLimitUtilsTest, UnlimitedBucketAlwaysHasTokens) {
+  rate_limit_utils::TokenBucket bucket;
+  auto now = rate_limit_utils::TokenBucket::Clock::now();
+  bucket.Consume(1 << 30);
+  EXPECT_TRUE(bucket.HasTokens(now));
+  EXPECT_EQ(bucket.Delay(now), std::chrono::milliseconds(0));
+}
+
+TEST_F(RateLimitUtilsTest, OverdraftIsRepaidAtRate) {
+  using namespace std::chrono_literals;
+  rate_limit_utils::TokenBucket bucket;
+  bucket.SetRate(1000);
+  auto now = rate_limit_utils::TokenBucket::Clock::now();
+
+  // A full second of tokens at most, however long the bucket was idle
+  EXPECT_TRUE(bucket.HasTokens(now + 10s));
+  bucket.Consume(1500);
+  EXPECT_FALSE(bucket.HasTokens(now + 10s));
+  auto delay = bucket.Delay(now + 10s);
+  EXPECT_GE(delay, 500ms);
+  EXPECT_LE(delay, 502ms);
+  EXPECT_TRUE(bucket.HasTokens(now + 10s + delay));
+}
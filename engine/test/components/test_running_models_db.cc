@@ -0,0 +1,60 @@
+#include "database/running_models.h"
+#include "gtest/gtest.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kTestDb = "./test.db";
+}
+class RunningModelsTestSuite : public ::testing::Test {
+ public:
+  RunningModelsTestSuite()
+      : db_(kTestDb, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+        running_models_(db_) {}
+  void SetUp() {
+    try {
+      db_.exec("DELETE FROM running_models");
+    } catch (const std::exception& e) {}
+  }
+
+ protected:
+  SQLite::Database db_;
+  cortex::db::RunningModels running_models_;
+
+  const cortex::db::RunningModelEntry kTestModel{
+      "test_model_id", "llama-cpp",
+      R"({"model":"test_model_id","ctx_len":2048})"};
+};
+
+TEST_F(RunningModelsTestSuite, TestUpsertAndLoad) {
+  EXPECT_TRUE(running_models_.UpsertRunningModel(kTestModel).value());
+
+  auto entries = running_models_.LoadRunningModelList();
+  ASSERT_TRUE(entries);
+  ASSERT_EQ(entries.value().size(), 1);
+  EXPECT_EQ(entries.value()[0].model, kTestModel.model);
+  EXPECT_EQ(entries.value()[0].engine, kTestModel.engine);
+  EXPECT_EQ(entries.value()[0].start_params, kTestModel.start_params);
+
+  // Upsert again with new parameters should replace the entry
+  auto updated = kTestModel;
+  updated.start_params = R"({"model":"test_model_id","ctx_len":4096})";
+  EXPECT_TRUE(running_models_.UpsertRunningModel(updated).value());
+  entries = running_models_.LoadRunningModelList();
+  ASSERT_TRUE(entries);
+  ASSERT_EQ(entries.value().size(), 1);
+  EXPECT_EQ(entries.value()[0].start_params, updated.start_params);
+
+  // Clean up
+  EXPECT_TRUE(running_models_.DeleteRunningModel(kTestModel.model).value());
+}
+
+TEST_F(RunningModelsTestSuite, TestDeleteRunningModel) {
+  EXPECT_TRUE(running_models_.UpsertRunningModel(kTestModel).value());
+  EXPECT_TRUE(running_models_.DeleteRunningModel(kTestModel.model).value());
+  EXPECT_FALSE(running_models_.DeleteRunningModel(kTestModel.model).value());
+
+  auto entries = running_models_.LoadRunningModelList();
+  ASSERT_TRUE(entries);
+  EXPECT_TRUE(entries.value().empty());
+}
+}  // namespace cortex::db
@@ -0,0 +1,60 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "gtest/gtest.h"
+#include "utils/sha256_utils.h"
+
+class Sha256UtilsTest : public ::testing::Test {};
+
+TEST_F(Sha256UtilsTest, KnownDigests) {
+  sha256_utils::Sha256 empty;
+  EXPECT_EQ(empty.FinalHex(),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+  sha256_utils::Sha256 hasher;
+  hasher.Update("a", 1);
+  hasher.Update("bc", 2);
+  EXPECT_EQ(hasher.FinalHex(),
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST_F(Sha256UtilsTest, FilePrefixMatchesStreamedHash) {
+  auto path = std::filesystem::temp_directory_path() / "sha256_prefix_test";
+  std::string data;
+  for (int i = 0; i < 100000; i++) {
+    data.push_back(static_cast<char>(i * 31));
+  }
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+  }
+
+  // Resume case: prefix from disk, rest from the network
+  sha256_utils::Sha256 resumed;
+  ASSERT_TRUE(sha256_utils::UpdateFromFile(resumed, path, 70000, 4096));
+  resumed.Update(data.data() + 70000, data.size() - 70000);
+
+  sha256_utils::Sha256 streamed;
+  streamed.Update(data.data(), data.size());
+  auto digest = streamed.FinalHex();
+  EXPECT_EQ(resumed.FinalHex(), digest);
+
+  // Segmented case: the file hashed in pieces as the ranges complete
+  sha256_utils::Sha256 pieces;
+  ASSERT_TRUE(sha256_utils::UpdateFromFileRange(pieces, path, 0, 30000));
+  ASSERT_TRUE(sha256_utils::UpdateFromFileRange(pieces, path, 30000, 70000,
+                                                4096));
+  EXPECT_EQ(pieces.FinalHex(), digest);
+
+  sha256_utils::Sha256 too_long;
+  EXPECT_TRUE(
+      sha256_utils::UpdateFromFile(too_long, path, data.size() + 1).has_error());
+
+  std::filesystem::remove(path);
+}
+
+TEST_F(Sha256UtilsTest, ChecksumEqualsIgnoresCase) {
+  EXPECT_TRUE(sha256_utils::ChecksumEquals("ABcd", "abCD"));
+  EXPECT_FALSE(sha256_utils::ChecksumEquals("abcd", "abce"));
+  EXPECT_FALSE(sha256_utils::ChecksumEquals("abcd", "abc"));
+}
@@ -1,11 +1,21 @@
+#pragma once
+
 #include <archive.h>
 #include <archive_entry.h>
 #include <minizip/unzip.h>
 #include <trantor/utils/Logger.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include "logging_utils.h"
+#include "utils/result.hpp"
 
 namespace archive_utils {
 inline bool UnzipFile(const std::string& input_zip_path,
@@ -153,4 +163,354 @@ inline bool UntarFile(const std::string& input_tar_path,
                                     << destination_path << "\n");
   return true;
 }
+
+/**
+ * Extracts a tar(.gz) or zip archive while it downloads. The bytes handed
+ * to Write are read by libarchive on the extractor thread, which writes
+ * each entry into a staging directory next to the destination as soon as
+ * it arrived. Commit moves the entries in only once the whole archive was
+ * extracted, so the destination never holds a partial extraction.
+ */
+class StreamingExtractor {
+ public:
+  /**
+   * At most capacity bytes wait for the extractor thread. on_space is called
+   * from that thread whenever it took some, so a writer held back by
+   * HasSpace can continue.
+   */
+  StreamingExtractor(std::filesystem::path destination, bool ignore_parent_dir,
+                     size_t capacity, std::function<void()> on_space)
+      : destination_(std::move(destination)),
+        staging_(StagingPath(destination_)),
+        ignore_parent_dir_(ignore_parent_dir),
+        capacity_(capacity),
+        on_space_(std::move(on_space)) {
+    Start();
+  }
+
+  StreamingExtractor(const StreamingExtractor&) = delete;
+  StreamingExtractor& operator=(const StreamingExtractor&) = delete;
+
+  // Stops extracting and removes the staging directory unless committed
+  ~StreamingExtractor() {
+    Stop();
+    if (!committed_) {
+      std::error_code ec;
+      std::filesystem::remove_all(staging_, ec);
+    }
+  }
+
+  static std::filesystem::path StagingPath(
+      const std::filesystem::path& destination) {
+    auto staging = destination;
+    staging += ".staging";
+    return staging;
+  }
+
+  const std::filesystem::path& Staging() const { return staging_; }
+
+  bool HasSpace(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Data after the end of the archive, or after an error, is dropped
+    return buffered_ == 0 || buffered_ + size <= capacity_ || done_;
+  }
+
+  void Write(const char* data, size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (done_) {
+        return;
+      }
+      chunks_.emplace_back(data, size);
+      buffered_ += size;
+    }
+    cv_.notify_one();
+  }
+
+  std::optional<std::string> Error() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+  }
+
+  // Start over with an empty staging directory, for data sent again
+  void Reset() {
+    Stop();
+    Start();
+  }
+
+  // The whole archive was written. Waits for the last entries
+  cpp::result<void, std::string> Finish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      eof_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (error_.has_value()) {
+      return cpp::fail(error_.value());
+    }
+    return {};
+  }
+
+  /**
+   * Move the extracted entries into the destination. Entries replace the
+   * files of the same name one rename at a time, other files in the
+   * destination are kept, as the old extractors did.
+   */
+  cpp::result<void, std::string> Commit() {
+    std::error_code ec;
+    std::filesystem::create_directories(destination_, ec);
+    if (auto res = MergeInto(staging_, destination_); res.has_error()) {
+      return res;
+    }
+    committed_ = true;
+    std::filesystem::remove_all(staging_, ec);
+    CTL_INF("Extracted to " << destination_.string());
+    return {};
+  }
+
+ private:
+  void Start() {
+    std::error_code ec;
+    std::filesystem::remove_all(staging_, ec);
+    chunks_.clear();
+    current_.clear();
+    buffered_ = 0;
+    eof_ = false;
+    aborted_ = false;
+    done_ = false;
+    error_.reset();
+    thread_ = std::thread([this] { Run(); });
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      aborted_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  static la_ssize_t Read(struct archive* a, void* client_data,
+                         const void** buffer) {
+    auto self = static_cast<StreamingExtractor*>(client_data);
+    {
+      std::unique_lock<std::mutex> lock(self->mutex_);
+      self->cv_.wait(lock, [self] {
+        return !self->chunks_.empty() || self->eof_ || self->aborted_;
+      });
+      if (self->aborted_) {
+        archive_set_error(a, ECANCELED, "Extraction cancelled");
+        return -1;
+      }
+      if (self->chunks_.empty()) {
+        return 0;
+      }
+      // libarchive may use the previous block until this call
+      self->current_ = std::move(self->chunks_.front());
+      self->chunks_.pop_front();
+      self->buffered_ -= self->current_.size();
+    }
+    if (self->on_space_) {
+      self->on_space_();
+    }
+    *buffer = self->current_.data();
+    return static_cast<la_ssize_t>(self->current_.size());
+  }
+
+  static cpp::result<void, std::string> MergeInto(
+      const std::filesystem::path& from, const std::filesystem::path& to) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(from, ec)) {
+      auto target = to / entry.path().filename();
+      if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+        if (!std::filesystem::is_directory(target, ec)) {
+          std::filesystem::remove(target, ec);
+          std::filesystem::create_directories(target, ec);
+        }
+        if (auto res = MergeInto(entry.path(), target); res.has_error()) {
+          return res;
+        }
+        continue;
+      }
+      if (std::filesystem::is_directory(target, ec) &&
+          !std::filesystem::is_symlink(target, ec)) {
+        std::filesystem::remove_all(target, ec);
+      }
+      std::filesystem::rename(entry.path(), target, ec);
+      if (ec) {
+        return cpp::fail("Failed to move " + entry.path().string() + " to " +
+                         target.string() + ": " + ec.message());
+      }
+    }
+    if (ec) {
+      return cpp::fail("Failed to read " + from.string() + ": " +
+                       ec.message());
+    }
+    return {};
+  }
+
+  static std::string ErrorString(struct archive* a) {
+    auto error = archive_error_string(a);
+    return error == nullptr ? "unknown error" : error;
+  }
+
+  // Where an entry goes, std::nullopt for entries escaping the staging
+  // directory. Only tar entries are flattened, zips keep their layout.
+  std::optional<std::filesystem::path> EntryPath(const char* pathname,
+                                                 bool flatten) const {
+    std::filesystem::path path(pathname == nullptr ? "" : pathname);
+    if (path.empty() || path.is_absolute() || path.has_root_name()) {
+      return std::nullopt;
+    }
+    for (const auto& part : path) {
+      if (part == "..") {
+        return std::nullopt;
+      }
+    }
+    if (flatten) {
+      return staging_ / path.filename();
+    }
+    return staging_ / path;
+  }
+
+  cpp::result<void, std::string> ExtractEntry(struct archive* a,
+                                              struct archive_entry* entry) {
+    bool flatten =
+        ignore_parent_dir_ && (archive_format(a) & ARCHIVE_FORMAT_BASE_MASK) !=
+                                  ARCHIVE_FORMAT_ZIP;
+    auto path = EntryPath(archive_entry_pathname(entry), flatten);
+    if (!path.has_value()) {
+      CTL_WRN("Skipping archive entry outside of the destination: "
+              << archive_entry_pathname(entry));
+      return {};
+    }
+    std::error_code ec;
+    auto type = archive_entry_filetype(entry);
+    if (type == AE_IFDIR) {
+      if (!flatten) {
+        std::filesystem::create_directories(path.value(), ec);
+      }
+      return {};
+    }
+    std::filesystem::create_directories(path->parent_path(), ec);
+    std::filesystem::remove(path.value(), ec);
+    if (type == AE_IFLNK) {
+      std::filesystem::create_symlink(archive_entry_symlink(entry),
+                                      path.value(), ec);
+      if (ec) {
+        return cpp::fail("Failed to create " + path->string() + ": " +
+                         ec.message());
+      }
+      return {};
+    }
+    if (auto target = archive_entry_hardlink(entry); target != nullptr) {
+      if (auto target_path = EntryPath(target, flatten);
+          target_path.has_value()) {
+        std::filesystem::copy_file(target_path.value(), path.value(), ec);
+      }
+      return {};
+    }
+    if (type != AE_IFREG) {
+      return {};
+    }
+
+    std::ofstream out_file(path.value(), std::ios::binary);
+    if (!out_file.is_open()) {
+      return cpp::fail("Failed to create file: " + path->string());
+    }
+    const void* buff;
+    size_t size;
+    la_int64_t offset;
+    int r;
+    while ((r = archive_read_data_block(a, &buff, &size, &offset)) ==
+           ARCHIVE_OK) {
+      out_file.seekp(offset);
+      out_file.write(static_cast<const char*>(buff), size);
+    }
+    if (r != ARCHIVE_EOF) {
+      return cpp::fail("Failed to read " + path->string() + ": " +
+                       ErrorString(a));
+    }
+    out_file.close();
+    if (!out_file) {
+      return cpp::fail("Failed to write " + path->string());
+    }
+#ifndef _WIN32
+    std::filesystem::permissions(
+        path.value(),
+        static_cast<std::filesystem::perms>(archive_entry_perm(entry) & 0777),
+        ec);
+#endif
+    return {};
+  }
+
+  void Run() {
+    auto a = archive_read_new();
+    archive_read_support_filter_all(a);
+    archive_read_support_format_tar(a);
+    archive_read_support_format_gnutar(a);
+    archive_read_support_format_zip_streamable(a);
+
+    std::optional<std::string> error;
+    std::error_code ec;
+    std::filesystem::create_directories(staging_, ec);
+    if (archive_read_open(a, this, nullptr, Read, nullptr) != ARCHIVE_OK) {
+      error = ErrorString(a);
+    }
+    struct archive_entry* entry;
+    while (!error.has_value()) {
+      auto r = archive_read_next_header(a, &entry);
+      if (r == ARCHIVE_EOF) {
+        break;
+      }
+      if (r != ARCHIVE_OK && r != ARCHIVE_WARN) {
+        error = ErrorString(a);
+        break;
+      }
+      if (auto res = ExtractEntry(a, entry); res.has_error()) {
+        error = res.error();
+      }
+    }
+    archive_read_free(a);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error.has_value() && !aborted_) {
+        error_ = "Failed to extract archive: " + error.value();
+      }
+      done_ = true;
+      chunks_.clear();
+      buffered_ = 0;
+    }
+    if (on_space_) {
+      on_space_();
+    }
+  }
+
+  std::filesystem::path destination_;
+  std::filesystem::path staging_;
+  bool ignore_parent_dir_;
+  size_t capacity_;
+  std::function<void()> on_space_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> chunks_;
+  // Block handed to libarchive last
+  std::string current_;
+  size_t buffered_ = 0;
+  bool eof_ = false;
+  bool aborted_ = false;
+  // The extractor thread stopped reading
+  bool done_ = false;
+  std::optional<std::string> error_;
+  bool committed_ = false;
+  std::thread thread_;
+};
 }  // namespace archive_utils
@@ -0,0 +1,539 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "utils/file_io_utils.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define CORTEX_HAS_IO_URING 1
+#endif
+
+namespace file_io_utils {
+
+/**
+ * Fixed set of equally sized buffers aligned for direct I/O. The memory of
+ * the writer stage never grows beyond it.
+ */
+class BufferPool {
+ public:
+  BufferPool(size_t buffer_size, size_t count) : buffer_size_(buffer_size) {
+    for (size_t i = 0; i < count; i++) {
+      auto buffer = static_cast<char*>(::operator new(
+          buffer_size, std::align_val_t(kDirectIoAlignment)));
+      buffers_.push_back(buffer);
+      free_.push_back(buffer);
+    }
+  }
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  ~BufferPool() {
+    for (auto buffer : buffers_) {
+      ::operator delete(buffer, std::align_val_t(kDirectIoAlignment));
+    }
+  }
+
+  size_t BufferSize() const { return buffer_size_; }
+
+  // nullptr when every buffer is in use
+  char* TryAcquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+      return nullptr;
+    }
+    auto buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+  }
+
+  char* Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !free_.empty(); });
+    auto buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+  }
+
+  void Release(char* buffer) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(buffer);
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  size_t buffer_size_;
+  std::vector<char*> buffers_;
+  std::vector<char*> free_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+/**
+ * Consecutive writes of one producer, such as one byte range of a download.
+ * Writes may complete out of order, Durable is the stream position up to
+ * which every write reached the file.
+ */
+class WriteStream {
+ public:
+  explicit WriteStream(uint64_t position = 0) : durable_(position) {}
+
+  uint64_t Durable() const { return durable_.load(std::memory_order_acquire); }
+
+  // No write of the stream is queued or running
+  bool Idle() const { return queued_.load(std::memory_order_acquire) == 0; }
+
+  bool Failed() const { return failed_.load(std::memory_order_acquire); }
+
+ private:
+  friend class AsyncFileWriter;
+
+  std::atomic<uint64_t> durable_;
+  std::atomic<int> queued_{0};
+  std::atomic<bool> failed_{false};
+  // Writer thread only: position after each started write, in order, and
+  // whether it completed
+  std::deque<std::pair<uint64_t, bool>> started_;
+};
+
+#if defined(CORTEX_HAS_IO_URING)
+/**
+ * Submission and completion queue of an io_uring instance, set up with the
+ * raw system calls. Only used from a single thread.
+ */
+class IoUring {
+ public:
+  // nullptr when the kernel is too old or io_uring is disabled
+  static std::unique_ptr<IoUring> Create(unsigned entries) {
+    io_uring_params params{};
+    auto fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    std::unique_ptr<IoUring> ring(new IoUring(fd));
+    if (!ring->Map(params)) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      munmap(sq_ring_, sq_size_);
+    }
+    close(fd_);
+  }
+
+  unsigned Capacity() const { return entries_; }
+
+  // Opcode of the queued writes, kernels before 5.6 lack IORING_OP_WRITE
+  void SetWriteOpcode(uint8_t opcode) { write_opcode_ = opcode; }
+
+  // Queue a write for the next Enter. The caller keeps within Capacity
+  void PushWrite(const RandomAccessFile::Part& part, uint64_t user_data) {
+    auto tail = *sq_tail_;
+    auto index = tail & *sq_mask_;
+    auto& sqe = sqes_[index];
+    sqe = io_uring_sqe{};
+    sqe.opcode = write_opcode_;
+    sqe.fd = part.fd;
+    sqe.addr = reinterpret_cast<uint64_t>(part.data);
+    sqe.len = static_cast<uint32_t>(part.size);
+    sqe.off = part.offset;
+    sqe.user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted_++;
+  }
+
+  // Submit the queued writes and wait until min_complete of them completed
+  bool Enter(unsigned min_complete) {
+    while (true) {
+      auto submitted = syscall(__NR_io_uring_enter, fd_, unsubmitted_,
+                               min_complete,
+                               min_complete > 0 ? IORING_ENTER_GETEVENTS : 0,
+                               nullptr, 0);
+      if (submitted < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      unsubmitted_ -= static_cast<unsigned>(submitted);
+      return true;
+    }
+  }
+
+  // Hand each available completion to fn(user_data, result)
+  template <typename Fn>
+  void Reap(Fn&& fn) {
+    auto head = *cq_head_;
+    auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const auto& cqe = cqes_[head & *cq_mask_];
+      fn(cqe.user_data, cqe.res);
+      head++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  explicit IoUring(int fd) : fd_(fd) {}
+
+  bool Map(const io_uring_params& params) {
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ring_ = MapRegion(sq_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_ : MapRegion(cq_size_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == nullptr) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(MapRegion(sqes_size_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) {
+      return false;
+    }
+
+    auto sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    entries_ = params.sq_entries;
+    return true;
+  }
+
+  void* MapRegion(size_t size, off_t offset) {
+    auto region = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return region == MAP_FAILED ? nullptr : region;
+  }
+
+  int fd_;
+  unsigned entries_ = 0;
+  unsigned unsubmitted_ = 0;
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  size_t sq_size_ = 0;
+  size_t cq_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  uint8_t write_opcode_ = IORING_OP_WRITE;
+};
+#endif
+
+/**
+ * Writes pool buffers to their files on a dedicated thread, so a slow disk
+ * does not stall the producers. On Linux the writes go through io_uring
+ * when the kernel offers it, elsewhere and as fallback through pwrite.
+ * on_complete runs on the writer thread after each write.
+ */
+class AsyncFileWriter {
+ public:
+  struct Write {
+    RandomAccessFile* file;
+    std::shared_ptr<WriteStream> stream;
+    // Pool buffer whose first byte belongs at file offset, holding data in
+    // [begin, end). Returned to the pool once written.
+    char* buffer;
+    size_t begin;
+    size_t end;
+    uint64_t offset;
+    // Stream position once the write completed
+    uint64_t position;
+  };
+
+  AsyncFileWriter(size_t buffer_size, size_t buffer_count,
+                  std::function<void()> on_complete)
+      : buffers_(buffer_size, buffer_count),
+        on_complete_(std::move(on_complete)) {
+#if defined(CORTEX_HAS_IO_URING)
+    ring_ = IoUring::Create(kRingEntries);
+#endif
+    thread_ = std::thread([this] { Run(); });
+  }
+
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  // Finishes the queued writes first
+  ~AsyncFileWriter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  BufferPool& Buffers() { return buffers_; }
+
+  void Submit(Write write) {
+    write.stream->queued_.fetch_add(1, std::memory_order_acq_rel);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(write));
+      pending_++;
+    }
+    cv_.notify_one();
+  }
+
+  // Wait until every submitted write completed
+  void Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_cv_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+#if defined(CORTEX_HAS_IO_URING)
+  /**
+   * Submit ring writes with another opcode, so tests can act as a kernel
+   * rejecting them. False without a ring. Only before the first Submit.
+   */
+  bool SetRingWriteOpcode(uint8_t opcode) {
+    if (ring_ == nullptr) {
+      return false;
+    }
+    ring_->SetWriteOpcode(opcode);
+    return true;
+  }
+#endif
+
+ private:
+#if defined(CORTEX_HAS_IO_URING)
+  static constexpr unsigned kRingEntries = 64;
+
+  struct RingWrite;
+
+  struct RingPart {
+    RingWrite* write;
+    RandomAccessFile::Part part;
+  };
+
+  struct RingWrite {
+    Write write;
+    std::vector<RingPart> parts;
+    size_t left = 0;
+    bool ok = true;
+  };
+
+  std::unique_ptr<IoUring> ring_;
+  // Writes with parts on the ring, the list keeps their addresses stable
+  std::list<RingWrite> ring_writes_;
+  unsigned ring_parts_ = 0;
+#endif
+
+  void Run() {
+    while (true) {
+      std::vector<Write> batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock,
+                 [this] { return stop_ || !queue_.empty() || InFlight(); });
+        if (stop_ && queue_.empty() && !InFlight()) {
+          return;
+        }
+        while (!queue_.empty() && HasRoom(batch.size())) {
+          batch.push_back(std::move(queue_.front()));
+          queue_.pop_front();
+        }
+      }
+      for (auto& write : batch) {
+        Start(std::move(write));
+      }
+#if defined(CORTEX_HAS_IO_URING)
+      if (ring_ != nullptr && ring_parts_ > 0) {
+        if (!ring_->Enter(1)) {
+          // Nothing can be completed through the ring anymore
+          ring_->Reap([this](uint64_t user_data, int32_t result) {
+            OnRingCompletion(user_data, result);
+          });
+          FailRing();
+          continue;
+        }
+        ring_->Reap([this](uint64_t user_data, int32_t result) {
+          OnRingCompletion(user_data, result);
+        });
+        // Not from a completion, Reap still updates the ring afterwards
+        if (disable_ring_ && ring_parts_ == 0) {
+          ring_.reset();
+        }
+      }
+#endif
+    }
+  }
+
+  bool InFlight() const {
+#if defined(CORTEX_HAS_IO_URING)
+    return ring_parts_ > 0;
+#else
+    return false;
+#endif
+  }
+
+  // A write splits into at most three parts, they must fit the ring
+  bool HasRoom(size_t batched) const {
+#if defined(CORTEX_HAS_IO_URING)
+    if (ring_ != nullptr) {
+      return ring_parts_ + (batched + 1) * 3 <= ring_->Capacity();
+    }
+#endif
+    return batched < kMaxBatch;
+  }
+
+  void Start(Write write) {
+    write.stream->started_.emplace_back(write.position, false);
+    auto data = write.buffer + write.begin;
+    auto size = write.end - write.begin;
+    auto offset = write.offset + write.begin;
+#if defined(CORTEX_HAS_IO_URING)
+    if (ring_ != nullptr && !disable_ring_) {
+      auto& ring_write = ring_writes_.emplace_back();
+      ring_write.write = std::move(write);
+      for (const auto& part :
+           ring_write.write.file->Split(data, size, offset)) {
+        ring_write.parts.push_back(RingPart{&ring_write, part});
+      }
+      ring_write.left = ring_write.parts.size();
+      for (auto& ring_part : ring_write.parts) {
+        ring_->PushWrite(ring_part.part,
+                         reinterpret_cast<uint64_t>(&ring_part));
+        ring_parts_++;
+      }
+      return;
+    }
+#endif
+    auto ok = write.file->WriteAt(data, size, offset);
+    Complete(write, ok);
+  }
+
+#if defined(CORTEX_HAS_IO_URING)
+  void OnRingCompletion(uint64_t user_data, int32_t result) {
+    auto& ring_part = *reinterpret_cast<RingPart*>(user_data);
+    auto& ring_write = *ring_part.write;
+    auto part = ring_part.part;
+    ring_parts_--;
+    if (result < 0 || static_cast<size_t>(result) < part.size) {
+      // Short writes, direct writes the filesystem rejects and kernels
+      // without IORING_OP_WRITE finish synchronously
+      if (result > 0) {
+        part.data += result;
+        part.size -= result;
+        part.offset += result;
+      } else if (result == -EINVAL && !part.direct) {
+        disable_ring_ = true;
+      }
+      ring_write.ok &= ring_write.write.file->WritePart(part);
+    }
+    if (--ring_write.left > 0) {
+      return;
+    }
+    Complete(ring_write.write, ring_write.ok);
+    ring_writes_.remove_if(
+        [&ring_write](const RingWrite& other) { return &other == &ring_write; });
+  }
+
+  // Finish the writes still on the ring synchronously and stop using it
+  void FailRing() {
+    for (auto& ring_write : ring_writes_) {
+      for (auto& ring_part : ring_write.parts) {
+        ring_write.ok &= ring_write.write.file->WritePart(ring_part.part);
+      }
+      Complete(ring_write.write, ring_write.ok);
+    }
+    ring_writes_.clear();
+    ring_parts_ = 0;
+    ring_.reset();
+  }
+
+  bool disable_ring_ = false;
+#endif
+
+  void Complete(Write& write, bool ok) {
+    auto& stream = *write.stream;
+    if (!ok) {
+      stream.failed_.store(true, std::memory_order_release);
+    }
+    for (auto& [position, done] : stream.started_) {
+      if (position == write.position) {
+        done = true;
+        break;
+      }
+    }
+    // A failed write leaves a gap the stream never gets past
+    while (!stream.started_.empty() && stream.started_.front().second) {
+      if (!stream.Failed()) {
+        stream.durable_.store(stream.started_.front().first,
+                              std::memory_order_release);
+      }
+      stream.started_.pop_front();
+    }
+    buffers_.Release(write.buffer);
+    stream.queued_.fetch_sub(1, std::memory_order_acq_rel);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_--;
+    }
+    drained_cv_.notify_all();
+    if (on_complete_) {
+      on_complete_();
+    }
+  }
+
+  // Writes taken at once by the pwrite fallback
+  static constexpr size_t kMaxBatch = 16;
+
+  BufferPool buffers_;
+  std::function<void()> on_complete_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable drained_cv_;
+  std::deque<Write> queue_;
+  // Submitted writes not completed yet
+  size_t pending_ = 0;
+  bool stop_ = false;
+  std::thread thread_;
+};
+}  // namespace file_io_utils
@@ -22,6 +22,13 @@ constexpr const auto kDefaultCorsEnabled = true;
 const std::vector<std::string> kDefaultEnabledOrigins{
     "http://localhost:39281", "http://127.0.0.1:39281", "http://0.0.0.0:39281"};
 constexpr const auto kDefaultNoProxy = "example.com,::1,localhost,127.0.0.1";
+constexpr const auto kDefaultRestoreModelsOnStartup = true;
+constexpr const auto kDefaultCpuPartitioning = true;
+constexpr const int kDefaultDownloadSegments = 4;
+constexpr const int kDefaultDownloadProgressIntervalMs = 1000;
+constexpr const int kDefaultDownloadMaxRate = 0;
+constexpr const auto kDefaultDownloadDirectIo = false;
+constexpr const auto kDefaultDownloadKeepArchives = false;
 
 struct CortexConfig {
   std::string logFolderPath;
@@ -59,6 +66,55 @@ struct CortexConfig {
 
   bool verifyPeerSsl;
   bool verifyHostSsl;
+
+  /**
+   * Reload the models which were running when the server stopped.
+   */
+  bool restoreModelsOnStartup;
+
+  /**
+   * Split the cpus between HTTP threads, background workers and engines and
+   * pin each group to its own cores.
+   */
+  bool cpuPartitioning;
+
+  /**
+   * Parallel ranged connections used for one file when the server supports
+   * byte ranges. 1 disables segmented downloads.
+   */
+  int downloadSegments;
+
+  /**
+   * Milliseconds between two progress events of a running download.
+   */
+  int downloadProgressIntervalMs;
+
+  /**
+   * Receive rate caps in KiB/s, 0 for unlimited. The first applies to all
+   * downloads together, the others to one priority class each.
+   */
+  int downloadMaxRate;
+  int downloadMaxRateHigh;
+  int downloadMaxRateNormal;
+  int downloadMaxRateLow;
+
+  /**
+   * Write downloaded data around the page cache, so a multi GB pull does
+   * not evict everything else from it.
+   */
+  bool downloadDirectIo;
+
+  /**
+   * host=url pairs. Downloads from a matching host may be served by the
+   * mirror instead, which keeps the path of the original URL.
+   */
+  std::vector<std::string> downloadMirrors;
+
+  /**
+   * Also write engine archives to disk. They are extracted while they
+   * download either way.
+   */
+  bool downloadKeepArchives;
 };
 
 class CortexConfigMgr {
@@ -114,6 +170,17 @@ class CortexConfigMgr {
       node["noProxy"] = config.noProxy;
       node["verifyPeerSsl"] = config.verifyPeerSsl;
       node["verifyHostSsl"] = config.verifyHostSsl;
+      node["restoreModelsOnStartup"] = config.restoreModelsOnStartup;
+      node["cpuPartitioning"] = config.cpuPartitioning;
+      node["downloadSegments"] = config.downloadSegments;
+      node["downloadProgressIntervalMs"] = config.downloadProgressIntervalMs;
+      node["downloadMaxRate"] = config.downloadMaxRate;
+      node["downloadMaxRateHigh"] = config.downloadMaxRateHigh;
+      node["downloadMaxRateNormal"] = config.downloadMaxRateNormal;
+      node["downloadMaxRateLow"] = config.downloadMaxRateLow;
+      node["downloadDirectIo"] = config.downloadDirectIo;
+      node["downloadMirrors"] = config.downloadMirrors;
+      node["downloadKeepArchives"] = config.downloadKeepArchives;
 
       out_file << node;
       out_file.close();
@@ -148,7 +215,12 @@ class CortexConfigMgr {
            !node["proxyUsername"] || !node["proxyPassword"] ||
            !node["verifyPeerSsl"] || !node["verifyHostSsl"] ||
            !node["verifyProxySsl"] || !node["verifyProxyHostSsl"] ||
-           !node["noProxy"]);
+           !node["noProxy"] || !node["restoreModelsOnStartup"] ||
+           !node["cpuPartitioning"] || !node["downloadSegments"] ||
+           !node["downloadProgressIntervalMs"] || !node["downloadMaxRate"] ||
+           !node["downloadMaxRateHigh"] || !node["downloadMaxRateNormal"] ||
+           !node["downloadMaxRateLow"] || !node["downloadDirectIo"] ||
+           !node["downloadMirrors"] || !node["downloadKeepArchives"]);
 
       CortexConfig config = {
           .logFolderPath = node["logFolderPath"]
@@ -232,6 +304,42 @@ class CortexConfigMgr {
           .verifyHostSsl = node["verifyHostSsl"]
                                ? node["verifyHostSsl"].as<bool>()
                                : default_cfg.verifyHostSsl,
+          .restoreModelsOnStartup =
+              node["restoreModelsOnStartup"]
+                  ? node["restoreModelsOnStartup"].as<bool>()
+                  : default_cfg.restoreModelsOnStartup,
+          .cpuPartitioning = node["cpuPartitioning"]
+                                 ? node["cpuPartitioning"].as<bool>()
+                                 : default_cfg.cpuPartitioning,
+          .downloadSegments = node["downloadSegments"]
+                                  ? node["downloadSegments"].as<int>()
+                                  : default_cfg.downloadSegments,
+          .downloadProgressIntervalMs =
+              node["downloadProgressIntervalMs"]
+                  ? node["downloadProgressIntervalMs"].as<int>()
+                  : default_cfg.downloadProgressIntervalMs,
+          .downloadMaxRate = node["downloadMaxRate"]
+                                 ? node["downloadMaxRate"].as<int>()
+                                 : default_cfg.downloadMaxRate,
+          .downloadMaxRateHigh = node["downloadMaxRateHigh"]
+                                     ? node["downloadMaxRateHigh"].as<int>()
+                                     : default_cfg.downloadMaxRateHigh,
+          .downloadMaxRateNormal = node["downloadMaxRateNormal"]
+                                       ? node["downloadMaxRateNormal"].as<int>()
+                                       : default_cfg.downloadMaxRateNormal,
+          .downloadMaxRateLow = node["downloadMaxRateLow"]
+                                    ? node["downloadMaxRateLow"].as<int>()
+                                    : default_cfg.downloadMaxRateLow,
+          .downloadDirectIo = node["downloadDirectIo"]
+                                  ? node["downloadDirectIo"].as<bool>()
+                                  : default_cfg.downloadDirectIo,
+          .downloadMirrors =
+              node["downloadMirrors"]
+                  ? node["downloadMirrors"].as<std::vector<std::string>>()
+                  : default_cfg.downloadMirrors,
+          .downloadKeepArchives = node["downloadKeepArchives"]
+                                      ? node["downloadKeepArchives"].as<bool>()
+                                      : default_cfg.downloadKeepArchives,
       };
       if (should_update_config) {
         l.unlock();
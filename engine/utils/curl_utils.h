@@ -1,6 +1,7 @@
 #pragma once
 
 #include <curl/curl.h>
+#include <algorithm>
 #include <json/reader.h>
 #include <json/value.h>
 #include <yaml-cpp/node/node.h>
@@ -25,6 +26,21 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb,
   return totalSize;
 }
 
+struct RangeBuffer {
+  std::string data;
+  size_t limit;
+};
+
+// Stops the transfer once the limit is reached, for servers which ignore the
+// Range header and send the whole file
+size_t RangeWriteCallback(void* contents, size_t size, size_t nmemb,
+                          RangeBuffer* output) {
+  size_t total_size = size * nmemb;
+  size_t n = std::min(total_size, output->limit - output->data.size());
+  output->data.append((char*)contents, n);
+  return n == total_size ? total_size : 0;
+}
+
 void SetUpProxy(CURL* handle, const std::string& url) {
   auto config = file_manager_utils::GetCortexConfig();
   if (!config.proxyUrl.empty()) {
@@ -122,6 +138,85 @@ inline cpp::result<std::string, std::string> SimpleGet(const std::string& url,
   return readBuffer;
 }
 
+/**
+ * Fetch length bytes starting at offset using a HTTP range request. The
+ * result may be shorter than length when the file ends earlier. Connecting
+ * and every stall are limited to kCurlGetTimeout seconds, timeout limits the
+ * whole request.
+ */
+inline cpp::result<std::string, std::string> SimpleGetRange(
+    const std::string& url, uint64_t offset, uint64_t length,
+    const int timeout = -1) {
+  if (length == 0) {
+    return std::string{};
+  }
+  auto curl = curl_easy_init();
+
+  if (!curl) {
+    return cpp::fail("Failed to init CURL");
+  }
+
+  auto headers = GetHeaders(url);
+  curl_slist* curl_headers = nullptr;
+  if (headers.has_value()) {
+    for (const auto& [key, value] : headers.value()) {
+      auto header = key + ": " + value;
+      curl_headers = curl_slist_append(curl_headers, header.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, curl_headers);
+  }
+
+  RangeBuffer buffer{.data = {}, .limit = length};
+  auto range =
+      std::to_string(offset) + "-" + std::to_string(offset + length - 1);
+
+  SetUpProxy(curl, url);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, RangeWriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+  // Callers wait on this while pulling a model, an unreachable or stalled
+  // host must not hold them. A range can be large, so without an explicit
+  // timeout it is bounded by progress rather than by total time.
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT,
+                   static_cast<long>(kCurlGetTimeout));
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME,
+                   static_cast<long>(kCurlGetTimeout));
+  if (timeout > 0) {
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+  }
+
+  auto res = curl_easy_perform(curl);
+
+  auto http_code = 0L;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+  curl_slist_free_all(curl_headers);
+  curl_easy_cleanup(curl);
+
+  // CURLE_WRITE_ERROR is expected when the server ignored the range
+  bool full_buffer = buffer.data.size() == length;
+  if (res != CURLE_OK && !(res == CURLE_WRITE_ERROR && full_buffer)) {
+    return cpp::fail("CURL request failed: " +
+                     static_cast<std::string>(curl_easy_strerror(res)));
+  }
+  if (http_code >= 400) {
+    CTL_ERR("HTTP request failed with status code: " +
+            std::to_string(http_code));
+    return cpp::fail("HTTP request failed with status code: " +
+                     std::to_string(http_code));
+  }
+  // A full response is only usable if it starts where we asked
+  if (http_code != 206 && offset != 0) {
+    return cpp::fail("Server does not support range requests");
+  }
+
+  return std::move(buffer.data);
+}
+
 inline cpp::result<std::string, std::string> SimpleRequest(
     const std::string& url, const RequestType& request_type,
     const std::string& body = "") {
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils/result.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+#endif
+
+namespace file_io_utils {
+
+// Alignment of offsets, sizes and memory for writes around the page cache
+constexpr size_t kDirectIoAlignment = 4096;
+
+/**
+ * File written at explicit offsets, so several transfers can fill disjoint
+ * ranges of it concurrently without sharing a file position.
+ *
+ * A file opened with direct set bypasses the page cache where the platform
+ * allows it. On Linux only whole aligned blocks can, so each write is split
+ * into an unaligned head and tail written through the cache and an aligned
+ * middle written around it.
+ */
+class RandomAccessFile {
+ public:
+  // Part of a write, together with the descriptor it has to go through
+  struct Part {
+    int fd;
+    const char* data;
+    size_t size;
+    uint64_t offset;
+    bool direct = false;
+  };
+
+  static cpp::result<std::unique_ptr<RandomAccessFile>, std::string> Open(
+      const std::filesystem::path& path, bool truncate, bool direct = false) {
+    // A new file rather than a truncated one, the old one can be a link to
+    // a blob other models share
+    if (truncate) {
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    }
+#ifdef _WIN32
+    auto handle = CreateFileW(path.wstring().c_str(), GENERIC_WRITE,
+                              FILE_SHARE_READ, nullptr,
+                              truncate ? CREATE_ALWAYS : OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      return cpp::fail("Failed to open output file " + path.string() +
+                       ", error " + std::to_string(GetLastError()));
+    }
+    return std::unique_ptr<RandomAccessFile>(new RandomAccessFile(handle));
+#else
+    auto fd = open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0),
+                   0644);
+    if (fd < 0) {
+      return cpp::fail("Failed to open output file " + path.string() + ": " +
+                       strerror(errno));
+    }
+    auto file = std::unique_ptr<RandomAccessFile>(new RandomAccessFile(fd));
+    if (direct) {
+#if defined(__linux__)
+      // Not every filesystem supports O_DIRECT, tmpfs for one
+      file->direct_fd_ = open(path.c_str(), O_WRONLY | O_DIRECT);
+      file->use_direct_ = file->direct_fd_ >= 0;
+#elif defined(__APPLE__)
+      fcntl(fd, F_NOCACHE, 1);
+#endif
+    }
+    return file;
+#endif
+  }
+
+  RandomAccessFile(const RandomAccessFile&) = delete;
+  RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+
+  ~RandomAccessFile() {
+#ifdef _WIN32
+    CloseHandle(handle_);
+#else
+    close(fd_);
+#if defined(__linux__)
+    if (direct_fd_ >= 0) {
+      close(direct_fd_);
+    }
+#endif
+#endif
+  }
+
+  /**
+   * Reserve size bytes up front. Besides failing early when the disk is
+   * full, this keeps the filesystem from fragmenting a file whose ranges
+   * arrive out of order.
+   */
+  cpp::result<void, std::string> Preallocate(uint64_t size) {
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(handle_, end, nullptr, FILE_BEGIN) ||
+        !SetEndOfFile(handle_)) {
+      return cpp::fail("Failed to preallocate " + std::to_string(size) +
+                       " bytes, error " + std::to_string(GetLastError()));
+    }
+#else
+#if defined(__linux__)
+    auto err = posix_fallocate(fd_, 0, static_cast<off_t>(size));
+    if (err == 0) {
+      return {};
+    }
+    // Not every filesystem can allocate blocks, a sparse file still works
+    if (err != EOPNOTSUPP && err != EINVAL) {
+      return cpp::fail("Failed to preallocate " + std::to_string(size) +
+                       " bytes: " + strerror(err));
+    }
+#endif
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+      return cpp::fail("Failed to preallocate " + std::to_string(size) +
+                       " bytes: " + strerror(errno));
+    }
+#endif
+    return {};
+  }
+
+#if defined(__linux__)
+  /**
+   * Split a write into the parts that go through the page cache and the
+   * aligned middle that can bypass it.
+   */
+  std::vector<Part> Split(const char* data, size_t size,
+                          uint64_t offset) const {
+    auto begin = (offset + kDirectIoAlignment - 1) / kDirectIoAlignment *
+                 kDirectIoAlignment;
+    auto end = (offset + size) / kDirectIoAlignment * kDirectIoAlignment;
+    auto head = static_cast<size_t>(begin - offset);
+    if (!use_direct_.load(std::memory_order_relaxed) || begin >= end ||
+        reinterpret_cast<uintptr_t>(data + head) % kDirectIoAlignment != 0) {
+      return {Part{fd_, data, size, offset}};
+    }
+    std::vector<Part> parts;
+    if (head > 0) {
+      parts.push_back(Part{fd_, data, head, offset});
+    }
+    parts.push_back(Part{direct_fd_, data + head,
+                         static_cast<size_t>(end - begin), begin, true});
+    if (end < offset + size) {
+      parts.push_back(Part{fd_, data + (end - offset),
+                           static_cast<size_t>(offset + size - end), end});
+    }
+    return parts;
+  }
+
+  /**
+   * Write a part of Split. A direct write the filesystem rejects is done
+   * through the page cache, and so are all later ones.
+   */
+  bool WritePart(Part part) {
+    while (part.size > 0) {
+      auto written = pwrite(part.fd, part.data, part.size,
+                            static_cast<off_t>(part.offset));
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EINVAL && part.direct) {
+          DisableDirect();
+          part.fd = fd_;
+          part.direct = false;
+          continue;
+        }
+        return false;
+      }
+      part.data += written;
+      part.size -= written;
+      part.offset += written;
+    }
+    return true;
+  }
+
+  void DisableDirect() { use_direct_.store(false, std::memory_order_relaxed); }
+#endif
+
+  /**
+   * Write all of data at offset. Returns false on any I/O error.
+   */
+  bool WriteAt(const char* data, size_t size, uint64_t offset) {
+#if defined(__linux__)
+    for (const auto& part : Split(data, size, offset)) {
+      if (!WritePart(part)) {
+        return false;
+      }
+    }
+    return true;
+#else
+    while (size > 0) {
+#ifdef _WIN32
+      OVERLAPPED overlapped{};
+      overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+      overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD written = 0;
+      auto chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+      if (!WriteFile(handle_, data, chunk, &written, &overlapped)) {
+        return false;
+      }
+#else
+      auto written = pwrite(fd_, data, size, static_cast<off_t>(offset));
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+#endif
+      data += written;
+      size -= written;
+      offset += written;
+    }
+    return true;
+#endif
+  }
+
+  /**
+   * Flush written data to the device, so progress recorded afterwards never
+   * claims bytes a crash could lose.
+   */
+  bool Sync() {
+#ifdef _WIN32
+    return FlushFileBuffers(handle_) != 0;
+#elif defined(__APPLE__)
+    return fsync(fd_) == 0;
+#else
+    return fdatasync(fd_) == 0;
+#endif
+  }
+
+ private:
+#ifdef _WIN32
+  explicit RandomAccessFile(HANDLE handle) : handle_(handle) {}
+  HANDLE handle_;
+#else
+  explicit RandomAccessFile(int fd) : fd_(fd) {}
+  int fd_;
+#if defined(__linux__)
+  // Second descriptor of the file opened with O_DIRECT, -1 without one
+  int direct_fd_ = -1;
+  std::atomic<bool> use_direct_{false};
+#endif
+#endif
+};
+
+// Whether path is one of several links to a file, as model files linked to
+// a shared blob are. Such a file is replaced, never written through.
+inline bool IsSharedLink(const std::filesystem::path& path) {
+  std::error_code ec;
+  auto links = std::filesystem::hard_link_count(path, ec);
+  return !ec && links > 1;
+}
+
+/**
+ * Ask the OS to start reading a file into the page cache, without waiting
+ * for it. A model mapped right after finds its weights cached instead of
+ * faulting them in page by page. Returns false where the platform offers no
+ * such hint.
+ */
+inline bool PrefetchFile(const std::filesystem::path& path) {
+#if defined(_WIN32)
+  return false;
+#else
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+#if defined(__APPLE__)
+  struct stat st;
+  auto ok = fstat(fd, &st) == 0;
+  if (ok) {
+    radvisory advice{};
+    advice.ra_count = static_cast<int>(
+        std::min<off_t>(st.st_size, std::numeric_limits<int>::max()));
+    ok = fcntl(fd, F_RDADVISE, &advice) != -1;
+  }
+#else
+  auto ok = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+#endif
+  close(fd);
+  return ok;
+#endif
+}
+
+/**
+ * Copy src to dst, replacing dst. On copy-on-write filesystems (btrfs, XFS,
+ * APFS) the copy shares the blocks of src, so it is instant and takes no
+ * space. Other Linux filesystems copy in the kernel without passing the
+ * data through user space.
+ */
+inline cpp::result<void, std::string> CloneFile(
+    const std::filesystem::path& src, const std::filesystem::path& dst) {
+  std::error_code ec;
+  std::filesystem::remove(dst, ec);
+#if defined(__linux__)
+  auto src_fd = open(src.c_str(), O_RDONLY);
+  if (src_fd < 0) {
+    return cpp::fail("Failed to open " + src.string() + ": " +
+                     strerror(errno));
+  }
+  struct stat st;
+  auto dst_fd = fstat(src_fd, &st) == 0
+                    ? open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644)
+                    : -1;
+  if (dst_fd < 0) {
+    auto error = strerror(errno);
+    close(src_fd);
+    return cpp::fail("Failed to create " + dst.string() + ": " + error);
+  }
+
+  auto copied = ioctl(dst_fd, FICLONE, src_fd) == 0;
+  off_t remaining = copied ? 0 : st.st_size;
+  while (remaining > 0) {
+    auto n = copy_file_range(src_fd, nullptr, dst_fd, nullptr,
+                             static_cast<size_t>(remaining), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    remaining -= n;
+  }
+  // Kernels before 5.3 can not copy across filesystems
+  auto error = errno;
+  auto fallback = remaining == st.st_size && remaining > 0 &&
+                  (error == EXDEV || error == ENOSYS || error == EINVAL ||
+                   error == EOPNOTSUPP);
+  close(src_fd);
+  close(dst_fd);
+  if (remaining == 0) {
+    return {};
+  }
+  if (!fallback) {
+    std::filesystem::remove(dst, ec);
+    return cpp::fail("Failed to copy " + src.string() + " to " +
+                     dst.string() + ": " + strerror(error));
+  }
+#elif defined(__APPLE__)
+  if (clonefile(src.c_str(), dst.c_str(), 0) == 0) {
+    return {};
+  }
+#endif
+  std::filesystem::copy_file(src, dst,
+                             std::filesystem::copy_options::overwrite_existing,
+                             ec);
+  if (ec) {
+    return cpp::fail("Failed to copy " + src.string() + " to " +
+                     dst.string() + ": " + ec.message());
+  }
+  return {};
+}
+}  // namespace file_io_utils
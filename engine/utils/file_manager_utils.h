@@ -185,6 +185,19 @@ inline config_yaml_utils::CortexConfig GetDefaultConfig() {
       .noProxy = config_yaml_utils::kDefaultNoProxy,
       .verifyPeerSsl = true,
       .verifyHostSsl = true,
+      .restoreModelsOnStartup =
+          config_yaml_utils::kDefaultRestoreModelsOnStartup,
+      .cpuPartitioning = config_yaml_utils::kDefaultCpuPartitioning,
+      .downloadSegments = config_yaml_utils::kDefaultDownloadSegments,
+      .downloadProgressIntervalMs =
+          config_yaml_utils::kDefaultDownloadProgressIntervalMs,
+      .downloadMaxRate = config_yaml_utils::kDefaultDownloadMaxRate,
+      .downloadMaxRateHigh = config_yaml_utils::kDefaultDownloadMaxRate,
+      .downloadMaxRateNormal = config_yaml_utils::kDefaultDownloadMaxRate,
+      .downloadMaxRateLow = config_yaml_utils::kDefaultDownloadMaxRate,
+      .downloadDirectIo = config_yaml_utils::kDefaultDownloadDirectIo,
+      .downloadMirrors = {},
+      .downloadKeepArchives = config_yaml_utils::kDefaultDownloadKeepArchives,
   };
 }
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdio>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace gguf_split_utils {
+
+/**
+ * A shard of a split GGUF model, named <prefix>-00001-of-00003.gguf as
+ * written by llama.cpp's gguf-split. index is 1-based.
+ */
+struct GGUFSplitName {
+  std::string prefix;
+  int index;
+  int count;
+};
+
+inline std::optional<GGUFSplitName> ParseSplitFileName(
+    const std::string& file_name) {
+  static const std::regex re(R"(^(.+)-(\d{5})-of-(\d{5})\.gguf$)");
+  std::smatch match;
+  if (!std::regex_match(file_name, match, re)) {
+    return std::nullopt;
+  }
+  auto index = std::stoi(match[2].str());
+  auto count = std::stoi(match[3].str());
+  if (index < 1 || count < 1 || index > count) {
+    return std::nullopt;
+  }
+  return GGUFSplitName{
+      .prefix = match[1].str(), .index = index, .count = count};
+}
+
+inline std::string GetSplitFileName(const std::string& prefix, int index,
+                                    int count) {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "-%05d-of-%05d.gguf", index, count);
+  return prefix + suffix;
+}
+
+/**
+ * File names of every shard in the set, in order.
+ */
+inline std::vector<std::string> GetSplitFileNames(const GGUFSplitName& split) {
+  std::vector<std::string> res;
+  res.reserve(split.count);
+  for (int i = 1; i <= split.count; i++) {
+    res.push_back(GetSplitFileName(split.prefix, i, split.count));
+  }
+  return res;
+}
+
+/**
+ * Whether a file should be offered when listing GGUF files. Only the first
+ * shard of a split model is shown, it stands for the whole set.
+ */
+inline bool IsSelectableGGUF(const std::string& file_name) {
+  if (file_name.size() < 5 ||
+      file_name.compare(file_name.size() - 5, 5, ".gguf") != 0) {
+    return false;
+  }
+  auto split = ParseSplitFileName(file_name);
+  return !split.has_value() || split->index == 1;
+}
+}  // namespace gguf_split_utils
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <json/json.h>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "utils/logging_utils.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace cortex::hw {
+
+using CpuSet = std::vector<int>;
+
+namespace detail {
+inline bool SetCurrentThreadAffinity(const CpuSet& cpus) {
+  if (cpus.empty()) {
+    return false;
+  }
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto c : cpus) {
+    CPU_SET(c, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+  DWORD_PTR mask = 0;
+  for (auto c : cpus) {
+    if (c < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+      mask |= (static_cast<DWORD_PTR>(1) << c);
+    }
+  }
+  return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  // macOS does not support binding threads to cores
+  return false;
+#endif
+}
+
+inline CpuSet GetCurrentThreadAffinity() {
+  CpuSet cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+      if (CPU_ISSET(c, &set)) {
+        cpus.push_back(c);
+      }
+    }
+  }
+#elif defined(_WIN32)
+  // There is no getter for the thread mask, read it back by setting the
+  // process mask and restoring the old one
+  DWORD_PTR process_mask = 0;
+  DWORD_PTR system_mask = 0;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask,
+                             &system_mask)) {
+    if (auto old = SetThreadAffinityMask(GetCurrentThread(), process_mask);
+        old != 0) {
+      SetThreadAffinityMask(GetCurrentThread(), old);
+      for (int c = 0; c < static_cast<int>(sizeof(DWORD_PTR) * 8); c++) {
+        if (old & (static_cast<DWORD_PTR>(1) << c)) {
+          cpus.push_back(c);
+        }
+      }
+    }
+  }
+#endif
+  return cpus;
+}
+
+// Parse a kernel cpu list such as "0,8" or "0-3,8-11"
+inline CpuSet ParseCpuList(const std::string& list) {
+  CpuSet cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    try {
+      auto dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last =
+          dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int c = first; c <= last; c++) {
+        cpus.push_back(c);
+      }
+    } catch (const std::exception&) {
+      return {};
+    }
+  }
+  return cpus;
+}
+
+/**
+ * Group cpus by the physical core they belong to, ordered by their lowest
+ * cpu. Linux numbers sibling threads apart (k and k + cores on x86), so the
+ * siblings are read from sysfs. Elsewhere, and when sysfs is not readable,
+ * siblings are assumed to be adjacent, which is how Windows numbers them.
+ */
+inline std::vector<CpuSet> GroupCoreSiblings(const CpuSet& cpus,
+                                             int physical_cores) {
+  std::vector<CpuSet> cores;
+#if defined(__linux__)
+  bool complete = true;
+  for (auto c : cpus) {
+    bool grouped = std::any_of(cores.begin(), cores.end(), [c](const auto& s) {
+      return std::find(s.begin(), s.end(), c) != s.end();
+    });
+    if (grouped) {
+      continue;
+    }
+    std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(c) +
+                       "/topology/thread_siblings_list");
+    std::string list;
+    CpuSet siblings;
+    if (std::getline(file, list)) {
+      siblings = ParseCpuList(list);
+    }
+    if (std::find(siblings.begin(), siblings.end(), c) == siblings.end()) {
+      complete = false;
+      break;
+    }
+    // Siblings the process may not run on are left out
+    CpuSet core;
+    for (auto s : siblings) {
+      if (std::find(cpus.begin(), cpus.end(), s) != cpus.end()) {
+        core.push_back(s);
+      }
+    }
+    cores.push_back(std::move(core));
+  }
+  if (complete) {
+    return cores;
+  }
+  cores.clear();
+#endif
+  int logical_cores = std::max<int>(1, cpus.size());
+  int smt = std::max(1, logical_cores / std::clamp(physical_cores, 1,
+                                                   logical_cores));
+  for (size_t i = 0; i < cpus.size(); i += smt) {
+    cores.emplace_back(cpus.begin() + i,
+                       cpus.begin() + std::min(cpus.size(), i + smt));
+  }
+  return cores;
+}
+}  // namespace detail
+
+/**
+ * Splits the logical cpus of the machine into disjoint sets of whole
+ * physical cores: one for the HTTP IO threads, one for background work
+ * (downloads, file watcher) and one pool shared out between engines. Each
+ * running model gets its own slice of the engine pool and a matching thread
+ * count.
+ */
+class CpuBudget {
+ public:
+  CpuBudget(CpuBudget const&) = delete;
+  CpuBudget& operator=(CpuBudget const&) = delete;
+
+  static CpuBudget& GetInstance() {
+    static CpuBudget cb;
+    return cb;
+  }
+
+  /**
+   * Partition the cpus the process is allowed to run on. physical_cores is
+   * only used to guess the sibling threads where the OS does not report
+   * them.
+   */
+  void Initialize(int physical_cores, bool pin_threads) {
+    auto cpus = detail::GetCurrentThreadAffinity();
+    if (cpus.empty()) {
+      for (int c = 0;
+           c < static_cast<int>(std::thread::hardware_concurrency()); c++) {
+        cpus.push_back(c);
+      }
+    }
+    Initialize(detail::GroupCoreSiblings(cpus, physical_cores), pin_threads);
+  }
+
+  // cores holds the logical cpus of each physical core
+  void Initialize(const std::vector<CpuSet>& cores, bool pin_threads) {
+    std::lock_guard<std::mutex> l(mtx_);
+    pin_threads_ = pin_threads;
+    core_of_.clear();
+    size_t logical_cores = 0;
+    for (size_t i = 0; i < cores.size(); i++) {
+      for (auto c : cores[i]) {
+        core_of_[c] = static_cast<int>(i);
+      }
+      logical_cores += cores[i].size();
+    }
+
+    // On small machines reserving cores would starve the engines, so all
+    // sets span every core and only the engine thread counts are reduced.
+    int physical_cores = static_cast<int>(cores.size());
+    int io_count = std::clamp(physical_cores / 8, 1, 4);
+    int bg_count = 1;
+    io_cpus_.clear();
+    background_cpus_.clear();
+    engine_cores_.clear();
+    auto flatten = [&cores](int first, int last) {
+      CpuSet res;
+      for (int i = first; i < last; i++) {
+        res.insert(res.end(), cores[i].begin(), cores[i].end());
+      }
+      return res;
+    };
+    if (physical_cores < 4 ||
+        physical_cores - io_count - bg_count < physical_cores / 2) {
+      io_cpus_ = flatten(0, physical_cores);
+      background_cpus_ = io_cpus_;
+      engine_cores_ = cores;
+    } else {
+      io_cpus_ = flatten(0, io_count);
+      background_cpus_ = flatten(io_count, io_count + bg_count);
+      engine_cores_.assign(cores.begin() + io_count + bg_count, cores.end());
+    }
+    model_cpus_.clear();
+    initialized_ = true;
+    CTL_INF("CPU budget - physical: " << physical_cores << ", logical: "
+                                      << logical_cores << ", io: "
+                                      << io_cpus_.size() << ", background: "
+                                      << background_cpus_.size()
+                                      << ", engine cores: "
+                                      << engine_cores_.size());
+  }
+
+  bool IsInitialized() const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return initialized_;
+  }
+
+  void PinCurrentThreadToIo() const {
+    std::unique_lock<std::mutex> l(mtx_);
+    auto cpus = io_cpus_;
+    l.unlock();
+    PinCurrentThread(cpus);
+  }
+
+  void PinCurrentThreadToBackground() const {
+    std::unique_lock<std::mutex> l(mtx_);
+    auto cpus = background_cpus_;
+    l.unlock();
+    PinCurrentThread(cpus);
+  }
+
+  /**
+   * Reserve engine cpus for a model, one physical core per requested thread.
+   * Without a request the model gets every free core, so a lone model runs
+   * on the whole pool. A model asking for more than is free gets the rest of
+   * the pool, and shares the whole pool once nothing is left.
+   */
+  CpuSet AllocateEngineCpus(const std::string& model,
+                            std::optional<int> requested_threads) {
+    std::lock_guard<std::mutex> l(mtx_);
+    if (!initialized_) {
+      return {};
+    }
+    ReleaseEngineCpusNoLock(model);
+
+    std::vector<const CpuSet*> free_cores;
+    for (const auto& core : engine_cores_) {
+      bool used = std::any_of(
+          model_cpus_.begin(), model_cpus_.end(), [&core](const auto& kv) {
+            return std::find(kv.second.begin(), kv.second.end(), core[0]) !=
+                   kv.second.end();
+          });
+      if (!used) {
+        free_cores.push_back(&core);
+      }
+    }
+
+    size_t wanted = requested_threads && *requested_threads > 0
+                        ? static_cast<size_t>(*requested_threads)
+                        : std::max<size_t>(1, free_cores.size());
+    if (wanted > free_cores.size()) {
+      CTL_WRN("Engine cpus are oversubscribed: model "
+              << model << " wants " << wanted << " cores, "
+              << free_cores.size() << " of " << engine_cores_.size()
+              << " are free");
+    }
+
+    CpuSet res;
+    if (free_cores.empty()) {
+      for (const auto& core : engine_cores_) {
+        res.insert(res.end(), core.begin(), core.end());
+      }
+    } else {
+      for (size_t i = 0; i < std::min(wanted, free_cores.size()); i++) {
+        res.insert(res.end(), free_cores[i]->begin(), free_cores[i]->end());
+      }
+    }
+    model_cpus_[model] = res;
+    return res;
+  }
+
+  void ReleaseEngineCpus(const std::string& model) {
+    std::lock_guard<std::mutex> l(mtx_);
+    ReleaseEngineCpusNoLock(model);
+  }
+
+  /**
+   * Number of compute threads for a cpu set, one per physical core.
+   */
+  int GetThreadCount(const CpuSet& cpus) const {
+    std::lock_guard<std::mutex> l(mtx_);
+    std::vector<int> cores;
+    for (auto c : cpus) {
+      auto it = core_of_.find(c);
+      // Cpus outside the budget count as a core of their own
+      int core = it != core_of_.end() ? it->second : -1 - c;
+      if (std::find(cores.begin(), cores.end(), core) == cores.end()) {
+        cores.push_back(core);
+      }
+    }
+    return std::max<int>(1, cores.size());
+  }
+
+  bool ShouldPinThreads() const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return initialized_ && pin_threads_;
+  }
+
+ private:
+  CpuBudget() {}
+
+  void PinCurrentThread(const CpuSet& cpus) const {
+    if (!ShouldPinThreads()) {
+      return;
+    }
+    if (!detail::SetCurrentThreadAffinity(cpus)) {
+      CTL_DBG("Could not set thread affinity");
+    }
+  }
+
+  void ReleaseEngineCpusNoLock(const std::string& model) {
+    model_cpus_.erase(model);
+  }
+
+  mutable std::mutex mtx_;
+  bool initialized_ = false;
+  bool pin_threads_ = false;
+  CpuSet io_cpus_;
+  CpuSet background_cpus_;
+  std::vector<CpuSet> engine_cores_;
+  std::unordered_map<int, int> core_of_;
+  std::unordered_map<std::string, CpuSet> model_cpus_;
+};
+
+/**
+ * Pin the calling thread to a cpu set for the lifetime of the object and
+ * restore the previous affinity afterwards. Threads created in between
+ * inherit the affinity, which is how engine worker threads get bound.
+ */
+class ScopedThreadAffinity {
+ public:
+  explicit ScopedThreadAffinity(const CpuSet& cpus) {
+    if (cpus.empty() || !CpuBudget::GetInstance().ShouldPinThreads()) {
+      return;
+    }
+    previous_ = detail::GetCurrentThreadAffinity();
+    applied_ = detail::SetCurrentThreadAffinity(cpus);
+  }
+
+  ~ScopedThreadAffinity() {
+    if (applied_ && !previous_.empty()) {
+      detail::SetCurrentThreadAffinity(previous_);
+    }
+  }
+
+  ScopedThreadAffinity(const ScopedThreadAffinity&) = delete;
+  ScopedThreadAffinity& operator=(const ScopedThreadAffinity&) = delete;
+
+ private:
+  CpuSet previous_;
+  bool applied_ = false;
+};
+
+// Reserve a slice of the engine cpus for a model about to be loaded with
+// load_params. The thread count is only derived from the slice when the
+// caller did not set cpu_threads.
+inline CpuSet ReserveEngineCpus(const std::string& model,
+                                Json::Value& load_params) {
+  auto& cpu_budget = CpuBudget::GetInstance();
+  std::optional<int> requested_threads;
+  if (load_params.isMember("cpu_threads")) {
+    requested_threads = load_params["cpu_threads"].asInt();
+  }
+  auto cpus = cpu_budget.AllocateEngineCpus(model, requested_threads);
+  if (!cpus.empty() && !requested_threads) {
+    load_params["cpu_threads"] = cpu_budget.GetThreadCount(cpus);
+  }
+  return cpus;
+}
+}  // namespace cortex::hw
@@ -166,6 +166,36 @@ GetHuggingFaceModelRepoInfo(const std::string& author,
   return HuggingFaceModelRepoInfo::FromJson(result.value());
 }
 
+/**
+ * SHA-256 of the LFS files in a directory of a repository, keyed by their
+ * path in the repository. Files which are not stored in LFS are left out.
+ */
+inline cpp::result<std::unordered_map<std::string, std::string>, std::string>
+GetLfsChecksums(const std::string& author, const std::string& modelName,
+                const std::string& branch = "main",
+                const std::string& directory = "") {
+  auto url_obj = url_parser::Url{
+      .protocol = "https",
+      .host = kHuggingFaceHost,
+      .pathParams = {"api", "models", author, modelName, "tree", branch}};
+  if (!directory.empty()) {
+    url_obj.pathParams.push_back(directory);
+  }
+
+  auto result = curl_utils::SimpleGetJson(url_obj.ToFullPath());
+  if (result.has_error()) {
+    return cpp::fail("Failed to list files of " + author + "/" + modelName);
+  }
+
+  std::unordered_map<std::string, std::string> checksums;
+  for (const auto& file : result.value()) {
+    if (file.isMember("lfs") && file["lfs"].isMember("oid")) {
+      checksums[file["path"].asString()] = file["lfs"]["oid"].asString();
+    }
+  }
+  return checksums;
+}
+
 inline std::string GetMetadataUrl(const std::string& model_id) {
   auto url_obj = url_parser::Url{
       .protocol = "https",
@@ -0,0 +1,590 @@
+#pragma once
+
+#include <json/json.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "utils/json_helper.h"
+#include "utils/result.hpp"
+
+namespace json_schema_utils {
+
+// Rules shared by every grammar, same shapes as llama.cpp's
+// json-schema-to-grammar so the engine's sampler sees familiar input
+inline const std::map<std::string, std::pair<std::string,
+                                             std::vector<std::string>>>&
+PrimitiveRules() {
+  static const std::map<std::string,
+                        std::pair<std::string, std::vector<std::string>>>
+      rules = {
+          {"space", {R"(| " " | "\n" [ \t]{0,20})", {}}},
+          {"boolean", {R"(("true" | "false") space)", {"space"}}},
+          {"null", {R"("null" space)", {"space"}}},
+          {"integral-part", {R"([0] | [1-9] [0-9]{0,15})", {}}},
+          {"decimal-part", {R"([0-9]{1,16})", {}}},
+          {"integer",
+           {R"(("-"? integral-part) space)", {"integral-part", "space"}}},
+          {"number",
+           {R"(("-"? integral-part) ("." decimal-part)? )"
+            R"(([eE] [-+]? integral-part)? space)",
+            {"integral-part", "decimal-part", "space"}}},
+          {"char",
+           {R"([^"\\\x7F\x00-\x1F] | [\\] (["\\bfnrt] | "u" [0-9a-fA-F]{4}))",
+            {}}},
+          {"string", {R"("\"" char* "\"" space)", {"char", "space"}}},
+          {"value",
+           {"object | array | string | number | boolean | null",
+            {"object", "array", "string", "number", "boolean", "null"}}},
+          {"object",
+           {R"("{" space ( string ":" space value )"
+            R"(("," space string ":" space value)* )? "}" space)",
+            {"string", "value", "space"}}},
+          {"array",
+           {R"("[" space ( value ("," space value)* )? "]" space)",
+            {"value", "space"}}},
+          {"uuid",
+           {R"("\"" [0-9a-fA-F]{8} "-" [0-9a-fA-F]{4} "-" [0-9a-fA-F]{4} )"
+            R"("-" [0-9a-fA-F]{4} "-" [0-9a-fA-F]{12} "\"" space)",
+            {"space"}}},
+          {"date",
+           {R"([0-9]{4} "-" ( "0" [1-9] | "1" [0-2] ) "-" )"
+            R"(( "0" [1-9] | [1-2] [0-9] | "3" [0-1] ))",
+            {}}},
+          {"time",
+           {R"(([01] [0-9] | "2" [0-3]) ":" [0-5] [0-9] ":" [0-5] [0-9] )"
+            R"(( "." [0-9]{3} )? ( "Z" | ( "+" | "-" ) )"
+            R"(( [01] [0-9] | "2" [0-3] ) ":" [0-5] [0-9] ))",
+            {}}},
+          {"date-time", {R"(date "T" time)", {"date", "time"}}},
+          {"date-string", {R"("\"" date "\"" space)", {"date", "space"}}},
+          {"time-string", {R"("\"" time "\"" space)", {"time", "space"}}},
+          {"date-time-string",
+           {R"("\"" date-time "\"" space)", {"date-time", "space"}}},
+          {"email-string",
+           {R"("\"" [A-Za-z0-9._%+-]+ "@" [A-Za-z0-9-]+ )"
+            R"(( "." [A-Za-z0-9-]+ )+ "\"" space)",
+            {"space"}}},
+      };
+  return rules;
+}
+
+inline std::string FormatLiteral(const std::string& literal) {
+  std::string res = "\"";
+  for (unsigned char c : literal) {
+    switch (c) {
+      case '"':
+        res += "\\\"";
+        break;
+      case '\\':
+        res += "\\\\";
+        break;
+      case '\n':
+        res += "\\n";
+        break;
+      case '\r':
+        res += "\\r";
+        break;
+      default:
+        res += static_cast<char>(c);
+    }
+  }
+  return res + "\"";
+}
+
+/**
+ * Translates a JSON schema into a GBNF grammar, rule by rule. Supported:
+ * objects (properties, required, additionalProperties), arrays (items,
+ * prefixItems, minItems, maxItems), enum, const, anyOf, oneOf, allOf of
+ * objects, type lists, string formats (date, time, date-time, uuid, email),
+ * minLength / maxLength and local $ref. Other keywords, like pattern or
+ * numeric bounds, are ignored and give a looser grammar.
+ */
+class GrammarBuilder {
+ public:
+  explicit GrammarBuilder(const Json::Value& schema) : root_(schema) {}
+
+  cpp::result<std::string, std::string> Build() {
+    auto res = Visit(root_, "root");
+    if (res.has_error()) {
+      return cpp::fail(res.error());
+    }
+    if (res.value() != "root") {
+      rules_["root"] = res.value();
+    }
+    std::string grammar;
+    for (const auto& [name, body] : rules_) {
+      grammar += name + " ::= " + body + "\n";
+    }
+    return grammar;
+  }
+
+ private:
+  static std::string SanitizeName(const std::string& name) {
+    std::string res;
+    for (char c : name) {
+      bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9') || c == '-';
+      if (ok) {
+        res += c;
+      } else if (res.empty() || res.back() != '-') {
+        res += '-';
+      }
+    }
+    return res;
+  }
+
+  // Adds a rule and returns its name, reusing an identical one if any
+  std::string AddRule(const std::string& name, const std::string& body) {
+    auto key = SanitizeName(name);
+    auto it = rules_.find(key);
+    // An empty body is the placeholder of a $ref being visited
+    if (it == rules_.end() || it->second.empty() || it->second == body) {
+      rules_[key] = body;
+      return key;
+    }
+    for (int i = 0;; i++) {
+      auto candidate = key + std::to_string(i);
+      auto found = rules_.find(candidate);
+      if (found == rules_.end() || found->second == body) {
+        rules_[candidate] = body;
+        return candidate;
+      }
+    }
+  }
+
+  std::string AddPrimitive(const std::string& name) {
+    const auto& [body, deps] = PrimitiveRules().at(name);
+    if (rules_.find(name) == rules_.end()) {
+      rules_[name] = body;
+      for (const auto& dep : deps) {
+        AddPrimitive(dep);
+      }
+    }
+    return name;
+  }
+
+  cpp::result<std::string, std::string> ResolveRef(const std::string& ref) {
+    auto it = refs_.find(ref);
+    if (it != refs_.end()) {
+      return it->second;
+    }
+    std::string path;
+    if (ref.rfind("#/definitions/", 0) == 0) {
+      path = "definitions";
+    } else if (ref.rfind("#/$defs/", 0) == 0) {
+      path = "$defs";
+    } else {
+      return cpp::fail("Unsupported $ref: " + ref);
+    }
+    auto def_name = ref.substr(path.size() + 3);
+    const auto& defs = root_[path];
+    if (!defs.isObject() || !defs.isMember(def_name)) {
+      return cpp::fail("Unresolved $ref: " + ref);
+    }
+    // Register the name before visiting so recursive schemas terminate
+    auto name = SanitizeName("ref-" + def_name);
+    refs_[ref] = name;
+    rules_[name] = "";
+    auto body = Visit(defs[def_name], name);
+    if (body.has_error()) {
+      return body;
+    }
+    if (body.value() != name) {
+      rules_[name] = body.value();
+    }
+    return name;
+  }
+
+  std::string LiteralRule(const Json::Value& value) {
+    return FormatLiteral(json_helper::DumpJsonString(value));
+  }
+
+  cpp::result<std::string, std::string> Alternatives(
+      const Json::Value& options, const std::string& name) {
+    std::string body;
+    for (Json::ArrayIndex i = 0; i < options.size(); i++) {
+      auto alt = Visit(options[i], name + "-" + std::to_string(i));
+      if (alt.has_error()) {
+        return alt;
+      }
+      body += (i == 0 ? "" : " | ") + alt.value();
+    }
+    return AddRule(name, body);
+  }
+
+  cpp::result<std::string, std::string> StringRule(const Json::Value& schema,
+                                                   const std::string& name) {
+    auto format = schema.get("format", "").asString();
+    if (format == "date" || format == "time" || format == "date-time" ||
+        format == "email") {
+      return AddPrimitive(format + "-string");
+    }
+    if (format == "uuid") {
+      return AddPrimitive("uuid");
+    }
+    if (!schema.isMember("minLength") && !schema.isMember("maxLength")) {
+      return AddPrimitive("string");
+    }
+    AddPrimitive("char");
+    auto min_len = schema.get("minLength", 0).asUInt();
+    std::string repeat = "{" + std::to_string(min_len) + ",";
+    if (schema.isMember("maxLength")) {
+      repeat += std::to_string(schema["maxLength"].asUInt());
+    }
+    repeat += "}";
+    AddPrimitive("space");
+    return AddRule(name, "\"\\\"\" char" + repeat + " \"\\\"\" space");
+  }
+
+  cpp::result<std::string, std::string> ArrayRule(const Json::Value& schema,
+                                                  const std::string& name) {
+    AddPrimitive("space");
+    if (schema.isMember("prefixItems") ||
+        (schema.isMember("items") && schema["items"].isArray())) {
+      const auto& items = schema.isMember("prefixItems")
+                              ? schema["prefixItems"]
+                              : schema["items"];
+      std::string body = "\"[\" space";
+      for (Json::ArrayIndex i = 0; i < items.size(); i++) {
+        auto item = Visit(items[i], name + "-" + std::to_string(i));
+        if (item.has_error()) {
+          return item;
+        }
+        body += (i == 0 ? " " : " \",\" space ") + item.value();
+      }
+      return AddRule(name, body + " \"]\" space");
+    }
+
+    auto item = schema.isMember("items")
+                    ? Visit(schema["items"], name + "-item")
+                    : cpp::result<std::string, std::string>(
+                          AddPrimitive("value"));
+    if (item.has_error()) {
+      return item;
+    }
+    auto min_items = schema.get("minItems", 0).asUInt();
+    bool has_max = schema.isMember("maxItems");
+    auto max_items = schema.get("maxItems", 0).asUInt();
+    if (has_max && max_items == 0) {
+      return AddRule(name, "\"[\" space \"]\" space");
+    }
+    auto rest = "( \",\" space " + item.value() + " )";
+    if (min_items <= 1 && !has_max) {
+      rest += "*";
+    } else {
+      rest += "{" + std::to_string(min_items == 0 ? 0 : min_items - 1) + "," +
+              (has_max ? std::to_string(max_items - 1) : "") + "}";
+    }
+    auto list = item.value() + " " + rest;
+    if (min_items == 0) {
+      list = "( " + list + " )?";
+    }
+    return AddRule(name, "\"[\" space " + list + " \"]\" space");
+  }
+
+  cpp::result<std::string, std::string> ObjectRule(
+      const std::vector<std::pair<std::string, Json::Value>>& properties,
+      const std::set<std::string>& required, const Json::Value& additional,
+      const std::string& name) {
+    AddPrimitive("space");
+    if (properties.empty()) {
+      if (additional.isObject()) {
+        auto value = Visit(additional, name + "-additional-value");
+        if (value.has_error()) {
+          return value;
+        }
+        AddPrimitive("string");
+        auto kv = "string \":\" space " + value.value();
+        return AddRule(name, "\"{\" space ( " + kv + " ( \",\" space " + kv +
+                                 " )* )? \"}\" space");
+      }
+      if (additional.isBool() && !additional.asBool()) {
+        return AddRule(name, "\"{\" space \"}\" space");
+      }
+      return AddPrimitive("object");
+    }
+
+    // Required properties keep their order, optional ones may follow in
+    // order, each of them absent or present
+    std::vector<std::string> required_kvs;
+    std::vector<std::string> optional_kvs;
+    std::vector<std::string> optional_names;
+    for (const auto& [prop, prop_schema] : properties) {
+      auto value = Visit(prop_schema, name + "-" + prop);
+      if (value.has_error()) {
+        return value;
+      }
+      auto kv = AddRule(name + "-" + prop + "-kv",
+                        FormatLiteral(json_helper::DumpJsonString(prop)) +
+                            " space \":\" space " + value.value());
+      if (required.count(prop)) {
+        required_kvs.push_back(kv);
+      } else {
+        optional_kvs.push_back(kv);
+        optional_names.push_back(prop);
+      }
+    }
+
+    std::function<std::string(size_t, bool)> optional_chain =
+        [&](size_t i, bool first_is_optional) -> std::string {
+      auto res = first_is_optional
+                     ? "( \",\" space " + optional_kvs[i] + " )?"
+                     : optional_kvs[i];
+      if (i + 1 < optional_kvs.size()) {
+        res += " " + AddRule(name + "-" + optional_names[i] + "-rest",
+                             optional_chain(i + 1, true));
+      }
+      return res;
+    };
+
+    std::string body = "\"{\" space";
+    for (size_t i = 0; i < required_kvs.size(); i++) {
+      body += (i == 0 ? " " : " \",\" space ") + required_kvs[i];
+    }
+    if (!optional_kvs.empty()) {
+      body += " (";
+      if (!required_kvs.empty()) {
+        body += " \",\" space (";
+      }
+      for (size_t i = 0; i < optional_kvs.size(); i++) {
+        body += (i == 0 ? " " : " | ") + optional_chain(i, false);
+      }
+      if (!required_kvs.empty()) {
+        body += " )";
+      }
+      body += " )?";
+    }
+    return AddRule(name, body + " \"}\" space");
+  }
+
+  cpp::result<std::string, std::string> Visit(const Json::Value& schema,
+                                              const std::string& name) {
+    if (schema.isBool()) {
+      if (!schema.asBool()) {
+        return cpp::fail("Schema 'false' accepts no value");
+      }
+      return AddPrimitive("value");
+    }
+    if (!schema.isObject()) {
+      return cpp::fail("Schema must be an object");
+    }
+
+    if (schema.isMember("$ref")) {
+      return ResolveRef(schema["$ref"].asString());
+    }
+    if (schema.isMember("anyOf")) {
+      return Alternatives(schema["anyOf"], name);
+    }
+    if (schema.isMember("oneOf")) {
+      return Alternatives(schema["oneOf"], name);
+    }
+    if (schema.isMember("const")) {
+      AddPrimitive("space");
+      return AddRule(name, LiteralRule(schema["const"]) + " space");
+    }
+    if (schema.isMember("enum")) {
+      if (!schema["enum"].isArray() || schema["enum"].empty()) {
+        return cpp::fail("enum must be a non empty array");
+      }
+      AddPrimitive("space");
+      std::string body = "(";
+      for (Json::ArrayIndex i = 0; i < schema["enum"].size(); i++) {
+        body += (i == 0 ? " " : " | ") + LiteralRule(schema["enum"][i]);
+      }
+      return AddRule(name, body + " ) space");
+    }
+
+    const auto& type = schema["type"];
+    if (type.isArray()) {
+      Json::Value options(Json::arrayValue);
+      for (const auto& t : type) {
+        Json::Value option = schema;
+        option["type"] = t;
+        options.append(option);
+      }
+      return Alternatives(options, name);
+    }
+
+    if (schema.isMember("allOf")) {
+      // Only objects can be merged, properties of later schemas win
+      std::vector<std::pair<std::string, Json::Value>> properties;
+      std::set<std::string> required;
+      for (const auto& part : schema["allOf"]) {
+        const auto* s = &part;
+        Json::Value resolved;
+        if (part.isMember("$ref")) {
+          auto ref = part["$ref"].asString();
+          auto prefix = ref.rfind("#/$defs/", 0) == 0 ? std::string("$defs")
+                                                       : "definitions";
+          resolved = root_[prefix][ref.substr(prefix.size() + 3)];
+          s = &resolved;
+        }
+        if (!s->isObject() || !s->isMember("properties")) {
+          return cpp::fail("allOf is only supported for object schemas");
+        }
+        for (const auto& prop : (*s)["properties"].getMemberNames()) {
+          properties.emplace_back(prop, (*s)["properties"][prop]);
+        }
+        for (const auto& r : (*s)["required"]) {
+          required.insert(r.asString());
+        }
+      }
+      return ObjectRule(properties, required, Json::Value(false), name);
+    }
+
+    auto type_name = type.asString();
+    if (type_name == "object" ||
+        (type.isNull() && (schema.isMember("properties") ||
+                           schema.isMember("additionalProperties")))) {
+      std::vector<std::pair<std::string, Json::Value>> properties;
+      // jsoncpp keeps members sorted, the schema order is lost
+      for (const auto& prop : schema["properties"].getMemberNames()) {
+        properties.emplace_back(prop, schema["properties"][prop]);
+      }
+      std::set<std::string> required;
+      for (const auto& r : schema["required"]) {
+        required.insert(r.asString());
+      }
+      return ObjectRule(properties, required,
+                        schema.get("additionalProperties", Json::Value(true)),
+                        name);
+    }
+    if (type_name == "array" ||
+        (type.isNull() && (schema.isMember("items") ||
+                           schema.isMember("prefixItems")))) {
+      return ArrayRule(schema, name);
+    }
+    if (type_name == "string") {
+      return StringRule(schema, name);
+    }
+    if (type_name == "integer" || type_name == "number" ||
+        type_name == "boolean" || type_name == "null") {
+      return AddPrimitive(type_name);
+    }
+    if (type.isNull()) {
+      return AddPrimitive("value");
+    }
+    return cpp::fail("Unsupported schema type: " + type_name);
+  }
+
+  const Json::Value& root_;
+  std::map<std::string, std::string> rules_;
+  std::unordered_map<std::string, std::string> refs_;
+};
+
+inline cpp::result<std::string, std::string> SchemaToGrammar(
+    const Json::Value& schema) {
+  return GrammarBuilder(schema).Build();
+}
+
+/**
+ * Least recently used cache of compiled grammars, keyed by the hash of the
+ * schema's compact JSON. jsoncpp sorts object members, so the same schema
+ * gets the same key whatever the key order of the request.
+ */
+class GrammarCache {
+ public:
+  explicit GrammarCache(size_t capacity) : capacity_(capacity) {}
+
+  cpp::result<std::string, std::string> GetOrCompile(
+      const Json::Value& schema) {
+    auto canonical = json_helper::DumpJsonString(schema);
+    auto hash = std::hash<std::string>{}(canonical);
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      auto it = index_.find(hash);
+      if (it != index_.end() && it->second->schema == canonical) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->grammar;
+      }
+    }
+
+    auto grammar = SchemaToGrammar(schema);
+    if (grammar.has_error()) {
+      return grammar;
+    }
+
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = index_.find(hash);
+    if (it != index_.end()) {
+      entries_.erase(it->second);
+      index_.erase(it);
+    }
+    entries_.push_front(Entry{.schema = std::move(canonical),
+                              .grammar = grammar.value()});
+    index_[hash] = entries_.begin();
+    if (entries_.size() > capacity_) {
+      index_.erase(std::hash<std::string>{}(entries_.back().schema));
+      entries_.pop_back();
+    }
+    return grammar;
+  }
+
+  size_t Size() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    std::string schema;
+    std::string grammar;
+  };
+
+  size_t capacity_;
+  std::mutex mutex_;
+  // Most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<size_t, std::list<Entry>::iterator> index_;
+};
+
+/**
+ * Sets the request's grammar from an OpenAI style response_format:
+ * {"type": "json_schema", "json_schema": {"schema": {...}}} or
+ * {"type": "json_object"}, with an optional "schema" as llama.cpp's server
+ * accepts. A grammar already in the request is kept.
+ */
+inline cpp::result<void, std::string> ApplyResponseFormat(
+    Json::Value& request, GrammarCache& cache) {
+  if (!request.isMember("response_format") ||
+      !request["response_format"].isObject() ||
+      !request.get("grammar", "").asString().empty()) {
+    return {};
+  }
+  const auto& format = request["response_format"];
+  auto type = format.get("type", "text").asString();
+  const Json::Value* schema = nullptr;
+  if (type == "json_schema") {
+    schema = &format["json_schema"]["schema"];
+    if (schema->isNull()) {
+      return cpp::fail(
+          "response_format.json_schema.schema is required for json_schema");
+    }
+  } else if (type == "json_object") {
+    if (format.isMember("schema")) {
+      schema = &format["schema"];
+    }
+  } else {
+    return {};
+  }
+
+  if (schema == nullptr) {
+    Json::Value any_object;
+    any_object["type"] = "object";
+    auto grammar = cache.GetOrCompile(any_object);
+    request["grammar"] = grammar.value();
+    return {};
+  }
+  auto grammar = cache.GetOrCompile(*schema);
+  if (grammar.has_error()) {
+    return cpp::fail("Invalid response_format schema: " + grammar.error());
+  }
+  request["grammar"] = grammar.value();
+  return {};
+}
+}  // namespace json_schema_utils
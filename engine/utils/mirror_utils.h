@@ -0,0 +1,224 @@
+#pragma once
+
+#include <json/json.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "utils/string_utils.h"
+
+namespace mirror_utils {
+
+struct UrlParts {
+  // scheme://authority, identifies a download host
+  std::string origin;
+  std::string host;
+  // Path, query and fragment
+  std::string rest;
+};
+
+inline std::optional<UrlParts> SplitUrl(const std::string& url) {
+  auto scheme_end = url.find("://");
+  if (scheme_end == std::string::npos) {
+    return std::nullopt;
+  }
+  auto authority_begin = scheme_end + 3;
+  auto authority_end = url.find_first_of("/?#", authority_begin);
+  if (authority_end == std::string::npos) {
+    authority_end = url.size();
+  }
+  auto host = url.substr(authority_begin, authority_end - authority_begin);
+  if (auto at = host.rfind('@'); at != std::string::npos) {
+    host = host.substr(at + 1);
+  }
+  if (string_utils::StartsWith(host, "[")) {
+    host = host.substr(0, host.find(']') + 1);
+  } else if (auto colon = host.find(':'); colon != std::string::npos) {
+    host = host.substr(0, colon);
+  }
+  std::transform(host.begin(), host.end(), host.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return UrlParts{.origin = url.substr(0, authority_end),
+                  .host = host,
+                  .rest = url.substr(authority_end)};
+}
+
+// A pattern is a host name, or *.domain for every host below domain
+inline bool MatchesHost(const std::string& pattern, const std::string& host) {
+  if (string_utils::StartsWith(pattern, "*.")) {
+    auto suffix = pattern.substr(1);
+    return host.size() > suffix.size() &&
+           string_utils::EndsWith(host, suffix);
+  }
+  return pattern == host;
+}
+
+/**
+ * URLs the file at url can be fetched from: url itself, then the mirrors
+ * whose host pattern matches in the order configured. mirrors holds
+ * host=base pairs, the base replaces scheme and host of url and keeps its
+ * path.
+ */
+inline std::vector<std::string> SourceUrls(
+    const std::string& url, const std::vector<std::string>& mirrors) {
+  std::vector<std::string> urls{url};
+  auto parts = SplitUrl(url);
+  if (!parts.has_value()) {
+    return urls;
+  }
+  for (const auto& mirror : mirrors) {
+    auto separator = mirror.find('=');
+    if (separator == std::string::npos) {
+      continue;
+    }
+    auto pattern = mirror.substr(0, separator);
+    auto base = mirror.substr(separator + 1);
+    string_utils::Trim(pattern);
+    string_utils::Trim(base);
+    std::transform(pattern.begin(), pattern.end(), pattern.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    while (string_utils::EndsWith(base, "/")) {
+      base.pop_back();
+    }
+    if (base.empty() || !MatchesHost(pattern, parts->host)) {
+      continue;
+    }
+    auto mirrored = base + parts->rest;
+    if (std::find(urls.begin(), urls.end(), mirrored) == urls.end()) {
+      urls.push_back(std::move(mirrored));
+    }
+  }
+  return urls;
+}
+
+/**
+ * Latency, throughput and failures of each download host, shared by all
+ * downloads of the process. A failing host is skipped for a cooldown that
+ * doubles with every further failure in a row.
+ */
+class MirrorHealth {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    uint64_t successes = 0;
+    uint64_t failures = 0;
+    int consecutive_failures = 0;
+    // Moving averages of probe response time and per transfer throughput
+    std::optional<double> latency_ms;
+    std::optional<double> bytes_per_second;
+    std::string last_error;
+    Clock::time_point unavailable_until{};
+  };
+
+  void RecordLatency(const std::string& origin, double latency_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = hosts_[origin];
+    stats.latency_ms = Average(stats.latency_ms, latency_ms);
+  }
+
+  void RecordThroughput(const std::string& origin, double bytes_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = hosts_[origin];
+    stats.bytes_per_second = Average(stats.bytes_per_second, bytes_per_second);
+  }
+
+  void RecordSuccess(const std::string& origin) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = hosts_[origin];
+    stats.successes++;
+    stats.consecutive_failures = 0;
+  }
+
+  void RecordFailure(const std::string& origin, const std::string& error,
+                     Clock::time_point now = Clock::now()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = hosts_[origin];
+    stats.failures++;
+    stats.last_error = error;
+    auto cooldown = std::min(
+        kBaseCooldown * (1 << std::min(stats.consecutive_failures, 16)),
+        kMaxCooldown);
+    stats.consecutive_failures++;
+    stats.unavailable_until = now + cooldown;
+  }
+
+  bool IsAvailable(const std::string& origin,
+                   Clock::time_point now = Clock::now()) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(origin);
+    return it == hosts_.end() || it->second.unavailable_until <= now;
+  }
+
+  std::optional<double> Throughput(const std::string& origin) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(origin);
+    if (it == hosts_.end()) {
+      return std::nullopt;
+    }
+    return it->second.bytes_per_second;
+  }
+
+  /**
+   * Expected seconds to fetch a segment of segment_bytes from origin. A host
+   * without throughput samples only counts its latency, so it gets the
+   * chance to be measured.
+   */
+  double EstimatedSeconds(const std::string& origin,
+                          uint64_t segment_bytes) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(origin);
+    if (it == hosts_.end()) {
+      return 0;
+    }
+    auto seconds = it->second.latency_ms.value_or(0) / 1000;
+    if (it->second.bytes_per_second.value_or(0) > 0) {
+      seconds += segment_bytes / it->second.bytes_per_second.value();
+    }
+    return seconds;
+  }
+
+  Json::Value ToJson(Clock::time_point now = Clock::now()) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value hosts(Json::arrayValue);
+    for (const auto& [origin, stats] : hosts_) {
+      Json::Value host;
+      host["host"] = origin;
+      host["available"] = stats.unavailable_until <= now;
+      host["successes"] = Json::Value::UInt64(stats.successes);
+      host["failures"] = Json::Value::UInt64(stats.failures);
+      host["consecutiveFailures"] = stats.consecutive_failures;
+      if (stats.latency_ms.has_value()) {
+        host["latencyMs"] = stats.latency_ms.value();
+      }
+      if (stats.bytes_per_second.has_value()) {
+        host["bytesPerSecond"] =
+            Json::Value::UInt64(stats.bytes_per_second.value());
+      }
+      if (!stats.last_error.empty()) {
+        host["lastError"] = stats.last_error;
+      }
+      hosts.append(host);
+    }
+    return hosts;
+  }
+
+ private:
+  static constexpr double kSmoothing = 0.3;
+  static constexpr std::chrono::seconds kBaseCooldown{5};
+  static constexpr std::chrono::seconds kMaxCooldown{300};
+
+  static double Average(std::optional<double> average, double sample) {
+    return average.has_value()
+               ? average.value() + kSmoothing * (sample - average.value())
+               : sample;
+  }
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Stats> hosts_;
+};
+}  // namespace mirror_utils
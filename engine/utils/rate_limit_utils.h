@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace rate_limit_utils {
+
+/**
+ * Token bucket refilled at rate bytes per second, holding at most one
+ * second of tokens. Consume may overdraw it, the debt is repaid before
+ * HasTokens holds again. A rate of 0 means unlimited.
+ */
+class TokenBucket {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void SetRate(uint64_t bytes_per_second) {
+    Refill(Clock::now());
+    rate_ = bytes_per_second;
+    tokens_ = std::min(tokens_, static_cast<double>(rate_));
+  }
+
+  uint64_t Rate() const { return rate_; }
+
+  bool HasTokens(Clock::time_point now) {
+    if (rate_ == 0) {
+      return true;
+    }
+    Refill(now);
+    return tokens_ > 0;
+  }
+
+  void Consume(uint64_t bytes) {
+    if (rate_ != 0) {
+      tokens_ -= static_cast<double>(bytes);
+    }
+  }
+
+  // Time until HasTokens holds again, zero when it holds now
+  std::chrono::milliseconds Delay(Clock::time_point now) {
+    if (HasTokens(now)) {
+      return std::chrono::milliseconds(0);
+    }
+    // Round up, a wakeup just before the refill would find no tokens yet
+    return std::chrono::milliseconds(
+        static_cast<int64_t>(-tokens_ * 1000 / rate_) + 1);
+  }
+
+ private:
+  void Refill(Clock::time_point now) {
+    if (now <= last_refill_) {
+      return;
+    }
+    auto elapsed = std::chrono::duration<double>(now - last_refill_).count();
+    last_refill_ = now;
+    tokens_ = std::min(tokens_ + elapsed * rate_, static_cast<double>(rate_));
+  }
+
+  uint64_t rate_ = 0;
+  double tokens_ = 0;
+  Clock::time_point last_refill_ = Clock::now();
+};
+}  // namespace rate_limit_utils
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <openssl/evp.h>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "utils/result.hpp"
+
+namespace sha256_utils {
+
+/**
+ * Incremental SHA-256. OpenSSL picks the SHA-NI / ARMv8 crypto code paths at
+ * runtime when the cpu supports them.
+ */
+class Sha256 {
+ public:
+  Sha256() : ctx_(EVP_MD_CTX_new(), EVP_MD_CTX_free) {
+    if (ctx_ == nullptr ||
+        EVP_DigestInit_ex(ctx_.get(), EVP_sha256(), nullptr) != 1) {
+      ctx_.reset();
+    }
+  }
+
+  Sha256(const Sha256&) = delete;
+  Sha256& operator=(const Sha256&) = delete;
+
+  bool Update(const void* data, size_t size) {
+    return ctx_ != nullptr && EVP_DigestUpdate(ctx_.get(), data, size) == 1;
+  }
+
+  // Lowercase hex digest. The hasher can not be updated afterwards
+  std::string FinalHex() {
+    if (ctx_ == nullptr) {
+      return "";
+    }
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(ctx_.get(), digest, &length) != 1) {
+      return "";
+    }
+    ctx_.reset();
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string res;
+    res.reserve(length * 2);
+    for (unsigned int i = 0; i < length; i++) {
+      res.push_back(kHex[digest[i] >> 4]);
+      res.push_back(kHex[digest[i] & 0x0f]);
+    }
+    return res;
+  }
+
+ private:
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx_;
+};
+
+/**
+ * Feed length bytes of a file, starting at offset, into a hasher. One reader
+ * thread fills two buffers in turn while the other one is hashed, so disk
+ * and cpu work overlap. SHA-256 is a sequential chain, so the digest itself
+ * can not be split across threads.
+ */
+inline cpp::result<void, std::string> UpdateFromFileRange(
+    Sha256& hasher, const std::filesystem::path& path, uint64_t offset,
+    uint64_t length, size_t chunk_size = 4 * 1024 * 1024) {
+  std::unique_ptr<FILE, decltype(&fclose)> file(
+      fopen(path.string().c_str(), "rb"), fclose);
+  if (file == nullptr) {
+    return cpp::fail("Failed to open " + path.string());
+  }
+#if defined(_WIN32)
+  auto seeked = _fseeki64(file.get(), offset, SEEK_SET) == 0;
+#else
+  auto seeked = fseeko(file.get(), offset, SEEK_SET) == 0;
+#endif
+  if (!seeked) {
+    return cpp::fail("Failed to seek in " + path.string());
+  }
+
+  struct Buffer {
+    std::vector<char> data;
+    // Read and not hashed yet
+    bool full = false;
+  };
+  std::array<Buffer, 2> buffers;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop = false;
+
+  std::thread reader([&, f = file.get()] {
+    uint64_t to_read = length;
+    for (size_t i = 0; to_read > 0; i++) {
+      auto& buffer = buffers[i % buffers.size()];
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return stop || !buffer.full; });
+        if (stop) {
+          return;
+        }
+      }
+      buffer.data.resize(std::min<uint64_t>(to_read, chunk_size));
+      buffer.data.resize(fread(buffer.data.data(), 1, buffer.data.size(), f));
+      to_read -= buffer.data.size();
+      bool eof = buffer.data.empty();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.full = true;
+      }
+      cv.notify_all();
+      if (eof) {
+        return;
+      }
+    }
+  });
+
+  cpp::result<void, std::string> res;
+  uint64_t remaining = length;
+  for (size_t i = 0; remaining > 0; i++) {
+    auto& buffer = buffers[i % buffers.size()];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return buffer.full; });
+    }
+    if (buffer.data.empty()) {
+      res = cpp::fail("Unexpected end of file " + path.string());
+      break;
+    }
+    if (!hasher.Update(buffer.data.data(), buffer.data.size())) {
+      res = cpp::fail("Failed to hash " + path.string());
+      break;
+    }
+    remaining -= buffer.data.size();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      buffer.full = false;
+    }
+    cv.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  cv.notify_all();
+  reader.join();
+  return res;
+}
+
+// Feed the first length bytes of a file into a hasher
+inline cpp::result<void, std::string> UpdateFromFile(
+    Sha256& hasher, const std::filesystem::path& path, uint64_t length,
+    size_t chunk_size = 4 * 1024 * 1024) {
+  return UpdateFromFileRange(hasher, path, 0, length, chunk_size);
+}
+
+inline bool ChecksumEquals(const std::string& lhs, const std::string& rhs) {
+  return lhs.size() == rhs.size() &&
+         std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) {
+           return std::tolower(static_cast<unsigned char>(a)) ==
+                  std::tolower(static_cast<unsigned char>(b));
+         });
+}
+}  // namespace sha256_utils
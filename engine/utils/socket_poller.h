@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace socket_utils {
+
+#if defined(_WIN32)
+using Socket = SOCKET;
+#else
+using Socket = int;
+#endif
+
+/**
+ * Readiness notification for a changing set of sockets: epoll on Linux,
+ * poll elsewhere. Wakeup may be called from any thread to end a Wait early.
+ */
+class SocketPoller {
+ public:
+  struct Event {
+    Socket socket;
+    bool readable;
+    bool writable;
+    bool error;
+  };
+
+  SocketPoller() {
+#if defined(__linux__)
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeup_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+#elif !defined(_WIN32)
+    if (pipe(wakeup_pipe_) == 0) {
+      for (auto fd : wakeup_pipe_) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+    }
+#endif
+  }
+
+  SocketPoller(const SocketPoller&) = delete;
+  SocketPoller& operator=(const SocketPoller&) = delete;
+
+  ~SocketPoller() {
+#if defined(__linux__)
+    close(wakeup_fd_);
+    close(epoll_fd_);
+#elif !defined(_WIN32)
+    close(wakeup_pipe_[0]);
+    close(wakeup_pipe_[1]);
+#endif
+  }
+
+  // Start watching socket, or change what it is watched for
+  void Watch(Socket socket, bool read, bool write) {
+#if defined(__linux__)
+    epoll_event ev{};
+    ev.events = (read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0);
+    ev.data.fd = socket;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, socket, &ev) != 0 &&
+        errno == ENOENT) {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &ev);
+    }
+#else
+    short events = (read ? POLLIN : 0) | (write ? POLLOUT : 0);
+    sockets_[socket] = events;
+#endif
+  }
+
+  void Remove(Socket socket) {
+#if defined(__linux__)
+    // The socket may already be closed, which removed it from the set
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket, nullptr);
+#else
+    sockets_.erase(socket);
+#endif
+  }
+
+  /**
+   * Wait up to timeout_ms for sockets to become ready or for Wakeup. An
+   * empty result means the timeout or a wakeup.
+   */
+  std::vector<Event> Wait(int timeout_ms) {
+    std::vector<Event> res;
+#if defined(__linux__)
+    epoll_event evs[64];
+    auto n = epoll_wait(epoll_fd_, evs, 64, timeout_ms);
+    for (int i = 0; i < n; i++) {
+      if (evs[i].data.fd == wakeup_fd_) {
+        uint64_t value;
+        while (read(wakeup_fd_, &value, sizeof(value)) > 0) {
+        }
+        continue;
+      }
+      res.push_back(Event{
+          .socket = evs[i].data.fd,
+          .readable = (evs[i].events & EPOLLIN) != 0,
+          .writable = (evs[i].events & EPOLLOUT) != 0,
+          .error = (evs[i].events & (EPOLLERR | EPOLLHUP)) != 0,
+      });
+    }
+#else
+    std::vector<pollfd> fds;
+#if defined(_WIN32)
+    // WSAPoll cannot be woken up, so new work waits at most this long
+    timeout_ms = timeout_ms < 0 ? kWakeupMsecs
+                                : std::min(timeout_ms, kWakeupMsecs);
+    if (sockets_.empty()) {
+      Sleep(timeout_ms);
+      return res;
+    }
+#else
+    fds.push_back(pollfd{.fd = wakeup_pipe_[0], .events = POLLIN});
+#endif
+    for (const auto& [socket, events] : sockets_) {
+      fds.push_back(pollfd{.fd = socket, .events = events});
+    }
+#if defined(_WIN32)
+    auto n = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout_ms);
+#else
+    auto n = poll(fds.data(), fds.size(), timeout_ms);
+#endif
+    if (n <= 0) {
+      return res;
+    }
+    for (const auto& fd : fds) {
+      if (fd.revents == 0) {
+        continue;
+      }
+#if !defined(_WIN32)
+      if (fd.fd == wakeup_pipe_[0]) {
+        char buffer[64];
+        while (read(wakeup_pipe_[0], buffer, sizeof(buffer)) > 0) {
+        }
+        continue;
+      }
+#endif
+      res.push_back(Event{
+          .socket = fd.fd,
+          .readable = (fd.revents & POLLIN) != 0,
+          .writable = (fd.revents & POLLOUT) != 0,
+          .error = (fd.revents & (POLLERR | POLLHUP)) != 0,
+      });
+    }
+#endif
+    return res;
+  }
+
+  void Wakeup() {
+#if defined(__linux__)
+    uint64_t value = 1;
+    [[maybe_unused]] auto n = write(wakeup_fd_, &value, sizeof(value));
+#elif !defined(_WIN32)
+    char value = 1;
+    [[maybe_unused]] auto n = write(wakeup_pipe_[1], &value, 1);
+#endif
+  }
+
+ private:
+#if defined(__linux__)
+  int epoll_fd_ = -1;
+  int wakeup_fd_ = -1;
+#else
+  std::unordered_map<Socket, short> sockets_;
+#if defined(_WIN32)
+  static constexpr int kWakeupMsecs = 100;
+#else
+  int wakeup_pipe_[2] = {-1, -1};
+#endif
+#endif
+};
+}  // namespace socket_utils